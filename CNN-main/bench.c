@@ -0,0 +1,624 @@
+/*
+ * bench.c — per-layer benchmark suite
+ * -------------------------------------------
+ * Times every stage of the network in isolation (convolution,
+ * pooling, dense, softmax and their backward passes), the full
+ * forward()/backpropagation(), the optimizer updates, the
+ * threaded predict() and trainBatch() paths and the IDX loader, over a sweep of batch
+ * sizes and thread counts. Each case is run a fixed number of
+ * times after a warm-up; min/median/p99 latency, GFLOP/s, the
+ * allocations the timed calls made (from the profile counters)
+ * and the size of the buffers the case preallocated are
+ * printed and written to a JSON report.
+ *
+ * When the MNIST training images are not available, a
+ * synthetic IDX image/label pair is generated from the seed,
+ * so the suite runs anywhere and two runs see the same data.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "lib/tensor.h"
+#include "lib/simd.h"
+#include "lib/import.h"
+#include "lib/convolution.h"
+#include "lib/pooling.h"
+#include "lib/dense.h"
+#include "lib/output.h"
+#include "lib/workspace.h"
+#include "lib/inference.h"
+#include "lib/backprop.h"
+#include "lib/trainer.h"
+#include "lib/optimizer.h"
+#include "lib/network.h"
+#include "lib/profile.h"
+#include "lib/random.h"
+
+#define BENCH_WARMUP 2
+#define BENCH_MAX_SWEEP 16
+#define SYNTHETIC_IMAGES 10000
+#define SYNTHETIC_SIZE 28
+#define SYNTHETIC_IMAGES_PATH "./bench-synthetic-images.idx3-ubyte"
+#define SYNTHETIC_LABELS_PATH "./bench-synthetic-labels.idx1-ubyte"
+
+/*
+ * Options: command-line settings, see usage().
+ */
+typedef struct {
+    int batches[BENCH_MAX_SWEEP];
+    int numBatches;
+    int threads[BENCH_MAX_SWEEP];
+    int numThreads;
+    int reps;
+    uint64_t seed;
+    const char* dataDir;
+    const char* jsonPath;
+} Options;
+
+/*
+ * Result: one benchmark case. Times are per call in
+ * microseconds; `flops` is the work of one call (0 for
+ * kernels that are not arithmetic-bound). `allocations` and
+ * `allocatedBytes` are per call too, averaged over the timed
+ * reps; `workspaceBytes` is what the case set up beforehand
+ * (workspaces, gradients, output buffers).
+ */
+typedef struct {
+    const char* name;
+    int batch;
+    int threads;
+    int reps;
+    double minUs;
+    double medianUs;
+    double p99Us;
+    double flops;
+    double allocations;
+    double allocatedBytes;
+    size_t workspaceBytes;
+} Result;
+
+typedef struct {
+    Result* results;
+    int count;
+    int capacity;
+} Report;
+
+/*
+ * Bench: everything a timed call may touch. The network and
+ * data are shared by all cases; the remaining pointers are set
+ * up per case.
+ */
+typedef struct {
+    ConvLayer* convLayer;
+    DenseLayer* denseLayer;
+    Network* net;           /* the same model as a layer graph */
+    Dataset* dataset;
+    const char* imagesPath;
+    const char* labelsPath;
+    int batch;
+
+    Workspace* ws;
+    Gradients* grads;
+    NetWorkspace* netWs;
+    Tensor* netGrads;
+    Predictor* predictor;
+    Trainer* trainer;
+    Optimizer* optimizer;
+    real* probs;
+} Bench;
+
+typedef void (*BenchFunction)(Bench* bench);
+
+/*
+ * profileSeconds()
+ * Monotonic time in seconds.
+ */
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * measure()
+ * Runs `function` BENCH_WARMUP times untimed, then `reps`
+ * times timed, and appends the statistics to `report`. The
+ * profile allocation counters (summed over all threads) are
+ * read around the timed reps; they count every alignedAlloc(),
+ * i.e. every tensor and arena buffer, and stay 0 when built
+ * with -DCNN_NO_PROFILE.
+ */
+static void measure(Report* report, const char* name, BenchFunction function, Bench* bench, int threads, int reps, double flops, size_t workspace) {
+    double* samples = malloc(reps * sizeof(double));
+    assert(samples != NULL);
+    for (int r=0; r<BENCH_WARMUP; r++) {
+        function(bench);
+    }
+    ProfileTotals before, after;
+    profileSnapshot(&before);
+    for (int r=0; r<reps; r++) {
+        double start = profileSeconds();
+        function(bench);
+        samples[r] = (profileSeconds() - start) * 1e6;
+    }
+    profileSnapshot(&after);
+    qsort(samples, reps, sizeof(double), compareDoubles);
+
+    if (report->count == report->capacity) {
+        report->capacity = report->capacity > 0 ? 2 * report->capacity : 64;
+        report->results = realloc(report->results, report->capacity * sizeof(Result));
+        assert(report->results != NULL);
+    }
+    Result* result = &report->results[report->count++];
+    result->name = name;
+    result->batch = bench->batch;
+    result->threads = threads;
+    result->reps = reps;
+    result->minUs = samples[0];
+    result->medianUs = reps % 2 ? samples[reps / 2] : 0.5 * (samples[reps / 2 - 1] + samples[reps / 2]);
+    result->p99Us = samples[(99 * reps + 99) / 100 - 1];
+    result->flops = flops;
+    result->allocations = (double)(after.allocations - before.allocations) / reps;
+    result->allocatedBytes = (double)(after.allocatedBytes - before.allocatedBytes) / reps;
+    result->workspaceBytes = workspace;
+    free(samples);
+
+    printf("%-20s batch %4d  threads %2d | min %10.1f us | median %10.1f us | p99 %10.1f us | %8.2f us/img",
+           name, result->batch, threads, result->minUs, result->medianUs, result->p99Us, result->medianUs / result->batch);
+    if (flops > 0) {
+        printf(" | %6.2f GFLOP/s", flops / (result->medianUs * 1e3));
+    }
+#ifdef CNN_NO_PROFILE
+    printf(" | allocs n/a");
+#else
+    printf(" | %.1f allocs (%.0f B)", result->allocations, result->allocatedBytes);
+#endif
+    printf(" | workspace %zu B\n", workspace);
+}
+
+static void benchConvolutionForward(Bench* bench) {
+    Workspace* ws = bench->ws;
+    size_t imageSize = (size_t)ws->width * ws->height;
+    size_t positions = (size_t)ws->convWidth * ws->convHeight;
+    for (int b=0; b<bench->batch; b++) {
+        convolutionForward(bench->convLayer, bench->dataset->images + b * imageSize, ws->width, ws->height, ws->columns.data + b * positions, ws->columns.strides[0], &ws->convoluted);
+    }
+}
+
+static void benchPoolingForward(Bench* bench) {
+    Workspace* ws = bench->ws;
+    Tensor pooled;
+    for (int b=0; b<bench->batch; b++) {
+        tensorSelect(&ws->pooled, b, &pooled);
+        poolingForward(&ws->convoluted, &pooled, NULL, bench->convLayer->relu);
+    }
+}
+
+static void benchDenseForward(Bench* bench) {
+    Tensor pooled;
+    Tensor totals;
+    tensorNarrow(&bench->ws->pooled, 0, bench->batch, &pooled);
+    tensorNarrow(&bench->ws->totals, 0, bench->batch, &totals);
+    denseForward(bench->denseLayer, &pooled, &totals);
+}
+
+static void benchSoftmax(Bench* bench) {
+    Tensor totals;
+    tensorNarrow(&bench->ws->totals, 0, bench->batch, &totals);
+    softmaxBatch(&totals, &bench->ws->probs);
+}
+
+static void benchDenseBackprop(Bench* bench) {
+    denseBackprop(bench->denseLayer, bench->ws, bench->grads, bench->batch);
+}
+
+static void benchConvolutionBackprop(Bench* bench) {
+    convolutionBackprop(bench->convLayer, bench->ws, bench->grads, bench->batch);
+}
+
+static void benchForward(Bench* bench) {
+    forward(bench->convLayer, bench->denseLayer, bench->ws, bench->dataset->images, bench->batch);
+}
+
+static void benchBackpropagation(Bench* bench) {
+    backpropagation(bench->convLayer, bench->denseLayer, bench->ws, bench->grads, bench->dataset->images, bench->dataset->labels, bench->batch);
+}
+
+static void benchNetworkForward(Bench* bench) {
+    networkForward(bench->net, bench->netWs, bench->dataset->images, bench->batch);
+}
+
+static void benchNetworkBackward(Bench* bench) {
+    networkBackward(bench->net, bench->netWs, bench->netGrads, bench->dataset->images, bench->dataset->labels, bench->batch);
+}
+
+static void benchPredict(Bench* bench) {
+    predict(bench->predictor, bench->dataset->images, bench->batch, bench->probs);
+}
+
+static void benchOptimizerStep(Bench* bench) {
+    optimizerStep(bench->optimizer, bench->batch);
+}
+
+static void benchTrainBatch(Bench* bench) {
+    trainBatch(bench->trainer, bench->dataset->images, bench->dataset->labels, bench->batch);
+}
+
+/*
+ * benchLoader()
+ * Maps the image and label files, reads every byte (so page
+ * faults are paid for) and unmaps them again.
+ */
+static void benchLoader(Bench* bench) {
+    Dataset* dataset = openDataset(bench->imagesPath, bench->labelsPath);
+    assert(dataset != NULL);
+    size_t bytes = (size_t)dataset->count * dataset->width * dataset->height;
+    volatile unsigned int sum = 0;
+    unsigned int local = 0;
+    for (size_t i=0; i<bytes; i += 64) {
+        local += dataset->images[i];
+    }
+    for (int i=0; i<dataset->count; i++) {
+        local += dataset->labels[i];
+    }
+    sum = local;
+    (void)sum;
+    closeDataset(dataset);
+}
+
+static size_t workspaceBytes(Workspace* ws) {
+    return ws->arena.capacity * sizeof(real);
+}
+
+static size_t gradientBytes(Gradients* grads) {
+    return (grads->filters->size + grads->weights->size + grads->biases->size) * sizeof(real);
+}
+
+/*
+ * runLayerCases()
+ * Single-threaded cases for one batch size: each layer on its
+ * own, then the full forward and backward passes, both for the
+ * fixed pipeline and for the same model as a layer graph, and
+ * one step of each kind of optimizer over the graph's weights.
+ */
+static void runLayerCases(Report* report, Bench* bench, int batch, int reps) {
+    ConvLayer* convLayer = bench->convLayer;
+    DenseLayer* denseLayer = bench->denseLayer;
+    bench->batch = batch;
+    bench->ws = initWorkspace(convLayer, denseLayer, bench->dataset->width, bench->dataset->height, batch);
+    bench->grads = initGradients(convLayer, denseLayer);
+    backpropagation(convLayer, denseLayer, bench->ws, bench->grads, bench->dataset->images, bench->dataset->labels, batch);
+
+    Workspace* ws = bench->ws;
+    double taps = (double)convLayer->filterSize * convLayer->filterSize;
+    double positions = (double)ws->convWidth * ws->convHeight;
+    double convFlops = 2.0 * convLayer->numFilters * taps * positions * batch;
+    double denseFlops = 2.0 * denseLayer->size * denseLayer->inputSize * batch;
+    size_t bytes = workspaceBytes(ws);
+    size_t trainBytes = bytes + gradientBytes(bench->grads);
+
+    measure(report, "convolutionForward", benchConvolutionForward, bench, 1, reps, convFlops, bytes);
+    measure(report, "poolingForward", benchPoolingForward, bench, 1, reps, 0, bytes);
+    measure(report, "denseForward", benchDenseForward, bench, 1, reps, denseFlops, bytes);
+    measure(report, "softmax", benchSoftmax, bench, 1, reps, 0, bytes);
+    measure(report, "denseBackprop", benchDenseBackprop, bench, 1, reps, 2.0 * denseFlops, trainBytes);
+    measure(report, "convolutionBackprop", benchConvolutionBackprop, bench, 1, reps, convFlops, trainBytes);
+    measure(report, "forward", benchForward, bench, 1, reps, convFlops + denseFlops, bytes);
+    measure(report, "backpropagation", benchBackpropagation, bench, 1, reps, 2.0 * convFlops + 3.0 * denseFlops, trainBytes);
+
+    freeGradients(bench->grads);
+    freeWorkspace(bench->ws);
+    bench->grads = NULL;
+    bench->ws = NULL;
+
+    bench->netWs = initNetWorkspace(bench->net, batch, 1);
+    bench->netGrads = initNetGradients(bench->net);
+    measure(report, "networkForward", benchNetworkForward, bench, 1, reps, convFlops + denseFlops, bench->netWs->arena.capacity * sizeof(real));
+    measure(report, "networkBackward", benchNetworkBackward, bench, 1, reps, 2.0 * convFlops + 3.0 * denseFlops,
+            (bench->netWs->arena.capacity + bench->netGrads->size) * sizeof(real));
+
+    const char* stepNames[] = { "sgdStep", "momentumStep", "adamStep" };
+    OptimizerType stepTypes[] = { OPTIMIZER_SGD, OPTIMIZER_MOMENTUM, OPTIMIZER_ADAM };
+    for (int i=0; i<3; i++) {
+        OptimizerConfig config;
+        defaultOptimizerConfig(&config);
+        config.type = stepTypes[i];
+        config.learningRate = 1e-9;
+        bench->optimizer = initOptimizer(&config, NULL);
+        optimizerAdd(bench->optimizer, bench->net->parameters.base, bench->netGrads->data, bench->net->parameters.capacity);
+        measure(report, stepNames[i], benchOptimizerStep, bench, 1, reps, 0, bench->optimizer->arena.capacity * sizeof(real));
+        freeOptimizer(bench->optimizer);
+        bench->optimizer = NULL;
+    }
+    tensorFree(bench->netGrads);
+    freeNetWorkspace(bench->netWs);
+    bench->netGrads = NULL;
+    bench->netWs = NULL;
+}
+
+/*
+ * runThreadedCases()
+ * predict() and trainBatch() for one batch size on `threads`
+ * workers.
+ */
+static void runThreadedCases(Report* report, Bench* bench, int batch, int threads, int reps) {
+    ConvLayer* convLayer = bench->convLayer;
+    DenseLayer* denseLayer = bench->denseLayer;
+    int width = bench->dataset->width;
+    int height = bench->dataset->height;
+    double taps = (double)convLayer->filterSize * convLayer->filterSize;
+    double positions = (double)(width - convLayer->filterSize + 1) * (height - convLayer->filterSize + 1);
+    double convFlops = 2.0 * convLayer->numFilters * taps * positions * batch;
+    double denseFlops = 2.0 * denseLayer->size * denseLayer->inputSize * batch;
+    bench->batch = batch;
+
+    bench->predictor = initPredictor(convLayer, denseLayer, width, height, threads);
+    bench->probs = malloc((size_t)batch * denseLayer->size * sizeof(real));
+    assert(bench->probs != NULL);
+    size_t bytes = (size_t)batch * denseLayer->size * sizeof(real);
+    for (int t=0; t<threads; t++) {
+        bytes += workspaceBytes(bench->predictor->workspaces[t]);
+    }
+    measure(report, "predict", benchPredict, bench, threads, reps, convFlops + denseFlops, bytes);
+    free(bench->probs);
+    freePredictor(bench->predictor);
+    bench->predictor = NULL;
+    bench->probs = NULL;
+
+    OptimizerConfig config;
+    defaultOptimizerConfig(&config);
+    config.learningRate = 1e-9;
+    bench->trainer = initTrainer(convLayer, denseLayer, width, height, batch, threads, &config);
+    bytes = (size_t)batch * denseLayer->size * sizeof(real);
+    for (int t=0; t<bench->trainer->numThreads; t++) {
+        bytes += workspaceBytes(bench->trainer->workspaces[t]) + gradientBytes(bench->trainer->grads[t]);
+    }
+    measure(report, "trainBatch", benchTrainBatch, bench, threads, reps, 2.0 * convFlops + 3.0 * denseFlops, bytes);
+    freeTrainer(bench->trainer);
+    bench->trainer = NULL;
+}
+
+/*
+ * writeBigEndian()
+ * IDX header field.
+ */
+static void writeBigEndian(FILE* f, uint32_t value) {
+    uint8_t bytes[4] = {(uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value};
+    fwrite(bytes, 1, 4, f);
+}
+
+/*
+ * writeSyntheticData()
+ * Writes SYNTHETIC_IMAGES random 28×28 images (sparse strokes
+ * on a black background, like MNIST) and labels as IDX files,
+ * drawn from the seed's RANDOM_SYNTHETIC stream. The content
+ * only has to be deterministic, not learnable.
+ */
+static int writeSyntheticData(uint64_t seed) {
+    uint64_t next = 0;
+    size_t imageSize = SYNTHETIC_SIZE * SYNTHETIC_SIZE;
+    uint8_t* images = calloc(SYNTHETIC_IMAGES, imageSize);
+    uint8_t* labels = malloc(SYNTHETIC_IMAGES);
+    assert(images != NULL && labels != NULL);
+
+    for (int i=0; i<SYNTHETIC_IMAGES; i++) {
+        uint8_t* image = images + i * imageSize;
+        for (int s=0; s<4; s++) {
+            int x = 4 + (int)randomBelow(seed, RANDOM_SYNTHETIC, next++, SYNTHETIC_SIZE - 8);
+            int y = 4 + (int)randomBelow(seed, RANDOM_SYNTHETIC, next++, SYNTHETIC_SIZE - 8);
+            int dx = (int)randomBelow(seed, RANDOM_SYNTHETIC, next++, 3) - 1;
+            int dy = (int)randomBelow(seed, RANDOM_SYNTHETIC, next++, 3) - 1;
+            for (int step=0; step<12; step++) {
+                if (x < 0 || y < 0 || x >= SYNTHETIC_SIZE || y >= SYNTHETIC_SIZE) break;
+                image[y * SYNTHETIC_SIZE + x] = (uint8_t)(128 + randomBelow(seed, RANDOM_SYNTHETIC, next++, 128));
+                x += dx;
+                y += dy;
+            }
+        }
+        labels[i] = (uint8_t)randomBelow(seed, RANDOM_SYNTHETIC, next++, 10);
+    }
+
+    FILE* f = fopen(SYNTHETIC_IMAGES_PATH, "wb");
+    FILE* g = fopen(SYNTHETIC_LABELS_PATH, "wb");
+    int ok = f != NULL && g != NULL;
+    if (ok) {
+        writeBigEndian(f, IDX_UBYTE_3D);
+        writeBigEndian(f, SYNTHETIC_IMAGES);
+        writeBigEndian(f, SYNTHETIC_SIZE);
+        writeBigEndian(f, SYNTHETIC_SIZE);
+        ok = fwrite(images, imageSize, SYNTHETIC_IMAGES, f) == SYNTHETIC_IMAGES;
+        writeBigEndian(g, IDX_UBYTE_1D);
+        writeBigEndian(g, SYNTHETIC_IMAGES);
+        ok = fwrite(labels, 1, SYNTHETIC_IMAGES, g) == SYNTHETIC_IMAGES && ok;
+    }
+    if (f != NULL) ok = fclose(f) == 0 && ok;
+    if (g != NULL) ok = fclose(g) == 0 && ok;
+    free(images);
+    free(labels);
+    return ok;
+}
+
+/*
+ * writeJson()
+ * Machine-readable report: run configuration plus one object
+ * per case. `gflops` is null for kernels without a FLOP count.
+ */
+static int writeJson(const char* path, Options* options, Report* report, const char* data, int images) {
+    FILE* f = fopen(path, "w");
+    if (f == NULL) return 0;
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"version\": 1,\n");
+    fprintf(f, "  \"simd\": \"%s\",\n", simd->name);
+    fprintf(f, "  \"real\": \"%s\",\n", REAL_NAME);
+    fprintf(f, "  \"data\": \"%s\",\n", data);
+    fprintf(f, "  \"images\": %d,\n", images);
+    fprintf(f, "  \"seed\": %llu,\n", (unsigned long long)options->seed);
+    fprintf(f, "  \"reps\": %d,\n", options->reps);
+    fprintf(f, "  \"warmup\": %d,\n", BENCH_WARMUP);
+    fprintf(f, "  \"results\": [\n");
+    for (int i=0; i<report->count; i++) {
+        Result* r = &report->results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"batch\": %d, \"threads\": %d, \"reps\": %d, "
+                   "\"minUs\": %.3f, \"medianUs\": %.3f, \"p99Us\": %.3f, \"usPerImage\": %.3f, ",
+                r->name, r->batch, r->threads, r->reps, r->minUs, r->medianUs, r->p99Us, r->medianUs / r->batch);
+        if (r->flops > 0) {
+            fprintf(f, "\"gflops\": %.4f, ", r->flops / (r->medianUs * 1e3));
+        } else {
+            fprintf(f, "\"gflops\": null, ");
+        }
+#ifdef CNN_NO_PROFILE
+        fprintf(f, "\"allocations\": null, \"bytesAllocated\": null, ");
+#else
+        fprintf(f, "\"allocations\": %.3f, \"bytesAllocated\": %.1f, ", r->allocations, r->allocatedBytes);
+#endif
+        fprintf(f, "\"workspaceBytes\": %zu}%s\n", r->workspaceBytes, i + 1 < report->count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [--batch N,N,...] [--threads N,N,...] [--reps N] [--seed N] [--data DIR] [--json PATH]\n", program);
+    fprintf(stderr, "Defaults: --batch 1,8,32,128 --threads 1,2,4 --reps 50 --seed 1 --data ./MNIST --json bench.json\n");
+}
+
+/*
+ * parseList()
+ * Comma-separated positive integers into `values`; returns the
+ * count, or 0 if the list is malformed or too long.
+ */
+static int parseList(const char* text, int* values) {
+    int count = 0;
+    while (*text != '\0') {
+        char* end;
+        long value = strtol(text, &end, 10);
+        if (end == text || value <= 0 || count == BENCH_MAX_SWEEP) return 0;
+        values[count++] = (int)value;
+        text = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') return 0;
+    }
+    return count;
+}
+
+static int parseOptions(int argc, char** argv, Options* options) {
+    const int batches[] = {1, 8, 32, 128};
+    const int threads[] = {1, 2, 4};
+    options->numBatches = 4;
+    memcpy(options->batches, batches, sizeof(batches));
+    options->numThreads = 3;
+    memcpy(options->threads, threads, sizeof(threads));
+    options->reps = 50;
+    options->seed = 1;
+    options->dataDir = "./MNIST";
+    options->jsonPath = "bench.json";
+
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0 && i+1 < argc) {
+            options->numBatches = parseList(argv[++i], options->batches);
+            if (options->numBatches == 0) return 0;
+        } else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc) {
+            options->numThreads = parseList(argv[++i], options->threads);
+            if (options->numThreads == 0) return 0;
+        } else if (strcmp(argv[i], "--reps") == 0 && i+1 < argc) {
+            options->reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc) {
+            options->seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--data") == 0 && i+1 < argc) {
+            options->dataDir = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i+1 < argc) {
+            options->jsonPath = argv[++i];
+        } else {
+            return 0;
+        }
+    }
+    return options->reps > 0;
+}
+
+/*
+ * main()
+ * Loads (or synthesizes) the data, builds the same network as
+ * main.c and runs every case of the sweep.
+ */
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, &options)) {
+        usage(argv[0]);
+        return 1;
+    }
+    simdInit();
+
+    char imagesPath[1024];
+    char labelsPath[1024];
+    snprintf(imagesPath, sizeof(imagesPath), "%s/train-images.idx3-ubyte", options.dataDir);
+    snprintf(labelsPath, sizeof(labelsPath), "%s/train-labels.idx1-ubyte", options.dataDir);
+    const char* data = "mnist";
+    FILE* probe = fopen(imagesPath, "rb");
+    if (probe != NULL) {
+        fclose(probe);
+    } else {
+        printf("%s not found, generating %d synthetic images.\n", imagesPath, SYNTHETIC_IMAGES);
+        if (!writeSyntheticData(options.seed)) {
+            fprintf(stderr, "cannot write synthetic data\n");
+            return 1;
+        }
+        snprintf(imagesPath, sizeof(imagesPath), "%s", SYNTHETIC_IMAGES_PATH);
+        snprintf(labelsPath, sizeof(labelsPath), "%s", SYNTHETIC_LABELS_PATH);
+        data = "synthetic";
+    }
+
+    Bench bench = {0};
+    bench.imagesPath = imagesPath;
+    bench.labelsPath = labelsPath;
+    bench.dataset = openDataset(imagesPath, labelsPath);
+    if (bench.dataset == NULL) return 1;
+    bench.convLayer = initConvLayer(8, 3, options.seed);
+    bench.denseLayer = initDenseLayer(10, (bench.dataset->width - 2) / 2, (bench.dataset->height - 2) / 2, 8, options.seed);
+    bench.net = parseNetwork("conv:8:3,relu,pool:2,dense:10", 1, bench.dataset->width, bench.dataset->height, options.seed);
+    assert(bench.net != NULL);
+
+    int maxBatch = 0;
+    for (int i=0; i<options.numBatches; i++) {
+        if (options.batches[i] > maxBatch) maxBatch = options.batches[i];
+    }
+    if (maxBatch > bench.dataset->count) {
+        fprintf(stderr, "batch %d exceeds the %d images available\n", maxBatch, bench.dataset->count);
+        return 1;
+    }
+    printf("Benchmarking %s kernels, %s, %s data (%d images), %d reps after %d warm-up.\n\n",
+           simd->name, REAL_NAME, data, bench.dataset->count, options.reps, BENCH_WARMUP);
+
+    Report report = {0};
+    for (int i=0; i<options.numBatches; i++) {
+        runLayerCases(&report, &bench, options.batches[i], options.reps);
+    }
+    for (int i=0; i<options.numBatches; i++) {
+        for (int t=0; t<options.numThreads; t++) {
+            runThreadedCases(&report, &bench, options.batches[i], options.threads[t], options.reps);
+        }
+    }
+    bench.batch = bench.dataset->count;
+    measure(&report, "idxLoader", benchLoader, &bench, 1, options.reps, 0, bench.dataset->imageFile.size + bench.dataset->labelFile.size);
+
+    int ok = writeJson(options.jsonPath, &options, &report, data, bench.dataset->count);
+    if (ok) {
+        printf("\nWrote %d results to %s\n", report.count, options.jsonPath);
+    } else {
+        fprintf(stderr, "%s: cannot write report\n", options.jsonPath);
+    }
+
+    closeDataset(bench.dataset);
+    if (strcmp(data, "synthetic") == 0) {
+        remove(SYNTHETIC_IMAGES_PATH);
+        remove(SYNTHETIC_LABELS_PATH);
+    }
+    free(report.results);
+    freeConvLayer(bench.convLayer);
+    freeDenseLayer(bench.denseLayer);
+    freeNetwork(bench.net);
+    return ok ? 0 : 1;
+}
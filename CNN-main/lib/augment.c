@@ -0,0 +1,514 @@
+/*
+ * augment.c — on-the-fly training data augmentation
+ * -------------------------------------------------
+ * Every output pixel is pulled back to a point of the source
+ * image: the inverse of a rotation about the centre and a
+ * shift, plus an elastic displacement field (uniform noise in
+ * [-1, 1) per pixel, Gaussian-blurred with σ and scaled by
+ * α). The source is copied into a plane with a one-pixel zero
+ * border and the SIMD bilinear kernel samples it at all the
+ * points in one call, so anything pulled in from outside the
+ * image is background. The blur is separable: one pass down
+ * the columns, a transpose and a second pass, each tap a
+ * single axpy over the whole image.
+ *
+ * A background thread takes batches from the DataStream,
+ * splits each one image per task across the worker pool (it
+ * joins in as worker 0) and publishes the result into the
+ * next free ring slot.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "tensor.h"
+#include "simd.h"
+#include "random.h"
+#include "threadpool.h"
+#include "profile.h"
+#include "augment.h"
+
+#define AUGMENT_PARAMS 3    /* shift x, shift y, angle */
+
+/*
+ * AugmentScratch: one worker's buffers for a single image.
+ */
+typedef struct {
+    real* plane;        /* [height + 2, width + 2], zero border */
+    real* x;            /* [height, width] source coordinates */
+    real* y;
+    real* out;          /* [height, width] resampled pixels */
+    real* field;        /* [2, height, width] elastic noise */
+    real* blur;         /* [height, width] blur pass */
+} AugmentScratch;
+
+typedef struct {
+    uint8_t* images;    /* [batchSize, height, width] */
+    uint8_t* labels;
+    int count;
+    int end;            /* epoch boundary, no images */
+    int full;
+    double busy;        /* seconds spent transforming it */
+} AugmentSlot;
+
+struct Augmenter {
+    DataStream* stream;
+    AugmentConfig config;
+    uint64_t seed;
+    int width;
+    int height;
+    int batchSize;
+    int radius;
+    real* kernel;       /* [2·radius + 1] normalised Gaussian, shared by the workers */
+    Arena arena;        /* slots, kernel and scratch */
+    AugmentScratch* scratch;    /* one per worker */
+    ThreadPool* pool;
+
+    /* batch being transformed */
+    const uint8_t* source;
+    uint8_t* target;
+    uint64_t epoch;
+    uint64_t first;
+
+    pthread_t thread;
+    int produce;
+    int consume;
+    int holding;        /* the consumer still reads slots[consume] */
+    AugmentSlot slots[AUGMENT_SLOTS];
+    AugmentStats stats;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    pthread_cond_t drained;
+    int shutdown;
+};
+
+/*
+ * defaultAugmentConfig()
+ * No transform at all, σ = 4 for when elastic is turned on,
+ * two workers.
+ */
+void defaultAugmentConfig(AugmentConfig* config) {
+    config->shift = 0.0;
+    config->rotation = 0.0;
+    config->elastic = 0.0;
+    config->sigma = 4.0;
+    config->workers = 2;
+}
+
+/*
+ * parseAugment()
+ * Comma-separated transforms:
+ *   shift:P        up to ±P pixels along each axis
+ *   rotate:D       up to ±D degrees
+ *   elastic:A[:S]  elastic distortion of scale A pixels, σ = S (4)
+ * Returns 0 on a malformed spec.
+ */
+int parseAugment(const char* spec, AugmentConfig* config) {
+    const char* p = spec;
+    while (*p != '\0') {
+        char* next;
+        if (strncmp(p, "shift:", 6) == 0) {
+            config->shift = strtod(p + 6, &next);
+        } else if (strncmp(p, "rotate:", 7) == 0) {
+            config->rotation = strtod(p + 7, &next);
+        } else if (strncmp(p, "elastic:", 8) == 0) {
+            config->elastic = strtod(p + 8, &next);
+            if (*next == ':') config->sigma = strtod(next + 1, &next);
+        } else {
+            break;
+        }
+        if (config->shift < 0.0 || config->rotation < 0.0 || config->elastic < 0.0 || config->sigma <= 0.0) break;
+        p = next;
+        if (*p == ',') p++;
+        else if (*p != '\0') break;
+    }
+    if (*p == '\0' && p != spec) return 1;
+    fprintf(stderr, "bad augmentation '%s'\n", spec);
+    return 0;
+}
+
+/*
+ * printAugment()
+ * One line with the enabled transforms and the worker count.
+ */
+void printAugment(const AugmentConfig* config) {
+    printf("Augmentation:");
+    if (config->shift > 0.0) printf(" shift ±%g px,", config->shift);
+    if (config->rotation > 0.0) printf(" rotation ±%g°,", config->rotation);
+    if (config->elastic > 0.0) printf(" elastic α %g σ %g,", config->elastic, config->sigma);
+    printf(" %d worker(s)\n", config->workers);
+}
+
+/*
+ * kernelRadius()
+ * Half-width of the blur: 3σ, but never wider than the image.
+ */
+static int kernelRadius(const AugmentConfig* config, int width, int height) {
+    int radius = (int)ceil(3.0 * config->sigma);
+    int limit = (width > height ? width : height) - 1;
+    return radius < limit ? radius : limit;
+}
+
+/*
+ * layoutScratch()
+ * Carves (or, on a measuring arena, sizes) one worker's buffers.
+ */
+static void layoutScratch(Arena* arena, AugmentScratch* scratch, int width, int height) {
+    size_t pixels = (size_t)width * height;
+    scratch->plane = arenaAlloc(arena, (size_t)(width + 2) * (height + 2));
+    scratch->x = arenaAlloc(arena, pixels);
+    scratch->y = arenaAlloc(arena, pixels);
+    scratch->out = arenaAlloc(arena, pixels);
+    scratch->field = arenaAlloc(arena, 2 * pixels);
+    scratch->blur = arenaAlloc(arena, pixels);
+}
+
+/*
+ * gaussianKernel()
+ * Fills `kernel` with the 2·radius + 1 taps of a normalised
+ * Gaussian of width config->sigma. Depends only on the
+ * config, so it is built once per Augmenter.
+ */
+static void gaussianKernel(const AugmentConfig* config, int radius, real* kernel) {
+    double sum = 0.0;
+    for (int t=-radius; t<=radius; t++) {
+        kernel[t + radius] = (real)exp(-0.5 * t * t / (config->sigma * config->sigma));
+        sum += kernel[t + radius];
+    }
+    for (int t=0; t<=2 * radius; t++) {
+        kernel[t] = (real)(kernel[t] / sum);
+    }
+}
+
+/*
+ * blurColumns()
+ * out = in ⊛ kernel down every column, zero outside: rows are
+ * contiguous, so each tap is one axpy over every row it
+ * reaches at once.
+ */
+static void blurColumns(const real* in, real* out, const real* kernel, int radius, int width, int height) {
+    memset(out, 0, (size_t)width * height * sizeof(real));
+    for (int t=-radius; t<=radius; t++) {
+        int lo = t < 0 ? -t : 0;
+        int hi = t > 0 ? height - t : height;
+        if (lo >= hi) continue;
+        simd->axpy(kernel[t + radius], in + (size_t)(lo + t) * width, out + (size_t)lo * width, (hi - lo) * width);
+    }
+}
+
+static void transpose(const real* in, real* out, int width, int height) {
+    for (int row=0; row<height; row++) {
+        for (int col=0; col<width; col++) {
+            out[(size_t)col * height + row] = in[(size_t)row * width + col];
+        }
+    }
+}
+
+/*
+ * blurField()
+ * out = noise blurred along both axes: down the columns, then
+ * down the columns of the transpose. Overwrites `noise`.
+ */
+static void blurField(real* noise, real* blur, real* out, const real* kernel, int radius, int width, int height) {
+    blurColumns(noise, blur, kernel, radius, width, height);
+    transpose(blur, noise, width, height);
+    blurColumns(noise, blur, kernel, radius, height, width);
+    transpose(blur, out, height, width);
+}
+
+/*
+ * transformImage()
+ * Augments image `index` of epoch `epoch` from `src` into
+ * `dst`. Draws AUGMENT_PARAMS uniforms, then 2·width·height
+ * for the elastic field, from a per-image range of the
+ * epoch's stream, so the result depends on nothing else.
+ * `kernel` is the gaussianKernel() for `radius`.
+ */
+static void transformImage(const AugmentConfig* config, AugmentScratch* scratch, int width, int height, const real* kernel, int radius, uint64_t seed, uint64_t epoch, uint64_t index, const uint8_t* src, uint8_t* dst) {
+    size_t pixels = (size_t)width * height;
+    int stride = width + 2;
+    uint64_t randomStream = RANDOM_PART(RANDOM_AUGMENT, epoch);
+    uint64_t first = index * (AUGMENT_PARAMS + (config->elastic > 0.0 ? 2 * pixels : 0));
+    real params[AUGMENT_PARAMS];
+    randomUniform(seed, randomStream, first, params, AUGMENT_PARAMS);
+
+    memset(scratch->plane, 0, (size_t)stride * (height + 2) * sizeof(real));
+    for (int row=0; row<height; row++) {
+        for (int col=0; col<width; col++) {
+            scratch->plane[(size_t)(row + 1) * stride + col + 1] = src[(size_t)row * width + col];
+        }
+    }
+
+    if (config->elastic > 0.0) {
+        randomUniform(seed, randomStream, first + AUGMENT_PARAMS, scratch->field, 2 * pixels);
+        for (size_t i=0; i<2 * pixels; i++) {
+            scratch->field[i] = 2.0 * scratch->field[i] - 1.0;
+        }
+        blurField(scratch->field, scratch->blur, scratch->x, kernel, radius, width, height);
+        blurField(scratch->field + pixels, scratch->blur, scratch->y, kernel, radius, width, height);
+        simd->scale(config->elastic, scratch->x, scratch->x, (int)pixels);
+        simd->scale(config->elastic, scratch->y, scratch->y, (int)pixels);
+    } else {
+        memset(scratch->x, 0, pixels * sizeof(real));
+        memset(scratch->y, 0, pixels * sizeof(real));
+    }
+
+    /* inverse map: undo the shift, rotate back by -θ, move into plane coordinates */
+    double shiftX = config->shift * (2.0 * params[0] - 1.0);
+    double shiftY = config->shift * (2.0 * params[1] - 1.0);
+    double angle = config->rotation * (2.0 * params[2] - 1.0) * 3.14159265358979323846 / 180.0;
+    double c = cos(angle);
+    double s = sin(angle);
+    double centreX = (width - 1) / 2.0;
+    double centreY = (height - 1) / 2.0;
+    for (int row=0; row<height; row++) {
+        double ry = row - centreY - shiftY;
+        for (int col=0; col<width; col++) {
+            double rx = col - centreX - shiftX;
+            size_t i = (size_t)row * width + col;
+            scratch->x[i] += (real)(c * rx + s * ry + centreX + 1.0);
+            scratch->y[i] += (real)(-s * rx + c * ry + centreY + 1.0);
+        }
+    }
+
+    simd->bilinear(scratch->plane, stride, height + 2, scratch->x, scratch->y, scratch->out, (int)pixels);
+    for (size_t i=0; i<pixels; i++) {
+        real v = scratch->out[i] + (real)0.5;
+        dst[i] = (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+    }
+}
+
+/*
+ * augmentTask()
+ * Task `task`: image `task` of the batch being transformed.
+ */
+static void augmentTask(void* context, int task, int thread) {
+    Augmenter* augmenter = context;
+    size_t imageSize = (size_t)augmenter->width * augmenter->height;
+    transformImage(&augmenter->config, &augmenter->scratch[thread], augmenter->width, augmenter->height, augmenter->kernel, augmenter->radius,
+                   augmenter->seed, augmenter->epoch, augmenter->first + task,
+                   augmenter->source + task * imageSize, augmenter->target + task * imageSize);
+}
+
+/*
+ * producerMain()
+ * Body of the background thread: pulls the next batch (or
+ * epoch end) from the stream, waits for a free slot,
+ * transforms the batch into it and publishes it. A stream
+ * error is published as a slot with count -1, after which the
+ * thread stops.
+ */
+static void* producerMain(void* arg) {
+    Augmenter* augmenter = arg;
+    uint64_t epoch = 0;
+    uint64_t index = 0;
+
+    for (;;) {
+        const uint8_t* images;
+        const uint8_t* labels;
+        int count = streamNext(augmenter->stream, &images, &labels);
+
+        pthread_mutex_lock(&augmenter->lock);
+        AugmentSlot* slot = &augmenter->slots[augmenter->produce];
+        while (slot->full && !augmenter->shutdown) {
+            pthread_cond_wait(&augmenter->drained, &augmenter->lock);
+        }
+        int shutdown = augmenter->shutdown;
+        pthread_mutex_unlock(&augmenter->lock);
+        if (shutdown) return NULL;
+
+        double start = profileSeconds();
+        if (count > 0) {
+            augmenter->source = images;
+            augmenter->target = slot->images;
+            augmenter->epoch = epoch;
+            augmenter->first = index;
+            threadPoolRun(augmenter->pool, augmentTask, augmenter, count);
+            memcpy(slot->labels, labels, count);
+            index += count;
+        } else {
+            epoch++;
+            index = 0;
+        }
+        double busy = profileSeconds() - start;
+
+        pthread_mutex_lock(&augmenter->lock);
+        slot->count = count;
+        slot->end = count <= 0;
+        slot->full = 1;
+        slot->busy = busy;
+        augmenter->produce = (augmenter->produce + 1) % AUGMENT_SLOTS;
+        pthread_cond_signal(&augmenter->filled);
+        pthread_mutex_unlock(&augmenter->lock);
+        if (count < 0) return NULL;
+    }
+}
+
+/*
+ * initAugmenter()
+ * Starts augmenting `stream`, whose batches hold at most
+ * `batchSize` images. The stream must outlive the augmenter
+ * and is read only through it from now on.
+ */
+Augmenter* initAugmenter(DataStream* stream, int batchSize, const AugmentConfig* config, uint64_t seed) {
+    assert(batchSize > 0 && config->workers > 0);
+    Augmenter* augmenter = calloc(1, sizeof(Augmenter));
+    assert(augmenter != NULL);
+
+    int count;
+    streamShape(stream, &count, &augmenter->width, &augmenter->height);
+    augmenter->stream = stream;
+    augmenter->config = *config;
+    augmenter->seed = seed;
+    augmenter->batchSize = batchSize;
+    augmenter->radius = kernelRadius(config, augmenter->width, augmenter->height);
+    augmenter->scratch = malloc(config->workers * sizeof(AugmentScratch));
+    assert(augmenter->scratch != NULL);
+
+    size_t imageSize = (size_t)augmenter->width * augmenter->height;
+    arenaInit(&augmenter->arena, 0);
+    for (int pass=0; pass<2; pass++) {
+        for (int s=0; s<AUGMENT_SLOTS; s++) {
+            augmenter->slots[s].images = arenaBytes(&augmenter->arena, batchSize * imageSize);
+            augmenter->slots[s].labels = arenaBytes(&augmenter->arena, batchSize);
+        }
+        augmenter->kernel = arenaAlloc(&augmenter->arena, 2 * augmenter->radius + 1);
+        for (int w=0; w<config->workers; w++) {
+            layoutScratch(&augmenter->arena, &augmenter->scratch[w], augmenter->width, augmenter->height);
+        }
+        if (pass == 0) arenaInit(&augmenter->arena, augmenter->arena.used);
+    }
+    gaussianKernel(config, augmenter->radius, augmenter->kernel);
+    augmenter->pool = initThreadPool(config->workers);
+
+    pthread_mutex_init(&augmenter->lock, NULL);
+    pthread_cond_init(&augmenter->filled, NULL);
+    pthread_cond_init(&augmenter->drained, NULL);
+    int rc = pthread_create(&augmenter->thread, NULL, producerMain, augmenter);
+    assert(rc == 0);
+    (void)rc;
+    return augmenter;
+}
+
+/*
+ * freeAugmenter()
+ * Stops the background thread and releases the buffers; the
+ * stream is left open.
+ */
+void freeAugmenter(Augmenter* augmenter) {
+    pthread_mutex_lock(&augmenter->lock);
+    augmenter->shutdown = 1;
+    pthread_cond_broadcast(&augmenter->drained);
+    pthread_mutex_unlock(&augmenter->lock);
+    pthread_join(augmenter->thread, NULL);
+
+    pthread_cond_destroy(&augmenter->drained);
+    pthread_cond_destroy(&augmenter->filled);
+    pthread_mutex_destroy(&augmenter->lock);
+    freeThreadPool(augmenter->pool);
+    arenaFree(&augmenter->arena);
+    free(augmenter->scratch);
+    free(augmenter);
+}
+
+/*
+ * augmentNext()
+ * streamNext() for augmented batches: points `images`/`labels`
+ * at the next batch and returns its size, 0 once at the end
+ * of every epoch and -1 if the stream failed (do not call it
+ * again after that). The views stay valid until the next call.
+ */
+int augmentNext(Augmenter* augmenter, const uint8_t** images, const uint8_t** labels) {
+    pthread_mutex_lock(&augmenter->lock);
+    if (augmenter->holding) {
+        augmenter->slots[augmenter->consume].full = 0;
+        augmenter->consume = (augmenter->consume + 1) % AUGMENT_SLOTS;
+        augmenter->holding = 0;
+        pthread_cond_signal(&augmenter->drained);
+    }
+    AugmentSlot* slot = &augmenter->slots[augmenter->consume];
+    if (!slot->full) {
+        double start = profileSeconds();
+        while (!slot->full) {
+            pthread_cond_wait(&augmenter->filled, &augmenter->lock);
+        }
+        augmenter->stats.stalls++;
+        augmenter->stats.waited += profileSeconds() - start;
+    }
+    augmenter->holding = 1;
+    int count = slot->count;
+    /* counted on hand-over: slots prefetched past the last
+       epoch the trainer asks for are never reported */
+    augmenter->stats.images += count > 0 ? count : 0;
+    augmenter->stats.busy += slot->busy;
+    pthread_mutex_unlock(&augmenter->lock);
+
+    *images = slot->images;
+    *labels = slot->labels;
+    return count;
+}
+
+/*
+ * augmentStats()
+ * Counters since initAugmenter().
+ */
+void augmentStats(Augmenter* augmenter, AugmentStats* stats) {
+    pthread_mutex_lock(&augmenter->lock);
+    *stats = augmenter->stats;
+    pthread_mutex_unlock(&augmenter->lock);
+}
+
+/*
+ * augmentSelfTest()
+ * With every transform off the output must equal the input.
+ * With all of them on, an image must come out the same from a
+ * fresh worker's scratch, and differently under another index.
+ * Returns the number of failures.
+ */
+int augmentSelfTest(void) {
+    enum { SIZE = 28 };
+    AugmentConfig config;
+    defaultAugmentConfig(&config);
+    uint8_t src[SIZE * SIZE];
+    uint8_t dst[3][SIZE * SIZE];
+    for (int i=0; i<SIZE * SIZE; i++) {
+        src[i] = (uint8_t)randomBelow(RANDOM_TEST_SEED, RANDOM_PART(RANDOM_SELFTEST, RANDOM_FIXTURE_AUGMENT), i, 256);
+    }
+
+    int radius = kernelRadius(&config, SIZE, SIZE);
+    real* kernel = NULL;
+    AugmentScratch scratch[2];
+    Arena arena;
+    arenaInit(&arena, 0);
+    for (int pass=0; pass<2; pass++) {
+        kernel = arenaAlloc(&arena, 2 * radius + 1);
+        layoutScratch(&arena, &scratch[0], SIZE, SIZE);
+        layoutScratch(&arena, &scratch[1], SIZE, SIZE);
+        if (pass == 0) arenaInit(&arena, arena.used);
+    }
+    gaussianKernel(&config, radius, kernel);
+    int failures = 0;
+
+    transformImage(&config, &scratch[0], SIZE, SIZE, kernel, radius, 7, 0, 0, src, dst[0]);
+    int ok = memcmp(src, dst[0], sizeof(src)) == 0;
+    printf("Augment self-test: identity %s\n", ok ? "ok" : "FAILED");
+    failures += !ok;
+
+    config.shift = 2.0;
+    config.rotation = 15.0;
+    config.elastic = 8.0;
+    transformImage(&config, &scratch[0], SIZE, SIZE, kernel, radius, 7, 3, 41, src, dst[0]);
+    transformImage(&config, &scratch[0], SIZE, SIZE, kernel, radius, 7, 3, 42, src, dst[1]);
+    transformImage(&config, &scratch[1], SIZE, SIZE, kernel, radius, 7, 3, 41, src, dst[2]);
+    ok = memcmp(dst[0], dst[2], sizeof(src)) == 0 && memcmp(dst[0], dst[1], sizeof(src)) != 0;
+    printf("Augment self-test: shift, rotation, elastic reproducible per (seed, epoch, index) %s\n", ok ? "ok" : "FAILED");
+    failures += !ok;
+
+    arenaFree(&arena);
+    return failures;
+}
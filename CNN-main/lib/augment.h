@@ -0,0 +1,57 @@
+/*
+ * augment.h — on-the-fly training data augmentation
+ * -------------------------------------------------
+ * An Augmenter sits between a DataStream and the trainer and
+ * hands out the same batches with every image randomly
+ * shifted, rotated and elastically distorted (Simard et al.,
+ * ICDAR 2003), so no augmented copies ever touch the disk.
+ *
+ * Background workers transform batches into a ring of
+ * AUGMENT_SLOTS slots ahead of the trainer. Image `index` of
+ * epoch `epoch` always gets the transform drawn from sample
+ * (seed, epoch, index) of the RANDOM_AUGMENT stream, so a run
+ * is reproducible for every worker count. AugmentStats
+ * counts the augmentation throughput and every time the
+ * trainer had to wait for it.
+ */
+
+#ifndef AUGMENT_H
+#define AUGMENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "datastream.h"
+
+#define AUGMENT_SLOTS 4
+
+typedef struct {
+    double shift;       /* largest translation per axis, pixels */
+    double rotation;    /* largest rotation either way, degrees */
+    double elastic;     /* elastic displacement scale α, pixels (0 = off) */
+    double sigma;       /* smoothness σ of the elastic field, pixels */
+    int workers;        /* augmentation threads */
+} AugmentConfig;
+
+typedef struct {
+    long images;        /* augmented and handed to the trainer */
+    double busy;        /* seconds the workers spent on those */
+    double waited;      /* seconds the trainer blocked in augmentNext() */
+    long stalls;        /* batches the trainer had to wait for */
+} AugmentStats;
+
+typedef struct Augmenter Augmenter;
+
+void defaultAugmentConfig(AugmentConfig* config);
+int parseAugment(const char* spec, AugmentConfig* config);
+void printAugment(const AugmentConfig* config);
+
+Augmenter* initAugmenter(DataStream* stream, int batchSize, const AugmentConfig* config, uint64_t seed);
+void freeAugmenter(Augmenter* augmenter);
+int augmentNext(Augmenter* augmenter, const uint8_t** images, const uint8_t** labels);
+void augmentStats(Augmenter* augmenter, AugmentStats* stats);
+int augmentSelfTest(void);
+
+#endif
@@ -2,7 +2,8 @@
  * backprop.h — prototypes for back-prop routines
  * ---------------------------------------------
  * Exposes the high-level `backpropagation()` helper used during
- * training plus the required includes for dependent layer structs.
+ * training, the gradient buffers it accumulates into, plus the
+ * required includes for dependent layer structs.
  */
 
 #ifndef BACKPROP_OLD_H
@@ -18,7 +19,25 @@
 #include "pooling.h"
 #include "dense.h"
 #include "output.h"
+#include "workspace.h"
+#include "inference.h"
 
-double* backpropagation(ConvLayer* convLayer, DenseLayer* denseLayer, double** image, int width, int height, int divisor, int label, double learningRate);
+/*
+ * Gradients: dL/dParameter buffers shaped like the layer
+ * parameters they belong to. backpropagation() adds into them
+ * so a whole mini-batch can be summed before one update.
+ */
+typedef struct {
+    Tensor* filters;    /* [numFilters, filterSize, filterSize] */
+    Tensor* weights;    /* [classes, inputSize] */
+    Tensor* biases;     /* [classes] */
+} Gradients;
+
+Gradients* initGradients(ConvLayer* convLayer, DenseLayer* denseLayer);
+void freeGradients(Gradients* grads);
+void zeroGradients(Gradients* grads);
+void denseBackprop(DenseLayer* denseLayer, Workspace* ws, Gradients* grads, int count);
+void convolutionBackprop(ConvLayer* convLayer, Workspace* ws, Gradients* grads, int count);
+real* backpropagation(ConvLayer* convLayer, DenseLayer* denseLayer, Workspace* ws, Gradients* grads, const uint8_t* images, const uint8_t* labels, int count);
 
 #endif
\ No newline at end of file
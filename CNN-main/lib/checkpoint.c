@@ -0,0 +1,387 @@
+/*
+ * checkpoint.c — binary model checkpoints
+ * ---------------------------------------
+ * Files are written to `path.tmp` and renamed over `path`, so
+ * a crash mid-write never leaves a torn checkpoint behind.
+ * Numbers are stored in host byte order; the header's
+ * `realSize` guards against loading float64 weights into a
+ * float32 build and vice versa.
+ *
+ * The asynchronous Checkpointer copies the weights into a
+ * snapshot buffer (a memcpy, between batches) and a background
+ * thread checksums and writes it, so training never waits on
+ * the disk. If a new snapshot arrives before the previous one
+ * was picked up, the newer one wins.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "checkpoint.h"
+
+_Static_assert(sizeof(CheckpointHeader) == TENSOR_ALIGNMENT, "checkpoint header must fill one aligned block");
+
+/*
+ * blockBytes()
+ * Size of one tensor block, padded to TENSOR_ALIGNMENT.
+ */
+static size_t blockBytes(size_t elements) {
+    size_t bytes = elements * sizeof(real);
+    return (bytes + TENSOR_ALIGNMENT - 1) / TENSOR_ALIGNMENT * TENSOR_ALIGNMENT;
+}
+
+static size_t checkpointBytes(ConvLayer* convLayer, DenseLayer* denseLayer) {
+    return sizeof(CheckpointHeader) + blockBytes(convLayer->filters->size) + blockBytes(denseLayer->weights->size) + blockBytes(denseLayer->biases->size);
+}
+
+/*
+ * fnv1a()
+ * 64-bit FNV-1a hash; cheap and plenty to catch truncation or
+ * bit rot.
+ */
+static uint64_t fnv1a(const uint8_t* bytes, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+/*
+ * serializeCheckpoint()
+ * Writes header and blocks into `buffer` (checkpointBytes()
+ * long). The checksum is left for sealCheckpoint().
+ */
+static void serializeCheckpoint(uint8_t* buffer, ConvLayer* convLayer, DenseLayer* denseLayer, long step) {
+    size_t total = checkpointBytes(convLayer, denseLayer);
+    memset(buffer, 0, total);
+
+    CheckpointHeader* header = (CheckpointHeader*)buffer;
+    memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header->version = CHECKPOINT_VERSION;
+    header->realSize = sizeof(real);
+    header->numFilters = convLayer->numFilters;
+    header->filterSize = convLayer->filterSize;
+    header->relu = convLayer->relu;
+    header->classes = denseLayer->size;
+    header->inputSize = denseLayer->inputSize;
+    header->step = (uint64_t)step;
+    header->dataBytes = total - sizeof(CheckpointHeader);
+
+    uint8_t* block = buffer + sizeof(CheckpointHeader);
+    Tensor* tensors[] = {convLayer->filters, denseLayer->weights, denseLayer->biases};
+    for (int t = 0; t < 3; t++) {
+        memcpy(block, tensors[t]->data, tensors[t]->size * sizeof(real));
+        block += blockBytes(tensors[t]->size);
+    }
+}
+
+static void sealCheckpoint(uint8_t* buffer) {
+    CheckpointHeader* header = (CheckpointHeader*)buffer;
+    header->checksum = fnv1a(buffer + sizeof(CheckpointHeader), header->dataBytes);
+}
+
+/*
+ * writeCheckpoint()
+ * One fwrite of the sealed buffer to `path.tmp`, then an
+ * atomic rename. Returns 1 on success.
+ */
+static int writeCheckpoint(const char* path, const uint8_t* buffer) {
+    const CheckpointHeader* header = (const CheckpointHeader*)buffer;
+    size_t total = sizeof(CheckpointHeader) + header->dataBytes;
+    size_t length = strlen(path);
+    char* tmp = malloc(length + 5);
+    assert(tmp != NULL);
+    memcpy(tmp, path, length);
+    memcpy(tmp + length, ".tmp", 5);
+
+    FILE* f = fopen(tmp, "wb");
+    int ok = f != NULL && fwrite(buffer, 1, total, f) == total;
+    ok = f != NULL && fclose(f) == 0 && ok;
+#ifdef _WIN32
+    remove(path);
+#endif
+    ok = ok && rename(tmp, path) == 0;
+    if (!ok) {
+        fprintf(stderr, "%s: cannot write checkpoint\n", path);
+        remove(tmp);
+    }
+    free(tmp);
+    return ok;
+}
+
+/*
+ * saveCheckpoint()
+ * Synchronously writes the model to `path`, tagged with the
+ * optimizer `step`. Returns 1 on success.
+ */
+int saveCheckpoint(const char* path, ConvLayer* convLayer, DenseLayer* denseLayer, long step) {
+    uint8_t* buffer = alignedAlloc(checkpointBytes(convLayer, denseLayer));
+    serializeCheckpoint(buffer, convLayer, denseLayer, step);
+    sealCheckpoint(buffer);
+    int ok = writeCheckpoint(path, buffer);
+    alignedFree(buffer);
+    return ok;
+}
+
+/*
+ * mapCheckpoint()
+ * Maps the whole file copy-on-write (or reads it into one
+ * aligned block on Windows). Returns NULL on failure.
+ */
+static void* mapCheckpoint(const char* path, size_t* size) {
+#ifdef _WIN32
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) return NULL;
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    void* base = length > 0 ? alignedAlloc((size_t)length) : NULL;
+    if (base != NULL && fread(base, 1, (size_t)length, f) != (size_t)length) {
+        alignedFree(base);
+        base = NULL;
+    }
+    fclose(f);
+    *size = base != NULL ? (size_t)length : 0;
+    return base;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void* base = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED) base = NULL;
+    }
+    close(fd);
+    *size = base != NULL ? (size_t)st.st_size : 0;
+    return base;
+#endif
+}
+
+static void unmapCheckpoint(void* base, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    alignedFree(base);
+#else
+    munmap(base, size);
+#endif
+}
+
+/*
+ * validHeader()
+ * Checks magic, version, scalar size, shapes and length
+ * against the mapped file, and that the layers fit
+ * `width`×`height` inputs; prints why on failure.
+ */
+static int validHeader(const char* path, const CheckpointHeader* header, size_t size, int width, int height) {
+    if (size < sizeof(CheckpointHeader) || memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0) {
+        fprintf(stderr, "%s: not a checkpoint\n", path);
+        return 0;
+    }
+    if (header->version != CHECKPOINT_VERSION) {
+        fprintf(stderr, "%s: checkpoint version %u, expected %d\n", path, (unsigned)header->version, CHECKPOINT_VERSION);
+        return 0;
+    }
+    if (header->realSize != sizeof(real)) {
+        fprintf(stderr, "%s: saved with %u-byte reals, this build uses %s\n", path, (unsigned)header->realSize, REAL_NAME);
+        return 0;
+    }
+    if (header->numFilters <= 0 || header->filterSize <= 0 || header->classes <= 0 || header->inputSize <= 0) {
+        fprintf(stderr, "%s: bad layer shapes\n", path);
+        return 0;
+    }
+    /* the dense layer reads the pooled convolution output */
+    long pooled = header->filterSize <= width && header->filterSize <= height
+                ? (long)((width - header->filterSize + 1) / 2) * ((height - header->filterSize + 1) / 2) : 0;
+    if (pooled == 0 || (long)header->numFilters * pooled != header->inputSize) {
+        fprintf(stderr, "%s: %d %dx%d filters and %d dense inputs do not fit %dx%d images\n", path,
+                header->numFilters, header->filterSize, header->filterSize, header->inputSize, width, height);
+        return 0;
+    }
+    size_t expected = blockBytes((size_t)header->numFilters * header->filterSize * header->filterSize)
+                    + blockBytes((size_t)header->classes * header->inputSize)
+                    + blockBytes((size_t)header->classes);
+    if (header->dataBytes != expected || size - sizeof(CheckpointHeader) < expected) {
+        fprintf(stderr, "%s: truncated or inconsistent checkpoint\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * loadCheckpoint()
+ * Maps `path`, validates header and checksum and wires the
+ * layer structs to the mapped blocks — no per-tensor copies or
+ * allocations. Returns NULL if the file is missing, bad, or
+ * holds a model for other than `width`×`height` images.
+ */
+Checkpoint* loadCheckpoint(const char* path, int width, int height) {
+    Checkpoint* checkpoint = malloc(sizeof(Checkpoint));
+    assert(checkpoint != NULL);
+    checkpoint->base = mapCheckpoint(path, &checkpoint->size);
+    if (checkpoint->base == NULL) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        free(checkpoint);
+        return NULL;
+    }
+
+    const CheckpointHeader* header = checkpoint->base;
+    const uint8_t* data = (const uint8_t*)checkpoint->base + sizeof(CheckpointHeader);
+    if (!validHeader(path, header, checkpoint->size, width, height)) {
+        freeCheckpoint(checkpoint);
+        return NULL;
+    }
+    if (fnv1a(data, header->dataBytes) != header->checksum) {
+        fprintf(stderr, "%s: checksum mismatch\n", path);
+        freeCheckpoint(checkpoint);
+        return NULL;
+    }
+
+    int filterShape[3] = {header->numFilters, header->filterSize, header->filterSize};
+    int weightShape[2] = {header->classes, header->inputSize};
+    int biasShape[1] = {header->classes};
+    real* block = (real*)data;
+    tensorView(&checkpoint->filters, block, 3, filterShape);
+    block += blockBytes(checkpoint->filters.size) / sizeof(real);
+    tensorView(&checkpoint->weights, block, 2, weightShape);
+    block += blockBytes(checkpoint->weights.size) / sizeof(real);
+    tensorView(&checkpoint->biases, block, 1, biasShape);
+
+    checkpoint->step = (long)header->step;
+    checkpoint->convLayer.numFilters = header->numFilters;
+    checkpoint->convLayer.filterSize = header->filterSize;
+    checkpoint->convLayer.relu = header->relu;
+    checkpoint->convLayer.filters = &checkpoint->filters;
+    checkpoint->denseLayer.size = header->classes;
+    checkpoint->denseLayer.inputSize = header->inputSize;
+    checkpoint->denseLayer.weights = &checkpoint->weights;
+    checkpoint->denseLayer.biases = &checkpoint->biases;
+    return checkpoint;
+}
+
+/*
+ * freeCheckpoint()
+ * Unmaps the file; the layers become invalid.
+ */
+void freeCheckpoint(Checkpoint* checkpoint) {
+    unmapCheckpoint(checkpoint->base, checkpoint->size);
+    free(checkpoint);
+}
+
+struct Checkpointer {
+    char* path;
+    ConvLayer* convLayer;
+    DenseLayer* denseLayer;
+    size_t bytes;
+    uint8_t* snapshot;      /* filled by the training thread */
+    uint8_t* writing;       /* owned by the writer thread */
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    int pending;
+    int shutdown;
+};
+
+/*
+ * writerMain()
+ * Background thread: take the latest snapshot, seal and
+ * write it, repeat. Drains a pending snapshot before exiting.
+ */
+static void* writerMain(void* arg) {
+    Checkpointer* checkpointer = arg;
+
+    pthread_mutex_lock(&checkpointer->lock);
+    for (;;) {
+        while (!checkpointer->pending && !checkpointer->shutdown) {
+            pthread_cond_wait(&checkpointer->ready, &checkpointer->lock);
+        }
+        if (!checkpointer->pending) break;
+        uint8_t* buffer = checkpointer->snapshot;
+        checkpointer->snapshot = checkpointer->writing;
+        checkpointer->writing = buffer;
+        checkpointer->pending = 0;
+        pthread_mutex_unlock(&checkpointer->lock);
+
+        sealCheckpoint(buffer);
+        writeCheckpoint(checkpointer->path, buffer);
+
+        pthread_mutex_lock(&checkpointer->lock);
+    }
+    pthread_mutex_unlock(&checkpointer->lock);
+    return NULL;
+}
+
+/*
+ * initCheckpointer()
+ * Starts a writer thread that saves `convLayer`/`denseLayer`
+ * to `path` whenever checkpointAsync() is called.
+ */
+Checkpointer* initCheckpointer(const char* path, ConvLayer* convLayer, DenseLayer* denseLayer) {
+    Checkpointer* checkpointer = malloc(sizeof(Checkpointer));
+    assert(checkpointer != NULL);
+
+    checkpointer->path = malloc(strlen(path) + 1);
+    assert(checkpointer->path != NULL);
+    strcpy(checkpointer->path, path);
+    checkpointer->convLayer = convLayer;
+    checkpointer->denseLayer = denseLayer;
+    checkpointer->bytes = checkpointBytes(convLayer, denseLayer);
+    checkpointer->snapshot = alignedAlloc(checkpointer->bytes);
+    checkpointer->writing = alignedAlloc(checkpointer->bytes);
+    checkpointer->pending = 0;
+    checkpointer->shutdown = 0;
+
+    pthread_mutex_init(&checkpointer->lock, NULL);
+    pthread_cond_init(&checkpointer->ready, NULL);
+    int rc = pthread_create(&checkpointer->thread, NULL, writerMain, checkpointer);
+    assert(rc == 0);
+    (void)rc;
+    return checkpointer;
+}
+
+/*
+ * checkpointAsync()
+ * Snapshots the current weights and returns; the writer
+ * thread does the checksum and the I/O. Call between batches
+ * so the snapshot is consistent.
+ */
+void checkpointAsync(Checkpointer* checkpointer, long step) {
+    pthread_mutex_lock(&checkpointer->lock);
+    serializeCheckpoint(checkpointer->snapshot, checkpointer->convLayer, checkpointer->denseLayer, step);
+    checkpointer->pending = 1;
+    pthread_cond_signal(&checkpointer->ready);
+    pthread_mutex_unlock(&checkpointer->lock);
+}
+
+/*
+ * freeCheckpointer()
+ * Waits for the last snapshot to reach disk, then stops the
+ * writer.
+ */
+void freeCheckpointer(Checkpointer* checkpointer) {
+    pthread_mutex_lock(&checkpointer->lock);
+    checkpointer->shutdown = 1;
+    pthread_cond_signal(&checkpointer->ready);
+    pthread_mutex_unlock(&checkpointer->lock);
+    pthread_join(checkpointer->thread, NULL);
+
+    pthread_cond_destroy(&checkpointer->ready);
+    pthread_mutex_destroy(&checkpointer->lock);
+    alignedFree(checkpointer->snapshot);
+    alignedFree(checkpointer->writing);
+    free(checkpointer->path);
+    free(checkpointer);
+}
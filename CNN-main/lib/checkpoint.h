@@ -0,0 +1,68 @@
+/*
+ * checkpoint.h — binary model checkpoints
+ * ---------------------------------------
+ * A 64-byte header (magic, version, scalar size, layer
+ * shapes, training step, checksum) followed by the filters,
+ * weights and biases as 64-byte-aligned contiguous blocks.
+ * Saving is one write of one buffer; loading is one mmap whose
+ * blocks become the layer tensors in place.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "tensor.h"
+#include "convolution.h"
+#include "dense.h"
+
+#define CHECKPOINT_MAGIC "CNNCKPT"
+#define CHECKPOINT_VERSION 1
+
+typedef struct {
+    char magic[8];          /* CHECKPOINT_MAGIC, NUL-padded */
+    uint32_t version;
+    uint32_t realSize;      /* sizeof(real) the blocks were written with */
+    int32_t numFilters;
+    int32_t filterSize;
+    int32_t relu;
+    int32_t classes;
+    int32_t inputSize;
+    uint32_t reserved;
+    uint64_t step;          /* optimizer steps taken when saved */
+    uint64_t dataBytes;     /* bytes of block data after the header */
+    uint64_t checksum;      /* FNV-1a 64 of the block data */
+} CheckpointHeader;
+
+/*
+ * Checkpoint: a loaded model. The layers' tensors point into
+ * the private, writable mapping, so the model can be served or
+ * trained further; release it with freeCheckpoint(), never
+ * with freeConvLayer()/freeDenseLayer().
+ */
+typedef struct {
+    void* base;
+    size_t size;
+    long step;
+    Tensor filters;
+    Tensor weights;
+    Tensor biases;
+    ConvLayer convLayer;
+    DenseLayer denseLayer;
+} Checkpoint;
+
+typedef struct Checkpointer Checkpointer;
+
+int saveCheckpoint(const char* path, ConvLayer* convLayer, DenseLayer* denseLayer, long step);
+Checkpoint* loadCheckpoint(const char* path, int width, int height);
+void freeCheckpoint(Checkpoint* checkpoint);
+
+Checkpointer* initCheckpointer(const char* path, ConvLayer* convLayer, DenseLayer* denseLayer);
+void checkpointAsync(Checkpointer* checkpointer, long step);
+void freeCheckpointer(Checkpointer* checkpointer);
+
+#endif
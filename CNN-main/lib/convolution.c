@@ -1,73 +1,58 @@
 /*
  * convolution.c — Convolution layer implementation
  * -------------------------------------------------
- * Handles filter initialisation (He), forward pass grid
- * construction and the actual 2-D convolution used in our
- * toy MNIST CNN. Written for learning purposes, so the code
- * trades some performance for clarity.
+ * Handles filter initialisation (He) and the forward pass
+ * of the 2-D convolution used in our toy MNIST CNN. The
+ * input is lowered with im2col so the convolution itself is
+ * one blocked matrix multiply per image. The im2col blocks of
+ * a whole batch sit side by side in one matrix, so the filter
+ * gradient is a single pass over every position of every
+ * image.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include <assert.h>
 
+#include "gemm.h"
+#include "simd.h"
+#include "random.h"
 #include "convolution.h"
 
 /*
- * convBoxMuller()
- * Returns one sample from a standard normal distribution
- * using the Box-Muller transform. Used for He-style weight
- * initialisation of the filters.
+ * pixelValue: byte → [0,1] lookup used while packing, so the
+ * dataset can stay in uint8 and is normalised exactly once,
+ * on its way into the im2col matrix. Built at compile time so
+ * layers restored from a checkpoint need no setup call.
  */
-double convBoxMuller() {
-    static int hasSpare = 0;
-    static double spare;
-    
-    if (hasSpare) {
-        hasSpare = 0;
-        return spare;
-    }
-
-    hasSpare = 1;
-    double u, v, s;
-    do {
-        u = ((double)rand() / RAND_MAX) * 2.0 - 1.0;
-        v = ((double)rand() / RAND_MAX) * 2.0 - 1.0;
-        s = u * u + v * v;
-    } while (s >= 1.0 || s == 0.0);
-
-    s = sqrt(-2.0 * log(s) / s);
-    spare = v * s;
-    return u * s;
-}
+#define PIXEL1(i) ((real)(i) / (real)255)
+#define PIXEL4(i) PIXEL1(i), PIXEL1((i) + 1), PIXEL1((i) + 2), PIXEL1((i) + 3)
+#define PIXEL16(i) PIXEL4(i), PIXEL4((i) + 4), PIXEL4((i) + 8), PIXEL4((i) + 12)
+#define PIXEL64(i) PIXEL16(i), PIXEL16((i) + 16), PIXEL16((i) + 32), PIXEL16((i) + 48)
+static const real pixelValue[256] = { PIXEL64(0), PIXEL64(64), PIXEL64(128), PIXEL64(192) };
 
 /*
  * initConvLayer()
  * Allocates a convolutional layer structure and initialises
  * `numFilters` square filters of size `filterSize`×`filterSize`
- * with He-initialised Gaussian noise.
+ * with He-initialised Gaussian noise drawn from `seed` (see
+ * random.h). All filters share one contiguous [numFilters,
+ * filterSize, filterSize] tensor.
  */
-ConvLayer* initConvLayer(int numFilters, int filterSize) {
+ConvLayer* initConvLayer(int numFilters, int filterSize, uint64_t seed) {
     ConvLayer* layer = malloc(sizeof(ConvLayer));
     assert(layer != NULL);
 
     layer->numFilters = numFilters;
     layer->filterSize = filterSize;
-    layer->filters = malloc(numFilters * sizeof(double**));
-    assert(layer->filters != NULL);
+    layer->relu = 1;
+    layer->filters = tensorCreate3D(numFilters, filterSize, filterSize);
 
-    for (int i=0; i<numFilters; i++) {
-        layer->filters[i] = malloc(filterSize * sizeof(double*));
-        assert(layer->filters[i] != NULL);
-        for (int j=0; j<filterSize; j++) {
-            layer->filters[i][j] = malloc(filterSize * sizeof(double));
-            for (int k=0; k<filterSize; k++) {
-                double heInit = convBoxMuller() * sqrt(2.0 / ((double)filterSize * (double)filterSize));
-                layer->filters[i][j][k] = heInit;
-            }
-        }
-    }
+    real* filters = layer->filters->data;
+    randomGaussian(seed, RANDOM_CONV_INIT, 0, filters, layer->filters->size);
+    simd->scale(sqrt(2.0 / ((real)filterSize * (real)filterSize)), filters, filters, (int)layer->filters->size);
     return layer;
 }
 
@@ -76,78 +61,83 @@ ConvLayer* initConvLayer(int numFilters, int filterSize) {
  * Frees all heap allocations belonging to a ConvLayer.
  */
 void freeConvLayer(ConvLayer* layer) {
-    for (int i=0; i<layer->numFilters; i++) {
-        for (int j=0; j<layer->filterSize; j++) {
-            free(layer->filters[i][j]);
-        }
-        free(layer->filters[i]);
-    }
-    free(layer->filters);
+    tensorFree(layer->filters);
     free(layer);
 }
 
 /*
- * convolutionGrid()
- * Slides a `divisor`×`divisor` window across the input image
- * and flattens each patch into a 1-D cell. Returns an array
- * of those cells so that the actual convolution becomes a
- * dot-product.
+ * im2col()
+ * Lowers one row-major `height`×`width` uint8 image into a
+ * [filterSize², outH·outW] matrix of normalised pixels whose
+ * rows are `ld` reals apart: row kx·filterSize+ky holds the
+ * pixel under filter tap (kx, ky) for every output position.
+ * The convolution then becomes a single GEMM with the
+ * [numFilters, filterSize²] filter matrix.
  */
-double** convolutionGrid(double** image, int width, int height, int divisor) {
-    double** grid = malloc((width - (divisor-1)) * (height - (divisor-1)) * sizeof(double*));
-    assert(grid != NULL);
-
-    for (int i=0; i<(width - (divisor-1)); i++) {
-        for (int j=0; j<(height - (divisor-1)); j++) {
-            double* cell = malloc(divisor * divisor * sizeof(double));
-            assert(cell != NULL);
-
-            for (int k=0; k<divisor; k++) {
-                for (int l=0; l<divisor; l++) {
-                    cell[k * divisor + l] = image[i + k][j + l];
+void im2col(const uint8_t* image, int width, int height, int filterSize, real* columns, size_t ld) {
+    int outWidth = width - (filterSize-1);
+    int outHeight = height - (filterSize-1);
+
+    for (int kx=0; kx<filterSize; kx++) {
+        for (int ky=0; ky<filterSize; ky++) {
+            real* row = columns + (kx * filterSize + ky) * ld;
+            for (int i=0; i<outHeight; i++) {
+                const uint8_t* src = image + (i + kx) * width + ky;
+                real* dst = row + i * outWidth;
+                for (int j=0; j<outWidth; j++) {
+                    dst[j] = pixelValue[src[j]];
                 }
             }
-
-            grid[i * (height - (divisor-1)) + j] = cell;
         }
     }
-    return grid;
 }
 
 /*
- * convolution()
- * Computes the dot-product between a single filter and one
- * flattened image cell.
+ * convolutionForward()
+ * Convolves one image with every filter, giving the
+ * [numFilters, outH, outW] `output`. The image's im2col block
+ * is written to `columns` (rows `ld` apart, see im2col()) and
+ * kept there for the backward pass.
  */
-double convolution(double** filter, double* cell) {
-    double sum = 0.0;
-    for (int i=0; i<3; i++) {
-        for (int j=0; j<3; j++) {
-            sum += cell[i * 3 + j] * filter[i][j];
-        }
-    }
-    return sum;
+void convolutionForward(ConvLayer* convLayer, const uint8_t* image, int width, int height, real* columns, size_t ld, Tensor* output) {
+    int filterSize = convLayer->filterSize;
+    int taps = filterSize * filterSize;
+    int outWidth = width - (filterSize-1);
+    int outHeight = height - (filterSize-1);
+    int positions = outWidth * outHeight;
+    assert(output->shape[0] == convLayer->numFilters && output->shape[1] == outHeight && output->shape[2] == outWidth);
+
+    im2col(image, width, height, filterSize, columns, ld);
+    gemm(0, 0, convLayer->numFilters, positions, taps,
+         1.0, convLayer->filters->data, taps, columns, (int)ld,
+         0.0, output->data, positions);
 }
 
 /*
- * convolutionForward()
- * Produces the convolved feature maps for all filters.
- * Output is a `(w-div+1)×(h-div+1)` grid where each entry
- * is an array of `numFilters` activations.
+ * convolutionFilterGradient()
+ * Adds dL/dfilters for `count` images whose im2col blocks C
+ * and output gradients G ([numFilters, outH·outW] each) lie
+ * side by side in `columns` and `dL_dconv`, both with rows
+ * `ld` reals apart: dL/dF += G·Cᵀ, a sum over every position
+ * of every image. Both operands already run along that sum, so
+ * instead of packing them for gemm() it is a blocked
+ * correlation: each CONV_GRAD_BLOCK-wide strip of the
+ * numFilters + filterSize² rows stays in L1 while all their
+ * pairwise dot products are taken.
  */
-double** convolutionForward(ConvLayer* convLayer, double** image, int width, int height, int divisor) {
-    double** grid = convolutionGrid(image, width, height, divisor);
-    double** output = malloc((width - (divisor-1)) * (height - (divisor-1)) * sizeof(double*));
-    assert(output != NULL);
-
-    for (int i=0; i<(width - (divisor-1)); i++) {
-        for (int j=0; j<(height - (divisor-1)); j++) {
-            output[i * (height - (divisor-1)) + j] = malloc(convLayer->numFilters * sizeof(double));
-            assert(output[i * (height - (divisor-1)) + j] != NULL);
-            for (int k=0; k<convLayer->numFilters; k++) {
-                output[i * (height - (divisor-1)) + j][k] = convolution(convLayer->filters[k], grid[i * (height - (divisor-1)) + j]);
+void convolutionFilterGradient(ConvLayer* convLayer, const real* columns, const real* dL_dconv, size_t ld, int count, int width, int height, Tensor* dL_dfilters) {
+    int filterSize = convLayer->filterSize;
+    int taps = filterSize * filterSize;
+    int length = count * (width - (filterSize-1)) * (height - (filterSize-1));
+    real* grad = dL_dfilters->data;
+
+    for (int start=0; start<length; start += CONV_GRAD_BLOCK) {
+        int n = length - start < CONV_GRAD_BLOCK ? length - start : CONV_GRAD_BLOCK;
+        for (int f=0; f<convLayer->numFilters; f++) {
+            const real* g = dL_dconv + f * ld + start;
+            for (int t=0; t<taps; t++) {
+                grad[f * taps + t] += simd->dot(g, columns + t * ld + start, n);
             }
         }
     }
-    return output;
-}
\ No newline at end of file
+}
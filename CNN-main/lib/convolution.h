@@ -3,17 +3,25 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <math.h>
 #include <assert.h>
 
+#include "tensor.h"
+
+#define CONV_GRAD_BLOCK 128    /* positions per strip of the filter-gradient correlation */
+
 typedef struct {
     int numFilters;
     int filterSize;
-    double*** filters;
+    Tensor* filters;    /* [numFilters, filterSize, filterSize] */
+    int relu;           /* apply ReLU before pooling */
 } ConvLayer;
 
-ConvLayer* initConvLayer(int numFilters, int filterSize);
+ConvLayer* initConvLayer(int numFilters, int filterSize, uint64_t seed);
 void freeConvLayer(ConvLayer* layer);
-double** convolutionForward(ConvLayer* convLayer, double** image, int width, int height, int divisor);
+void im2col(const uint8_t* image, int width, int height, int filterSize, real* columns, size_t ld);
+void convolutionForward(ConvLayer* convLayer, const uint8_t* image, int width, int height, real* columns, size_t ld, Tensor* output);
+void convolutionFilterGradient(ConvLayer* convLayer, const real* columns, const real* dL_dconv, size_t ld, int count, int width, int height, Tensor* dL_dfilters);
 
-#endif
\ No newline at end of file
+#endif
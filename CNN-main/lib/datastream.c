@@ -0,0 +1,342 @@
+/*
+ * datastream.c — streaming, shuffling training data source
+ * --------------------------------------------------------
+ * Each epoch visits the windows (runs of `window` consecutive
+ * images in the file) in a shuffled order and shuffles the
+ * images inside every window; both permutations are drawn from
+ * the (seed, epoch) shuffle stream of random.h, so the order
+ * is the same on every run and independent of thread timing.
+ *
+ * The producer thread reads a window into a staging buffer,
+ * waits for a free ring slot and scatters the window into it
+ * in shuffled order, so every batch the trainer sees is one
+ * contiguous run of images and labels. A failed seek or a
+ * short read (say, the file was truncated mid-run) stops the
+ * producer, and streamNext() reports it as -1 instead of
+ * handing out stale staging bytes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "import.h"
+#include "random.h"
+#include "datastream.h"
+
+typedef struct {
+    uint8_t* images;    /* [window, height, width], shuffled */
+    uint8_t* labels;    /* [window] */
+    int count;          /* images held, ≤ window */
+    int last;           /* final window of its epoch */
+    int full;
+} StreamSlot;
+
+struct DataStream {
+    FILE* imageFile;
+    FILE* labelFile;
+    char* imagesPath;
+    char* labelsPath;
+    int64_t imageOffset;
+    int64_t labelOffset;
+    int count;
+    int width;
+    int height;
+    int batchSize;
+    int window;
+    int numWindows;
+    uint64_t seed;
+
+    /* producer side */
+    pthread_t thread;
+    uint8_t* stagingImages;
+    uint8_t* stagingLabels;
+    int* windowOrder;
+    int* imageOrder;
+    int produce;
+
+    /* consumer side */
+    int consume;
+    int position;
+
+    StreamSlot slots[STREAM_SLOTS];
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    pthread_cond_t drained;
+    int shutdown;
+    int failed;         /* the producer hit a read error and stopped */
+};
+
+/*
+ * shuffle()
+ * Fills `order` with a random permutation of 0 … n-1, taking
+ * samples *next, *next + 1, … of the epoch's shuffle stream.
+ */
+static void shuffle(int* order, int n, uint64_t seed, uint64_t randomStream, uint64_t* next) {
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    for (int i = n - 1; i > 0; i--) {
+        int j = (int)randomBelow(seed, randomStream, (*next)++, (uint32_t)(i + 1));
+        int t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+}
+
+/*
+ * readWindow()
+ * Reads window `w` of the files into the staging buffers and
+ * returns the number of images in it, or -1 (after printing
+ * why) if a seek or read fails.
+ */
+static int readWindow(DataStream* stream, int w) {
+    size_t imageSize = (size_t)stream->width * stream->height;
+    int start = w * stream->window;
+    int count = stream->count - start < stream->window ? stream->count - start : stream->window;
+
+    if (!seekIdx(stream->imageFile, stream->imageOffset + (int64_t)start * (int64_t)imageSize)
+        || fread(stream->stagingImages, imageSize, count, stream->imageFile) != (size_t)count) {
+        fprintf(stderr, "%s: cannot read images %d-%d\n", stream->imagesPath, start, start + count - 1);
+        return -1;
+    }
+    if (!seekIdx(stream->labelFile, stream->labelOffset + start)
+        || fread(stream->stagingLabels, 1, count, stream->labelFile) != (size_t)count) {
+        fprintf(stderr, "%s: cannot read labels %d-%d\n", stream->labelsPath, start, start + count - 1);
+        return -1;
+    }
+    return count;
+}
+
+/*
+ * checkStreamLabels()
+ * Reads the whole label file once (one byte per image) and
+ * validates it with checkLabels(). Returns 1 if it is fine.
+ */
+static int checkStreamLabels(DataStream* stream) {
+    uint8_t* labels = malloc(stream->count);
+    assert(labels != NULL);
+    int ok = seekIdx(stream->labelFile, stream->labelOffset)
+        && fread(labels, 1, stream->count, stream->labelFile) == (size_t)stream->count;
+    if (!ok) {
+        fprintf(stderr, "%s: cannot read labels\n", stream->labelsPath);
+    }
+    ok = ok && checkLabels(stream->labelsPath, labels, stream->count);
+    free(labels);
+    return ok;
+}
+
+static char* copyString(const char* s) {
+    char* copy = malloc(strlen(s) + 1);
+    assert(copy != NULL);
+    strcpy(copy, s);
+    return copy;
+}
+
+/*
+ * producerMain()
+ * Body of the background thread: for every epoch, read the
+ * windows in shuffled order and publish each one, shuffled,
+ * into the next free slot. Runs ahead into the next epoch
+ * until closeStream() stops it.
+ */
+static void* producerMain(void* arg) {
+    DataStream* stream = arg;
+    size_t imageSize = (size_t)stream->width * stream->height;
+
+    for (unsigned int epoch = 0; ; epoch++) {
+        uint64_t randomStream = RANDOM_PART(RANDOM_SHUFFLE, epoch);
+        uint64_t next = 0;
+        shuffle(stream->windowOrder, stream->numWindows, stream->seed, randomStream, &next);
+
+        for (int k = 0; k < stream->numWindows; k++) {
+            int count = readWindow(stream, stream->windowOrder[k]);
+            if (count < 0) {
+                pthread_mutex_lock(&stream->lock);
+                stream->failed = 1;
+                pthread_cond_signal(&stream->filled);
+                pthread_mutex_unlock(&stream->lock);
+                return NULL;
+            }
+            shuffle(stream->imageOrder, count, stream->seed, randomStream, &next);
+
+            pthread_mutex_lock(&stream->lock);
+            StreamSlot* slot = &stream->slots[stream->produce];
+            while (slot->full && !stream->shutdown) {
+                pthread_cond_wait(&stream->drained, &stream->lock);
+            }
+            int shutdown = stream->shutdown;
+            pthread_mutex_unlock(&stream->lock);
+            if (shutdown) return NULL;
+
+            for (int i = 0; i < count; i++) {
+                int src = stream->imageOrder[i];
+                memcpy(slot->images + i * imageSize, stream->stagingImages + src * imageSize, imageSize);
+                slot->labels[i] = stream->stagingLabels[src];
+            }
+
+            pthread_mutex_lock(&stream->lock);
+            slot->count = count;
+            slot->last = k == stream->numWindows - 1;
+            slot->full = 1;
+            stream->produce = (stream->produce + 1) % STREAM_SLOTS;
+            pthread_cond_signal(&stream->filled);
+            pthread_mutex_unlock(&stream->lock);
+        }
+    }
+}
+
+/*
+ * openStream()
+ * Opens and validates the image/label files and starts the
+ * producer. `window` (images per shuffle window) is rounded up
+ * to a multiple of `batchSize` so batches never straddle two
+ * slots. Returns NULL if either file is missing or malformed,
+ * or a label is out of range.
+ */
+DataStream* openStream(const char* imagesPath, const char* labelsPath, int batchSize, int window, uint64_t seed) {
+    assert(batchSize > 0 && window > 0);
+    DataStream* stream = calloc(1, sizeof(DataStream));
+    assert(stream != NULL);
+
+    int imageDims[3];
+    int labelDims[1];
+    stream->imageFile = openIdx(imagesPath, IDX_UBYTE_3D, imageDims, &stream->imageOffset);
+    stream->labelFile = openIdx(labelsPath, IDX_UBYTE_1D, labelDims, &stream->labelOffset);
+    if (stream->imageFile == NULL || stream->labelFile == NULL || imageDims[0] != labelDims[0]) {
+        if (stream->imageFile != NULL && stream->labelFile != NULL) {
+            fprintf(stderr, "%s: %d images but %s has %d labels\n", imagesPath, imageDims[0], labelsPath, labelDims[0]);
+        }
+        if (stream->imageFile != NULL) fclose(stream->imageFile);
+        if (stream->labelFile != NULL) fclose(stream->labelFile);
+        free(stream);
+        return NULL;
+    }
+
+    stream->count = imageDims[0];
+    stream->height = imageDims[1];
+    stream->width = imageDims[2];
+    stream->batchSize = batchSize;
+    stream->window = (window + batchSize - 1) / batchSize * batchSize;
+    if (stream->window > stream->count) stream->window = stream->count;
+    stream->numWindows = (stream->count + stream->window - 1) / stream->window;
+    stream->seed = seed;
+    stream->imagesPath = copyString(imagesPath);
+    stream->labelsPath = copyString(labelsPath);
+    if (!checkStreamLabels(stream)) {
+        free(stream->labelsPath);
+        free(stream->imagesPath);
+        fclose(stream->labelFile);
+        fclose(stream->imageFile);
+        free(stream);
+        return NULL;
+    }
+
+    size_t imageSize = (size_t)stream->width * stream->height;
+    stream->stagingImages = malloc(stream->window * imageSize);
+    stream->stagingLabels = malloc(stream->window);
+    stream->windowOrder = malloc(stream->numWindows * sizeof(int));
+    stream->imageOrder = malloc(stream->window * sizeof(int));
+    assert(stream->stagingImages != NULL && stream->stagingLabels != NULL && stream->windowOrder != NULL && stream->imageOrder != NULL);
+    for (int s = 0; s < STREAM_SLOTS; s++) {
+        stream->slots[s].images = malloc(stream->window * imageSize);
+        stream->slots[s].labels = malloc(stream->window);
+        assert(stream->slots[s].images != NULL && stream->slots[s].labels != NULL);
+    }
+
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->filled, NULL);
+    pthread_cond_init(&stream->drained, NULL);
+    int rc = pthread_create(&stream->thread, NULL, producerMain, stream);
+    assert(rc == 0);
+    (void)rc;
+    return stream;
+}
+
+/*
+ * closeStream()
+ * Stops the producer and releases the files and buffers.
+ */
+void closeStream(DataStream* stream) {
+    pthread_mutex_lock(&stream->lock);
+    stream->shutdown = 1;
+    pthread_cond_broadcast(&stream->drained);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->thread, NULL);
+
+    pthread_cond_destroy(&stream->drained);
+    pthread_cond_destroy(&stream->filled);
+    pthread_mutex_destroy(&stream->lock);
+    for (int s = 0; s < STREAM_SLOTS; s++) {
+        free(stream->slots[s].images);
+        free(stream->slots[s].labels);
+    }
+    free(stream->imageOrder);
+    free(stream->windowOrder);
+    free(stream->stagingLabels);
+    free(stream->stagingImages);
+    free(stream->labelsPath);
+    free(stream->imagesPath);
+    fclose(stream->labelFile);
+    fclose(stream->imageFile);
+    free(stream);
+}
+
+/*
+ * streamShape()
+ * Images per epoch and image size, from the file headers.
+ */
+void streamShape(DataStream* stream, int* count, int* width, int* height) {
+    *count = stream->count;
+    *width = stream->width;
+    *height = stream->height;
+}
+
+/*
+ * streamBufferBytes()
+ * Total size of the staging buffer and ring slots, i.e. the
+ * stream's memory footprint.
+ */
+size_t streamBufferBytes(DataStream* stream) {
+    size_t window = (size_t)stream->window * ((size_t)stream->width * stream->height + 1);
+    return window * (STREAM_SLOTS + 1);
+}
+
+/*
+ * streamNext()
+ * Points `images`/`labels` at the next batch and returns its
+ * size. The views stay valid until the following call. At the
+ * end of an epoch it returns 0 once; the call after that
+ * starts the next epoch. Returns -1 once the files could not
+ * be read (the reason was printed); the stream is then dead.
+ */
+int streamNext(DataStream* stream, const uint8_t** images, const uint8_t** labels) {
+    pthread_mutex_lock(&stream->lock);
+    StreamSlot* slot = &stream->slots[stream->consume];
+    if (slot->full && stream->position == slot->count) {
+        int last = slot->last;
+        slot->full = 0;
+        stream->consume = (stream->consume + 1) % STREAM_SLOTS;
+        stream->position = 0;
+        pthread_cond_signal(&stream->drained);
+        if (last) {
+            pthread_mutex_unlock(&stream->lock);
+            return 0;
+        }
+        slot = &stream->slots[stream->consume];
+    }
+    while (!slot->full && !stream->failed) {
+        pthread_cond_wait(&stream->filled, &stream->lock);
+    }
+    pthread_mutex_unlock(&stream->lock);
+    if (!slot->full) return -1;
+
+    int count = slot->count - stream->position < stream->batchSize ? slot->count - stream->position : stream->batchSize;
+    *images = slot->images + (size_t)stream->position * stream->width * stream->height;
+    *labels = slot->labels + stream->position;
+    stream->position += count;
+    return count;
+}
@@ -0,0 +1,30 @@
+/*
+ * datastream.h — streaming, shuffling training data source
+ * --------------------------------------------------------
+ * Reads an IDX image/label pair in fixed-size windows on a
+ * background thread into a two-slot ring, shuffles every
+ * window, and hands out contiguous mini-batches. Memory use
+ * is bounded by the window size instead of the dataset size,
+ * and reading the next window overlaps training on the
+ * current one.
+ */
+
+#ifndef DATASTREAM_H
+#define DATASTREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#define STREAM_SLOTS 2
+
+typedef struct DataStream DataStream;
+
+DataStream* openStream(const char* imagesPath, const char* labelsPath, int batchSize, int window, uint64_t seed);
+void closeStream(DataStream* stream);
+void streamShape(DataStream* stream, int* count, int* width, int* height);
+size_t streamBufferBytes(DataStream* stream);
+int streamNext(DataStream* stream, const uint8_t** images, const uint8_t** labels);
+
+#endif
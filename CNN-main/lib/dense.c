@@ -11,60 +11,29 @@
 #include <math.h>
 #include <assert.h>
 
+#include "simd.h"
+#include "random.h"
 #include "dense.h"
 
-/*
- * denseBoxMuller()
- * Same as convBoxMuller but lives here so we don't have
- * to expose convolution internals. Generates Gaussian
- * noise for He initialisation.
- */
-double denseBoxMuller() {
-    static int hasSpare = 0;
-    static double spare;
-    
-    if (hasSpare) {
-        hasSpare = 0;
-        return spare;
-    }
-
-    hasSpare = 1;
-    double u, v, s;
-    do {
-        u = ((double)rand() / RAND_MAX) * 2.0 - 1.0;
-        v = ((double)rand() / RAND_MAX) * 2.0 - 1.0;
-        s = u * u + v * v;
-    } while (s >= 1.0 || s == 0.0);
-
-    s = sqrt(-2.0 * log(s) / s);
-    spare = v * s;
-    return u * s;
-}
-
 /*
  * initDenseLayer()
  * Allocates a DenseLayer with `size` output neurons.
- * Weight matrix dimensions: size × (width·height·numFilters).
+ * Weight matrix dimensions: size × (width·height·numFilters),
+ * stored row-major in one contiguous tensor and He-initialised
+ * from `seed`; biases start at zero.
  */
-DenseLayer* initDenseLayer(int size, int width, int height, int numFilters) {
+DenseLayer* initDenseLayer(int size, int width, int height, int numFilters, uint64_t seed) {
     DenseLayer* layer = malloc(sizeof(DenseLayer));
     assert(layer != NULL);
 
     layer->size = size;
-    layer->biases = calloc(size, sizeof(double));
-    assert(layer->biases != NULL);
-    layer->weights = malloc(size * sizeof(double*));
-    assert(layer->weights != NULL);
+    layer->inputSize = width * height * numFilters;
+    layer->biases = tensorCreate1D(size);
+    layer->weights = tensorCreate2D(size, layer->inputSize);
 
-    for (int i=0; i<size; i++) {
-        layer->weights[i] = malloc(width * height * numFilters * sizeof(double));
-        assert(layer->weights[i] != NULL);
-
-        for (int j=0; j<width*height*numFilters; j++) {
-            double heInit = denseBoxMuller() * sqrt(2.0 / ((double)width * (double)height * (double)numFilters));
-            layer->weights[i][j] = heInit;
-        }
-    }
+    real* weights = layer->weights->data;
+    randomGaussian(seed, RANDOM_DENSE_INIT, 0, weights, layer->weights->size);
+    simd->scale(sqrt(2.0 / ((real)width * (real)height * (real)numFilters)), weights, weights, (int)layer->weights->size);
     return layer;
 }
 
@@ -73,28 +42,28 @@ DenseLayer* initDenseLayer(int size, int width, int height, int numFilters) {
  * Tidies up all memory associated with a DenseLayer.
  */
 void freeDenseLayer(DenseLayer* layer) {
-    for (int i=0; i<layer->size; i++) {
-        free(layer->weights[i]);
-    }
-    free(layer->weights);
-    free(layer->biases);
+    tensorFree(layer->weights);
+    tensorFree(layer->biases);
     free(layer);
 }
 
 /*
  * denseForward()
- * Computes `output = W·x + b` for the given flattened
- * input vector.
+ * Computes `output = X·Wᵀ + b` for a batch: `input` holds one
+ * flat vector of `inputSize` values per image and `output` one
+ * row of `size` totals per image.
  */
-double* denseForward(DenseLayer* denseLayer, double* input, int width, int height, int numFilters) {
-    double* output = malloc(denseLayer->size * sizeof(double));
-    for (int i=0; i<denseLayer->size; i++) {
-        output[i] = 0.0;
-        for (int j=0; j<width*height*numFilters; j++) {
-            output[i] += input[j] * denseLayer->weights[i][j];
+void denseForward(DenseLayer* denseLayer, Tensor* input, Tensor* output) {
+    int batch = (int)(output->size / denseLayer->size);
+    assert(output->size == (size_t)batch * denseLayer->size);
+    assert(input->size == (size_t)batch * denseLayer->inputSize);
+
+    for (int b=0; b<batch; b++) {
+        real* x = input->data + (size_t)b * denseLayer->inputSize;
+        real* totals = output->data + (size_t)b * denseLayer->size;
+        for (int i=0; i<denseLayer->size; i++) {
+            real* row = tensorSlice(denseLayer->weights, i);
+            totals[i] = simd->dot(x, row, denseLayer->inputSize) + denseLayer->biases->data[i];
         }
-        output[i] += denseLayer->biases[i];
     }
-
-    return output;
-}
\ No newline at end of file
+}
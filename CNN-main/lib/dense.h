@@ -9,17 +9,21 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <math.h>
 #include <assert.h>
 
+#include "tensor.h"
+
 typedef struct {
     int size;
-    double* biases;
-    double** weights;
+    int inputSize;
+    Tensor* biases;     /* [size] */
+    Tensor* weights;    /* [size, inputSize] */
 } DenseLayer;
 
-DenseLayer* initDenseLayer(int size, int width, int height, int numFilters);
+DenseLayer* initDenseLayer(int size, int width, int height, int numFilters, uint64_t seed);
 void freeDenseLayer(DenseLayer* layer);
-double* denseForward(DenseLayer* denseLayer, double* input, int width, int height, int numFilters);
+void denseForward(DenseLayer* denseLayer, Tensor* input, Tensor* output);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,145 @@
+/*
+ * gemm.c — cache-blocked, register-tiled matrix multiply
+ * ------------------------------------------------------
+ * Classic three-level blocking: B is packed into KC×NC
+ * panels, A into MC×KC panels, both laid out so that the
+ * MR×NR micro-kernel streams through them with unit stride.
+ * Edges are zero-padded while packing, so the kernel itself
+ * never branches on the matrix size. The micro-kernel comes
+ * from the SIMD dispatch table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "tensor.h"
+#include "simd.h"
+#include "gemm.h"
+
+/*
+ * Packing buffers are per thread and allocated on first use,
+ * so steady-state calls never touch the allocator and worker
+ * threads can multiply concurrently. Both live in one block
+ * that a thread-specific key frees when the thread exits, so
+ * short-lived thread pools do not leak it.
+ */
+static _Thread_local real* packedA = NULL;
+static _Thread_local real* packedB = NULL;
+static pthread_key_t packKey;
+static pthread_once_t packKeyOnce = PTHREAD_ONCE_INIT;
+
+static void createPackKey(void) {
+    int rc = pthread_key_create(&packKey, alignedFree);
+    assert(rc == 0);
+    (void)rc;
+}
+
+/*
+ * allocatePacking()
+ * First gemm() call on this thread: carves packedA and
+ * packedB from one block registered for release at exit.
+ */
+static void allocatePacking(void) {
+    pthread_once(&packKeyOnce, createPackKey);
+    packedA = alignedAlloc(((size_t)GEMM_MC * GEMM_KC + (size_t)GEMM_KC * GEMM_NC) * sizeof(real));
+    packedB = packedA + (size_t)GEMM_MC * GEMM_KC;
+    pthread_setspecific(packKey, packedA);
+}
+
+/*
+ * packA()
+ * Copies the mc×kc block of op(A) starting at (row, col) into
+ * MR-row slivers: sliver s holds rows s·MR … s·MR+MR-1, one
+ * column after another.
+ */
+static void packA(int transA, const real* A, int lda, int row, int col, int mc, int kc, real* out) {
+    for (int s = 0; s < mc; s += GEMM_MR) {
+        for (int p = 0; p < kc; p++) {
+            for (int i = 0; i < GEMM_MR; i++) {
+                int r = s + i;
+                real value = 0.0;
+                if (r < mc) {
+                    value = transA ? A[(size_t)(col + p) * lda + row + r] : A[(size_t)(row + r) * lda + col + p];
+                }
+                *out++ = value;
+            }
+        }
+    }
+}
+
+/*
+ * packB()
+ * Copies the kc×nc block of op(B) starting at (row, col) into
+ * NR-column slivers, one row after another.
+ */
+static void packB(int transB, const real* B, int ldb, int row, int col, int kc, int nc, real* out) {
+    for (int s = 0; s < nc; s += GEMM_NR) {
+        for (int p = 0; p < kc; p++) {
+            if (!transB && s + GEMM_NR <= nc) {
+                memcpy(out, B + (size_t)(row + p) * ldb + col + s, GEMM_NR * sizeof(real));
+                out += GEMM_NR;
+                continue;
+            }
+            for (int j = 0; j < GEMM_NR; j++) {
+                int c = s + j;
+                real value = 0.0;
+                if (c < nc) {
+                    value = transB ? B[(size_t)(col + c) * ldb + row + p] : B[(size_t)(row + p) * ldb + col + c];
+                }
+                *out++ = value;
+            }
+        }
+    }
+}
+
+/*
+ * gemm()
+ * C (M×N) = alpha·op(A)·op(B) + beta·C with op(A) M×K and
+ * op(B) K×N. All matrices are row-major with leading
+ * dimensions lda/ldb/ldc.
+ */
+void gemm(int transA, int transB, int M, int N, int K,
+          real alpha, const real* A, int lda, const real* B, int ldb,
+          real beta, real* C, int ldc) {
+    if (M <= 0 || N <= 0) return;
+
+    if (beta != 1.0) {
+        for (int i = 0; i < M; i++) {
+            real* row = C + (size_t)i * ldc;
+            for (int j = 0; j < N; j++) {
+                row[j] = beta == 0.0 ? 0.0 : beta * row[j];
+            }
+        }
+    }
+    if (K <= 0 || alpha == 0.0) return;
+
+    if (packedA == NULL) {
+        allocatePacking();
+    }
+
+    for (int jc = 0; jc < N; jc += GEMM_NC) {
+        int nc = N - jc < GEMM_NC ? N - jc : GEMM_NC;
+        for (int pc = 0; pc < K; pc += GEMM_KC) {
+            int kc = K - pc < GEMM_KC ? K - pc : GEMM_KC;
+            packB(transB, B, ldb, pc, jc, kc, nc, packedB);
+
+            for (int ic = 0; ic < M; ic += GEMM_MC) {
+                int mc = M - ic < GEMM_MC ? M - ic : GEMM_MC;
+                packA(transA, A, lda, ic, pc, mc, kc, packedA);
+
+                for (int jr = 0; jr < nc; jr += GEMM_NR) {
+                    int nr = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+                    const real* b = packedB + (size_t)jr * kc;
+                    for (int ir = 0; ir < mc; ir += GEMM_MR) {
+                        int mr = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+                        const real* a = packedA + (size_t)ir * kc;
+                        simd->gemmKernel(kc, a, b, C + (size_t)(ic + ir) * ldc + jc + jr, ldc, mr, nr, alpha);
+                    }
+                }
+            }
+        }
+    }
+}
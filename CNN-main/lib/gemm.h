@@ -0,0 +1,31 @@
+/*
+ * gemm.h — cache-blocked matrix multiply
+ * --------------------------------------
+ * Row-major C = alpha·op(A)·op(B) + beta·C, where op(X) is X
+ * or Xᵀ. The convolution layer lowers its input with im2col
+ * so that both its forward and backward passes are a call
+ * to this routine.
+ */
+
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "tensor.h"
+
+/* register tile of the micro-kernel: NR is one cache line of C */
+#define GEMM_MR 4
+#define GEMM_NR (TENSOR_ALIGNMENT / (int)sizeof(real))
+
+/* cache blocks: A block (MC×KC) stays in L2, B panel (KC×NR) in L1 */
+#define GEMM_MC 64
+#define GEMM_KC 256
+#define GEMM_NC 1024
+
+void gemm(int transA, int transB, int M, int N, int K,
+          real alpha, const real* A, int lda, const real* B, int ldb,
+          real beta, real* C, int ldc);
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * gradcheck.c — finite-difference gradient check
+ * ----------------------------------------------
+ * Runs a few random images through backpropagation() (or
+ * networkBackward() for a layer graph) and then nudges
+ * parameters one at a time by ±h, comparing (L(w+h) -
+ * L(w-h)) / 2h with the analytic gradient. The step
+ * and the pass threshold follow the precision of `real`:
+ * float32 needs a much larger h to stay above rounding noise,
+ * but h must stay small enough that the ±h nudge rarely moves
+ * a 2×2 max-pool winner (the loss has a kink there).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <assert.h>
+
+#include "tensor.h"
+#include "workspace.h"
+#include "inference.h"
+#include "backprop.h"
+#include "network.h"
+#include "random.h"
+#include "gradcheck.h"
+
+#ifdef CNN_FLOAT32
+#define GRADCHECK_STEP 1e-3
+#define GRADCHECK_TOLERANCE 2e-2
+#else
+#define GRADCHECK_STEP 1e-6
+#define GRADCHECK_TOLERANCE 1e-6
+#endif
+
+#define GRADCHECK_SAMPLES 64    /* parameters checked per group */
+
+/*
+ * Objective: the model under test plus the batch it is
+ * scored on. Exactly one of the layer pair or `net` is set.
+ * `next` is the next unused sample of the RANDOM_GRADCHECK
+ * stream, shared by the batch and the parameter picks.
+ */
+typedef struct {
+    ConvLayer* convLayer;
+    DenseLayer* denseLayer;
+    Workspace* ws;
+    Network* net;
+    NetWorkspace* netWs;
+    const uint8_t* images;
+    const uint8_t* labels;
+    int count;
+    uint64_t seed;
+    uint64_t next;
+} Objective;
+
+/*
+ * batchLoss()
+ * Summed loss over the batch (backpropagation() sums
+ * gradients, so this is the matching objective).
+ */
+static double batchLoss(Objective* objective) {
+    real* probs;
+    int classes;
+    if (objective->net != NULL) {
+        probs = networkForward(objective->net, objective->netWs, objective->images, objective->count);
+        classes = objective->net->classes;
+    } else {
+        probs = forward(objective->convLayer, objective->denseLayer, objective->ws, objective->images, objective->count);
+        classes = objective->denseLayer->size;
+    }
+    double sum = 0.0;
+    for (int b = 0; b < objective->count; b++) {
+        sum += loss(probs + b * classes, objective->labels[b]);
+    }
+    return sum;
+}
+
+/*
+ * checkGroup()
+ * Compares up to GRADCHECK_SAMPLES entries of `params` with
+ * `grads` and returns ‖numeric - analytic‖ / (‖numeric‖ +
+ * ‖analytic‖) over them. Measuring the group as a whole keeps
+ * near-zero entries from drowning in float32 rounding noise.
+ */
+static double checkGroup(Objective* objective, Tensor* params, const real* grads) {
+    int samples = params->size < GRADCHECK_SAMPLES ? (int)params->size : GRADCHECK_SAMPLES;
+    double diff = 0.0;
+    double numericNorm = 0.0;
+    double analyticNorm = 0.0;
+
+    for (int s = 0; s < samples; s++) {
+        size_t i = params->size <= GRADCHECK_SAMPLES ? (size_t)s : (size_t)(randomBits(objective->seed, RANDOM_GRADCHECK, objective->next++) % params->size);
+        real saved = params->data[i];
+
+        params->data[i] = saved + (real)GRADCHECK_STEP;
+        double plus = batchLoss(objective);
+        params->data[i] = saved - (real)GRADCHECK_STEP;
+        double minus = batchLoss(objective);
+        params->data[i] = saved;
+
+        double numeric = (plus - minus) / (2.0 * GRADCHECK_STEP);
+        double analytic = grads[i];
+        diff += (numeric - analytic) * (numeric - analytic);
+        numericNorm += numeric * numeric;
+        analyticNorm += analytic * analytic;
+    }
+
+    double scale = sqrt(numericNorm) + sqrt(analyticNorm);
+    return scale > 0.0 ? sqrt(diff) / scale : 0.0;
+}
+
+/*
+ * randomBatch()
+ * `count` random images and labels, from the objective's
+ * gradient-check stream.
+ */
+static void randomBatch(Objective* objective, uint8_t* images, uint8_t* labels, int count, size_t imageSize, int classes) {
+    for (size_t i = 0; i < (size_t)count * imageSize; i++) {
+        images[i] = (uint8_t)randomBelow(objective->seed, RANDOM_GRADCHECK, objective->next++, 256);
+    }
+    for (int b = 0; b < count; b++) {
+        labels[b] = (uint8_t)randomBelow(objective->seed, RANDOM_GRADCHECK, objective->next++, (uint32_t)classes);
+    }
+}
+
+static int reportGroup(const char* name, double error) {
+    int ok = error <= GRADCHECK_TOLERANCE;
+    printf("Gradient check (%s): %-7s rel. error %.3e %s\n", REAL_NAME, name, error, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+/*
+ * gradientCheck()
+ * Checks filters, weights and biases on `count` random
+ * width×height images (drawn from `seed`) and prints the
+ * relative error per group. Returns the number of groups over
+ * the tolerance.
+ */
+int gradientCheck(ConvLayer* convLayer, DenseLayer* denseLayer, int width, int height, int count, uint64_t seed) {
+    Workspace* ws = initWorkspace(convLayer, denseLayer, width, height, count);
+    Gradients* grads = initGradients(convLayer, denseLayer);
+    uint8_t* images = malloc((size_t)count * width * height);
+    uint8_t* labels = malloc(count);
+    assert(images != NULL && labels != NULL);
+    Objective objective = {convLayer, denseLayer, ws, NULL, NULL, images, labels, count, seed, 0};
+    randomBatch(&objective, images, labels, count, (size_t)width * height, denseLayer->size);
+
+    backpropagation(convLayer, denseLayer, ws, grads, images, labels, count);
+
+    const char* names[] = {"filters", "weights", "biases"};
+    Tensor* params[] = {convLayer->filters, denseLayer->weights, denseLayer->biases};
+    Tensor* groups[] = {grads->filters, grads->weights, grads->biases};
+    int failures = 0;
+    for (int g = 0; g < 3; g++) {
+        failures += !reportGroup(names[g], checkGroup(&objective, params[g], groups[g]->data));
+    }
+
+    free(labels);
+    free(images);
+    freeGradients(grads);
+    freeWorkspace(ws);
+    return failures;
+}
+
+/*
+ * networkGradientCheck()
+ * Same check for a layer graph: the weights and the biases of
+ * every conv and dense layer are one group each.
+ */
+int networkGradientCheck(Network* net, int count, uint64_t seed) {
+    NetWorkspace* ws = initNetWorkspace(net, count, 1);
+    NetWorkspace* inference = initNetWorkspace(net, count, 0);
+    Tensor* grads = initNetGradients(net);
+    size_t imageSize = (size_t)net->channels * net->width * net->height;
+    uint8_t* images = malloc(count * imageSize);
+    uint8_t* labels = malloc(count);
+    assert(images != NULL && labels != NULL);
+    Objective objective = {NULL, NULL, NULL, net, inference, images, labels, count, seed, 0};
+    randomBatch(&objective, images, labels, count, imageSize, net->classes);
+
+    networkBackward(net, ws, grads, images, labels, count);
+
+    int failures = 0;
+    for (int l = 0; l < net->numLayers; l++) {
+        NetLayer* layer = &net->layers[l];
+        if (layer->type != NET_CONV && layer->type != NET_DENSE) continue;
+        char name[32];
+        snprintf(name, sizeof(name), "%s%d.w", layer->type == NET_CONV ? "conv" : "dense", l);
+        failures += !reportGroup(name, checkGroup(&objective, &layer->weights, grads->data + (layer->weights.data - net->parameters.base)));
+        snprintf(name, sizeof(name), "%s%d.b", layer->type == NET_CONV ? "conv" : "dense", l);
+        failures += !reportGroup(name, checkGroup(&objective, &layer->biases, grads->data + (layer->biases.data - net->parameters.base)));
+    }
+
+    free(labels);
+    free(images);
+    tensorFree(grads);
+    freeNetWorkspace(inference);
+    freeNetWorkspace(ws);
+    return failures;
+}
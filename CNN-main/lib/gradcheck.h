@@ -0,0 +1,25 @@
+/*
+ * gradcheck.h — finite-difference gradient check
+ * ----------------------------------------------
+ * Compares the analytic gradients from backpropagation()
+ * against central differences of the loss, so a change to
+ * the numeric type or to a kernel can be shown not to break
+ * training.
+ */
+
+#ifndef GRADCHECK_H
+#define GRADCHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "convolution.h"
+#include "dense.h"
+#include "network.h"
+
+int gradientCheck(ConvLayer* convLayer, DenseLayer* denseLayer, int width, int height, int count, uint64_t seed);
+int networkGradientCheck(Network* net, int count, uint64_t seed);
+
+#endif
@@ -1,149 +1,285 @@
 /*
  * import.c — MNIST file loaders
  * --------------------------------
- * Reads the IDX image/label files shipped with the dataset
- * and converts them into easy‐to‐use in-memory formats.
- * Pure C so the rest of the CNN can stay dependency-free.
+ * Maps the IDX image/label files shipped with the dataset
+ * read-only and hands out uint8 views into them, so loading
+ * costs one mmap per file and the resident set is the file
+ * itself. Pure C so the rest of the CNN can stay
+ * dependency-free; on Windows the file is read into one heap
+ * block instead.
  */
 
+#define _FILE_OFFSET_BITS 64    /* 64-bit off_t for fseeko() on 32-bit hosts */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <assert.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #include "import.h"
 
+#define IDX_HEADER_MAX (4 + 4 * 3)
+
 /*
- * swapEndian()
- * IDX files are big-endian, while most PCs are little-endian.
- * This helper flips byte order of a 32-bit integer.
+ * readBigEndian()
+ * IDX headers are big-endian regardless of the host; this
+ * assembles a 32-bit integer from its four bytes.
  */
-uint32_t swapEndian(uint32_t val) {
-    val = ((val << 8) & 0xFF00FF00) | ((val >> 8) & 0xFF00FF);
-    return (val << 16) | (val >> 16);
+static uint32_t readBigEndian(const uint8_t* bytes) {
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
 }
 
 /*
- * readParameters()
- * Returns [numImages, width, height] parsed from the IDX header.
+ * mapFile()
+ * Maps (or on Windows reads) the whole file. Returns NULL on
+ * failure.
  */
-int* readParameters(char* filename) {
-    int* parameters = malloc(3*sizeof(int));
+static void* mapFile(const char* filename, size_t* size) {
+#ifdef _WIN32
     FILE* f = fopen(filename, "rb");
-    assert(parameters != NULL && f != NULL);
-
-    uint32_t magicNumber;
-    uint32_t numImages;
-    unsigned int height;
-    unsigned int width;
+    if (f == NULL) return NULL;
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    void* base = length > 0 ? malloc((size_t)length) : NULL;
+    if (base != NULL && fread(base, 1, (size_t)length, f) != (size_t)length) {
+        free(base);
+        base = NULL;
+    }
+    fclose(f);
+    *size = base != NULL ? (size_t)length : 0;
+    return base;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void* base = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED) base = NULL;
+    }
+    close(fd);
+    *size = base != NULL ? (size_t)st.st_size : 0;
+    return base;
+#endif
+}
 
-    (void) !fread(&magicNumber, sizeof(uint32_t), 1, f);
-    (void) !fread(&numImages, sizeof(uint32_t), 1, f);
-    (void) !fread(&height, sizeof(unsigned int), 1, f);
-    (void) !fread(&width, sizeof(unsigned int), 1, f);
+static void unmapFile(void* base, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    free(base);
+#else
+    munmap(base, size);
+#endif
+}
 
-    parameters[0] = (int)swapEndian(numImages);
-    parameters[1] = (int)swapEndian(width);
-    parameters[2] = (int)swapEndian(height);
+/*
+ * seekIdx()
+ * Positions `f` at byte `offset` with a 64-bit seek (plain
+ * fseek() takes a long, which is 32 bits on Windows). Returns
+ * 1 on success, 0 on failure.
+ */
+int seekIdx(FILE* f, int64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(f, offset, SEEK_SET) == 0;
+#else
+    return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
 
-    fclose(f);
-    return parameters;
+/*
+ * fileLength()
+ * Size of the open file `f` in bytes, or -1 on failure.
+ */
+static int64_t fileLength(FILE* f) {
+#ifdef _WIN32
+    if (_fseeki64(f, 0, SEEK_END) != 0) return -1;
+    return _ftelli64(f);
+#else
+    if (fseeko(f, 0, SEEK_END) != 0) return -1;
+    return (int64_t)ftello(f);
+#endif
 }
 
 /*
- * readImage()
- * Reads a single unsigned-byte image and normalises pixels to [0,1].
+ * parseIdxHeader()
+ * Checks that `bytes` (the first bytes of a `fileSize`-byte
+ * file) start an unsigned-byte IDX header with the expected
+ * `magic`, which also fixes the number of dimensions, and that
+ * the file is long enough for the dimensions it declares.
+ * Fills `dims` and returns the header length; on failure
+ * prints why and returns 0.
  */
-double** readImage(FILE* f, int width, int height) {
-    unsigned char buffer[width * height];
-    double** image = malloc(height * sizeof(double*));
-    assert(image != NULL);
-    (void) !fread(buffer, sizeof(buffer), 1, f);
-
-    for (int i=0; i<height; i++) {
-        image[i] = malloc(width * sizeof(double));
-        assert(image[i] != NULL);
-        for (int j=0; j<width; j++) {
-            image[i][j] = buffer[j+i*width] / 255.0;
+static size_t parseIdxHeader(const char* filename, const uint8_t* bytes, size_t available, size_t fileSize, uint32_t magic, int* dims) {
+    int ndim = (int)(magic & 0xFF);
+    size_t header = 4 + 4 * (size_t)ndim;
+    assert(header <= IDX_HEADER_MAX);
+    if (available < header || readBigEndian(bytes) != magic) {
+        fprintf(stderr, "%s: not an IDX file with magic 0x%08x\n", filename, (unsigned)magic);
+        return 0;
+    }
+
+    size_t payload = 1;
+    for (int d = 0; d < ndim; d++) {
+        uint32_t dim = readBigEndian(bytes + 4 + 4 * d);
+        if (dim == 0 || dim > INT32_MAX) {
+            fprintf(stderr, "%s: bad dimension %u\n", filename, (unsigned)dim);
+            return 0;
+        }
+        if (dim > SIZE_MAX / payload) {
+            fprintf(stderr, "%s: dimensions overflow\n", filename);
+            return 0;
         }
+        dims[d] = (int)dim;
+        payload *= dim;
     }
+    if (fileSize - header < payload) {
+        fprintf(stderr, "%s: truncated (%zu of %zu data bytes)\n", filename, fileSize - header, payload);
+        return 0;
+    }
+    return header;
+}
 
-    return image;
+/*
+ * mapIdx()
+ * Maps `filename` and validates its header (see
+ * parseIdxHeader()). Returns 1 on success; on failure prints
+ * why and returns 0.
+ */
+int mapIdx(const char* filename, uint32_t magic, IdxFile* file) {
+    file->base = mapFile(filename, &file->size);
+    if (file->base == NULL) {
+        fprintf(stderr, "%s: cannot open\n", filename);
+        return 0;
+    }
+
+    file->ndim = (int)(magic & 0xFF);
+    size_t header = parseIdxHeader(filename, file->base, file->size, file->size, magic, file->dims);
+    if (header == 0) {
+        unmapIdx(file);
+        return 0;
+    }
+    file->data = (const uint8_t*)file->base + header;
+    return 1;
 }
 
 /*
- * readImages()
- * Loads the entire image file into a 3-D double array.
+ * openIdx()
+ * Opens `filename` for streaming: validates the header the
+ * same way as mapIdx(), fills `dims` and returns the file
+ * positioned at the first data byte, with the header length
+ * in `*offset`. Returns NULL on failure.
  */
-double*** readImages(char* filename) {
+FILE* openIdx(const char* filename, uint32_t magic, int* dims, int64_t* offset) {
     FILE* f = fopen(filename, "rb");
-
-    int magicNumber;
-    int numImages;
-    int height;
-    int width;
-
-    (void) !fread(&magicNumber, sizeof(uint32_t), 1, f);
-    (void) !fread(&numImages, sizeof(uint32_t), 1, f);
-    (void) !fread(&height, sizeof(unsigned int), 1, f);
-    (void) !fread(&width, sizeof(unsigned int), 1, f);
-
-    magicNumber = (int)swapEndian(magicNumber);
-    numImages = (int)swapEndian(numImages);
-    height = (int)swapEndian(height);
-    width = (int)swapEndian(width);
-
-    double*** images = malloc(numImages * sizeof(double**));
-    assert(images != NULL && f != NULL);
-    for (int i=0; i<numImages; i++) {
-        images[i] = readImage(f, width, height);
+    if (f == NULL) {
+        fprintf(stderr, "%s: cannot open\n", filename);
+        return NULL;
     }
 
-    fclose(f);
-    return images;
+    uint8_t bytes[IDX_HEADER_MAX];
+    size_t available = fread(bytes, 1, sizeof(bytes), f);
+    int64_t fileSize = fileLength(f);
+    size_t header = fileSize > 0 ? parseIdxHeader(filename, bytes, available, (size_t)fileSize, magic, dims) : 0;
+    if (header == 0 || !seekIdx(f, (int64_t)header)) {
+        fclose(f);
+        return NULL;
+    }
+    *offset = (int64_t)header;
+    return f;
 }
 
-/*int* readLabels(char* filename, int numImages) {
-    FILE* f = fopen(filename, "rb");
-    int* labels = malloc(numImages * sizeof(int));
-    assert(labels != NULL && f != NULL);
-    unsigned char buffer[numImages];
-    (void) !fread(buffer, sizeof(unsigned char), numImages, f);
-    
-
-    for (int i=0; i<numImages; i++) {
-        labels[i] = (int)buffer[i];
-        printf("Label[%d]: %d\n", i, labels[i]);
+/*
+ * unmapIdx()
+ * Releases a mapping made by mapIdx().
+ */
+void unmapIdx(IdxFile* file) {
+    if (file->base != NULL) {
+        unmapFile(file->base, file->size);
     }
+    file->base = NULL;
+    file->data = NULL;
+    file->size = 0;
+}
 
-    fclose(f);
-    return labels;
-}*/
+/*
+ * checkLabels()
+ * Returns 1 if every one of the `count` labels is a class
+ * below MNIST_CLASSES; otherwise prints the first bad one and
+ * returns 0. Labels index the probability rows, so one out of
+ * range would read past them.
+ */
+int checkLabels(const char* filename, const uint8_t* labels, int count) {
+    for (int i=0; i<count; i++) {
+        if (labels[i] >= MNIST_CLASSES) {
+            fprintf(stderr, "%s: label %d of sample %d is not below %d\n", filename, labels[i], i, MNIST_CLASSES);
+            return 0;
+        }
+    }
+    return 1;
+}
 
 /*
- * readLabels()
- * Reads all labels into an int array.
+ * openDataset()
+ * Maps an image file and its label file and checks that they
+ * describe the same number of samples and that every label is
+ * a valid class. Returns NULL if either file is missing or
+ * malformed.
  */
-int* readLabels(char* filename) {
-    FILE* f = fopen(filename, "rb");
-    assert(f != NULL);
-
-    int magicNumber;
-    int numLabels;
-    (void) !fread(&magicNumber, sizeof(uint32_t), 1, f);
-    (void) !fread(&numLabels, sizeof(uint32_t), 1, f);
-    magicNumber = (int)swapEndian(magicNumber);
-    numLabels = (int)swapEndian(numLabels);
-
-    int* labels = malloc(numLabels * sizeof(int));
-    assert(labels != NULL);
-    unsigned char buffer[numLabels];
-    (void) !fread(buffer, sizeof(unsigned char), numLabels, f);
-    
-    for (int i=0; i<numLabels; i++) {
-        labels[i] = (int)buffer[i];
+Dataset* openDataset(const char* imagesPath, const char* labelsPath) {
+    Dataset* dataset = malloc(sizeof(Dataset));
+    assert(dataset != NULL);
+
+    if (!mapIdx(imagesPath, IDX_UBYTE_3D, &dataset->imageFile)) {
+        free(dataset);
+        return NULL;
+    }
+    if (!mapIdx(labelsPath, IDX_UBYTE_1D, &dataset->labelFile)) {
+        unmapIdx(&dataset->imageFile);
+        free(dataset);
+        return NULL;
+    }
+    if (dataset->imageFile.dims[0] != dataset->labelFile.dims[0]) {
+        fprintf(stderr, "%s: %d images but %s has %d labels\n", imagesPath, dataset->imageFile.dims[0], labelsPath, dataset->labelFile.dims[0]);
+        closeDataset(dataset);
+        return NULL;
+    }
+    if (!checkLabels(labelsPath, dataset->labelFile.data, dataset->labelFile.dims[0])) {
+        closeDataset(dataset);
+        return NULL;
     }
 
-    fclose(f);
-    return labels;
-}
\ No newline at end of file
+    dataset->count = dataset->imageFile.dims[0];
+    dataset->height = dataset->imageFile.dims[1];
+    dataset->width = dataset->imageFile.dims[2];
+    dataset->images = dataset->imageFile.data;
+    dataset->labels = dataset->labelFile.data;
+    return dataset;
+}
+
+/*
+ * closeDataset()
+ * Unmaps both files; views handed out become invalid.
+ */
+void closeDataset(Dataset* dataset) {
+    unmapIdx(&dataset->imageFile);
+    unmapIdx(&dataset->labelFile);
+    free(dataset);
+}
+
+/*
+ * datasetImage()
+ * Pointer to the `height`×`width` pixels of image `index`.
+ */
+const uint8_t* datasetImage(Dataset* dataset, int index) {
+    assert(index >= 0 && index < dataset->count);
+    return dataset->images + (size_t)index * dataset->width * dataset->height;
+}
@@ -1,7 +1,8 @@
 /*
  * import.h — MNIST loader prototypes
  * ----------------------------------
- * Declares helpers for reading images and labels from IDX files.
+ * Declares the memory-mapped IDX reader and the Dataset view
+ * that pairs an image file with its label file.
  */
 
 #ifndef IMPORT_H
@@ -12,8 +13,46 @@
 #include <stdint.h>
 #include <assert.h>
 
-int* readParameters(char* filename);
-double*** readImages(char* filename);
-int* readLabels(char* filename);
+#include "tensor.h"
 
-#endif
\ No newline at end of file
+#define IDX_UBYTE_1D 0x00000801     /* label files */
+#define IDX_UBYTE_3D 0x00000803     /* image files */
+#define MNIST_CLASSES 10            /* labels are 0 … MNIST_CLASSES-1 */
+
+/*
+ * IdxFile: a read-only mapping of one IDX file. `data` points
+ * just past the header, at dims[0]·dims[1]·… unsigned bytes.
+ */
+typedef struct {
+    void* base;
+    size_t size;
+    int ndim;
+    int dims[3];
+    const uint8_t* data;
+} IdxFile;
+
+/*
+ * Dataset: images and labels as uint8 views straight into the
+ * mapped files. Nothing is converted up front; pixels are
+ * scaled to [0,1] when the convolution packs its input.
+ */
+typedef struct {
+    int count;
+    int width;
+    int height;
+    const uint8_t* images;      /* [count, height, width] */
+    const uint8_t* labels;      /* [count] */
+    IdxFile imageFile;
+    IdxFile labelFile;
+} Dataset;
+
+int mapIdx(const char* filename, uint32_t magic, IdxFile* file);
+void unmapIdx(IdxFile* file);
+FILE* openIdx(const char* filename, uint32_t magic, int* dims, int64_t* offset);
+int seekIdx(FILE* f, int64_t offset);
+int checkLabels(const char* filename, const uint8_t* labels, int count);
+Dataset* openDataset(const char* imagesPath, const char* labelsPath);
+void closeDataset(Dataset* dataset);
+const uint8_t* datasetImage(Dataset* dataset, int index);
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ * inference.c — batched forward pass and parallel scoring
+ * -------------------------------------------------------
+ * The image set is cut into PREDICT_CHUNK-sized tasks that
+ * threads claim from the pool's atomic counter. Every task
+ * writes a disjoint block of the output, so scoring needs no
+ * locks and gives the same numbers for any thread count.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "inference.h"
+#include "profile.h"
+
+/*
+ * runForward()
+ * Runs `count` consecutive images through the CNN layers
+ * (Conv ➜ ReLU ➜ MaxPool ➜ Dense ➜ Softmax). Convolution and
+ * pooling are fused per image: each image's full-resolution
+ * conv output lives only in the single-image `ws->convoluted`
+ * scratch while it is pooled, so only the pooled maps are kept
+ * for the batch. With `record` set the pooling argmax codes
+ * are saved for the backward pass.
+ */
+static real* runForward(ConvLayer* convLayer, DenseLayer* denseLayer, Workspace* ws, const uint8_t* images, int count, int record) {
+    size_t imageSize = (size_t)ws->width * ws->height;
+    size_t pooledSize = ws->pooled.strides[0];
+    size_t positions = (size_t)ws->convWidth * ws->convHeight;
+    Tensor pooled;
+    Tensor totals;
+    assert(count > 0 && count <= ws->batchSize);
+
+    for (int b = 0; b < count; b++) {
+        PROFILE_BEGIN(convStart);
+        convolutionForward(convLayer, images + b * imageSize, ws->width, ws->height, ws->columns.data + b * positions, ws->columns.strides[0], &ws->convoluted);
+        PROFILE_END(PROFILE_CONV_FORWARD, convStart);
+        PROFILE_BEGIN(poolStart);
+        tensorSelect(&ws->pooled, b, &pooled);
+        poolingForward(&ws->convoluted, &pooled, record ? ws->argmax + b * pooledSize : NULL, convLayer->relu);
+        PROFILE_END(PROFILE_POOL_FORWARD, poolStart);
+    }
+    PROFILE_BEGIN(denseStart);
+    tensorNarrow(&ws->pooled, 0, count, &pooled);
+    tensorNarrow(&ws->totals, 0, count, &totals);
+    denseForward(denseLayer, &pooled, &totals);
+    PROFILE_END(PROFILE_DENSE_FORWARD, denseStart);
+
+    PROFILE_BEGIN(softmaxStart);
+    softmaxBatch(&totals, &ws->probs);
+    PROFILE_END(PROFILE_SOFTMAX, softmaxStart);
+    return ws->probs.data;
+}
+
+/*
+ * forward()
+ * Inference pass: returns the [count, classes] probabilities.
+ * All intermediates live in the workspace, so the returned
+ * pointer is only valid until the next pass.
+ */
+real* forward(ConvLayer* convLayer, DenseLayer* denseLayer, Workspace* ws, const uint8_t* images, int count) {
+    return runForward(convLayer, denseLayer, ws, images, count, 0);
+}
+
+/*
+ * forwardTraining()
+ * Same as forward(), but also records what the backward pass
+ * needs (the pooling argmax codes; im2col columns are always
+ * kept).
+ */
+real* forwardTraining(ConvLayer* convLayer, DenseLayer* denseLayer, Workspace* ws, const uint8_t* images, int count) {
+    return runForward(convLayer, denseLayer, ws, images, count, 1);
+}
+
+/*
+ * initPredictor()
+ * Starts a pool of `numThreads` and gives each thread a
+ * workspace for PREDICT_CHUNK images.
+ */
+Predictor* initPredictor(ConvLayer* convLayer, DenseLayer* denseLayer, int width, int height, int numThreads) {
+    Predictor* predictor = malloc(sizeof(Predictor));
+    assert(predictor != NULL && numThreads > 0);
+
+    predictor->convLayer = convLayer;
+    predictor->denseLayer = denseLayer;
+    predictor->chunk = PREDICT_CHUNK;
+    predictor->pool = initThreadPool(numThreads);
+    predictor->workspaces = malloc(numThreads * sizeof(Workspace*));
+    assert(predictor->workspaces != NULL);
+
+    for (int t=0; t<numThreads; t++) {
+        predictor->workspaces[t] = initWorkspace(convLayer, denseLayer, width, height, predictor->chunk);
+    }
+    return predictor;
+}
+
+/*
+ * freePredictor()
+ * Stops the pool and frees the per-thread workspaces.
+ */
+void freePredictor(Predictor* predictor) {
+    for (int t=0; t<threadPoolSize(predictor->pool); t++) {
+        freeWorkspace(predictor->workspaces[t]);
+    }
+    freeThreadPool(predictor->pool);
+    free(predictor->workspaces);
+    free(predictor);
+}
+
+/*
+ * predictTask()
+ * Scores chunk `task` in the calling thread's workspace and
+ * copies the probabilities to their slot in the output.
+ */
+static void predictTask(void* context, int task, int thread) {
+    Predictor* predictor = context;
+    Workspace* ws = predictor->workspaces[thread];
+    int classes = predictor->denseLayer->size;
+    int start = task * predictor->chunk;
+    int count = predictor->count - start < predictor->chunk ? predictor->count - start : predictor->chunk;
+    size_t imageSize = (size_t)ws->width * ws->height;
+
+    real* probs = forward(predictor->convLayer, predictor->denseLayer, ws, predictor->images + start * imageSize, count);
+    memcpy(predictor->probs + (size_t)start * classes, probs, (size_t)count * classes * sizeof(real));
+}
+
+/*
+ * predict()
+ * Scores `count` consecutive images and writes their class
+ * probabilities to `probs`, a caller-owned [count, classes]
+ * buffer.
+ */
+void predict(Predictor* predictor, const uint8_t* images, int count, real* probs) {
+    if (count <= 0) return;
+    predictor->images = images;
+    predictor->probs = probs;
+    predictor->count = count;
+    threadPoolRun(predictor->pool, predictTask, predictor, (count + predictor->chunk - 1) / predictor->chunk);
+}
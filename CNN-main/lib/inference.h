@@ -0,0 +1,47 @@
+/*
+ * inference.h — batched forward pass and parallel scoring
+ * -------------------------------------------------------
+ * `forward()` runs a batch of images through the network in
+ * one workspace. A Predictor spreads a large set of images
+ * over a thread pool, each thread reusing its own workspace,
+ * and writes the N×classes probabilities straight into a
+ * caller-supplied buffer.
+ */
+
+#ifndef INFERENCE_H
+#define INFERENCE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "convolution.h"
+#include "pooling.h"
+#include "dense.h"
+#include "output.h"
+#include "workspace.h"
+#include "threadpool.h"
+
+#define PREDICT_CHUNK 32    /* images per task / per-thread workspace */
+
+typedef struct {
+    ConvLayer* convLayer;
+    DenseLayer* denseLayer;
+    ThreadPool* pool;
+    Workspace** workspaces;     /* one per thread */
+    int chunk;
+
+    /* job currently being scored */
+    const uint8_t* images;
+    real* probs;
+    int count;
+} Predictor;
+
+real* forward(ConvLayer* convLayer, DenseLayer* denseLayer, Workspace* ws, const uint8_t* images, int count);
+real* forwardTraining(ConvLayer* convLayer, DenseLayer* denseLayer, Workspace* ws, const uint8_t* images, int count);
+
+Predictor* initPredictor(ConvLayer* convLayer, DenseLayer* denseLayer, int width, int height, int numThreads);
+void freePredictor(Predictor* predictor);
+void predict(Predictor* predictor, const uint8_t* images, int count, real* probs);
+
+#endif
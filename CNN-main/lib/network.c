@@ -0,0 +1,938 @@
+/*
+ * network.c — configurable layer graph
+ * ------------------------------------
+ * Layers run in order over a whole batch. Convolution is
+ * im2col + GEMM per image, or Winograd for 3×3 stride-1
+ * layers (the columns are rebuilt in the backward pass
+ * instead of being kept per image), dense is one
+ * GEMM per batch, ReLU runs in place and max-pooling records
+ * one argmax code per output for the backward scatter.
+ *
+ * Memory planning: a pass is a timeline of steps (forward of
+ * layer l at step l, the loss at step L, backward of layer l
+ * at step 2L - l). Every activation, gradient and argmax
+ * buffer gets the interval of steps it must survive, and
+ * buffers are placed greedily, largest first, at the lowest
+ * offset not used by any buffer whose interval overlaps. An
+ * inference pass therefore ping-pongs between two blocks,
+ * while training keeps exactly what the backward pass reads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "gemm.h"
+#include "winograd.h"
+#include "simd.h"
+#include "random.h"
+#include "convolution.h"
+#include "output.h"
+#include "profile.h"
+#include "network.h"
+
+/*
+ * initNetwork()
+ * An empty graph over `channels`×`height`×`width` inputs whose
+ * weights will be drawn from `seed`; add layers with the
+ * netAdd*() helpers, then buildNetwork().
+ */
+Network* initNetwork(int channels, int width, int height, uint64_t seed) {
+    Network* net = malloc(sizeof(Network));
+    assert(net != NULL && channels > 0 && width > 0 && height > 0);
+
+    net->layers = NULL;
+    net->numLayers = 0;
+    net->capacity = 0;
+    net->channels = channels;
+    net->width = width;
+    net->height = height;
+    net->classes = 0;
+    net->seed = seed;
+    arenaInit(&net->parameters, 0);
+    return net;
+}
+
+/*
+ * freeNetwork()
+ * Releases the parameters and the layer list.
+ */
+void freeNetwork(Network* net) {
+    arenaFree(&net->parameters);
+    free(net->layers);
+    free(net);
+}
+
+static NetLayer* addLayer(Network* net, NetLayerType type) {
+    if (net->numLayers == net->capacity) {
+        net->capacity = net->capacity > 0 ? 2 * net->capacity : 8;
+        net->layers = realloc(net->layers, net->capacity * sizeof(NetLayer));
+        assert(net->layers != NULL);
+    }
+    NetLayer* layer = &net->layers[net->numLayers++];
+    memset(layer, 0, sizeof(NetLayer));
+    layer->type = type;
+    return layer;
+}
+
+void netAddConv(Network* net, int filters, int size, int stride, int padding) {
+    NetLayer* layer = addLayer(net, NET_CONV);
+    layer->outputs = filters;
+    layer->size = size;
+    layer->stride = stride;
+    layer->padding = padding;
+}
+
+void netAddRelu(Network* net) {
+    addLayer(net, NET_RELU);
+}
+
+void netAddMaxPool(Network* net, int size, int stride) {
+    NetLayer* layer = addLayer(net, NET_MAXPOOL);
+    layer->size = size;
+    layer->stride = stride;
+}
+
+void netAddDense(Network* net, int units) {
+    NetLayer* layer = addLayer(net, NET_DENSE);
+    layer->outputs = units;
+}
+
+static size_t shapeSize(const int* shape) {
+    return (size_t)shape[0] * shape[1] * shape[2];
+}
+
+/*
+ * inferShape()
+ * Sets `layer->outShape` from its inShape; returns 0 (and
+ * says why) if the layer cannot be applied to that input.
+ */
+static int inferShape(NetLayer* layer, int index) {
+    int channels = layer->inShape[0];
+    int height = layer->inShape[1];
+    int width = layer->inShape[2];
+
+    switch (layer->type) {
+    case NET_CONV:
+        if (layer->outputs <= 0 || layer->size <= 0 || layer->stride <= 0 || layer->padding < 0
+            || height + 2 * layer->padding < layer->size || width + 2 * layer->padding < layer->size) break;
+        layer->outShape[0] = layer->outputs;
+        layer->outShape[1] = (height + 2 * layer->padding - layer->size) / layer->stride + 1;
+        layer->outShape[2] = (width + 2 * layer->padding - layer->size) / layer->stride + 1;
+        return 1;
+    case NET_RELU:
+        memcpy(layer->outShape, layer->inShape, sizeof(layer->outShape));
+        return 1;
+    case NET_MAXPOOL:
+        /* argmax codes are one byte: dy·size + dx */
+        if (layer->size <= 0 || layer->size > 15 || layer->stride <= 0 || height < layer->size || width < layer->size) break;
+        layer->outShape[0] = channels;
+        layer->outShape[1] = (height - layer->size) / layer->stride + 1;
+        layer->outShape[2] = (width - layer->size) / layer->stride + 1;
+        return 1;
+    case NET_DENSE:
+        if (layer->outputs <= 0) break;
+        layer->outShape[0] = layer->outputs;
+        layer->outShape[1] = 1;
+        layer->outShape[2] = 1;
+        return 1;
+    }
+    fprintf(stderr, "layer %d: cannot apply to a [%d, %d, %d] input\n", index, channels, height, width);
+    return 0;
+}
+
+/*
+ * layoutParameters()
+ * Carves every layer's weights and biases from the parameter
+ * arena; run measuring first, like layoutWorkspace().
+ */
+static void layoutParameters(Network* net) {
+    for (int l=0; l<net->numLayers; l++) {
+        NetLayer* layer = &net->layers[l];
+        if (layer->type == NET_CONV) {
+            int shape[4] = {layer->outputs, layer->inShape[0], layer->size, layer->size};
+            arenaTensor(&net->parameters, &layer->weights, 4, shape);
+        } else if (layer->type == NET_DENSE) {
+            int shape[2] = {layer->outputs, (int)shapeSize(layer->inShape)};
+            arenaTensor(&net->parameters, &layer->weights, 2, shape);
+        } else {
+            continue;
+        }
+        arenaTensor(&net->parameters, &layer->biases, 1, &layer->outputs);
+    }
+}
+
+/*
+ * buildNetwork()
+ * Infers all shapes, allocates the parameters in one zeroed
+ * block and He-initialises the weights (biases start at 0).
+ * Returns 0 if the layers do not fit together.
+ */
+int buildNetwork(Network* net) {
+    if (net->numLayers == 0) {
+        fprintf(stderr, "network has no layers\n");
+        return 0;
+    }
+    int shape[3] = {net->channels, net->height, net->width};
+    for (int l=0; l<net->numLayers; l++) {
+        NetLayer* layer = &net->layers[l];
+        memcpy(layer->inShape, shape, sizeof(shape));
+        if (!inferShape(layer, l)) return 0;
+        memcpy(shape, layer->outShape, sizeof(shape));
+    }
+    net->classes = (int)shapeSize(shape);
+
+    arenaFree(&net->parameters);
+    layoutParameters(net);
+    arenaInit(&net->parameters, net->parameters.used);
+    layoutParameters(net);
+
+    for (int l=0; l<net->numLayers; l++) {
+        NetLayer* layer = &net->layers[l];
+        if (layer->type != NET_CONV && layer->type != NET_DENSE) continue;
+        real fanIn = (real)(layer->weights.size / layer->outputs);
+        randomGaussian(net->seed, RANDOM_PART(RANDOM_NETWORK_INIT, l), 0, layer->weights.data, layer->weights.size);
+        simd->scale(sqrt(2.0 / fanIn), layer->weights.data, layer->weights.data, (int)layer->weights.size);
+    }
+    return 1;
+}
+
+/*
+ * parseNetwork()
+ * Builds a network from a comma-separated layer list:
+ *   conv:F:K[:S[:P]]   F filters of K×K, stride S (1), padding P (0)
+ *   relu
+ *   pool:K[:S]         K×K max-pooling, stride S (K)
+ *   dense:N            N units
+ * e.g. "conv:8:3,relu,pool:2,dense:10". Returns NULL (with a
+ * message) on a malformed list or mismatched shapes.
+ */
+Network* parseNetwork(const char* spec, int channels, int width, int height, uint64_t seed) {
+    Network* net = initNetwork(channels, width, height, seed);
+    const char* item = spec;
+
+    while (*item != '\0') {
+        const char* end = strchr(item, ',');
+        size_t length = end != NULL ? (size_t)(end - item) : strlen(item);
+        int args[4] = {0, 0, 0, 0};
+        int numArgs = 0;
+        const char* p = memchr(item, ':', length);
+        size_t nameLength = p != NULL ? (size_t)(p - item) : length;
+        int ok = 1;
+
+        while (p != NULL && p < item + length && ok) {
+            char* next;
+            long value = strtol(p + 1, &next, 10);
+            ok = next != p + 1 && numArgs < 4 && (next == item + length || *next == ':');
+            if (ok) args[numArgs++] = (int)value;
+            p = next < item + length ? next : NULL;
+        }
+
+        if (ok && nameLength == 4 && strncmp(item, "conv", 4) == 0 && numArgs >= 2) {
+            netAddConv(net, args[0], args[1], numArgs > 2 ? args[2] : 1, args[3]);
+        } else if (ok && nameLength == 4 && strncmp(item, "relu", 4) == 0 && numArgs == 0) {
+            netAddRelu(net);
+        } else if (ok && nameLength == 4 && strncmp(item, "pool", 4) == 0 && numArgs >= 1 && numArgs <= 2) {
+            netAddMaxPool(net, args[0], numArgs > 1 ? args[1] : args[0]);
+        } else if (ok && nameLength == 5 && strncmp(item, "dense", 5) == 0 && numArgs == 1) {
+            netAddDense(net, args[0]);
+        } else {
+            fprintf(stderr, "bad layer '%.*s' in '%s'\n", (int)length, item, spec);
+            freeNetwork(net);
+            return NULL;
+        }
+        item += length;
+        if (*item == ',') item++;
+    }
+
+    if (!buildNetwork(net)) {
+        freeNetwork(net);
+        return NULL;
+    }
+    return net;
+}
+
+/*
+ * printNetwork()
+ * One line per layer with its output shape and parameter count.
+ */
+void printNetwork(Network* net) {
+    size_t total = 0;
+    printf("Network: [%d, %d, %d] input\n", net->channels, net->height, net->width);
+    for (int l=0; l<net->numLayers; l++) {
+        NetLayer* layer = &net->layers[l];
+        size_t params = layer->type == NET_CONV || layer->type == NET_DENSE ? layer->weights.size + layer->biases.size : 0;
+        total += params;
+        char description[64];
+        switch (layer->type) {
+        case NET_CONV:
+            snprintf(description, sizeof(description), "conv %dx%dx%d stride %d pad %d", layer->outputs, layer->size, layer->size, layer->stride, layer->padding);
+            break;
+        case NET_RELU:
+            snprintf(description, sizeof(description), "relu");
+            break;
+        case NET_MAXPOOL:
+            snprintf(description, sizeof(description), "maxpool %dx%d stride %d", layer->size, layer->size, layer->stride);
+            break;
+        case NET_DENSE:
+            snprintf(description, sizeof(description), "dense %d", layer->outputs);
+            break;
+        }
+        printf("  %-30s -> [%d, %d, %d]  %zu params\n", description, layer->outShape[0], layer->outShape[1], layer->outShape[2], params);
+    }
+    printf("  softmax over %d classes, %zu parameters in total\n", net->classes, total);
+}
+
+/*
+ * PlanBuffer: one activation, gradient or argmax buffer of a
+ * pass. `owner` is the buffer it shares memory with (itself
+ * unless an in-place ReLU aliased it); only owners are placed.
+ */
+typedef struct {
+    size_t elements;
+    int first;              /* steps it must survive, inclusive */
+    int last;
+    int owner;
+    size_t offset;
+} PlanBuffer;
+
+/*
+ * NetPlan: where every buffer of a workspace goes inside the
+ * planned block. Indexes: activation i → i, gradient i →
+ * L + 1 + i, argmax of layer l → 2L + 2 + l.
+ */
+typedef struct {
+    PlanBuffer* buffers;
+    int count;
+    size_t total;           /* elements of the planned block */
+    size_t unplanned;       /* elements without any reuse */
+} NetPlan;
+
+static void useBuffer(PlanBuffer* buffers, int index, size_t elements, int first, int last) {
+    PlanBuffer* buffer = &buffers[index];
+    size_t perLine = TENSOR_ALIGNMENT / sizeof(real);
+    buffer->elements = (elements + perLine - 1) / perLine * perLine;
+    buffer->first = first;
+    buffer->last = last;
+    buffer->owner = index;
+}
+
+/*
+ * aliasBuffer()
+ * Lets `index` live in `target`'s memory: the owner's size and
+ * interval grow to cover both.
+ */
+static void aliasBuffer(PlanBuffer* buffers, int index, int target) {
+    PlanBuffer* owner = &buffers[buffers[target].owner];
+    PlanBuffer* buffer = &buffers[index];
+    if (buffer->elements > owner->elements) owner->elements = buffer->elements;
+    if (buffer->first < owner->first) owner->first = buffer->first;
+    if (buffer->last > owner->last) owner->last = buffer->last;
+    buffer->owner = buffers[target].owner;
+}
+
+/*
+ * sortBuffers()
+ * Insertion sort of buffer indexes, by size (largest first)
+ * or by offset; plans have a few dozen buffers at most.
+ */
+static void sortBuffers(int* indexes, int count, const PlanBuffer* buffers, int bySize) {
+    for (int i=1; i<count; i++) {
+        int index = indexes[i];
+        int j = i;
+        for (; j>0; j--) {
+            const PlanBuffer* prev = &buffers[indexes[j-1]];
+            int before = bySize ? prev->elements >= buffers[index].elements : prev->offset <= buffers[index].offset;
+            if (before) break;
+            indexes[j] = indexes[j-1];
+        }
+        indexes[j] = index;
+    }
+}
+
+/*
+ * placeBuffers()
+ * Greedy offset assignment (see the top of this file).
+ */
+static void placeBuffers(NetPlan* plan) {
+    PlanBuffer* buffers = plan->buffers;
+    int* order = malloc(plan->count * sizeof(int));
+    int* placed = malloc(plan->count * sizeof(int));
+    int* conflicts = malloc(plan->count * sizeof(int));
+    assert(order != NULL && placed != NULL && conflicts != NULL);
+
+    int owners = 0;
+    plan->unplanned = 0;
+    for (int i=0; i<plan->count; i++) {
+        if (buffers[i].elements == 0) continue;
+        plan->unplanned += buffers[i].elements;
+        if (buffers[i].owner == i) order[owners++] = i;
+    }
+    sortBuffers(order, owners, buffers, 1);
+
+    int numPlaced = 0;
+    plan->total = 0;
+    for (int i=0; i<owners; i++) {
+        PlanBuffer* buffer = &buffers[order[i]];
+        int numConflicts = 0;
+        for (int j=0; j<numPlaced; j++) {
+            PlanBuffer* other = &buffers[placed[j]];
+            if (other->first <= buffer->last && buffer->first <= other->last) {
+                conflicts[numConflicts++] = placed[j];
+            }
+        }
+        sortBuffers(conflicts, numConflicts, buffers, 0);
+
+        size_t offset = 0;
+        for (int j=0; j<numConflicts; j++) {
+            PlanBuffer* other = &buffers[conflicts[j]];
+            if (offset + buffer->elements <= other->offset) break;
+            if (other->offset + other->elements > offset) offset = other->offset + other->elements;
+        }
+        buffer->offset = offset;
+        if (offset + buffer->elements > plan->total) plan->total = offset + buffer->elements;
+        placed[numPlaced++] = order[i];
+    }
+    for (int i=0; i<plan->count; i++) {
+        buffers[i].offset = buffers[buffers[i].owner].offset;
+    }
+
+    free(conflicts);
+    free(placed);
+    free(order);
+}
+
+/*
+ * planNetwork()
+ * Lifetimes of every buffer a `batchSize` pass needs. In
+ * inference an activation lives from the step producing it to
+ * the step consuming it; in training conv and dense layers also
+ * keep their input, and ReLU its output, until their backward
+ * step. A ReLU works in place on both its activation and its
+ * gradient.
+ */
+static void planNetwork(Network* net, int batchSize, int training, NetPlan* plan) {
+    int L = net->numLayers;
+    plan->count = 3 * L + 2;
+    plan->buffers = calloc(plan->count, sizeof(PlanBuffer));
+    assert(plan->buffers != NULL);
+    PlanBuffer* buffers = plan->buffers;
+    for (int i=0; i<plan->count; i++) {
+        buffers[i].owner = i;
+    }
+
+    for (int i=0; i<=L; i++) {
+        const int* shape = i < L ? net->layers[i].inShape : net->layers[L-1].outShape;
+        int first = i > 0 ? i - 1 : 0;
+        int last = i;
+        if (training && i < L && (net->layers[i].type == NET_CONV || net->layers[i].type == NET_DENSE)) {
+            last = 2 * L - i;
+        }
+        if (training && i > 0 && net->layers[i-1].type == NET_RELU) {
+            last = 2 * L - (i - 1);
+        }
+        useBuffer(buffers, i, batchSize * shapeSize(shape), first, last);
+        if (i > 0 && net->layers[i-1].type == NET_RELU) {
+            aliasBuffer(buffers, i, i - 1);
+        }
+    }
+    if (!training) {
+        placeBuffers(plan);
+        return;
+    }
+
+    for (int i=L; i>=1; i--) {
+        const int* shape = i < L ? net->layers[i].inShape : net->layers[L-1].outShape;
+        useBuffer(buffers, L + 1 + i, batchSize * shapeSize(shape), 2 * L - i, 2 * L - i + 1);
+        if (i < L && net->layers[i].type == NET_RELU) {
+            aliasBuffer(buffers, L + 1 + i, L + 1 + i + 1);
+        }
+    }
+    for (int l=0; l<L; l++) {
+        if (net->layers[l].type != NET_MAXPOOL) continue;
+        size_t bytes = batchSize * shapeSize(net->layers[l].outShape);
+        useBuffer(buffers, 2 * L + 2 + l, (bytes + sizeof(real) - 1) / sizeof(real), l, 2 * L - l);
+    }
+    placeBuffers(plan);
+}
+
+static int useWinograd(NetLayer* layer) {
+    return layer->type == NET_CONV && winogradApplies(layer->size, layer->stride, layer->inShape[0]);
+}
+
+/*
+ * convElements()
+ * Largest per-image column matrix (im2col or Winograd input)
+ * or, with `scratch`, Winograd scratch over all conv layers.
+ */
+static size_t convElements(Network* net, int scratch) {
+    size_t largest = 1;
+    for (int l=0; l<net->numLayers; l++) {
+        NetLayer* layer = &net->layers[l];
+        if (layer->type != NET_CONV) continue;
+        size_t elements;
+        if (useWinograd(layer)) {
+            elements = scratch ? winogradScratchSize(layer->outputs, layer->inShape[0], layer->outShape[1], layer->outShape[2])
+                               : winogradColumnSize(layer->inShape[0], layer->outShape[1], layer->outShape[2]);
+        } else {
+            elements = scratch ? 1 : (size_t)layer->inShape[0] * layer->size * layer->size * layer->outShape[1] * layer->outShape[2];
+        }
+        if (elements > largest) largest = elements;
+    }
+    return largest;
+}
+
+/*
+ * layoutNetWorkspace()
+ * Carves the conv buffers, the probabilities and the planned block
+ * from the arena and points every view at its planned offset.
+ */
+static void layoutNetWorkspace(NetWorkspace* ws, Network* net, NetPlan* plan) {
+    int L = net->numLayers;
+    int columnShape[1] = {(int)convElements(net, 0)};
+    int scratchShape[1] = {(int)convElements(net, 1)};
+    int probShape[2] = {ws->batchSize, net->classes};
+    arenaTensor(&ws->arena, &ws->columns, 1, columnShape);
+    arenaTensor(&ws->arena, &ws->scratch, 1, scratchShape);
+    arenaTensor(&ws->arena, &ws->probs, 2, probShape);
+    real* block = arenaAlloc(&ws->arena, plan->total);
+    if (block == NULL) return;
+
+    for (int i=0; i<=L; i++) {
+        const int* shape = i < L ? net->layers[i].inShape : net->layers[L-1].outShape;
+        int batchShape[4] = {ws->batchSize, shape[0], shape[1], shape[2]};
+        tensorView(&ws->activations[i], block + plan->buffers[i].offset, 4, batchShape);
+        if (ws->training && i > 0) {
+            tensorView(&ws->gradients[i], block + plan->buffers[L + 1 + i].offset, 4, batchShape);
+        }
+    }
+    for (int l=0; l<L; l++) {
+        int planned = ws->training && net->layers[l].type == NET_MAXPOOL;
+        ws->argmax[l] = planned ? (uint8_t*)(block + plan->buffers[2 * L + 2 + l].offset) : NULL;
+    }
+}
+
+/*
+ * initNetWorkspace()
+ * Plans and allocates every buffer of a `batchSize`-image
+ * pass; `training` adds what networkBackward() needs.
+ */
+NetWorkspace* initNetWorkspace(Network* net, int batchSize, int training) {
+    NetWorkspace* ws = malloc(sizeof(NetWorkspace));
+    assert(ws != NULL && batchSize > 0 && net->classes > 0);
+
+    int L = net->numLayers;
+    ws->batchSize = batchSize;
+    ws->training = training;
+    ws->activations = calloc(L + 1, sizeof(Tensor));
+    ws->gradients = calloc(L + 1, sizeof(Tensor));
+    ws->argmax = calloc(L, sizeof(uint8_t*));
+    assert(ws->activations != NULL && ws->gradients != NULL && ws->argmax != NULL);
+
+    NetPlan plan;
+    planNetwork(net, batchSize, training, &plan);
+    ws->plannedBytes = plan.total * sizeof(real);
+    ws->unplannedBytes = plan.unplanned * sizeof(real);
+
+    arenaInit(&ws->arena, 0);
+    layoutNetWorkspace(ws, net, &plan);
+    arenaInit(&ws->arena, ws->arena.used);
+    layoutNetWorkspace(ws, net, &plan);
+    free(plan.buffers);
+    return ws;
+}
+
+/*
+ * freeNetWorkspace()
+ * Releases the arena and the view tables.
+ */
+void freeNetWorkspace(NetWorkspace* ws) {
+    arenaFree(&ws->arena);
+    free(ws->activations);
+    free(ws->gradients);
+    free(ws->argmax);
+    free(ws);
+}
+
+/*
+ * netIm2col()
+ * Lowers one [C, H, W] image into `layer`'s [C·K², outH·outW]
+ * column matrix: row (c·K + ky)·K + kx holds the input under
+ * filter tap (c, ky, kx) for every output position, 0 where
+ * the tap falls into the padding.
+ */
+static void netIm2col(NetLayer* layer, const real* image, real* columns) {
+    int height = layer->inShape[1];
+    int width = layer->inShape[2];
+    int outHeight = layer->outShape[1];
+    int outWidth = layer->outShape[2];
+    int size = layer->size;
+
+    for (int c=0; c<layer->inShape[0]; c++) {
+        const real* plane = image + (size_t)c * height * width;
+        for (int ky=0; ky<size; ky++) {
+            for (int kx=0; kx<size; kx++) {
+                real* row = columns + (size_t)((c * size + ky) * size + kx) * outHeight * outWidth;
+                for (int i=0; i<outHeight; i++) {
+                    int y = i * layer->stride + ky - layer->padding;
+                    real* dst = row + i * outWidth;
+                    for (int j=0; j<outWidth; j++) {
+                        int x = j * layer->stride + kx - layer->padding;
+                        dst[j] = y >= 0 && y < height && x >= 0 && x < width ? plane[y * width + x] : 0.0;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+ * netCol2im()
+ * Adjoint of netIm2col(): adds every column entry back onto
+ * the input pixel it was read from (padding taps are dropped).
+ */
+static void netCol2im(NetLayer* layer, const real* columns, real* image) {
+    int height = layer->inShape[1];
+    int width = layer->inShape[2];
+    int outHeight = layer->outShape[1];
+    int outWidth = layer->outShape[2];
+    int size = layer->size;
+
+    for (int c=0; c<layer->inShape[0]; c++) {
+        real* plane = image + (size_t)c * height * width;
+        for (int ky=0; ky<size; ky++) {
+            for (int kx=0; kx<size; kx++) {
+                const real* row = columns + (size_t)((c * size + ky) * size + kx) * outHeight * outWidth;
+                for (int i=0; i<outHeight; i++) {
+                    int y = i * layer->stride + ky - layer->padding;
+                    if (y < 0 || y >= height) continue;
+                    const real* src = row + i * outWidth;
+                    for (int j=0; j<outWidth; j++) {
+                        int x = j * layer->stride + kx - layer->padding;
+                        if (x >= 0 && x < width) plane[y * width + x] += src[j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void convForward(NetLayer* layer, NetWorkspace* ws, Tensor* input, Tensor* output, int count) {
+    int taps = (int)(layer->weights.size / layer->outputs);
+    int positions = layer->outShape[1] * layer->outShape[2];
+
+    for (int b=0; b<count; b++) {
+        real* out = tensorSlice(output, b);
+        if (useWinograd(layer)) {
+            winogradInput(tensorSlice(input, b), layer->inShape[0], layer->inShape[1], layer->inShape[2], layer->padding,
+                          layer->outShape[1], layer->outShape[2], ws->columns.data);
+            winogradForward(layer->weights.data, ws->columns.data, layer->outputs, layer->inShape[0], layer->outShape[1], layer->outShape[2],
+                            ws->scratch.data, out);
+        } else {
+            netIm2col(layer, tensorSlice(input, b), ws->columns.data);
+            gemm(0, 0, layer->outputs, positions, taps,
+                 1.0, layer->weights.data, taps, ws->columns.data, positions,
+                 0.0, out, positions);
+        }
+        for (int f=0; f<layer->outputs; f++) {
+            real bias = layer->biases.data[f];
+            real* row = out + (size_t)f * positions;
+            for (int p=0; p<positions; p++) {
+                row[p] += bias;
+            }
+        }
+    }
+}
+
+/*
+ * convBackward()
+ * Per image, with the columns C rebuilt from the kept input:
+ *   dL/dW += G·Cᵀ,  dL/db += row sums of G,
+ *   dL/dC  = Wᵀ·G, scattered back to dL/dX by netCol2im(),
+ * or the same through winogradBackward(). `dInput` is NULL
+ * for the first layer.
+ */
+static void convBackward(NetLayer* layer, NetWorkspace* ws, Tensor* input, Tensor* dOutput, Tensor* dInput, real* dWeights, real* dBiases, int count) {
+    int taps = (int)(layer->weights.size / layer->outputs);
+    int positions = layer->outShape[1] * layer->outShape[2];
+    size_t inputSize = shapeSize(layer->inShape);
+
+    for (int b=0; b<count; b++) {
+        real* g = tensorSlice(dOutput, b);
+        real* dImage = dInput != NULL ? tensorSlice(dInput, b) : NULL;
+        for (int f=0; f<layer->outputs; f++) {
+            const real* row = g + (size_t)f * positions;
+            real sum = 0.0;
+            for (int p=0; p<positions; p++) {
+                sum += row[p];
+            }
+            dBiases[f] += sum;
+        }
+        if (dImage != NULL) {
+            memset(dImage, 0, inputSize * sizeof(real));
+        }
+
+        if (useWinograd(layer)) {
+            winogradInput(tensorSlice(input, b), layer->inShape[0], layer->inShape[1], layer->inShape[2], layer->padding,
+                          layer->outShape[1], layer->outShape[2], ws->columns.data);
+            winogradBackward(layer->weights.data, ws->columns.data, g, layer->outputs, layer->inShape[0], layer->outShape[1], layer->outShape[2],
+                             ws->scratch.data, dWeights, dImage, layer->inShape[1], layer->inShape[2], layer->padding);
+            continue;
+        }
+        netIm2col(layer, tensorSlice(input, b), ws->columns.data);
+        gemm(0, 1, layer->outputs, taps, positions,
+             1.0, g, positions, ws->columns.data, positions,
+             1.0, dWeights, taps);
+        if (dImage == NULL) continue;
+
+        gemm(1, 0, taps, positions, layer->outputs,
+             1.0, layer->weights.data, taps, g, positions,
+             0.0, ws->columns.data, positions);
+        netCol2im(layer, ws->columns.data, dImage);
+    }
+}
+
+/*
+ * poolForward()
+ * Max over every size×size window; with `argmax` the position
+ * of the winner (first maximum on ties) is recorded as
+ * dy·size + dx. The 2×2, stride-2 inference case uses the SIMD
+ * kernel.
+ */
+static void poolForward(NetLayer* layer, Tensor* input, Tensor* output, uint8_t* argmax, int count) {
+    int planes = count * layer->inShape[0];
+    int inHeight = layer->inShape[1];
+    int inWidth = layer->inShape[2];
+    int height = layer->outShape[1];
+    int width = layer->outShape[2];
+    int size = layer->size;
+    int stride = layer->stride;
+
+    for (int k=0; k<planes; k++) {
+        const real* plane = input->data + (size_t)k * inHeight * inWidth;
+        real* pooled = output->data + (size_t)k * height * width;
+
+        if (argmax == NULL && size == 2 && stride == 2) {
+            for (int i=0; i<height; i++) {
+                simd->maxPool(plane + (2*i) * inWidth, plane + (2*i + 1) * inWidth, pooled + i * width, width);
+            }
+            continue;
+        }
+        for (int i=0; i<height; i++) {
+            for (int j=0; j<width; j++) {
+                const real* window = plane + (i * stride) * inWidth + j * stride;
+                real max = window[0];
+                int at = 0;
+                for (int dy=0; dy<size; dy++) {
+                    for (int dx=0; dx<size; dx++) {
+                        if (window[dy * inWidth + dx] > max) {
+                            max = window[dy * inWidth + dx];
+                            at = dy * size + dx;
+                        }
+                    }
+                }
+                pooled[i * width + j] = max;
+                if (argmax != NULL) argmax[(size_t)k * height * width + i * width + j] = (uint8_t)at;
+            }
+        }
+    }
+}
+
+/*
+ * poolBackward()
+ * Adds each pooled gradient to the recorded winner of its
+ * window (overlapping windows may share a winner).
+ */
+static void poolBackward(NetLayer* layer, Tensor* dOutput, const uint8_t* argmax, Tensor* dInput, int count) {
+    int planes = count * layer->inShape[0];
+    int inHeight = layer->inShape[1];
+    int inWidth = layer->inShape[2];
+    int height = layer->outShape[1];
+    int width = layer->outShape[2];
+    memset(dInput->data, 0, (size_t)planes * inHeight * inWidth * sizeof(real));
+
+    for (int k=0; k<planes; k++) {
+        const real* dPooled = dOutput->data + (size_t)k * height * width;
+        const uint8_t* index = argmax + (size_t)k * height * width;
+        real* dPlane = dInput->data + (size_t)k * inHeight * inWidth;
+        for (int i=0; i<height; i++) {
+            for (int j=0; j<width; j++) {
+                int at = index[i * width + j];
+                int y = i * layer->stride + at / layer->size;
+                int x = j * layer->stride + at % layer->size;
+                dPlane[y * inWidth + x] += dPooled[i * width + j];
+            }
+        }
+    }
+}
+
+static void denseLayerForward(NetLayer* layer, Tensor* input, Tensor* output, int count) {
+    int inputSize = (int)shapeSize(layer->inShape);
+    gemm(0, 1, count, layer->outputs, inputSize,
+         1.0, input->data, inputSize, layer->weights.data, inputSize,
+         0.0, output->data, layer->outputs);
+    for (int b=0; b<count; b++) {
+        simd->axpy(1.0, layer->biases.data, tensorSlice(output, b), layer->outputs);
+    }
+}
+
+/*
+ * denseLayerBackward()
+ * Same three products as denseBackprop(): dL/dW += Gᵀ·X,
+ * dL/db += Σ rows of G, dL/dX = G·W.
+ */
+static void denseLayerBackward(NetLayer* layer, Tensor* input, Tensor* dOutput, Tensor* dInput, real* dWeights, real* dBiases, int count) {
+    int inputSize = (int)shapeSize(layer->inShape);
+    gemm(1, 0, layer->outputs, inputSize, count,
+         1.0, dOutput->data, layer->outputs, input->data, inputSize,
+         1.0, dWeights, inputSize);
+    for (int b=0; b<count; b++) {
+        simd->axpy(1.0, tensorSlice(dOutput, b), dBiases, layer->outputs);
+    }
+    if (dInput != NULL) {
+        gemm(0, 0, count, inputSize, layer->outputs,
+             1.0, dOutput->data, layer->outputs, layer->weights.data, inputSize,
+             0.0, dInput->data, inputSize);
+    }
+}
+
+/*
+ * runNetwork()
+ * Scales the uint8 images into activations[0], runs every
+ * layer in order and the softmax; returns the probabilities.
+ */
+static real* runNetwork(Network* net, NetWorkspace* ws, const uint8_t* images, int count, int record) {
+    int L = net->numLayers;
+    size_t imageSize = shapeSize(net->layers[0].inShape);
+    Tensor* input = &ws->activations[0];
+    assert(count > 0 && count <= ws->batchSize && (!record || ws->training));
+
+    for (size_t i=0; i<(size_t)count * imageSize; i++) {
+        input->data[i] = (real)images[i] / (real)255;
+    }
+    for (int l=0; l<L; l++) {
+        NetLayer* layer = &net->layers[l];
+        Tensor* in = &ws->activations[l];
+        Tensor* out = &ws->activations[l + 1];
+        size_t size = (size_t)count * shapeSize(layer->outShape);
+
+        switch (layer->type) {
+        case NET_CONV: {
+            PROFILE_BEGIN(convStart);
+            convForward(layer, ws, in, out, count);
+            PROFILE_END(PROFILE_CONV_FORWARD, convStart);
+            break;
+        }
+        case NET_RELU: {
+            /* timed with pooling, like the ReLU folded into poolingForward() */
+            PROFILE_BEGIN(reluStart);
+            for (size_t i=0; i<size; i++) {
+                out->data[i] = in->data[i] > 0 ? in->data[i] : 0;
+            }
+            PROFILE_END(PROFILE_POOL_FORWARD, reluStart);
+            break;
+        }
+        case NET_MAXPOOL: {
+            PROFILE_BEGIN(poolStart);
+            poolForward(layer, in, out, record ? ws->argmax[l] : NULL, count);
+            PROFILE_END(PROFILE_POOL_FORWARD, poolStart);
+            break;
+        }
+        case NET_DENSE: {
+            PROFILE_BEGIN(denseStart);
+            denseLayerForward(layer, in, out, count);
+            PROFILE_END(PROFILE_DENSE_FORWARD, denseStart);
+            break;
+        }
+        }
+    }
+
+    PROFILE_BEGIN(softmaxStart);
+    Tensor totals;
+    int shape[2] = {count, net->classes};
+    tensorView(&totals, ws->activations[L].data, 2, shape);
+    softmaxBatch(&totals, &ws->probs);
+    PROFILE_END(PROFILE_SOFTMAX, softmaxStart);
+    return ws->probs.data;
+}
+
+/*
+ * networkForward()
+ * Inference pass over `count` consecutive images; returns the
+ * [count, classes] probabilities, valid until the next pass.
+ */
+real* networkForward(Network* net, NetWorkspace* ws, const uint8_t* images, int count) {
+    return runNetwork(net, ws, images, count, 0);
+}
+
+/*
+ * networkBackward()
+ * Forward pass, fused softmax + cross-entropy backward, then
+ * every layer's backward in reverse order. Parameter gradients
+ * are added into `grads` (from initNetGradients()); returns the
+ * probabilities like networkForward().
+ */
+real* networkBackward(Network* net, NetWorkspace* ws, Tensor* grads, const uint8_t* images, const uint8_t* labels, int count) {
+    int L = net->numLayers;
+    assert(ws->training && grads->size == net->parameters.capacity);
+    runNetwork(net, ws, images, count, 1);
+
+    PROFILE_BEGIN(lossStart);
+    Tensor dTotals;
+    int shape[2] = {count, net->classes};
+    tensorView(&dTotals, ws->gradients[L].data, 2, shape);
+    softmaxCrossEntropyBackward(&ws->probs, labels, count, &dTotals);
+    PROFILE_END(PROFILE_LOSS_BACKWARD, lossStart);
+
+    for (int l=L-1; l>=0; l--) {
+        NetLayer* layer = &net->layers[l];
+        Tensor* in = &ws->activations[l];
+        Tensor* dOut = &ws->gradients[l + 1];
+        Tensor* dIn = l > 0 ? &ws->gradients[l] : NULL;
+        real* dWeights = grads->data + (layer->weights.data - net->parameters.base);
+        real* dBiases = grads->data + (layer->biases.data - net->parameters.base);
+
+        switch (layer->type) {
+        case NET_CONV: {
+            PROFILE_BEGIN(convStart);
+            convBackward(layer, ws, in, dOut, dIn, dWeights, dBiases, count);
+            PROFILE_END(PROFILE_CONV_BACKWARD, convStart);
+            break;
+        }
+        case NET_RELU: {
+            if (dIn == NULL) break;
+            const real* out = ws->activations[l + 1].data;
+            size_t size = (size_t)count * shapeSize(layer->outShape);
+            for (size_t i=0; i<size; i++) {
+                dIn->data[i] = out[i] > 0 ? dOut->data[i] : 0;
+            }
+            break;
+        }
+        case NET_MAXPOOL: {
+            if (dIn == NULL) break;
+            PROFILE_BEGIN(poolStart);
+            poolBackward(layer, dOut, ws->argmax[l], dIn, count);
+            PROFILE_END(PROFILE_CONV_BACKWARD, poolStart);
+            break;
+        }
+        case NET_DENSE: {
+            PROFILE_BEGIN(denseStart);
+            denseLayerBackward(layer, in, dOut, dIn, dWeights, dBiases, count);
+            PROFILE_END(PROFILE_DENSE_BACKWARD, denseStart);
+            break;
+        }
+        }
+    }
+    return ws->probs.data;
+}
+
+/*
+ * initNetGradients()
+ * A zeroed buffer laid out exactly like the parameter arena,
+ * so every layer's gradient sits at its parameters' offset.
+ */
+Tensor* initNetGradients(Network* net) {
+    return tensorCreate1D((int)net->parameters.capacity);
+}
@@ -0,0 +1,99 @@
+/*
+ * network.h — configurable layer graph
+ * ------------------------------------
+ * A Network is an ordered list of layers (convolution with
+ * stride, padding and any number of input channels, ReLU,
+ * max-pooling, dense) ending in a softmax over the last
+ * layer's outputs. buildNetwork() infers every layer's shape
+ * from the input size and allocates all parameters in one
+ * block; a NetWorkspace then plans every activation and
+ * gradient buffer of a pass up front, letting buffers whose
+ * lifetimes do not overlap share memory.
+ */
+
+#ifndef NETWORK_H
+#define NETWORK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "tensor.h"
+
+typedef enum {
+    NET_CONV,
+    NET_RELU,
+    NET_MAXPOOL,
+    NET_DENSE
+} NetLayerType;
+
+/*
+ * NetLayer: one stage of the graph. Shapes are [channels,
+ * height, width]; a dense layer's output is [units, 1, 1].
+ */
+typedef struct {
+    NetLayerType type;
+    int outputs;            /* conv filters / dense units */
+    int size;               /* conv filter / pooling window */
+    int stride;
+    int padding;            /* conv only, zeros on every side */
+
+    int inShape[3];         /* filled in by buildNetwork() */
+    int outShape[3];
+    Tensor weights;         /* conv [outputs, C, size, size], dense [outputs, C·H·W] */
+    Tensor biases;          /* [outputs] */
+} NetLayer;
+
+typedef struct {
+    NetLayer* layers;
+    int numLayers;
+    int capacity;
+    int channels;           /* input image */
+    int width;
+    int height;
+    int classes;            /* outputs of the last layer */
+    uint64_t seed;          /* weight initialisation, see random.h */
+    Arena parameters;       /* every weight and bias, contiguous */
+} Network;
+
+/*
+ * NetWorkspace: buffers of one pass over up to `batchSize`
+ * images. activations[i] is the input of layer i (i = 0 is
+ * the image batch) and gradients[i] its dL/d; both are
+ * [batch, C, H, W] views into the planned block, as are the
+ * pooling argmax codes. Gradients and argmax codes only exist
+ * in a training workspace.
+ */
+typedef struct {
+    int batchSize;
+    int training;
+    Tensor* activations;    /* [numLayers + 1] */
+    Tensor* gradients;      /* [numLayers + 1], training only */
+    uint8_t** argmax;       /* [numLayers], pooling layers only */
+    Tensor columns;         /* im2col / Winograd input of the largest conv layer, one image */
+    Tensor scratch;         /* Winograd scratch of the largest such layer */
+    Tensor probs;           /* [batch, classes] */
+    size_t plannedBytes;    /* activation/gradient block after reuse */
+    size_t unplannedBytes;  /* the same buffers without reuse */
+    Arena arena;
+} NetWorkspace;
+
+Network* initNetwork(int channels, int width, int height, uint64_t seed);
+void freeNetwork(Network* net);
+void netAddConv(Network* net, int filters, int size, int stride, int padding);
+void netAddRelu(Network* net);
+void netAddMaxPool(Network* net, int size, int stride);
+void netAddDense(Network* net, int units);
+int buildNetwork(Network* net);
+Network* parseNetwork(const char* spec, int channels, int width, int height, uint64_t seed);
+void printNetwork(Network* net);
+
+NetWorkspace* initNetWorkspace(Network* net, int batchSize, int training);
+void freeNetWorkspace(NetWorkspace* ws);
+
+real* networkForward(Network* net, NetWorkspace* ws, const uint8_t* images, int count);
+real* networkBackward(Network* net, NetWorkspace* ws, Tensor* grads, const uint8_t* images, const uint8_t* labels, int count);
+Tensor* initNetGradients(Network* net);
+
+#endif
@@ -0,0 +1,319 @@
+/*
+ * optimizer.c — parameter update rules and learning-rate schedules
+ * ----------------------------------------------------------------
+ * optimizerStep() turns the configuration and step count into
+ * one UpdateStep, then walks the parameter space as a single
+ * range [0, size): the segments are laid end to end, and so is
+ * the state, so a thread's share of the range maps onto a few
+ * contiguous pieces of parameters, gradients and state.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "optimizer.h"
+
+static const char* typeNames[] = { "sgd", "momentum", "nesterov", "adam", "adamw" };
+
+/*
+ * defaultOptimizerConfig()
+ * Plain SGD at the type's default rate, constant schedule.
+ */
+void defaultOptimizerConfig(OptimizerConfig* config) {
+    config->type = OPTIMIZER_SGD;
+    config->learningRate = 0.0;
+    config->momentum = 0.9;
+    config->beta2 = 0.999;
+    config->epsilon = 1e-8;
+    config->weightDecay = 0.0;
+    config->schedule = SCHEDULE_CONSTANT;
+    config->decayEpochs = 1;
+    config->gamma = 0.5;
+    config->warmup = 0;
+}
+
+/*
+ * parseOptimizerType()
+ * sgd | momentum | nesterov | adam | adamw. Returns 0 on an
+ * unknown name.
+ */
+int parseOptimizerType(const char* name, OptimizerConfig* config) {
+    for (int i=0; i<(int)(sizeof(typeNames) / sizeof(typeNames[0])); i++) {
+        if (strcmp(name, typeNames[i]) == 0) {
+            config->type = (OptimizerType)i;
+            return 1;
+        }
+    }
+    fprintf(stderr, "unknown optimizer '%s'\n", name);
+    return 0;
+}
+
+/*
+ * parseSchedule()
+ *   constant
+ *   step[:E[:G]]   × G (0.5) every E (1) epochs
+ *   cosine         cosine decay to 0 over the run
+ * Returns 0 on a malformed spec.
+ */
+int parseSchedule(const char* spec, OptimizerConfig* config) {
+    if (strcmp(spec, "constant") == 0) {
+        config->schedule = SCHEDULE_CONSTANT;
+        return 1;
+    }
+    if (strcmp(spec, "cosine") == 0) {
+        config->schedule = SCHEDULE_COSINE;
+        return 1;
+    }
+    if (strncmp(spec, "step", 4) == 0 && (spec[4] == '\0' || spec[4] == ':')) {
+        const char* p = spec + 4;
+        char* next;
+        config->schedule = SCHEDULE_STEP;
+        if (*p == ':') {
+            config->decayEpochs = (int)strtol(p + 1, &next, 10);
+            p = next;
+            if (*p == ':') {
+                config->gamma = strtod(p + 1, &next);
+                p = next;
+            }
+        }
+        if (*p == '\0' && config->decayEpochs > 0 && config->gamma > 0.0) return 1;
+    }
+    fprintf(stderr, "bad schedule '%s'\n", spec);
+    return 0;
+}
+
+/*
+ * stateSlots()
+ * State buffers the rule keeps per parameter.
+ */
+static int stateSlots(OptimizerType type) {
+    switch (type) {
+    case OPTIMIZER_SGD:
+        return 0;
+    case OPTIMIZER_MOMENTUM:
+    case OPTIMIZER_NESTEROV:
+        return 1;
+    case OPTIMIZER_ADAM:
+    case OPTIMIZER_ADAMW:
+        return 2;
+    }
+    return 0;
+}
+
+/*
+ * initOptimizer()
+ * An optimizer with no parameters yet; `pool` (may be NULL)
+ * is borrowed for splitting large steps.
+ */
+Optimizer* initOptimizer(const OptimizerConfig* config, ThreadPool* pool) {
+    Optimizer* optimizer = malloc(sizeof(Optimizer));
+    assert(optimizer != NULL);
+
+    optimizer->config = *config;
+    if (optimizer->config.learningRate <= 0.0) {
+        optimizer->config.learningRate = config->type >= OPTIMIZER_ADAM ? 0.001 : 0.005;
+    }
+    optimizer->numSegments = 0;
+    optimizer->size = 0;
+    optimizer->state[0] = optimizer->state[1] = NULL;
+    arenaInit(&optimizer->arena, 0);
+    optimizer->pool = pool;
+    optimizer->step = 0;
+    optimizer->totalSteps = 0;
+    optimizer->stepsPerEpoch = 0;
+    optimizer->rate = optimizer->config.learningRate;
+    return optimizer;
+}
+
+void freeOptimizer(Optimizer* optimizer) {
+    arenaFree(&optimizer->arena);
+    free(optimizer);
+}
+
+/*
+ * optimizerAdd()
+ * Registers a parameter block and the gradient block that is
+ * summed over each mini-batch for it, and regrows the zeroed
+ * state to cover it. Only valid before the first step.
+ */
+void optimizerAdd(Optimizer* optimizer, real* params, const real* grads, size_t size) {
+    assert(optimizer->numSegments < OPTIMIZER_MAX_SEGMENTS && optimizer->step == 0);
+    OptimizerSegment* segment = &optimizer->segments[optimizer->numSegments++];
+    segment->params = params;
+    segment->grads = grads;
+    segment->size = size;
+    segment->offset = optimizer->size;
+    optimizer->size += size;
+
+    int slots = stateSlots(optimizer->config.type);
+    if (slots == 0) return;
+    arenaFree(&optimizer->arena);
+    for (int pass=0; pass<2; pass++) {
+        for (int s=0; s<slots; s++) {
+            optimizer->state[s] = arenaAlloc(&optimizer->arena, optimizer->size);
+        }
+        if (pass == 0) arenaInit(&optimizer->arena, optimizer->arena.used);
+    }
+}
+
+/*
+ * printOptimizer()
+ * One line with the rule, its settings and the schedule.
+ */
+void printOptimizer(Optimizer* optimizer) {
+    OptimizerConfig* config = &optimizer->config;
+    printf("Optimizer: %s, lr %g", typeNames[config->type], config->learningRate);
+    if (config->type == OPTIMIZER_MOMENTUM || config->type == OPTIMIZER_NESTEROV) {
+        printf(", momentum %g", config->momentum);
+    } else if (config->type >= OPTIMIZER_ADAM) {
+        printf(", betas %g/%g, eps %g", config->momentum, config->beta2, config->epsilon);
+    }
+    if (config->weightDecay > 0.0) {
+        printf(", weight decay %g", config->weightDecay);
+    }
+    if (config->schedule == SCHEDULE_STEP) {
+        printf(", x%g every %d epoch(s)", config->gamma, config->decayEpochs);
+    } else if (config->schedule == SCHEDULE_COSINE) {
+        printf(", cosine decay");
+    }
+    if (config->warmup > 0) {
+        printf(", %ld warm-up steps", config->warmup);
+    }
+    printf(" (%zu parameters, %.1f KB of state)\n", optimizer->size, optimizer->arena.capacity * sizeof(real) / 1e3);
+}
+
+/*
+ * optimizerPlan()
+ * Tells the schedule how long an epoch and the run are.
+ * Without it step decay and cosine decay keep the base rate.
+ */
+void optimizerPlan(Optimizer* optimizer, long stepsPerEpoch, int epochs) {
+    optimizer->stepsPerEpoch = stepsPerEpoch;
+    optimizer->totalSteps = optimizer->step + stepsPerEpoch * epochs;
+}
+
+/*
+ * optimizerRate()
+ * The scheduled learning rate of (0-based) step `step`: linear
+ * warm-up over the first `warmup` steps, times the decay.
+ */
+double optimizerRate(Optimizer* optimizer, long step) {
+    OptimizerConfig* config = &optimizer->config;
+    double rate = config->learningRate;
+    if (step < config->warmup) {
+        rate *= (double)(step + 1) / config->warmup;
+    }
+    if (config->schedule == SCHEDULE_STEP && optimizer->stepsPerEpoch > 0) {
+        rate *= pow(config->gamma, (double)(step / (optimizer->stepsPerEpoch * config->decayEpochs)));
+    } else if (config->schedule == SCHEDULE_COSINE && optimizer->totalSteps > config->warmup) {
+        double progress = (double)(step - config->warmup) / (optimizer->totalSteps - config->warmup);
+        if (progress < 0.0) progress = 0.0;
+        if (progress > 1.0) progress = 1.0;
+        rate *= 0.5 * (1.0 + cos(3.14159265358979323846 * progress));
+    }
+    return rate;
+}
+
+/*
+ * prepareStep()
+ * Fills optimizer->update for the 1-based step `t`.
+ */
+static void prepareStep(Optimizer* optimizer, long t, int batchSize) {
+    OptimizerConfig* config = &optimizer->config;
+    UpdateStep* update = &optimizer->update;
+    double rate = optimizer->rate;
+
+    memset(update, 0, sizeof(UpdateStep));
+    update->gradScale = 1.0 / batchSize;
+    update->decay = config->weightDecay;
+    update->momentum = config->momentum;
+    update->shrink = 1.0;
+    switch (config->type) {
+    case OPTIMIZER_SGD:
+        update->rate = rate;
+        break;
+    case OPTIMIZER_MOMENTUM:
+        update->velocityStep = rate;
+        break;
+    case OPTIMIZER_NESTEROV:
+        update->gradStep = rate;
+        update->velocityStep = rate * config->momentum;
+        break;
+    case OPTIMIZER_ADAMW:
+        update->decay = 0.0;
+        update->shrink = 1.0 - rate * config->weightDecay;
+        /* fall through */
+    case OPTIMIZER_ADAM:
+        update->beta2 = config->beta2;
+        update->rate = rate / (1.0 - pow(config->momentum, (double)t));
+        update->rootCorrection = 1.0 / sqrt(1.0 - pow(config->beta2, (double)t));
+        update->epsilon = config->epsilon;
+        break;
+    }
+}
+
+/*
+ * updateRange()
+ * Applies the prepared step to elements [lo, hi) of the
+ * concatenated parameter space.
+ */
+static void updateRange(Optimizer* optimizer, size_t lo, size_t hi) {
+    const UpdateStep* update = &optimizer->update;
+    for (int s=0; s<optimizer->numSegments; s++) {
+        OptimizerSegment* segment = &optimizer->segments[s];
+        size_t start = lo > segment->offset ? lo : segment->offset;
+        size_t end = hi < segment->offset + segment->size ? hi : segment->offset + segment->size;
+        if (start >= end) continue;
+
+        real* w = segment->params + (start - segment->offset);
+        const real* g = segment->grads + (start - segment->offset);
+        int n = (int)(end - start);
+        switch (optimizer->config.type) {
+        case OPTIMIZER_SGD:
+            simd->sgdUpdate(update, g, w, n);
+            break;
+        case OPTIMIZER_MOMENTUM:
+        case OPTIMIZER_NESTEROV:
+            simd->momentumUpdate(update, g, optimizer->state[0] + start, w, n);
+            break;
+        case OPTIMIZER_ADAM:
+        case OPTIMIZER_ADAMW:
+            simd->adamUpdate(update, g, optimizer->state[0] + start, optimizer->state[1] + start, w, n);
+            break;
+        }
+    }
+}
+
+/*
+ * updateTask()
+ * Task `task` of an n-way split: a share of the range whose
+ * ends fall on cache-line multiples.
+ */
+static void updateTask(void* context, int task, int thread) {
+    Optimizer* optimizer = context;
+    int n = threadPoolSize(optimizer->pool);
+    size_t align = TENSOR_ALIGNMENT / sizeof(real);
+    size_t lo = optimizer->size * task / n / align * align;
+    size_t hi = task == n - 1 ? optimizer->size : optimizer->size * (task + 1) / n / align * align;
+    (void)thread;
+    updateRange(optimizer, lo, hi);
+}
+
+/*
+ * optimizerStep()
+ * Updates every registered block from its gradients, summed
+ * over `batchSize` images, at the scheduled rate.
+ */
+void optimizerStep(Optimizer* optimizer, int batchSize) {
+    optimizer->rate = optimizerRate(optimizer, optimizer->step);
+    prepareStep(optimizer, ++optimizer->step, batchSize);
+
+    if (optimizer->pool != NULL && threadPoolSize(optimizer->pool) > 1 && optimizer->size >= OPTIMIZER_PARALLEL_MIN) {
+        threadPoolRun(optimizer->pool, updateTask, optimizer, threadPoolSize(optimizer->pool));
+    } else {
+        updateRange(optimizer, 0, optimizer->size);
+    }
+}
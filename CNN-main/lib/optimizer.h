@@ -0,0 +1,94 @@
+/*
+ * optimizer.h — parameter update rules and learning-rate schedules
+ * ----------------------------------------------------------------
+ * An Optimizer owns the update of a set of parameter blocks
+ * from their summed mini-batch gradients: plain SGD, SGD with
+ * classical or Nesterov momentum, Adam and AdamW, each with an
+ * optional L2 weight decay, warm-up and step or cosine decay
+ * of the learning rate. Its state (velocities, Adam moments)
+ * lives in one block laid out parallel to the parameters, and
+ * a step is a single fused SIMD pass per block (see
+ * UpdateStep in simd.h), split across a thread pool when the
+ * model is large enough for that to pay off.
+ */
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "tensor.h"
+#include "simd.h"
+#include "threadpool.h"
+
+#define OPTIMIZER_MAX_SEGMENTS 8
+#define OPTIMIZER_PARALLEL_MIN 65536    /* parameters before a step is split across threads */
+
+typedef enum {
+    OPTIMIZER_SGD,
+    OPTIMIZER_MOMENTUM,
+    OPTIMIZER_NESTEROV,
+    OPTIMIZER_ADAM,
+    OPTIMIZER_ADAMW
+} OptimizerType;
+
+typedef enum {
+    SCHEDULE_CONSTANT,
+    SCHEDULE_STEP,          /* × gamma every decayEpochs epochs */
+    SCHEDULE_COSINE         /* cosine from the base rate to 0 over the run */
+} ScheduleType;
+
+typedef struct {
+    OptimizerType type;
+    double learningRate;    /* 0 = the type's default */
+    double momentum;        /* μ, or Adam's β1 */
+    double beta2;
+    double epsilon;
+    double weightDecay;     /* L2 for SGD/momentum/Adam, decoupled for AdamW */
+    ScheduleType schedule;
+    int decayEpochs;
+    double gamma;
+    long warmup;            /* steps of linear warm-up */
+} OptimizerConfig;
+
+/*
+ * OptimizerSegment: one parameter block, its gradient block
+ * and its offset into each state buffer.
+ */
+typedef struct {
+    real* params;
+    const real* grads;
+    size_t size;
+    size_t offset;
+} OptimizerSegment;
+
+typedef struct {
+    OptimizerConfig config;
+    OptimizerSegment segments[OPTIMIZER_MAX_SEGMENTS];
+    int numSegments;
+    size_t size;            /* parameters over all segments */
+    real* state[2];         /* velocity / Adam m and v, [size] each */
+    Arena arena;
+    ThreadPool* pool;       /* NULL = single-threaded */
+    long step;
+    long totalSteps;        /* set by optimizerPlan() */
+    long stepsPerEpoch;
+    double rate;            /* learning rate of the last step */
+    UpdateStep update;      /* step in progress */
+} Optimizer;
+
+void defaultOptimizerConfig(OptimizerConfig* config);
+int parseOptimizerType(const char* name, OptimizerConfig* config);
+int parseSchedule(const char* spec, OptimizerConfig* config);
+
+Optimizer* initOptimizer(const OptimizerConfig* config, ThreadPool* pool);
+void freeOptimizer(Optimizer* optimizer);
+void optimizerAdd(Optimizer* optimizer, real* params, const real* grads, size_t size);
+void printOptimizer(Optimizer* optimizer);
+void optimizerPlan(Optimizer* optimizer, long stepsPerEpoch, int epochs);
+double optimizerRate(Optimizer* optimizer, long step);
+void optimizerStep(Optimizer* optimizer, int batchSize);
+
+#endif
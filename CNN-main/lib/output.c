@@ -1,51 +1,95 @@
 /*
  * output.c — Softmax + metrics helpers
  * ------------------------------------
- * Final activation layer and training metrics.
- * Nothing fancy, just exponential + normalisation
- * and a couple of convenience routines.
+ * Final activation layer, its fused cross-entropy
+ * gradient and training metrics. Nothing fancy, just
+ * exponential + normalisation and a couple of
+ * convenience routines.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <math.h>
 #include <assert.h>
 
+#include "simd.h"
 #include "dense.h"
 
 /*
  * softmax()
- * Converts raw logits into a probability distribution.
+ * Converts raw logits into a probability distribution,
+ * written to `output`. The largest logit is subtracted first,
+ * so exp() never overflows however large the logits grow.
  */
-double* softmax(double* input, int size) {
-    double* output = malloc(size * sizeof(double));
-    assert(output != NULL);
-
-    double sum = 0.0;
+void softmax(real* input, real* output, int size) {
+    real max = input[0];
+    for (int i=1; i<size; i++) {
+        if (input[i] > max) max = input[i];
+    }
     for (int i=0; i<size; i++) {
-        sum += exp(input[i]);
+        output[i] = input[i] - max;
     }
+    simd->vexp(output, output, size);
 
+    real sum = 0.0;
     for (int i=0; i<size; i++) {
-        output[i] = exp(input[i]) / sum;
+        sum += output[i];
+    }
+    simd->scale(1.0 / sum, output, output, size);
+}
+
+/*
+ * softmaxBatch()
+ * Row-wise softmax of [count, classes] logits into `probs`.
+ */
+void softmaxBatch(Tensor* totals, Tensor* probs) {
+    assert(totals->ndim == 2 && probs->shape[1] == totals->shape[1] && probs->shape[0] >= totals->shape[0]);
+    for (int b=0; b<totals->shape[0]; b++) {
+        softmax(tensorSlice(totals, b), tensorSlice(probs, b), totals->shape[1]);
+    }
+}
+
+/*
+ * softmaxCrossEntropyBackward()
+ * Gradient of the cross-entropy loss through the softmax,
+ * w.r.t. the logits, for every image of the batch:
+ * dL/dtotals = probs - onehot(label). Uses the probabilities
+ * cached by the forward pass, so it needs no exp() and no
+ * temporaries. `grad` must have at least as many rows as
+ * there are `labels` (one per row of `probs`).
+ */
+void softmaxCrossEntropyBackward(Tensor* probs, const uint8_t* labels, int count, Tensor* grad) {
+    int classes = probs->shape[1];
+    assert(grad->shape[1] == classes && grad->shape[0] >= count && probs->shape[0] >= count);
+
+    for (int b=0; b<count; b++) {
+        const real* p = tensorSlice(probs, b);
+        real* g = tensorSlice(grad, b);
+        for (int i=0; i<classes; i++) {
+            g[i] = p[i] - (i == labels[b]);
+        }
     }
-    return output;
 }
 
 /*
  * loss()
- * Negative log-likelihood for the correct class.
+ * Negative log-likelihood for the correct class. A probability
+ * that underflowed to 0 counts as the smallest normal `real`,
+ * so one confident mistake cannot turn a running average into
+ * inf.
  */
-double loss(double* probs, int label) {
-    return -log(probs[label]);
+double loss(real* probs, int label) {
+    real p = probs[label] > REAL_MIN ? probs[label] : REAL_MIN;
+    return -log(p);
 }
 
 /*
  * accuracy()
  * Returns 1 if argmax(probs) equals the ground-truth label.
  */
-int accuracy(double* probs, int label, int size) {
-    double max = probs[0];
+int accuracy(real* probs, int label, int size) {
+    real max = probs[0];
     int index = 0;
     for (int i=0; i<size; i++) {
         if (probs[i] > max) {
@@ -56,4 +100,16 @@ int accuracy(double* probs, int label, int size) {
     
     if (index == label) return 1;
     else return 0;
-}
\ No newline at end of file
+}
+
+/*
+ * argmax()
+ * Index of the most probable class.
+ */
+int argmax(const real* probs, int size) {
+    int best = 0;
+    for (int i=1; i<size; i++) {
+        if (probs[i] > probs[best]) best = i;
+    }
+    return best;
+}
@@ -1,7 +1,8 @@
 /*
  * output.h — prototypes for softmax & metrics
  * ------------------------------------------
- * Defines softmax activation + loss/accuracy helpers.
+ * Defines softmax activation, its fused cross-entropy
+ * backward pass + loss/accuracy helpers.
  */
 
 #ifndef OUTPUT_H
@@ -9,11 +10,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <math.h>
 #include <assert.h>
 
-double* softmax(double* input, int size);
-double loss(double* probs, int label);
-int accuracy(double* probs, int label, int size);
+#include "tensor.h"
+
+void softmax(real* input, real* output, int size);
+void softmaxBatch(Tensor* totals, Tensor* probs);
+void softmaxCrossEntropyBackward(Tensor* probs, const uint8_t* labels, int count, Tensor* grad);
+double loss(real* probs, int label);
+int accuracy(real* probs, int label, int size);
+int argmax(const real* probs, int size);
 
 #endif
\ No newline at end of file
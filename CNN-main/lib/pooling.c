@@ -3,73 +3,99 @@
  * ----------------------------------------------
  * Down-samples each feature map by a factor of two
  * via max-pooling. Simple and fast; no trainable
- * parameters.
+ * parameters. Since max(relu(x)) = relu(max(x)), the
+ * optional ReLU is applied to the pooled values only.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <assert.h>
 
+#include "simd.h"
 #include "pooling.h"
 
-/*
- * tabMax()
- * Utility: returns the maximum value of an array
- * of length `size`. Used by the pooling layer.
- */
-double tabMax(double* tab, int size) {
-    double max = tab[0];
-    for (int i=0; i<size; i++) {
-        if (tab[i] > max) {
-            max = tab[i];
-        }
-    }
-    return max;
-}
-
 /*
  * poolingForward()
- * Performs 2×2 max-pooling on each filter channel.
- * The input is a flattened convolution grid where
- * every cell holds `numFilters` activations.
- * Returns a flat array that interleaves channels:
- *   [c0, c0, …, c1, c1, …]
+ * Performs 2×2, stride-2 max-pooling on each filter channel
+ * of a [numFilters, h, w] convolution output into `output`,
+ * a [numFilters, h/2, w/2] tensor; flattened, channels come
+ * one after another: [c0, c0, …, c1, c1, …]. With `relu` set
+ * the pooled values are clamped at 0.
+ *
+ * When `argmax` is given (training) it receives one code per
+ * pooled value telling poolingBackward() which pixel won; the
+ * first maximum wins ties, so gradient goes to exactly one
+ * place. Without it (inference) the SIMD kernel is used.
  */
-double* poolingForward(double** input, int width, int height, int numFilters) {
-    double** output = malloc(width * height * sizeof(double));
-    assert(output != NULL);
+void poolingForward(Tensor* input, Tensor* output, uint8_t* argmax, int relu) {
+    int numFilters = input->shape[0];
+    int inWidth = input->shape[2];
+    int height = output->shape[1];
+    int width = output->shape[2];
+    assert(output->shape[0] == numFilters && height == input->shape[1] / 2 && width == inWidth / 2);
 
-    for (int i=0; i<width*height; i++) {
-        output[i] = malloc(numFilters * sizeof(double));
-        assert(output[i] != NULL);
+    for (int k=0; k<numFilters; k++) {
+        real* plane = tensorSlice(input, k);
+        real* pooled = tensorSlice(output, k);
 
-        for (int k=0; k<numFilters; k++) {
-            double* cell = malloc(4 * sizeof(double));
-            assert(cell != NULL);
-
-            cell[0] = input[2*i][k];
-            cell[1] = input[2*i + 1][k];
-            cell[2] = input[2*i + width][k];
-            cell[3] = input[2*i + width + 1][k];
+        if (argmax == NULL) {
+            for (int i=0; i<height; i++) {
+                simd->maxPool(plane + (2*i) * inWidth, plane + (2*i + 1) * inWidth, pooled + i * width, width);
+            }
+            if (relu) {
+                for (int p=0; p<height*width; p++) {
+                    pooled[p] = pooled[p] > 0 ? pooled[p] : 0;
+                }
+            }
+            continue;
+        }
 
-            output[i][k] = tabMax(cell, 4);
-            free(cell);
+        uint8_t* index = argmax + (size_t)k * height * width;
+        for (int i=0; i<height; i++) {
+            for (int j=0; j<width; j++) {
+                const real* top = plane + (2*i) * inWidth + 2*j;
+                const real* bottom = top + inWidth;
+                real max = top[0];
+                uint8_t at = 0;
+                if (top[1] > max) { max = top[1]; at = 1; }
+                if (bottom[0] > max) { max = bottom[0]; at = 2; }
+                if (bottom[1] > max) { max = bottom[1]; at = 3; }
+                if (relu && !(max > 0)) { max = 0; at = POOL_NONE; }
+                pooled[i * width + j] = max;
+                index[i * width + j] = at;
+            }
         }
     }
+}
 
-    double* flatOutput = malloc(width * height * numFilters * sizeof(double));
-    assert(flatOutput != NULL);
+/*
+ * poolingBackward()
+ * Scatters the [numFilters, h/2, w/2] pooled gradient to the
+ * winning pixel of each window recorded by poolingForward();
+ * every other pixel of the [numFilters, h, w] `grad` gets 0.
+ * Only the rows of each plane need to be contiguous, so `grad`
+ * may be one image's planes inside a batch-wide buffer.
+ */
+void poolingBackward(Tensor* dL_dpooled, const uint8_t* argmax, Tensor* grad) {
+    int numFilters = grad->shape[0];
+    int inWidth = grad->shape[2];
+    int height = dL_dpooled->shape[1];
+    int width = dL_dpooled->shape[2];
 
-    for (int i=0; i<numFilters; i++) {
-        for (int j=0; j<width*height; j++) {
-            flatOutput[i*width*height+j] = output[j][i];
-        }
-    }
+    for (int k=0; k<numFilters; k++) {
+        const real* dPooled = tensorSlice(dL_dpooled, k);
+        const uint8_t* index = argmax + (size_t)k * height * width;
+        real* dConv = tensorSlice(grad, k);
+        memset(dConv, 0, grad->strides[1] * grad->shape[1] * sizeof(real));
 
-    for (int i=0; i<width*height; i++) {
-        free(output[i]);
+        for (int i=0; i<height; i++) {
+            for (int j=0; j<width; j++) {
+                uint8_t at = index[i * width + j];
+                if (at == POOL_NONE) continue;
+                dConv[(2*i + (at >> 1)) * inWidth + 2*j + (at & 1)] = dPooled[i * width + j];
+            }
+        }
     }
-    free(output);
-
-    return flatOutput;
-}
\ No newline at end of file
+}
@@ -1,8 +1,9 @@
 /*
  * pooling.h — interface for 2×2 max-pool layer
  * --------------------------------------------
- * Keeps it ultra-simple: only a single forward
- * routine, no trainable weights.
+ * Keeps it ultra-simple: a forward routine (with the
+ * optional ReLU folded in) and the matching backward
+ * scatter, no trainable weights.
  */
 
 #ifndef POOLING_H
@@ -10,8 +11,19 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 
-double* poolingForward(double** input, int width, int height, int numFilters);
+#include "tensor.h"
 
-#endif
\ No newline at end of file
+/*
+ * Argmax codes: 2·dy + dx of the winning pixel inside its
+ * 2×2 window, or POOL_NONE when ReLU clipped the window to 0
+ * and no gradient flows back.
+ */
+#define POOL_NONE 0xFF
+
+void poolingForward(Tensor* input, Tensor* output, uint8_t* argmax, int relu);
+void poolingBackward(Tensor* dL_dpooled, const uint8_t* argmax, Tensor* grad);
+
+#endif
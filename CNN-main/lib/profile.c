@@ -0,0 +1,278 @@
+/*
+ * profile.c — hot-path instrumentation
+ * ------------------------------------
+ * Each thread gets a ProfileThread block on its first record,
+ * linked into a global registry under a mutex (the only lock,
+ * taken once per thread). Counters are only ever written by
+ * their owner, with relaxed atomic load/store pairs, so
+ * updates are plain adds and a snapshot from another thread
+ * reads torn-free values. Blocks outlive their threads, so
+ * the work of short-lived pools still shows up in the totals.
+ *
+ * While tracing, every record also lands in the thread's ring
+ * of PROFILE_TRACE_EVENTS events; profileWriteTrace() dumps
+ * all rings as "complete" events in the Chrome trace format,
+ * which chrome://tracing and ui.perfetto.dev open directly.
+ * Call it while the worker threads are idle.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <assert.h>
+
+#include "tensor.h"
+#include "profile.h"
+
+typedef struct {
+    uint64_t start;
+    uint64_t duration;
+    int stage;
+} TraceEvent;
+
+/* aligned, so sizeof rounds up to whole cache lines and no
+   two threads' blocks share one */
+typedef struct ProfileThread {
+    _Alignas(TENSOR_ALIGNMENT) _Atomic uint64_t nanos[PROFILE_STAGES];
+    _Atomic uint64_t calls[PROFILE_STAGES];
+    _Atomic uint64_t allocations;
+    _Atomic uint64_t allocatedBytes;
+    TraceEvent* events;         /* ring, allocated once tracing starts */
+    uint64_t numEvents;         /* recorded so far; the ring keeps the last PROFILE_TRACE_EVENTS */
+    atomic_int excluded;        /* left out of profileSnapshot() */
+    int id;
+    struct ProfileThread* next;
+} ProfileThread;
+
+_Static_assert(sizeof(ProfileThread) % TENSOR_ALIGNMENT == 0, "profile blocks must not share cache lines");
+
+#ifndef CNN_NO_PROFILE
+static const char* stageNames[PROFILE_STAGES] = {
+    "conv forward", "pool forward", "dense forward", "softmax",
+    "loss backward", "dense backward", "conv backward",
+    "gradient reduce", "weight update", "data wait",
+};
+
+static const char* stageLabels[PROFILE_STAGES] = {
+    "conv", "pool", "dense", "softmax", "loss'", "dense'", "conv'", "reduce", "update", "data",
+};
+#endif
+
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+static ProfileThread* registry = NULL;
+static int numThreads = 0;
+static _Thread_local ProfileThread* local = NULL;
+static atomic_int tracing = 0;
+static uint64_t traceOrigin = 0;
+
+/*
+ * profileNow()
+ * Monotonic clock in nanoseconds.
+ */
+uint64_t profileNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * profileSeconds()
+ * The same clock in seconds, for latencies and throughput.
+ */
+double profileSeconds(void) {
+    return profileNow() * 1e-9;
+}
+
+/*
+ * localThread()
+ * The calling thread's block, registered on first use. Not
+ * counted as an allocation: it is the counters' own storage.
+ */
+static ProfileThread* localThread(void) {
+    if (local != NULL) return local;
+    ProfileThread* thread = alignedAllocUncounted(sizeof(ProfileThread));
+    memset(thread, 0, sizeof(ProfileThread));
+
+    pthread_mutex_lock(&registryLock);
+    thread->id = numThreads++;
+    thread->next = registry;
+    registry = thread;
+    pthread_mutex_unlock(&registryLock);
+    local = thread;
+    return thread;
+}
+
+/* owner-only increment: no lock prefix, still race-free to read */
+static inline void bump(_Atomic uint64_t* counter, uint64_t amount) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+/*
+ * profileRecord()
+ * Charges the time since `start` (from profileNow()) to
+ * `stage` on the calling thread.
+ */
+void profileRecord(ProfileStage stage, uint64_t start) {
+    uint64_t end = profileNow();
+    ProfileThread* thread = localThread();
+    bump(&thread->nanos[stage], end - start);
+    bump(&thread->calls[stage], 1);
+
+    if (atomic_load_explicit(&tracing, memory_order_relaxed)) {
+        if (thread->events == NULL) {
+            thread->events = malloc(PROFILE_TRACE_EVENTS * sizeof(TraceEvent));
+            assert(thread->events != NULL);
+        }
+        TraceEvent* event = &thread->events[thread->numEvents++ % PROFILE_TRACE_EVENTS];
+        event->start = start;
+        event->duration = end - start;
+        event->stage = stage;
+    }
+}
+
+/*
+ * profileAllocation()
+ * Counts one allocation of `bytes` (called by alignedAlloc()).
+ */
+void profileAllocation(size_t bytes) {
+    ProfileThread* thread = localThread();
+    bump(&thread->allocations, 1);
+    bump(&thread->allocatedBytes, bytes);
+}
+
+/*
+ * profileExcludeThread()
+ * Leaves the calling thread's counters out of every later
+ * profileSnapshot(). There is no way back: a thread whose
+ * totals came and went would make the deltas in profileLog()
+ * jump.
+ */
+void profileExcludeThread(void) {
+    atomic_store_explicit(&localThread()->excluded, 1, memory_order_relaxed);
+}
+
+/*
+ * profileThreadExcluded()
+ * Whether the calling thread was excluded.
+ */
+int profileThreadExcluded(void) {
+    return local != NULL && atomic_load_explicit(&local->excluded, memory_order_relaxed);
+}
+
+/*
+ * profileSnapshot()
+ * Sums the counters of every thread not excluded into `totals`.
+ */
+void profileSnapshot(ProfileTotals* totals) {
+    memset(totals, 0, sizeof(*totals));
+    pthread_mutex_lock(&registryLock);
+    for (ProfileThread* thread = registry; thread != NULL; thread = thread->next) {
+        if (atomic_load_explicit(&thread->excluded, memory_order_relaxed)) continue;
+        for (int s=0; s<PROFILE_STAGES; s++) {
+            totals->nanos[s] += atomic_load_explicit(&thread->nanos[s], memory_order_relaxed);
+            totals->calls[s] += atomic_load_explicit(&thread->calls[s], memory_order_relaxed);
+        }
+        totals->allocations += atomic_load_explicit(&thread->allocations, memory_order_relaxed);
+        totals->allocatedBytes += atomic_load_explicit(&thread->allocatedBytes, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&registryLock);
+}
+
+/*
+ * profileLog()
+ * Prints one line with the time per image of every stage
+ * (summed over threads) since `previous`, images/sec over
+ * `seconds` and the allocations made in between; then stores
+ * the current totals in `previous`. Silent when profiling is
+ * compiled out.
+ */
+void profileLog(ProfileTotals* previous, int images, double seconds) {
+#ifndef CNN_NO_PROFILE
+    ProfileTotals now;
+    profileSnapshot(&now);
+    printf("    [profile] us/img:");
+    for (int s=0; s<PROFILE_STAGES; s++) {
+        if (now.calls[s] == previous->calls[s]) continue;
+        printf(" %s %.2f", stageLabels[s], (now.nanos[s] - previous->nanos[s]) * 1e-3 / images);
+    }
+    printf(" | %.0f img/s | %llu allocs (%llu B)\n", images / seconds,
+           (unsigned long long)(now.allocations - previous->allocations),
+           (unsigned long long)(now.allocatedBytes - previous->allocatedBytes));
+    *previous = now;
+#else
+    (void)previous;
+    (void)images;
+    (void)seconds;
+#endif
+}
+
+/*
+ * profileStartTrace()
+ * Starts keeping trace events; timestamps are relative to now.
+ */
+void profileStartTrace(void) {
+    traceOrigin = profileNow();
+    atomic_store(&tracing, 1);
+}
+
+/*
+ * profileWriteTrace()
+ * Writes the retained events of every thread as a Chrome
+ * trace JSON file. Returns 1 on success.
+ */
+int profileWriteTrace(const char* path) {
+#ifdef CNN_NO_PROFILE
+    fprintf(stderr, "%s: built with CNN_NO_PROFILE, no trace recorded\n", path);
+    return 0;
+#else
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "%s: cannot write trace\n", path);
+        return 0;
+    }
+
+    atomic_store(&tracing, 0);
+    pthread_mutex_lock(&registryLock);
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    int first = 1;
+    for (ProfileThread* thread = registry; thread != NULL; thread = thread->next) {
+        fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"thread %d\"}}",
+                first ? "" : ",\n", thread->id, thread->id);
+        first = 0;
+        if (thread->events == NULL) continue;
+
+        uint64_t kept = thread->numEvents < PROFILE_TRACE_EVENTS ? thread->numEvents : PROFILE_TRACE_EVENTS;
+        for (uint64_t i = thread->numEvents - kept; i < thread->numEvents; i++) {
+            TraceEvent* event = &thread->events[i % PROFILE_TRACE_EVENTS];
+            if (event->start < traceOrigin) continue;
+            fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                    stageNames[event->stage], thread->id, (event->start - traceOrigin) * 1e-3, event->duration * 1e-3);
+        }
+    }
+    fprintf(f, "\n]}\n");
+    pthread_mutex_unlock(&registryLock);
+    return fclose(f) == 0;
+#endif
+}
+
+/*
+ * profileShutdown()
+ * Frees every thread block. Only call once all instrumented
+ * threads are gone (at the end of main()).
+ */
+void profileShutdown(void) {
+    pthread_mutex_lock(&registryLock);
+    while (registry != NULL) {
+        ProfileThread* next = registry->next;
+        free(registry->events);
+        alignedFree(registry);
+        registry = next;
+    }
+    numThreads = 0;
+    local = NULL;
+    pthread_mutex_unlock(&registryLock);
+}
@@ -0,0 +1,73 @@
+/*
+ * profile.h — hot-path instrumentation
+ * ------------------------------------
+ * Per-stage wall time and call counts, allocation counters
+ * and an optional Chrome-trace/Perfetto event log. Every
+ * thread records into its own counters (no locks, no shared
+ * cache lines), and profileSnapshot() sums them on demand.
+ *
+ * Background work that should not count towards the training
+ * numbers (validation) runs on threads marked with
+ * profileExcludeThread(): they still show up in the trace but
+ * stay out of profileSnapshot().
+ *
+ * Instrumented code uses the PROFILE_* macros, which cost two
+ * clock reads per region. Building with -DCNN_NO_PROFILE
+ * compiles them out entirely.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+typedef enum {
+    PROFILE_CONV_FORWARD,
+    PROFILE_POOL_FORWARD,
+    PROFILE_DENSE_FORWARD,
+    PROFILE_SOFTMAX,
+    PROFILE_LOSS_BACKWARD,
+    PROFILE_DENSE_BACKWARD,
+    PROFILE_CONV_BACKWARD,      /* pooling backward + filter gradients */
+    PROFILE_REDUCE,             /* summing the workers' gradients */
+    PROFILE_UPDATE,             /* applying them to the weights */
+    PROFILE_DATA,               /* waiting for the next batch */
+    PROFILE_STAGES
+} ProfileStage;
+
+typedef struct {
+    uint64_t nanos[PROFILE_STAGES];
+    uint64_t calls[PROFILE_STAGES];
+    uint64_t allocations;
+    uint64_t allocatedBytes;
+} ProfileTotals;
+
+/* events kept per thread for the trace; older ones are overwritten */
+#define PROFILE_TRACE_EVENTS (1 << 16)
+
+#ifdef CNN_NO_PROFILE
+#define PROFILE_BEGIN(start)
+#define PROFILE_END(stage, start)
+#define PROFILE_ALLOCATION(bytes)
+#else
+#define PROFILE_BEGIN(start) uint64_t start = profileNow()
+#define PROFILE_END(stage, start) profileRecord((stage), (start))
+#define PROFILE_ALLOCATION(bytes) profileAllocation(bytes)
+#endif
+
+uint64_t profileNow(void);
+double profileSeconds(void);
+void profileRecord(ProfileStage stage, uint64_t start);
+void profileAllocation(size_t bytes);
+void profileExcludeThread(void);
+int profileThreadExcluded(void);
+void profileSnapshot(ProfileTotals* totals);
+void profileLog(ProfileTotals* previous, int images, double seconds);
+void profileStartTrace(void);
+int profileWriteTrace(const char* path);
+void profileShutdown(void);
+
+#endif
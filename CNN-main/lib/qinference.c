@@ -0,0 +1,209 @@
+/*
+ * qinference.c — int8 inference engine
+ * ------------------------------------
+ * Per image: pixels become 7-bit codes while being lowered
+ * into im2col columns (four taps per 32-bit group, the layout
+ * vpdpbusd consumes), each filter is one convU8 call giving
+ * int32 accumulators, ReLU and max-pool run on those exactly
+ * (every channel's scale is positive, so both commute with
+ * dequantization), and one multiply per pooled value
+ * requantizes it to an activation code for the int8 dense
+ * layer. Only the ten logits return to `real` for softmax.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "qinference.h"
+#include "simd.h"
+#include "output.h"
+#include "inference.h"
+
+static void layoutScratch(QuantScratch* scratch, QuantPredictor* predictor) {
+    QuantModel* model = predictor->model;
+    size_t pixels = (size_t)predictor->convWidth * predictor->convHeight;
+
+    scratch->image = arenaBytes(&scratch->arena, (size_t)predictor->width * predictor->height);
+    scratch->columns = arenaBytes(&scratch->arena, (size_t)model->quads * pixels * 4);
+    scratch->convoluted = arenaBytes(&scratch->arena, model->numFilters * pixels * sizeof(int32_t));
+    scratch->codes = arenaBytes(&scratch->arena, model->inputSize);
+    scratch->totals = arenaAlloc(&scratch->arena, model->classes);
+}
+
+/*
+ * initQuantPredictor()
+ * Starts a pool of `numThreads`, each with scratch for one
+ * `width`×`height` image.
+ */
+QuantPredictor* initQuantPredictor(QuantModel* model, int width, int height, int numThreads) {
+    QuantPredictor* predictor = malloc(sizeof(QuantPredictor));
+    assert(predictor != NULL && numThreads > 0);
+
+    predictor->model = model;
+    predictor->width = width;
+    predictor->height = height;
+    predictor->convWidth = width - (model->filterSize - 1);
+    predictor->convHeight = height - (model->filterSize - 1);
+    predictor->pooledWidth = predictor->convWidth / 2;
+    predictor->pooledHeight = predictor->convHeight / 2;
+    assert(predictor->pooledWidth * predictor->pooledHeight * model->numFilters == model->inputSize);
+    predictor->chunk = PREDICT_CHUNK;
+
+    predictor->pool = initThreadPool(numThreads);
+    predictor->scratch = malloc(numThreads * sizeof(QuantScratch*));
+    assert(predictor->scratch != NULL);
+    for (int t=0; t<numThreads; t++) {
+        QuantScratch* scratch = malloc(sizeof(QuantScratch));
+        assert(scratch != NULL);
+        arenaInit(&scratch->arena, 0);
+        layoutScratch(scratch, predictor);
+        arenaInit(&scratch->arena, scratch->arena.used);
+        layoutScratch(scratch, predictor);
+        predictor->scratch[t] = scratch;
+    }
+    return predictor;
+}
+
+/*
+ * freeQuantPredictor()
+ * Stops the pool and frees the scratch; the model stays.
+ */
+void freeQuantPredictor(QuantPredictor* predictor) {
+    for (int t=0; t<threadPoolSize(predictor->pool); t++) {
+        arenaFree(&predictor->scratch[t]->arena);
+        free(predictor->scratch[t]);
+    }
+    freeThreadPool(predictor->pool);
+    free(predictor->scratch);
+    free(predictor);
+}
+
+/*
+ * pixelCode: byte → 7-bit input code round(p·127/255), built
+ * at compile time like convolution.c's pixelValue table.
+ */
+#define CODE1(i) (uint8_t)(((i) * QUANT_CODE_MAX + 127) / 255)
+#define CODE4(i) CODE1(i), CODE1((i) + 1), CODE1((i) + 2), CODE1((i) + 3)
+#define CODE16(i) CODE4(i), CODE4((i) + 4), CODE4((i) + 8), CODE4((i) + 12)
+#define CODE64(i) CODE16(i), CODE16((i) + 16), CODE16((i) + 32), CODE16((i) + 48)
+static const uint8_t pixelCode[256] = { CODE64(0), CODE64(64), CODE64(128), CODE64(192) };
+
+/*
+ * im2colCodes()
+ * Lowers one image into [quads, pixels, 4] columns of pixel
+ * codes: the image is converted to codes once, then each
+ * group of four taps is gathered from it. Taps past
+ * filterSize² are masked to zero (as are their weights).
+ */
+static void im2colCodes(QuantPredictor* predictor, const uint8_t* image, QuantScratch* scratch) {
+    QuantModel* model = predictor->model;
+    int filterSize = model->filterSize;
+    int taps = filterSize * filterSize;
+    int width = predictor->width;
+    int outWidth = predictor->convWidth;
+    size_t pixels = (size_t)outWidth * predictor->convHeight;
+
+    for (int i=0; i<width*predictor->height; i++) {
+        scratch->image[i] = pixelCode[image[i]];
+    }
+
+    for (int q=0; q<model->quads; q++) {
+        int offsets[4];
+        uint8_t masks[4];
+        for (int t=0; t<4; t++) {
+            int k = 4*q + t;
+            offsets[t] = k < taps ? (k / filterSize) * width + k % filterSize : 0;
+            masks[t] = k < taps ? 0xFF : 0;
+        }
+        uint8_t* column = scratch->columns + q * pixels * 4;
+        for (int i=0; i<predictor->convHeight; i++) {
+            const uint8_t* src = scratch->image + (size_t)i * width;
+            uint8_t* dst = column + (size_t)i * outWidth * 4;
+            for (int j=0; j<outWidth; j++) {
+                dst[4*j] = src[j + offsets[0]] & masks[0];
+                dst[4*j + 1] = src[j + offsets[1]] & masks[1];
+                dst[4*j + 2] = src[j + offsets[2]] & masks[2];
+                dst[4*j + 3] = src[j + offsets[3]] & masks[3];
+            }
+        }
+    }
+}
+
+/*
+ * poolCodes()
+ * 2×2 max-pool (and ReLU) of one channel's accumulators,
+ * requantized to activation codes.
+ */
+static void poolCodes(QuantPredictor* predictor, const int32_t* conv, real requant, uint8_t* codes) {
+    QuantModel* model = predictor->model;
+    int convWidth = predictor->convWidth;
+
+    for (int i=0; i<predictor->pooledHeight; i++) {
+        const int32_t* row0 = conv + (size_t)(2*i) * convWidth;
+        const int32_t* row1 = row0 + convWidth;
+        for (int j=0; j<predictor->pooledWidth; j++) {
+            int32_t max = row0[2*j];
+            if (row0[2*j + 1] > max) max = row0[2*j + 1];
+            if (row1[2*j] > max) max = row1[2*j];
+            if (row1[2*j + 1] > max) max = row1[2*j + 1];
+            if (model->relu && max < 0) max = 0;
+
+            long code = lrint(max * requant) + model->activationZero;
+            codes[i * predictor->pooledWidth + j] = (uint8_t)(code < 0 ? 0 : code > QUANT_CODE_MAX ? QUANT_CODE_MAX : code);
+        }
+    }
+}
+
+/*
+ * scoreImage()
+ * Conv ➜ ReLU ➜ MaxPool ➜ Dense ➜ Softmax for one image in
+ * integer arithmetic, writing `classes` probabilities.
+ */
+static void scoreImage(QuantPredictor* predictor, QuantScratch* scratch, const uint8_t* image, real* probs) {
+    QuantModel* model = predictor->model;
+    int pixels = predictor->convWidth * predictor->convHeight;
+    int pooledSize = predictor->pooledWidth * predictor->pooledHeight;
+
+    im2colCodes(predictor, image, scratch);
+    for (int f=0; f<model->numFilters; f++) {
+        int32_t* conv = scratch->convoluted + (size_t)f * pixels;
+        simd->convU8(scratch->columns, model->filters + (size_t)f * model->quads * 4, model->quads, conv, pixels);
+        poolCodes(predictor, conv, model->requant[f], scratch->codes + (size_t)f * pooledSize);
+    }
+
+    for (int c=0; c<model->classes; c++) {
+        int32_t acc = simd->dotU8(scratch->codes, model->weights + (size_t)c * model->inputSize, model->inputSize);
+        acc -= model->activationZero * model->weightSums[c];
+        scratch->totals[c] = acc * model->activationScale * model->weightScales[c] + model->biases[c];
+    }
+    softmax(scratch->totals, probs, model->classes);
+}
+
+static void predictTask(void* context, int task, int thread) {
+    QuantPredictor* predictor = context;
+    QuantScratch* scratch = predictor->scratch[thread];
+    int classes = predictor->model->classes;
+    int start = task * predictor->chunk;
+    int end = predictor->count - start < predictor->chunk ? predictor->count : start + predictor->chunk;
+    size_t imageSize = (size_t)predictor->width * predictor->height;
+
+    for (int i=start; i<end; i++) {
+        scoreImage(predictor, scratch, predictor->images + i * imageSize, predictor->probs + (size_t)i * classes);
+    }
+}
+
+/*
+ * predictQuantized()
+ * Scores `count` consecutive images into the caller-owned
+ * [count, classes] `probs`.
+ */
+void predictQuantized(QuantPredictor* predictor, const uint8_t* images, int count, real* probs) {
+    if (count <= 0) return;
+    predictor->images = images;
+    predictor->probs = probs;
+    predictor->count = count;
+    threadPoolRun(predictor->pool, predictTask, predictor, (count + predictor->chunk - 1) / predictor->chunk);
+}
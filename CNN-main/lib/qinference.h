@@ -0,0 +1,58 @@
+/*
+ * qinference.h — int8 inference engine
+ * ------------------------------------
+ * Scores images with a QuantModel using integer convolution,
+ * pooling and dense kernels (simd->convU8 / simd->dotU8, VNNI
+ * where the CPU has it). Like the float Predictor it spreads
+ * the images over a thread pool and writes N×classes
+ * probabilities into a caller-supplied buffer.
+ */
+
+#ifndef QINFERENCE_H
+#define QINFERENCE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "tensor.h"
+#include "quantize.h"
+#include "threadpool.h"
+
+/*
+ * QuantScratch: single-image buffers of one thread, carved
+ * from one arena.
+ */
+typedef struct {
+    uint8_t* image;         /* [height·width] pixel codes */
+    uint8_t* columns;       /* [quads, convHeight·convWidth, 4] pixel codes */
+    int32_t* convoluted;    /* [numFilters, convHeight·convWidth] */
+    uint8_t* codes;         /* [inputSize] pooled activation codes */
+    real* totals;           /* [classes] */
+    Arena arena;
+} QuantScratch;
+
+typedef struct {
+    QuantModel* model;
+    ThreadPool* pool;
+    QuantScratch** scratch;     /* one per thread */
+    int width;                  /* input image */
+    int height;
+    int convWidth;
+    int convHeight;
+    int pooledWidth;
+    int pooledHeight;
+    int chunk;
+
+    /* job currently being scored */
+    const uint8_t* images;
+    real* probs;
+    int count;
+} QuantPredictor;
+
+QuantPredictor* initQuantPredictor(QuantModel* model, int width, int height, int numThreads);
+void freeQuantPredictor(QuantPredictor* predictor);
+void predictQuantized(QuantPredictor* predictor, const uint8_t* images, int count, real* probs);
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ * quantize.c — post-training int8 quantization
+ * --------------------------------------------
+ * Weights are quantized symmetrically per output channel,
+ * w ≈ scale·q with q in [-127, 127]. Pixels map to codes
+ * 0…127 (one fixed scale), and the pooled activations, the
+ * only other tensor that crosses a layer boundary, get an
+ * affine 7-bit code whose range is the min/max the float
+ * model produces on the calibration images. Everything else
+ * (conv accumulators, max-pool, ReLU, dense accumulators) is
+ * exact int32 arithmetic in the engine.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "quantize.h"
+#include "workspace.h"
+#include "inference.h"
+
+/*
+ * layoutQuantModel()
+ * Carves every array from the model's arena; run once to
+ * measure and once to allocate, like layoutWorkspace().
+ */
+static void layoutQuantModel(QuantModel* model) {
+    model->filters = arenaBytes(&model->arena, (size_t)model->numFilters * model->quads * 4);
+    model->filterScales = arenaAlloc(&model->arena, model->numFilters);
+    model->requant = arenaAlloc(&model->arena, model->numFilters);
+    model->weights = arenaBytes(&model->arena, (size_t)model->classes * model->inputSize);
+    model->weightScales = arenaAlloc(&model->arena, model->classes);
+    model->weightSums = arenaBytes(&model->arena, model->classes * sizeof(int32_t));
+    model->biases = arenaAlloc(&model->arena, model->classes);
+}
+
+/*
+ * quantizeRow()
+ * Symmetric int8 quantization of `n` values into `q`;
+ * returns the scale (1 for an all-zero row).
+ */
+static real quantizeRow(const real* values, int n, int8_t* q) {
+    real max = 0.0;
+    for (int i=0; i<n; i++) {
+        if (fabs(values[i]) > max) max = fabs(values[i]);
+    }
+    real scale = max > 0.0 ? max / QUANT_WEIGHT_MAX : 1.0;
+    for (int i=0; i<n; i++) {
+        q[i] = (int8_t)lrint(values[i] / scale);
+    }
+    return scale;
+}
+
+/*
+ * calibrate()
+ * Runs the float model over `count` images and returns the
+ * range of the pooled activations, widened to include 0 so
+ * that zero (and ReLU's floor) is exactly representable.
+ */
+static void calibrate(ConvLayer* convLayer, DenseLayer* denseLayer, const uint8_t* images, int count, int width, int height, real* low, real* high) {
+    Workspace* ws = initWorkspace(convLayer, denseLayer, width, height, PREDICT_CHUNK);
+    size_t imageSize = (size_t)width * height;
+    *low = 0.0;
+    *high = 0.0;
+
+    for (int start = 0; start < count; start += ws->batchSize) {
+        int chunk = count - start < ws->batchSize ? count - start : ws->batchSize;
+        forward(convLayer, denseLayer, ws, images + start * imageSize, chunk);
+        size_t values = (size_t)chunk * denseLayer->inputSize;
+        for (size_t i=0; i<values; i++) {
+            if (ws->pooled.data[i] < *low) *low = ws->pooled.data[i];
+            if (ws->pooled.data[i] > *high) *high = ws->pooled.data[i];
+        }
+    }
+    freeWorkspace(ws);
+}
+
+/*
+ * quantizeModel()
+ * Builds the int8 model from trained layers, calibrating the
+ * activation range on `count` `width`×`height` images (a few
+ * thousand training images are plenty).
+ */
+QuantModel* quantizeModel(ConvLayer* convLayer, DenseLayer* denseLayer, const uint8_t* images, int count, int width, int height) {
+    QuantModel* model = malloc(sizeof(QuantModel));
+    assert(model != NULL && count > 0);
+
+    int taps = convLayer->filterSize * convLayer->filterSize;
+    model->numFilters = convLayer->numFilters;
+    model->filterSize = convLayer->filterSize;
+    model->relu = convLayer->relu;
+    model->classes = denseLayer->size;
+    model->inputSize = denseLayer->inputSize;
+    model->quads = (taps + 3) / 4;
+
+    arenaInit(&model->arena, 0);
+    layoutQuantModel(model);
+    arenaInit(&model->arena, model->arena.used);
+    layoutQuantModel(model);
+
+    real low, high;
+    calibrate(convLayer, denseLayer, images, count, width, height, &low, &high);
+    model->inputScale = 1.0 / QUANT_CODE_MAX;
+    model->activationScale = high > low ? (high - low) / QUANT_CODE_MAX : 1.0;
+    model->activationZero = (int)lrint(-low / model->activationScale);
+
+    for (int f=0; f<model->numFilters; f++) {
+        int8_t* q = model->filters + (size_t)f * model->quads * 4;
+        model->filterScales[f] = quantizeRow(tensorSlice(convLayer->filters, f), taps, q);
+        model->requant[f] = model->inputScale * model->filterScales[f] / model->activationScale;
+    }
+
+    for (int c=0; c<model->classes; c++) {
+        int8_t* q = model->weights + (size_t)c * model->inputSize;
+        model->weightScales[c] = quantizeRow(tensorSlice(denseLayer->weights, c), model->inputSize, q);
+        model->weightSums[c] = 0;
+        for (int i=0; i<model->inputSize; i++) {
+            model->weightSums[c] += q[i];
+        }
+        model->biases[c] = denseLayer->biases->data[c];
+    }
+    return model;
+}
+
+void freeQuantModel(QuantModel* model) {
+    arenaFree(&model->arena);
+    free(model);
+}
+
+/*
+ * quantWeightBytes()
+ * Bytes of int8 weights (filters and dense matrix), for
+ * comparing with the float model's footprint.
+ */
+size_t quantWeightBytes(QuantModel* model) {
+    return (size_t)model->numFilters * model->quads * 4 + (size_t)model->classes * model->inputSize;
+}
@@ -0,0 +1,58 @@
+/*
+ * quantize.h — post-training int8 quantization
+ * --------------------------------------------
+ * Turns a trained ConvLayer/DenseLayer pair into a QuantModel:
+ * int8 filters and dense weights with one scale per output
+ * channel, plus an activation scale and zero point calibrated
+ * by running the float model over a sample of images. The
+ * model is scored by the integer engine in qinference.h.
+ */
+
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "tensor.h"
+#include "convolution.h"
+#include "dense.h"
+
+/* largest activation code: 7 bits keep u8·s8 pair sums inside int16 */
+#define QUANT_CODE_MAX 127
+/* largest weight magnitude (symmetric int8) */
+#define QUANT_WEIGHT_MAX 127
+/* images the float model scores to calibrate activations */
+#define QUANT_CALIBRATION 2048
+
+typedef struct {
+    int numFilters;
+    int filterSize;
+    int relu;
+    int classes;
+    int inputSize;          /* pooled activations per image */
+    int quads;              /* filter taps in groups of four, zero-padded */
+
+    real inputScale;        /* value of one pixel code */
+    int8_t* filters;        /* [numFilters, quads·4] */
+    real* filterScales;     /* [numFilters] */
+
+    real activationScale;   /* value of one pooled activation code */
+    int activationZero;     /* code that represents 0.0 */
+    real* requant;          /* [numFilters] conv accumulator → activation code */
+
+    int8_t* weights;        /* [classes, inputSize] */
+    real* weightScales;     /* [classes] */
+    int32_t* weightSums;    /* [classes] row sums, fold out the zero point */
+    real* biases;           /* [classes] */
+
+    Arena arena;            /* backs every array above */
+} QuantModel;
+
+QuantModel* quantizeModel(ConvLayer* convLayer, DenseLayer* denseLayer, const uint8_t* images, int count, int width, int height);
+void freeQuantModel(QuantModel* model);
+size_t quantWeightBytes(QuantModel* model);
+
+#endif
@@ -0,0 +1,199 @@
+/*
+ * random.c — counter-based random numbers
+ * ---------------------------------------
+ * Philox4x32-10 (Salmon et al., "Parallel random numbers: as
+ * easy as 1, 2, 3", SC11): ten rounds of two 32×32→64-bit
+ * multiplies and a key-dependent xor, mapping the counter
+ * (block, stream) under the key `seed` to 128 random bits.
+ * The integer part is exact, so a seed gives the same bits on
+ * every machine; the Gaussians also go through the SIMD
+ * boxMuller kernel, whose last bits follow the kernel table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "simd.h"
+#include "random.h"
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u   /* key schedule: golden ratio */
+#define PHILOX_W1 0xBB67AE85u   /* and √3 - 1 */
+#define PHILOX_ROUNDS 10
+
+/*
+ * philox()
+ * The four words of block `block` of `stream` under `seed`.
+ */
+void philox(uint64_t seed, uint64_t stream, uint64_t block, uint32_t out[4]) {
+    uint32_t c0 = (uint32_t)block;
+    uint32_t c1 = (uint32_t)(block >> 32);
+    uint32_t c2 = (uint32_t)stream;
+    uint32_t c3 = (uint32_t)(stream >> 32);
+    uint32_t k0 = (uint32_t)seed;
+    uint32_t k1 = (uint32_t)(seed >> 32);
+
+    for (int r=0; r<PHILOX_ROUNDS; r++) {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        c1 = (uint32_t)p1;
+        c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c3 = (uint32_t)p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+/*
+ * toUniform()
+ * The top bits of `bits` as a uniform real in [0, 1): a
+ * multiple of 2^-53 (float64) or 2^-24 (float32), so the
+ * conversion is exact and never rounds up to 1.
+ */
+static real toUniform(uint64_t bits) {
+#ifdef CNN_FLOAT32
+    return (real)(bits >> 40) * 0x1.0p-24f;
+#else
+    return (real)(bits >> 11) * 0x1.0p-53;
+#endif
+}
+
+static uint64_t joinWords(const uint32_t* words) {
+    return (uint64_t)words[0] << 32 | words[1];
+}
+
+/*
+ * randomBits()
+ * 64-bit sample `index` of a stream.
+ */
+uint64_t randomBits(uint64_t seed, uint64_t stream, uint64_t index) {
+    uint32_t words[4];
+    philox(seed, stream, index / 2, words);
+    return joinWords(words + 2 * (index % 2));
+}
+
+/*
+ * randomBelow()
+ * Sample `index` mapped onto 0 … n-1 by a multiply and shift
+ * (bias below n / 2^32, far under anything a shuffle shows).
+ */
+uint32_t randomBelow(uint64_t seed, uint64_t stream, uint64_t index, uint32_t n) {
+    return (uint32_t)(((randomBits(seed, stream, index) >> 32) * n) >> 32);
+}
+
+/*
+ * randomBetween()
+ * Uniform sample `index` scaled to [low, high).
+ */
+real randomBetween(uint64_t seed, uint64_t stream, uint64_t index, real low, real high) {
+    return low + (high - low) * toUniform(randomBits(seed, stream, index));
+}
+
+/*
+ * randomUniform()
+ * out[i] = uniform sample first + i in [0, 1).
+ */
+void randomUniform(uint64_t seed, uint64_t stream, uint64_t first, real* out, size_t n) {
+    uint32_t words[4];
+    for (size_t i=0; i<n; i++) {
+        uint64_t index = first + i;
+        if (i == 0 || index % 2 == 0) philox(seed, stream, index / 2, words);
+        out[i] = toUniform(joinWords(words + 2 * (index % 2)));
+    }
+}
+
+/*
+ * randomGaussian()
+ * out[i] = standard normal sample first + i. Pairs are built
+ * RANDOM_CHUNK at a time: Philox gives each pair's two
+ * uniforms, one boxMuller call turns all of them into
+ * Gaussians, and the ones inside [first, first + n) are kept.
+ */
+void randomGaussian(uint64_t seed, uint64_t stream, uint64_t first, real* out, size_t n) {
+    real u[RANDOM_CHUNK];
+    real v[RANDOM_CHUNK];
+    real z[2][RANDOM_CHUNK];
+    uint64_t end = first + n;
+
+    for (uint64_t pair = first / 2; 2 * pair < end; pair += RANDOM_CHUNK) {
+        uint64_t pairs = (end + 1) / 2 - pair;
+        int count = pairs < RANDOM_CHUNK ? (int)pairs : RANDOM_CHUNK;
+        for (int i=0; i<count; i++) {
+            uint32_t words[4];
+            philox(seed, stream, pair + i, words);
+            u[i] = toUniform(joinWords(words));
+            v[i] = toUniform(joinWords(words + 2));
+        }
+        simd->boxMuller(u, v, z[0], z[1], count);
+
+        for (int i=0; i<count; i++) {
+            for (int k=0; k<2; k++) {
+                uint64_t index = 2 * (pair + i) + k;
+                if (index >= first && index < end) out[index - first] = z[k][i];
+            }
+        }
+    }
+}
+
+/*
+ * randomSelfTest()
+ * Philox against the published known-answer vectors, the
+ * Gaussian sampler against itself drawn in odd-sized pieces
+ * (must match bit for bit) and its first two moments.
+ * Returns the number of failures.
+ */
+int randomSelfTest(void) {
+    static const uint64_t vectors[][3] = {
+        {0, 0, 0},
+        {0x299f31d0a4093822ull, 0x0370734413198a2eull, 0x85a308d3243f6a88ull},
+    };
+    static const uint32_t answers[][4] = {
+        {0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u},
+        {0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u},
+    };
+    enum { SAMPLES = 1 << 16, PIECES = 1000 };
+    int failures = 0;
+
+    for (int i=0; i<2; i++) {
+        uint32_t words[4];
+        philox(vectors[i][0], vectors[i][1], vectors[i][2], words);
+        int ok = memcmp(words, answers[i], sizeof(words)) == 0;
+        printf("Random self-test: philox4x32-10 vector %d %s\n", i, ok ? "ok" : "FAILED");
+        failures += !ok;
+    }
+
+    real* whole = malloc(SAMPLES * sizeof(real));
+    real* pieces = malloc(PIECES * sizeof(real));
+    assert(whole != NULL && pieces != NULL);
+    randomGaussian(7, RANDOM_GRADCHECK, 3, whole, SAMPLES);
+    for (int start=0; start<PIECES; start += 37) {
+        int count = PIECES - start < 37 ? PIECES - start : 37;
+        randomGaussian(7, RANDOM_GRADCHECK, 3 + start, pieces + start, count);
+    }
+    int ok = memcmp(whole, pieces, PIECES * sizeof(real)) == 0;
+
+    double sum = 0.0;
+    double squares = 0.0;
+    for (int i=0; i<SAMPLES; i++) {
+        sum += whole[i];
+        squares += (double)whole[i] * whole[i];
+    }
+    double mean = sum / SAMPLES;
+    double variance = squares / SAMPLES - mean * mean;
+    ok = ok && fabs(mean) < 0.02 && fabs(variance - 1.0) < 0.03;
+    printf("Random self-test: gaussian (%s) mean %+.4f variance %.4f %s\n", simd->name, mean, variance, ok ? "ok" : "FAILED");
+    failures += !ok;
+
+    free(pieces);
+    free(whole);
+    return failures;
+}
@@ -0,0 +1,68 @@
+/*
+ * random.h — counter-based random numbers
+ * ---------------------------------------
+ * Every random number in the program (training, self-test
+ * fixtures, synthetic benchmark data) comes from Philox4x32-10,
+ * a keyed bijection on 128-bit counters: sample `index` of
+ * stream `stream` under `seed` is a pure function of those
+ * three values. There is no generator state, so any thread
+ * can draw any sample on its own and a result never depends
+ * on how the work was split or in which order it ran.
+ *
+ * Block b of a stream gives four 32-bit words, i.e. uniform
+ * samples 2b and 2b+1 (64 bits each) or the Gaussian pair
+ * 2b, 2b+1 (Box-Muller over that block's two uniforms, via
+ * the SIMD boxMuller kernel).
+ */
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "tensor.h"
+
+#define RANDOM_CHUNK 64     /* Gaussian pairs transformed per kernel call */
+#define RANDOM_TEST_SEED 0x5eedu    /* self-tests use a fixed seed, so a failure reproduces */
+
+/*
+ * RandomStream: one per use, so no two consumers of the same
+ * seed ever see the same numbers. A use with many independent
+ * parts (one per layer, epoch, …) adds the part number shifted
+ * into the upper 32 bits with RANDOM_PART().
+ */
+typedef enum {
+    RANDOM_CONV_INIT = 1,
+    RANDOM_DENSE_INIT,
+    RANDOM_NETWORK_INIT,    /* + layer */
+    RANDOM_SHUFFLE,         /* + epoch */
+    RANDOM_GRADCHECK,
+    RANDOM_AUGMENT,         /* + epoch */
+    RANDOM_SELFTEST,        /* + fixture */
+    RANDOM_SYNTHETIC        /* bench and loadgen inputs */
+} RandomStream;
+
+/* parts of RANDOM_SELFTEST, one per self-test fixture */
+typedef enum {
+    RANDOM_FIXTURE_UPDATES,
+    RANDOM_FIXTURE_BOX_MULLER,
+    RANDOM_FIXTURE_BILINEAR,
+    RANDOM_FIXTURE_KERNELS,
+    RANDOM_FIXTURE_WINOGRAD,
+    RANDOM_FIXTURE_AUGMENT
+} RandomFixture;
+
+#define RANDOM_PART(stream, part) ((uint64_t)(stream) | (uint64_t)(uint32_t)(part) << 32)
+
+void philox(uint64_t seed, uint64_t stream, uint64_t block, uint32_t out[4]);
+uint64_t randomBits(uint64_t seed, uint64_t stream, uint64_t index);
+uint32_t randomBelow(uint64_t seed, uint64_t stream, uint64_t index, uint32_t n);
+real randomBetween(uint64_t seed, uint64_t stream, uint64_t index, real low, real high);
+void randomUniform(uint64_t seed, uint64_t stream, uint64_t first, real* out, size_t n);
+void randomGaussian(uint64_t seed, uint64_t stream, uint64_t first, real* out, size_t n);
+int randomSelfTest(void);
+
+#endif
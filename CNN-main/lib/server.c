@@ -0,0 +1,573 @@
+/*
+ * server.c — local inference server
+ * ---------------------------------
+ * Threads: the caller of runServer() accepts connections; each
+ * connection gets a reader thread that queues one Request per
+ * image (the Request lives on that thread's stack) and sleeps
+ * until it is answered; one dispatcher thread cuts the queue
+ * into micro-batches and runs them through predict(), whose
+ * pool threads do the scoring. The queue, the answers and the
+ * client list share one mutex; statistics are only touched by
+ * the dispatcher.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <assert.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#endif
+
+#include "server.h"
+#include "inference.h"
+#include "profile.h"
+
+#ifndef _WIN32
+
+typedef struct Request {
+    const uint8_t* image;
+    float* probs;
+    double arrival;         /* monotonic seconds */
+    int done;
+    struct Request* next;
+} Request;
+
+struct Server {
+    char* address;
+    int tcp;
+    int listenFd;
+    int width;
+    int height;
+    int classes;
+    size_t imageSize;
+    int maxBatch;
+    double maxLatency;      /* seconds */
+    Predictor* predictor;
+    uint8_t* images;        /* [maxBatch, imageSize] */
+    real* probs;            /* [maxBatch, classes] */
+    Request** batch;        /* [maxBatch] */
+
+    pthread_t dispatcher;
+    pthread_mutex_t lock;
+    pthread_cond_t arrived;
+    pthread_cond_t answered;
+    pthread_cond_t closed;
+    Request* head;
+    Request* tail;
+    int depth;
+    int maxDepth;           /* since the last report */
+    int stopping;
+    int clients[SERVER_MAX_CLIENTS];
+    int numClients;
+
+    /* dispatcher only */
+    double latencies[SERVER_LATENCY_WINDOW];
+    int numLatencies;
+    long requests;
+    long batches;
+    long totalRequests;
+    long totalBatches;
+    double reportStart;
+    double started;
+};
+
+typedef struct {
+    Server* server;
+    int fd;
+} Connection;
+
+/* clock of the dispatcher's timed waits; macOS condition
+   variables cannot be switched off the wall clock */
+#ifdef __APPLE__
+#define WAIT_CLOCK CLOCK_REALTIME
+#else
+#define WAIT_CLOCK CLOCK_MONOTONIC
+#endif
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void onSignal(int signal) {
+    (void)signal;
+    interrupted = 1;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * readFull() / writeFull()
+ * Move exactly `size` bytes, retrying short transfers and
+ * signals; 0 on EOF or error.
+ */
+static int readFull(int fd, void* buffer, size_t size) {
+    uint8_t* p = buffer;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        p += n;
+        size -= n;
+    }
+    return 1;
+}
+
+static int writeFull(int fd, const void* buffer, size_t size) {
+    const uint8_t* p = buffer;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        p += n;
+        size -= n;
+    }
+    return 1;
+}
+
+/*
+ * isPort()
+ * An address of digits only is a TCP port on 127.0.0.1;
+ * anything else is a Unix socket path.
+ */
+static int isPort(const char* address) {
+    if (*address == '\0') return 0;
+    for (const char* c = address; *c; c++) {
+        if (*c < '0' || *c > '9') return 0;
+    }
+    return 1;
+}
+
+/*
+ * openSocket()
+ * Creates a socket for `address` and binds it (`serving`
+ * set) or connects to it. Returns the descriptor,
+ * or -1 after printing why.
+ */
+static int openSocket(const char* address, int serving) {
+    int tcp = isPort(address);
+    int fd = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    struct sockaddr_in inet;
+    struct sockaddr_un local;
+    struct sockaddr* addr;
+    socklen_t length;
+    if (tcp) {
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        memset(&inet, 0, sizeof(inet));
+        inet.sin_family = AF_INET;
+        inet.sin_port = htons((uint16_t)atoi(address));
+        inet.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr = (struct sockaddr*)&inet;
+        length = sizeof(inet);
+    } else {
+        if (strlen(address) >= sizeof(local.sun_path)) {
+            fprintf(stderr, "%s: socket path too long\n", address);
+            close(fd);
+            return -1;
+        }
+        memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        strcpy(local.sun_path, address);
+        addr = (struct sockaddr*)&local;
+        length = sizeof(local);
+        if (serving) unlink(address);
+    }
+
+    if ((serving ? bind(fd, addr, length) : connect(fd, addr, length)) != 0) {
+        fprintf(stderr, "%s: %s\n", address, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * report()
+ * Prints throughput, batch size, queue depth and request
+ * latency (queued → answered) since the last report, then
+ * starts a new window.
+ */
+static void report(Server* server, double now) {
+    double elapsed = now - server->reportStart;
+    int n = server->numLatencies;
+    qsort(server->latencies, n, sizeof(double), compareDoubles);
+    printf("[server] %8.0f req/s | %5.1f images/batch | queue depth %3d (max %3d) | latency p50 %7.3f ms p99 %7.3f ms\n",
+           server->requests / elapsed, server->batches > 0 ? (double)server->requests / server->batches : 0.0,
+           server->depth, server->maxDepth,
+           n > 0 ? server->latencies[n / 2] * 1e3 : 0.0, n > 0 ? server->latencies[(99 * n + 99) / 100 - 1] * 1e3 : 0.0);
+    fflush(stdout);
+    server->totalRequests += server->requests;
+    server->totalBatches += server->batches;
+    server->requests = 0;
+    server->batches = 0;
+    server->numLatencies = 0;
+    server->maxDepth = server->depth;
+    server->reportStart = now;
+}
+
+/*
+ * scoreBatch()
+ * Runs the `count` requests in server->batch through the
+ * model and writes their probabilities back. No lock held:
+ * the requests are off the queue and only the dispatcher
+ * touches them until they are marked done.
+ */
+static void scoreBatch(Server* server, int count) {
+    for (int b=0; b<count; b++) {
+        memcpy(server->images + b * server->imageSize, server->batch[b]->image, server->imageSize);
+    }
+    predict(server->predictor, server->images, count, server->probs);
+    for (int b=0; b<count; b++) {
+        const real* probs = server->probs + (size_t)b * server->classes;
+        for (int k=0; k<server->classes; k++) {
+            server->batch[b]->probs[k] = (float)probs[k];
+        }
+    }
+}
+
+/*
+ * dispatcherMain()
+ * Waits for a request, then for a full batch, a request from
+ * every client or the oldest request's deadline, whichever
+ * comes first, and scores what is queued. On
+ * shutdown the queue is drained before the thread exits.
+ */
+static void* dispatcherMain(void* arg) {
+    Server* server = arg;
+
+    pthread_mutex_lock(&server->lock);
+    for (;;) {
+        while (server->depth == 0 && !server->stopping) {
+            pthread_cond_wait(&server->arrived, &server->lock);
+        }
+        if (server->depth == 0) break;
+        /* a connection has at most one request in flight, so
+           once every client is queued nothing else can join */
+        while (server->depth < server->maxBatch && server->depth < server->numClients && !server->stopping) {
+            double remaining = server->head->arrival + server->maxLatency - profileSeconds();
+            if (remaining <= 0.0) break;
+            struct timespec deadline;
+            clock_gettime(WAIT_CLOCK, &deadline);
+            long nanos = deadline.tv_nsec + (long)(remaining * 1e9);
+            deadline.tv_sec += nanos / 1000000000L;
+            deadline.tv_nsec = nanos % 1000000000L;
+            pthread_cond_timedwait(&server->arrived, &server->lock, &deadline);
+        }
+
+        int count = 0;
+        while (server->head != NULL && count < server->maxBatch) {
+            server->batch[count++] = server->head;
+            server->head = server->head->next;
+        }
+        if (server->head == NULL) server->tail = NULL;
+        server->depth -= count;
+        pthread_mutex_unlock(&server->lock);
+
+        scoreBatch(server, count);
+        double now = profileSeconds();
+        for (int b=0; b<count && server->numLatencies < SERVER_LATENCY_WINDOW; b++) {
+            server->latencies[server->numLatencies++] = now - server->batch[b]->arrival;
+        }
+        server->requests += count;
+        server->batches++;
+
+        pthread_mutex_lock(&server->lock);
+        for (int b=0; b<count; b++) {
+            server->batch[b]->done = 1;
+        }
+        pthread_cond_broadcast(&server->answered);
+        if (now - server->reportStart >= SERVER_REPORT_SECONDS) {
+            report(server, now);
+        }
+    }
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+/*
+ * connectionMain()
+ * One client: send the hello, then answer one image at a time
+ * until the client hangs up or the server stops.
+ */
+static void* connectionMain(void* arg) {
+    Connection* connection = arg;
+    Server* server = connection->server;
+    int fd = connection->fd;
+    free(connection);
+
+    uint8_t* image = malloc(server->imageSize);
+    float* probs = malloc(server->classes * sizeof(float));
+    assert(image != NULL && probs != NULL);
+
+    ServerHello hello;
+    memset(&hello, 0, sizeof(hello));
+    memcpy(hello.magic, SERVER_MAGIC, sizeof(SERVER_MAGIC));
+    hello.width = server->width;
+    hello.height = server->height;
+    hello.classes = server->classes;
+    hello.maxBatch = server->maxBatch;
+
+    int open = writeFull(fd, &hello, sizeof(hello));
+    while (open && readFull(fd, image, server->imageSize)) {
+        Request request = {image, probs, profileSeconds(), 0, NULL};
+
+        pthread_mutex_lock(&server->lock);
+        if (server->stopping) {
+            pthread_mutex_unlock(&server->lock);
+            break;
+        }
+        if (server->tail != NULL) {
+            server->tail->next = &request;
+        } else {
+            server->head = &request;
+        }
+        server->tail = &request;
+        if (++server->depth > server->maxDepth) server->maxDepth = server->depth;
+        pthread_cond_signal(&server->arrived);
+        while (!request.done) {
+            pthread_cond_wait(&server->answered, &server->lock);
+        }
+        pthread_mutex_unlock(&server->lock);
+
+        open = writeFull(fd, probs, server->classes * sizeof(float));
+    }
+
+    pthread_mutex_lock(&server->lock);
+    for (int i=0; i<server->numClients; i++) {
+        if (server->clients[i] == fd) {
+            server->clients[i] = server->clients[--server->numClients];
+            break;
+        }
+    }
+    close(fd);
+    pthread_cond_signal(&server->closed);
+    pthread_mutex_unlock(&server->lock);
+    free(probs);
+    free(image);
+    return NULL;
+}
+
+/*
+ * initServer()
+ * Binds `address` (see isPort()) and starts the dispatcher
+ * and a Predictor with `threads` workers for `convLayer`/
+ * `denseLayer`. Returns NULL if the address cannot be bound.
+ */
+Server* initServer(const char* address, ConvLayer* convLayer, DenseLayer* denseLayer, int width, int height, int threads, int maxBatch, int maxLatencyUs) {
+    assert(maxBatch > 0 && maxLatencyUs >= 0);
+    int fd = openSocket(address, 1);
+    if (fd < 0) return NULL;
+    if (listen(fd, SERVER_MAX_CLIENTS) != 0) {
+        perror("listen");
+        close(fd);
+        return NULL;
+    }
+
+    Server* server = malloc(sizeof(Server));
+    assert(server != NULL);
+    memset(server, 0, sizeof(Server));
+    server->address = malloc(strlen(address) + 1);
+    assert(server->address != NULL);
+    strcpy(server->address, address);
+    server->tcp = isPort(address);
+    server->listenFd = fd;
+    server->width = width;
+    server->height = height;
+    server->classes = denseLayer->size;
+    server->imageSize = (size_t)width * height;
+    server->maxBatch = maxBatch;
+    server->maxLatency = maxLatencyUs * 1e-6;
+    server->predictor = initPredictor(convLayer, denseLayer, width, height, threads);
+    server->images = malloc(maxBatch * server->imageSize);
+    server->probs = malloc((size_t)maxBatch * server->classes * sizeof(real));
+    server->batch = malloc(maxBatch * sizeof(Request*));
+    assert(server->images != NULL && server->probs != NULL && server->batch != NULL);
+    server->started = profileSeconds();
+    server->reportStart = server->started;
+
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_condattr_t arrivedAttributes;
+    pthread_condattr_init(&arrivedAttributes);
+#ifndef __APPLE__
+    pthread_condattr_setclock(&arrivedAttributes, WAIT_CLOCK);
+#endif
+    pthread_cond_init(&server->arrived, &arrivedAttributes);
+    pthread_condattr_destroy(&arrivedAttributes);
+    pthread_cond_init(&server->answered, NULL);
+    pthread_cond_init(&server->closed, NULL);
+    int rc = pthread_create(&server->dispatcher, NULL, dispatcherMain, server);
+    assert(rc == 0);
+    (void)rc;
+    return server;
+}
+
+/*
+ * runServer()
+ * Accepts clients until SIGINT or SIGTERM, then stops taking
+ * requests, answers the queued ones, disconnects everyone and
+ * prints the totals.
+ */
+void runServer(Server* server) {
+    interrupted = 0;
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+    printf("Serving on %s %s (batches of up to %d, %.2f ms max wait, %d threads). Ctrl-C to stop.\n",
+           server->tcp ? "127.0.0.1 port" : "unix socket", server->address, server->maxBatch, server->maxLatency * 1e3,
+           threadPoolSize(server->predictor->pool));
+    fflush(stdout);
+
+    while (!interrupted) {
+        struct pollfd listener = {server->listenFd, POLLIN, 0};
+        if (poll(&listener, 1, 200) <= 0) continue;
+        int fd = accept(server->listenFd, NULL, NULL);
+        if (fd < 0) continue;
+        if (server->tcp) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+
+        pthread_mutex_lock(&server->lock);
+        int full = server->numClients == SERVER_MAX_CLIENTS;
+        if (!full) server->clients[server->numClients++] = fd;
+        pthread_mutex_unlock(&server->lock);
+        if (full) {
+            close(fd);
+            continue;
+        }
+
+        Connection* connection = malloc(sizeof(Connection));
+        assert(connection != NULL);
+        connection->server = server;
+        connection->fd = fd;
+        pthread_t thread;
+        pthread_attr_t attributes;
+        pthread_attr_init(&attributes);
+        pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+        int rc = pthread_create(&thread, &attributes, connectionMain, connection);
+        assert(rc == 0);
+        (void)rc;
+        pthread_attr_destroy(&attributes);
+    }
+
+    pthread_mutex_lock(&server->lock);
+    server->stopping = 1;
+    pthread_cond_signal(&server->arrived);
+    pthread_mutex_unlock(&server->lock);
+    pthread_join(server->dispatcher, NULL);
+
+    pthread_mutex_lock(&server->lock);
+    for (int i=0; i<server->numClients; i++) {
+        shutdown(server->clients[i], SHUT_RDWR);
+    }
+    while (server->numClients > 0) {
+        pthread_cond_wait(&server->closed, &server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    double now = profileSeconds();
+    if (server->requests > 0) report(server, now);
+    printf("Served %ld requests in %ld batches (%.1f images/batch) over %.1f s.\n", server->totalRequests, server->totalBatches,
+           server->totalBatches > 0 ? (double)server->totalRequests / server->totalBatches : 0.0, now - server->started);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+}
+
+/*
+ * freeServer()
+ * Closes the listening socket (removing a Unix socket file)
+ * and frees everything. Call after runServer() returns.
+ */
+void freeServer(Server* server) {
+    close(server->listenFd);
+    if (!server->tcp) unlink(server->address);
+    pthread_cond_destroy(&server->closed);
+    pthread_cond_destroy(&server->answered);
+    pthread_cond_destroy(&server->arrived);
+    pthread_mutex_destroy(&server->lock);
+    freePredictor(server->predictor);
+    free(server->batch);
+    free(server->probs);
+    free(server->images);
+    free(server->address);
+    free(server);
+}
+
+/*
+ * serverConnect()
+ * Connects to a server and reads its hello. Returns the
+ * socket, or -1 after printing why.
+ */
+int serverConnect(const char* address, ServerHello* hello) {
+    int fd = openSocket(address, 0);
+    if (fd < 0) return -1;
+    if (!readFull(fd, hello, sizeof(ServerHello)) || memcmp(hello->magic, SERVER_MAGIC, sizeof(SERVER_MAGIC)) != 0) {
+        fprintf(stderr, "%s: not a CNN server\n", address);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * serverQuery()
+ * Sends one image and waits for its `classes` probabilities;
+ * returns 0 if the connection broke.
+ */
+int serverQuery(int fd, const uint8_t* image, size_t imageSize, float* probs, int classes) {
+    return writeFull(fd, image, imageSize) && readFull(fd, probs, classes * sizeof(float));
+}
+
+#else
+
+/*
+ * The server needs POSIX sockets and poll(); on Windows the
+ * entry points report that and fail, so --serve and loadgen
+ * exit cleanly while the rest of lib/ still builds.
+ */
+Server* initServer(const char* address, ConvLayer* convLayer, DenseLayer* denseLayer, int width, int height, int threads, int maxBatch, int maxLatencyUs) {
+    (void)convLayer; (void)denseLayer; (void)width; (void)height; (void)threads; (void)maxBatch; (void)maxLatencyUs;
+    fprintf(stderr, "%s: the inference server is not supported on this platform\n", address);
+    return NULL;
+}
+
+void runServer(Server* server) {
+    (void)server;
+}
+
+void freeServer(Server* server) {
+    (void)server;
+}
+
+int serverConnect(const char* address, ServerHello* hello) {
+    (void)hello;
+    fprintf(stderr, "%s: the inference server is not supported on this platform\n", address);
+    return -1;
+}
+
+int serverQuery(int fd, const uint8_t* image, size_t imageSize, float* probs, int classes) {
+    (void)fd; (void)image; (void)imageSize; (void)probs; (void)classes;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ * server.h — local inference server
+ * ---------------------------------
+ * Serves a trained model to other processes on the same
+ * machine over a Unix domain socket or a TCP port bound to
+ * 127.0.0.1. Every connection gets a ServerHello, then sends
+ * width·height image bytes per request and reads back
+ * `classes` float32 probabilities. Requests from all clients
+ * go into one queue; a dispatcher thread coalesces them into
+ * micro-batches of up to `maxBatch` images, waiting at most
+ * `maxLatencyUs` after the oldest one arrived, and scores each
+ * batch with predict() on the worker pool.
+ *
+ * The same header holds the client side (serverConnect(),
+ * serverQuery()) used by the bundled load generator.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "convolution.h"
+#include "dense.h"
+
+#define SERVER_MAGIC "CNNSRV1"
+#define SERVER_LATENCY_WINDOW 8192  /* latency samples kept per report */
+#define SERVER_REPORT_SECONDS 1.0
+#define SERVER_MAX_CLIENTS 256
+
+/*
+ * ServerHello: sent once on every new connection, native
+ * byte order (both ends are on the same machine).
+ */
+typedef struct {
+    char magic[8];          /* SERVER_MAGIC, NUL-padded */
+    uint32_t width;
+    uint32_t height;
+    uint32_t classes;
+    uint32_t maxBatch;
+} ServerHello;
+
+typedef struct Server Server;
+
+Server* initServer(const char* address, ConvLayer* convLayer, DenseLayer* denseLayer, int width, int height, int threads, int maxBatch, int maxLatencyUs);
+void runServer(Server* server);
+void freeServer(Server* server);
+
+int serverConnect(const char* address, ServerHello* hello);
+int serverQuery(int fd, const uint8_t* image, size_t imageSize, float* probs, int classes);
+
+#endif
@@ -0,0 +1,460 @@
+/*
+ * simd.c — scalar reference kernels, dispatch and self-test
+ * ---------------------------------------------------------
+ * The scalar table doubles as the ground truth the wider
+ * versions are checked against by simdSelfTest(). Setting
+ * CNN_SIMD=scalar|avx2|avx512|avx512vnni in the environment forces a
+ * particular table (if the CPU supports it).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "gemm.h"
+#include "random.h"
+#include "simd.h"
+
+static real scalarDot(const real* x, const real* y, int n) {
+    real sum = 0.0;
+    for (int i=0; i<n; i++) {
+        sum += x[i] * y[i];
+    }
+    return sum;
+}
+
+static void scalarAxpy(real alpha, const real* x, real* y, int n) {
+    for (int i=0; i<n; i++) {
+        y[i] += alpha * x[i];
+    }
+}
+
+static void scalarScale(real alpha, const real* x, real* y, int n) {
+    for (int i=0; i<n; i++) {
+        y[i] = alpha * x[i];
+    }
+}
+
+static void scalarExp(const real* x, real* y, int n) {
+    for (int i=0; i<n; i++) {
+        y[i] = (real)exp(x[i]);
+    }
+}
+
+static void scalarMaxPool(const real* row0, const real* row1, real* out, int width) {
+    for (int j=0; j<width; j++) {
+        real max = row0[2*j];
+        if (row0[2*j + 1] > max) max = row0[2*j + 1];
+        if (row1[2*j] > max) max = row1[2*j];
+        if (row1[2*j + 1] > max) max = row1[2*j + 1];
+        out[j] = max;
+    }
+}
+
+/*
+ * scalarGemmKernel()
+ * C[0:mr, 0:nr] += alpha · a·b for one MR sliver of packed A
+ * and one NR sliver of packed B. The full MR×NR tile is
+ * accumulated locally; only the valid corner is written.
+ */
+static void scalarGemmKernel(int kc, const real* a, const real* b, real* C, int ldc, int mr, int nr, real alpha) {
+    real acc[GEMM_MR][GEMM_NR] = {{0.0}};
+
+    for (int p = 0; p < kc; p++) {
+        for (int i = 0; i < GEMM_MR; i++) {
+            real ai = a[p * GEMM_MR + i];
+            for (int j = 0; j < GEMM_NR; j++) {
+                acc[i][j] += ai * b[p * GEMM_NR + j];
+            }
+        }
+    }
+
+    for (int i = 0; i < mr; i++) {
+        for (int j = 0; j < nr; j++) {
+            C[(size_t)i * ldc + j] += alpha * acc[i][j];
+        }
+    }
+}
+
+static int32_t scalarDotU8(const uint8_t* x, const int8_t* w, int n) {
+    int32_t sum = 0;
+    for (int i=0; i<n; i++) {
+        sum += x[i] * w[i];
+    }
+    return sum;
+}
+
+static void scalarConvU8(const uint8_t* x, const int8_t* w, int quads, int32_t* out, int n) {
+    for (int j=0; j<n; j++) {
+        int32_t sum = 0;
+        for (int q=0; q<quads; q++) {
+            const uint8_t* column = x + ((size_t)q * n + j) * 4;
+            for (int t=0; t<4; t++) {
+                sum += column[t] * w[4*q + t];
+            }
+        }
+        out[j] = sum;
+    }
+}
+
+static void scalarSgdUpdate(const UpdateStep* step, const real* grad, real* w, int n) {
+    for (int i=0; i<n; i++) {
+        w[i] -= step->rate * (step->gradScale * grad[i] + step->decay * w[i]);
+    }
+}
+
+static void scalarMomentumUpdate(const UpdateStep* step, const real* grad, real* v, real* w, int n) {
+    for (int i=0; i<n; i++) {
+        real g = step->gradScale * grad[i] + step->decay * w[i];
+        v[i] = step->momentum * v[i] + g;
+        w[i] -= step->gradStep * g + step->velocityStep * v[i];
+    }
+}
+
+static void scalarAdamUpdate(const UpdateStep* step, const real* grad, real* m, real* v, real* w, int n) {
+    for (int i=0; i<n; i++) {
+        real g = step->gradScale * grad[i] + step->decay * w[i];
+        m[i] = step->momentum * m[i] + (1.0 - step->momentum) * g;
+        v[i] = step->beta2 * v[i] + (1.0 - step->beta2) * g * g;
+        w[i] = step->shrink * w[i] - step->rate * m[i] / (step->rootCorrection * (real)sqrt(v[i]) + step->epsilon);
+    }
+}
+
+static void scalarBoxMuller(const real* u, const real* v, real* z0, real* z1, int n) {
+    for (int i=0; i<n; i++) {
+        double r = sqrt(-2.0 * log(1.0 - u[i]));
+        double theta = 6.28318530717958647693 * v[i];
+        z0[i] = (real)(r * cos(theta));
+        z1[i] = (real)(r * sin(theta));
+    }
+}
+
+static void scalarBilinear(const real* plane, int stride, int rows, const real* x, const real* y, real* out, int n) {
+    for (int i=0; i<n; i++) {
+        real cx = x[i] > 0 ? (x[i] < stride - 1 ? x[i] : stride - 1) : 0;
+        real cy = y[i] > 0 ? (y[i] < rows - 1 ? y[i] : rows - 1) : 0;
+        real x0 = floor(cx) < stride - 2 ? floor(cx) : stride - 2;
+        real y0 = floor(cy) < rows - 2 ? floor(cy) : rows - 2;
+        real fx = cx - x0;
+        real fy = cy - y0;
+        const real* p = plane + (size_t)y0 * stride + (size_t)x0;
+        real top = p[0] + fx * (p[1] - p[0]);
+        real bottom = p[stride] + fx * (p[stride + 1] - p[stride]);
+        out[i] = top + fy * (bottom - top);
+    }
+}
+
+const SimdKernels scalarKernels = {
+    "scalar",
+    scalarDot,
+    scalarAxpy,
+    scalarScale,
+    scalarExp,
+    scalarMaxPool,
+    scalarGemmKernel,
+    scalarDotU8,
+    scalarConvU8,
+    scalarSgdUpdate,
+    scalarMomentumUpdate,
+    scalarAdamUpdate,
+    scalarBoxMuller,
+    scalarBilinear,
+};
+
+const SimdKernels* simd = &scalarKernels;
+
+/*
+ * supported()
+ * Whether the running CPU (and OS) can execute a table.
+ */
+static int supported(const SimdKernels* kernels) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (kernels == &avx512VnniKernels) {
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni");
+    }
+    if (kernels == &avx512Kernels) {
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+    }
+    if (kernels == &avx2Kernels) {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+#endif
+    return kernels == &scalarKernels;
+}
+
+/*
+ * simdInit()
+ * Picks the widest kernel table the CPU supports, unless
+ * CNN_SIMD names a specific one.
+ */
+void simdInit(void) {
+    const SimdKernels* candidates[] = {
+#if defined(__x86_64__) || defined(__i386__)
+        &avx512VnniKernels,
+        &avx512Kernels,
+        &avx2Kernels,
+#endif
+        &scalarKernels,
+    };
+    int numCandidates = sizeof(candidates) / sizeof(candidates[0]);
+    const char* forced = getenv("CNN_SIMD");
+
+    simd = &scalarKernels;
+    for (int i=0; i<numCandidates; i++) {
+        if (forced != NULL && strcmp(forced, candidates[i]->name) != 0) continue;
+        if (supported(candidates[i])) {
+            simd = candidates[i];
+            break;
+        }
+    }
+}
+
+/*
+ * check()
+ * Relative comparison against the scalar reference; prints
+ * and counts mismatches.
+ */
+static int check(const char* table, const char* kernel, int n, const real* got, const real* want, int count, real tolerance) {
+    for (int i=0; i<count; i++) {
+        real scale = fabs(want[i]) > 1.0 ? fabs(want[i]) : 1.0;
+        if (!(fabs(got[i] - want[i]) <= tolerance * scale)) {
+            printf("  %-7s %-10s n=%-4d FAILED at %d: %.17g != %.17g\n", table, kernel, n, i, got[i], want[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * testUpdates()
+ * The three optimizer kernels on random gradients, state and
+ * weights; both the state and the weights must match.
+ */
+static int testUpdates(const SimdKernels* kernels) {
+    enum { MAX_N = 67 };
+    real grad[MAX_N];
+    real state[2][3][MAX_N];    /* [scalar, tested][m, v, w] */
+    int failures = 0;
+    UpdateStep step = { 0.125, 1e-3, 0.9, 0.05, 0.045, 0.999, 0.01, 15.8, 1e-8, 0.9995 };
+    uint64_t stream = RANDOM_PART(RANDOM_SELFTEST, RANDOM_FIXTURE_UPDATES);
+    uint64_t next = 0;
+
+    for (int n=0; n<=MAX_N; n++) {
+        for (int i=0; i<n; i++) {
+            grad[i] = randomBetween(RANDOM_TEST_SEED, stream, next++, -2.0, 2.0);
+            state[0][0][i] = state[1][0][i] = randomBetween(RANDOM_TEST_SEED, stream, next++, -1.0, 1.0);
+            state[0][1][i] = state[1][1][i] = randomBetween(RANDOM_TEST_SEED, stream, next++, 0.0, 1.0);
+            state[0][2][i] = state[1][2][i] = randomBetween(RANDOM_TEST_SEED, stream, next++, -1.0, 1.0);
+        }
+        scalarKernels.sgdUpdate(&step, grad, state[0][2], n);
+        kernels->sgdUpdate(&step, grad, state[1][2], n);
+        failures += check(kernels->name, "sgd", n, state[1][2], state[0][2], n, 8 * REAL_EPSILON);
+
+        scalarKernels.momentumUpdate(&step, grad, state[0][0], state[0][2], n);
+        kernels->momentumUpdate(&step, grad, state[1][0], state[1][2], n);
+        failures += check(kernels->name, "momentum", n, state[1][0], state[0][0], n, 8 * REAL_EPSILON);
+        failures += check(kernels->name, "momentum", n, state[1][2], state[0][2], n, 8 * REAL_EPSILON);
+
+        scalarKernels.adamUpdate(&step, grad, state[0][0], state[0][1], state[0][2], n);
+        kernels->adamUpdate(&step, grad, state[1][0], state[1][1], state[1][2], n);
+        failures += check(kernels->name, "adam", n, state[1][0], state[0][0], n, 16 * REAL_EPSILON);
+        failures += check(kernels->name, "adam", n, state[1][1], state[0][1], n, 16 * REAL_EPSILON);
+        failures += check(kernels->name, "adam", n, state[1][2], state[0][2], n, 64 * REAL_EPSILON);
+    }
+    return failures;
+}
+
+/*
+ * testBoxMuller()
+ * Gaussian pairs from random uniforms, including u = 0 (radius
+ * 0), u close to 1 (the largest radius) and angles on and next
+ * to every quadrant boundary.
+ */
+static int testBoxMuller(const SimdKernels* kernels) {
+    enum { MAX_N = 67 };
+    real u[MAX_N];
+    real v[MAX_N];
+    real z[2][2][MAX_N];    /* [scalar, tested][cos, sin] */
+    uint64_t stream = RANDOM_PART(RANDOM_SELFTEST, RANDOM_FIXTURE_BOX_MULLER);
+    uint64_t next = 0;
+    int failures = 0;
+
+    for (int n=0; n<=MAX_N; n++) {
+        for (int i=0; i<n; i++) {
+            u[i] = randomBetween(RANDOM_TEST_SEED, stream, next++, 0.0, 1.0);
+            v[i] = i < 16 ? (real)(i / 2) / 8 + (i % 2 ? REAL_EPSILON : 0) : randomBetween(RANDOM_TEST_SEED, stream, next++, 0.0, 1.0);
+        }
+        if (n > 0) u[0] = 0.0;
+        if (n > 1) u[1] = 1.0 - REAL_EPSILON / 2;
+        scalarKernels.boxMuller(u, v, z[0][0], z[0][1], n);
+        kernels->boxMuller(u, v, z[1][0], z[1][1], n);
+        failures += check(kernels->name, "boxMuller", n, z[1][0], z[0][0], n, 64 * REAL_EPSILON);
+        failures += check(kernels->name, "boxMuller", n, z[1][1], z[0][1], n, 64 * REAL_EPSILON);
+    }
+    return failures;
+}
+
+/*
+ * testBilinear()
+ * Samples of a random plane at random points, at whole and
+ * half pixels and well outside the plane on every side.
+ */
+static int testBilinear(const SimdKernels* kernels) {
+    enum { MAX_N = 67, STRIDE = 9, ROWS = 7 };
+    real plane[STRIDE * ROWS];
+    real x[MAX_N];
+    real y[MAX_N];
+    real out[2][MAX_N];
+    uint64_t stream = RANDOM_PART(RANDOM_SELFTEST, RANDOM_FIXTURE_BILINEAR);
+    uint64_t next = 0;
+    int failures = 0;
+
+    for (int i=0; i<STRIDE * ROWS; i++) {
+        plane[i] = randomBetween(RANDOM_TEST_SEED, stream, next++, 0.0, 1.0);
+    }
+    for (int n=0; n<=MAX_N; n++) {
+        for (int i=0; i<n; i++) {
+            x[i] = randomBetween(RANDOM_TEST_SEED, stream, next++, -2.0, STRIDE + 2.0);
+            y[i] = randomBetween(RANDOM_TEST_SEED, stream, next++, -2.0, ROWS + 2.0);
+            if (i % 5 == 1) x[i] = (real)(int)x[i];
+            if (i % 5 == 2) y[i] = (real)(int)y[i] + 0.5;
+        }
+        scalarKernels.bilinear(plane, STRIDE, ROWS, x, y, out[0], n);
+        kernels->bilinear(plane, STRIDE, ROWS, x, y, out[1], n);
+        failures += check(kernels->name, "bilinear", n, out[1], out[0], n, 8 * REAL_EPSILON);
+    }
+    return failures;
+}
+
+/*
+ * testTable()
+ * Runs every kernel of `kernels` on random data over a range
+ * of lengths (to hit all tail cases) and compares the output
+ * with the scalar table.
+ */
+static int testTable(const SimdKernels* kernels) {
+    enum { MAX_N = 67 };
+    real x[2 * MAX_N];
+    real y[2 * MAX_N];
+    real got[2 * MAX_N];
+    real want[2 * MAX_N];
+    uint64_t stream = RANDOM_PART(RANDOM_SELFTEST, RANDOM_FIXTURE_KERNELS);
+    uint64_t next = 0;
+    int failures = 0;
+
+    for (int n=0; n<=MAX_N; n++) {
+        for (int i=0; i<2*MAX_N; i++) {
+            x[i] = randomBetween(RANDOM_TEST_SEED, stream, next++, -2.0, 2.0);
+            y[i] = randomBetween(RANDOM_TEST_SEED, stream, next++, -2.0, 2.0);
+        }
+
+        want[0] = scalarKernels.dot(x, y, n);
+        got[0] = kernels->dot(x, y, n);
+        failures += check(kernels->name, "dot", n, got, want, 1, 4096 * REAL_EPSILON);
+
+        memcpy(want, y, n * sizeof(real));
+        memcpy(got, y, n * sizeof(real));
+        scalarKernels.axpy(0.37, x, want, n);
+        kernels->axpy(0.37, x, got, n);
+        failures += check(kernels->name, "axpy", n, got, want, n, 8 * REAL_EPSILON);
+
+        scalarKernels.scale(-1.7, x, want, n);
+        kernels->scale(-1.7, x, got, n);
+        failures += check(kernels->name, "scale", n, got, want, n, 8 * REAL_EPSILON);
+
+        for (int i=0; i<n; i++) {
+            x[i] = (sizeof(real) == sizeof(float) ? 20.0 : 60.0) * x[i];
+        }
+        x[0] = n % 2 ? -745.0 : 0.0;
+        scalarKernels.vexp(x, want, n);
+        kernels->vexp(x, got, n);
+        failures += check(kernels->name, "vexp", n, got, want, n, 64 * REAL_EPSILON);
+
+        scalarKernels.maxPool(x, y, want, n);
+        kernels->maxPool(x, y, got, n);
+        failures += check(kernels->name, "maxPool", n, got, want, n, 0.0);
+    }
+
+    for (int kc=0; kc<=MAX_N; kc+=11) {
+        real a[GEMM_MR * MAX_N];
+        real b[GEMM_NR * MAX_N];
+        real c[2][GEMM_MR * (GEMM_NR + 3)];
+        for (int i=0; i<GEMM_MR*kc; i++) a[i] = randomBetween(RANDOM_TEST_SEED, stream, next++, -1.0, 1.0);
+        for (int i=0; i<GEMM_NR*kc; i++) b[i] = randomBetween(RANDOM_TEST_SEED, stream, next++, -1.0, 1.0);
+
+        for (int mr=1; mr<=GEMM_MR; mr++) {
+            for (int nr=1; nr<=GEMM_NR; nr+=GEMM_NR-1) {
+                for (int i=0; i<GEMM_MR*(GEMM_NR+3); i++) {
+                    c[0][i] = c[1][i] = (real)i;
+                }
+                scalarKernels.gemmKernel(kc, a, b, c[0], GEMM_NR + 3, mr, nr, 0.5);
+                kernels->gemmKernel(kc, a, b, c[1], GEMM_NR + 3, mr, nr, 0.5);
+                failures += check(kernels->name, "gemmKernel", kc, c[1], c[0], GEMM_MR * (GEMM_NR + 3), 4096 * REAL_EPSILON);
+            }
+        }
+    }
+
+    for (int n=0; n<=MAX_N; n++) {
+        enum { QUADS = 3 };
+        uint8_t codes[QUADS * 4 * MAX_N];
+        int8_t weights[QUADS * 4 * MAX_N];
+        int32_t sums[2][MAX_N];
+        for (int i=0; i<QUADS*4*MAX_N; i++) {
+            codes[i] = (uint8_t)randomBelow(RANDOM_TEST_SEED, stream, next++, 128);
+            weights[i] = (int8_t)((int)randomBelow(RANDOM_TEST_SEED, stream, next++, 255) - 127);
+        }
+        codes[0] = 127;
+        weights[0] = weights[1] = -127;
+
+        sums[0][0] = scalarKernels.dotU8(codes, weights, QUADS * n);
+        sums[1][0] = kernels->dotU8(codes, weights, QUADS * n);
+        if (sums[0][0] != sums[1][0]) {
+            printf("  %-7s %-10s n=%-4d FAILED: %d != %d\n", kernels->name, "dotU8", QUADS * n, (int)sums[1][0], (int)sums[0][0]);
+            failures++;
+        }
+
+        scalarKernels.convU8(codes, weights, QUADS, sums[0], n);
+        kernels->convU8(codes, weights, QUADS, sums[1], n);
+        for (int j=0; j<n; j++) {
+            if (sums[0][j] != sums[1][j]) {
+                printf("  %-7s %-10s n=%-4d FAILED at %d: %d != %d\n", kernels->name, "convU8", n, j, (int)sums[1][j], (int)sums[0][j]);
+                failures++;
+                break;
+            }
+        }
+    }
+    return failures + testUpdates(kernels) + testBoxMuller(kernels) + testBilinear(kernels);
+}
+
+/*
+ * simdSelfTest()
+ * Checks every table the CPU can run against the scalar
+ * reference. Returns the number of failures (0 = all good).
+ */
+int simdSelfTest(void) {
+    const SimdKernels* tables[] = {
+        &scalarKernels,
+#if defined(__x86_64__) || defined(__i386__)
+        &avx2Kernels,
+        &avx512Kernels,
+        &avx512VnniKernels,
+#endif
+    };
+    int numTables = sizeof(tables) / sizeof(tables[0]);
+    int failures = 0;
+
+    for (int i=0; i<numTables; i++) {
+        if (!supported(tables[i])) {
+            printf("SIMD self-test: %-10s skipped (not supported by this CPU)\n", tables[i]->name);
+            continue;
+        }
+        int tableFailures = testTable(tables[i]);
+        printf("SIMD self-test: %-10s %s\n", tables[i]->name, tableFailures == 0 ? "ok" : "FAILED");
+        failures += tableFailures;
+    }
+    printf("SIMD dispatch: using %s kernels\n", simd->name);
+    return failures;
+}
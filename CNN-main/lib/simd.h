@@ -0,0 +1,101 @@
+/*
+ * simd.h — vector kernels with runtime CPU dispatch
+ * -------------------------------------------------
+ * The handful of inner loops every layer spends its time
+ * in, each in a scalar reference version plus AVX2/FMA and
+ * AVX-512 versions. simdInit() checks CPUID once and points
+ * `simd` at the widest table the machine supports, so one
+ * binary runs well on old and new CPUs alike.
+ *
+ * The two integer kernels serve the int8 inference engine
+ * (qinference.c). Their activations are 7-bit codes (0…127),
+ * so a pmaddubsw pair sum can never saturate 16 bits and every
+ * table computes the exact same integers.
+ *
+ * The three update kernels (sgdUpdate, momentumUpdate,
+ * adamUpdate) are the fused optimizer steps of optimizer.c:
+ * each reads a gradient, any optimizer state and the
+ * parameters once and writes them back in the same pass.
+ * boxMuller turns the uniforms of random.c into Gaussians.
+ */
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "tensor.h"
+
+/*
+ * UpdateStep: coefficients of one optimizer step, worked out
+ * once per step by optimizer.c. For every element, with
+ * g = gradScale·grad + decay·w:
+ *   SGD:      w -= rate·g
+ *   momentum: v = momentum·v + g
+ *             w -= gradStep·g + velocityStep·v
+ *   Adam:     m = momentum·m + (1 - momentum)·g
+ *             v = beta2·v + (1 - beta2)·g²
+ *             w = shrink·w - rate·m / (rootCorrection·√v + epsilon)
+ */
+typedef struct {
+    real gradScale;         /* 1 / batch size */
+    real decay;             /* L2 penalty folded into the gradient */
+    real momentum;          /* μ, or Adam's β1 */
+    real gradStep;          /* momentum: lr (Nesterov) or 0 */
+    real velocityStep;      /* momentum: lr·μ (Nesterov) or lr */
+    real beta2;
+    real rate;              /* SGD: lr; Adam: lr / (1 - β1^t) */
+    real rootCorrection;    /* Adam: 1 / √(1 - β2^t) */
+    real epsilon;
+    real shrink;            /* Adam: decoupled decay, 1 - lr·λ for AdamW */
+} UpdateStep;
+
+typedef struct {
+    const char* name;
+
+    /* Σ x[i]·y[i] */
+    real (*dot)(const real* x, const real* y, int n);
+    /* y[i] += alpha·x[i] */
+    void (*axpy)(real alpha, const real* x, real* y, int n);
+    /* y[i] = alpha·x[i] */
+    void (*scale)(real alpha, const real* x, real* y, int n);
+    /* y[i] = exp(x[i]) */
+    void (*vexp)(const real* x, real* y, int n);
+    /* out[j] = max of the 2×2 window at column 2j of rows row0/row1 */
+    void (*maxPool)(const real* row0, const real* row1, real* out, int width);
+    /* GEMM_MR×GEMM_NR micro-kernel, see gemm.c */
+    void (*gemmKernel)(int kc, const real* a, const real* b, real* C, int ldc, int mr, int nr, real alpha);
+    /* Σ x[i]·w[i], x[i] ≤ 127 */
+    int32_t (*dotU8)(const uint8_t* x, const int8_t* w, int n);
+    /* out[j] = Σ_q Σ_t x[(q·n + j)·4 + t]·w[4q + t], x ≤ 127: one filter
+       over n im2col columns stored as interleaved groups of four taps */
+    void (*convU8)(const uint8_t* x, const int8_t* w, int quads, int32_t* out, int n);
+    /* plain SGD, see UpdateStep */
+    void (*sgdUpdate)(const UpdateStep* step, const real* grad, real* w, int n);
+    /* SGD with (Nesterov) momentum, see UpdateStep */
+    void (*momentumUpdate)(const UpdateStep* step, const real* grad, real* v, real* w, int n);
+    /* Adam / AdamW, see UpdateStep */
+    void (*adamUpdate)(const UpdateStep* step, const real* grad, real* m, real* v, real* w, int n);
+    /* z0[i] = √(-2·ln(1 - u[i]))·cos(2π·v[i]), z1[i] the same with sin; u, v in [0, 1) */
+    void (*boxMuller)(const real* u, const real* v, real* z0, real* z1, int n);
+    /* out[i] = plane (stride × rows) sampled bilinearly at (x[i], y[i]), with
+       the coordinates clamped to the plane: callers pad it with a zero border */
+    void (*bilinear)(const real* plane, int stride, int rows, const real* x, const real* y, real* out, int n);
+} SimdKernels;
+
+extern const SimdKernels* simd;
+
+extern const SimdKernels scalarKernels;
+#if defined(__x86_64__) || defined(__i386__)
+extern const SimdKernels avx2Kernels;
+extern const SimdKernels avx512Kernels;
+extern const SimdKernels avx512VnniKernels;
+#endif
+
+void simdInit(void);
+int simdSelfTest(void);
+
+#endif
@@ -0,0 +1,1091 @@
+/*
+ * simd_x86.c — AVX2/FMA and AVX-512 kernels
+ * -----------------------------------------
+ * Every function carries its own target attribute, so this
+ * file builds with the same plain flags as the rest of the
+ * project; simdInit() only selects a table after CPUID says
+ * the instructions are there. Tails are handled with scalar
+ * loops (AVX2) or masked loads/stores (AVX-512).
+ *
+ * The kernels are written once against the V2_* / V5_* macro
+ * layer below, which maps to the ps or pd intrinsics depending
+ * on `real`. Only the horizontal sum, 2^n scaling, exp
+ * polynomial, exponent split, pooling lane shuffle and gather
+ * differ per type.
+ *
+ * The int8 kernels use pmaddubsw + pmaddwd (AVX2, AVX-512BW)
+ * or a single vpdpbusd (AVX-512 VNNI) per 4-byte group; they
+ * do not depend on `real`.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <assert.h>
+#include <immintrin.h>
+
+#include "gemm.h"
+#include "simd.h"
+
+#define AVX2 __attribute__((target("avx2,fma")))
+#define AVX512 __attribute__((target("avx512f")))
+#define AVX512BW __attribute__((target("avx512f,avx512bw")))
+#define AVX512VNNI __attribute__((target("avx512f,avx512bw,avx512vnni")))
+
+#ifdef CNN_FLOAT32
+
+#define V2 __m256
+#define V2_LANES 8
+#define V2_ZERO _mm256_setzero_ps
+#define V2_SET1 _mm256_set1_ps
+#define V2_LOAD _mm256_loadu_ps
+#define V2_STORE _mm256_storeu_ps
+#define V2_BROADCAST _mm256_broadcast_ss
+#define V2_ADD _mm256_add_ps
+#define V2_SUB _mm256_sub_ps
+#define V2_MUL _mm256_mul_ps
+#define V2_DIV _mm256_div_ps
+#define V2_SQRT _mm256_sqrt_ps
+#define V2_MIN _mm256_min_ps
+#define V2_MAX _mm256_max_ps
+#define V2_FMADD _mm256_fmadd_ps
+#define V2_FNMADD _mm256_fnmadd_ps
+#define V2_ROUND _mm256_round_ps
+#define V2_CMP _mm256_cmp_ps
+#define V2_BLENDV _mm256_blendv_ps
+#define V2_OR _mm256_or_ps
+
+#define V5 __m512
+#define V5_MASK __mmask16
+#define V5_LANES 16
+#define V5_FULL 0xFFFF
+#define V5_ZERO _mm512_setzero_ps
+#define V5_SET1 _mm512_set1_ps
+#define V5_LOAD _mm512_loadu_ps
+#define V5_MASKZ_LOAD _mm512_maskz_loadu_ps
+#define V5_MASK_STORE _mm512_mask_storeu_ps
+#define V5_ADD _mm512_add_ps
+#define V5_SUB _mm512_sub_ps
+#define V5_MUL _mm512_mul_ps
+#define V5_DIV _mm512_div_ps
+#define V5_SQRT _mm512_sqrt_ps
+#define V5_MIN _mm512_min_ps
+#define V5_MAX _mm512_max_ps
+#define V5_FMADD _mm512_fmadd_ps
+#define V5_FNMADD _mm512_fnmadd_ps
+#define V5_ROUND _mm512_roundscale_ps
+#define V5_SCALEF _mm512_scalef_ps
+#define V5_CMP_MASK _mm512_cmp_ps_mask
+#define V5_MASK_BLEND _mm512_mask_blend_ps
+#define V5_MASK_SUB _mm512_mask_sub_ps
+#define V5_GETEXP _mm512_getexp_ps
+#define V5_GETMANT(x) _mm512_getmant_ps(x, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_zero)
+#define V5_REDUCE_ADD _mm512_reduce_add_ps
+
+/* Cephes expf(): exp(r) = 1 + r + r²·P(r) on |r| ≤ ln2/2 */
+#define EXP_MAX 89.0f
+#define EXP_MIN -104.0f
+#define EXP_LOG2E 1.44269504088896341f
+#define EXP_LN2_HI 0.693359375f
+#define EXP_LN2_LO -2.12194440e-4f
+#define EXP_P0 1.9875691500e-4f
+#define EXP_P1 1.3981999507e-3f
+#define EXP_P2 8.3334519073e-3f
+#define EXP_P3 4.1665795894e-2f
+#define EXP_P4 1.6666665459e-1f
+#define EXP_P5 5.0000001201e-1f
+
+#else
+
+#define V2 __m256d
+#define V2_LANES 4
+#define V2_ZERO _mm256_setzero_pd
+#define V2_SET1 _mm256_set1_pd
+#define V2_LOAD _mm256_loadu_pd
+#define V2_STORE _mm256_storeu_pd
+#define V2_BROADCAST _mm256_broadcast_sd
+#define V2_ADD _mm256_add_pd
+#define V2_SUB _mm256_sub_pd
+#define V2_MUL _mm256_mul_pd
+#define V2_DIV _mm256_div_pd
+#define V2_SQRT _mm256_sqrt_pd
+#define V2_MIN _mm256_min_pd
+#define V2_MAX _mm256_max_pd
+#define V2_FMADD _mm256_fmadd_pd
+#define V2_FNMADD _mm256_fnmadd_pd
+#define V2_ROUND _mm256_round_pd
+#define V2_CMP _mm256_cmp_pd
+#define V2_BLENDV _mm256_blendv_pd
+#define V2_OR _mm256_or_pd
+
+#define V5 __m512d
+#define V5_MASK __mmask8
+#define V5_LANES 8
+#define V5_FULL 0xFF
+#define V5_ZERO _mm512_setzero_pd
+#define V5_SET1 _mm512_set1_pd
+#define V5_LOAD _mm512_loadu_pd
+#define V5_MASKZ_LOAD _mm512_maskz_loadu_pd
+#define V5_MASK_STORE _mm512_mask_storeu_pd
+#define V5_ADD _mm512_add_pd
+#define V5_SUB _mm512_sub_pd
+#define V5_MUL _mm512_mul_pd
+#define V5_DIV _mm512_div_pd
+#define V5_SQRT _mm512_sqrt_pd
+#define V5_MIN _mm512_min_pd
+#define V5_MAX _mm512_max_pd
+#define V5_FMADD _mm512_fmadd_pd
+#define V5_FNMADD _mm512_fnmadd_pd
+#define V5_ROUND _mm512_roundscale_pd
+#define V5_SCALEF _mm512_scalef_pd
+#define V5_CMP_MASK _mm512_cmp_pd_mask
+#define V5_MASK_BLEND _mm512_mask_blend_pd
+#define V5_MASK_SUB _mm512_mask_sub_pd
+#define V5_GETEXP _mm512_getexp_pd
+#define V5_GETMANT(x) _mm512_getmant_pd(x, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_zero)
+#define V5_REDUCE_ADD _mm512_reduce_add_pd
+
+/* Cephes exp(): exp(r) = 1 + 2r·P(r²) / (Q(r²) - r·P(r²)) on |r| ≤ ln2/2 */
+#define EXP_MAX 800.0
+#define EXP_MIN -800.0
+#define EXP_LOG2E 1.4426950408889634
+#define EXP_LN2_HI 6.93145751953125e-1
+#define EXP_LN2_LO 1.42860682030941723212e-6
+#define EXP_P0 1.26177193074810590878e-4
+#define EXP_P1 3.02994407707441961300e-2
+#define EXP_P2 9.99999999999999999910e-1
+#define EXP_Q0 3.00198505138664455042e-6
+#define EXP_Q1 2.52448340349684104192e-3
+#define EXP_Q2 2.27265548208155028766e-1
+#define EXP_Q3 2.00000000000000000009e0
+
+#endif
+
+/*
+ * Box-Muller series, used by both precisions: ln m = 2s·Σ s^2k/(2k+1)
+ * with s = (m-1)/(m+1), |s| ≤ 0.172 for m in [√½, √2); sin and cos
+ * as Taylor series on |x| ≤ π/4. Enough terms for float64.
+ */
+#define LOG_TERMS 11
+#define SIN_TERMS 8
+#define COS_TERMS 9
+#define TWO_PI 6.28318530717958647693
+#define SQRT2 1.41421356237309504880
+static const double LOG_SERIES[LOG_TERMS] = {
+    1.0, 1.0 / 3, 1.0 / 5, 1.0 / 7, 1.0 / 9, 1.0 / 11, 1.0 / 13, 1.0 / 15, 1.0 / 17, 1.0 / 19, 1.0 / 21
+};
+static const double SIN_SERIES[SIN_TERMS] = {           /* x³ … x¹⁷ */
+    -1.0 / 6, 1.0 / 120, -1.0 / 5040, 1.0 / 362880, -1.0 / 39916800, 1.0 / 6227020800.0,
+    -1.0 / 1307674368000.0, 1.0 / 355687428096000.0
+};
+static const double COS_SERIES[COS_TERMS] = {           /* x² … x¹⁸ */
+    -1.0 / 2, 1.0 / 24, -1.0 / 720, 1.0 / 40320, -1.0 / 3628800, 1.0 / 479001600,
+    -1.0 / 87178291200.0, 1.0 / 20922789888000.0, -1.0 / 6402373705728000.0
+};
+
+/* ------------------------------------------------------------------ */
+/* AVX2 + FMA                                                         */
+/* ------------------------------------------------------------------ */
+
+#ifdef CNN_FLOAT32
+
+AVX2 static inline real hsum256(__m256 v) {
+    __m128 low = _mm256_castps256_ps128(v);
+    __m128 high = _mm256_extractf128_ps(v, 1);
+    low = _mm_add_ps(low, high);
+    low = _mm_add_ps(low, _mm_movehl_ps(low, low));
+    return _mm_cvtss_f32(_mm_add_ss(low, _mm_shuffle_ps(low, low, 1)));
+}
+
+/*
+ * expPoly256()
+ * exp(r) on the reduced range.
+ */
+AVX2 static inline __m256 expPoly256(__m256 r) {
+    __m256 rr = _mm256_mul_ps(r, r);
+    __m256 p = _mm256_fmadd_ps(_mm256_set1_ps(EXP_P0), r, _mm256_set1_ps(EXP_P1));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P2));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P3));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P4));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P5));
+    p = _mm256_fmadd_ps(p, rr, r);
+    return _mm256_add_ps(p, _mm256_set1_ps(1.0f));
+}
+
+/*
+ * pow2n256()
+ * e·2^n, with 2^n built from exponent bits in two halves so
+ * results down to the subnormal range come out right.
+ */
+AVX2 static inline __m256 pow2n256(__m256 e, __m256 n) {
+    __m256i ni = _mm256_cvtps_epi32(n);
+    __m256i n1 = _mm256_srai_epi32(ni, 1);
+    __m256i n2 = _mm256_sub_epi32(ni, n1);
+    __m256i bias = _mm256_set1_epi32(127);
+    __m256i p1 = _mm256_slli_epi32(_mm256_add_epi32(n1, bias), 23);
+    __m256i p2 = _mm256_slli_epi32(_mm256_add_epi32(n2, bias), 23);
+    e = _mm256_mul_ps(e, _mm256_castsi256_ps(p1));
+    return _mm256_mul_ps(e, _mm256_castsi256_ps(p2));
+}
+
+/*
+ * frexp256()
+ * x = m·2^e for positive normal x, m in [1, 2).
+ */
+AVX2 static inline __m256 frexp256(__m256 x, __m256* e) {
+    __m256i bits = _mm256_castps_si256(x);
+    *e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+    bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F800000));
+    return _mm256_castsi256_ps(bits);
+}
+
+/*
+ * pairMax256()
+ * Max of adjacent lane pairs of a:b, in order.
+ */
+AVX2 static inline __m256 pairMax256(__m256 a, __m256 b) {
+    __m256 m = _mm256_max_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(m), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+/*
+ * gather256()
+ * base[index[i]] for an index held as a whole-valued real.
+ */
+AVX2 static inline __m256 gather256(const float* base, __m256 index) {
+    return _mm256_i32gather_ps(base, _mm256_cvttps_epi32(index), 4);
+}
+
+#else
+
+AVX2 static inline real hsum256(__m256d v) {
+    __m128d low = _mm256_castpd256_pd128(v);
+    __m128d high = _mm256_extractf128_pd(v, 1);
+    low = _mm_add_pd(low, high);
+    return _mm_cvtsd_f64(_mm_add_sd(low, _mm_unpackhi_pd(low, low)));
+}
+
+AVX2 static inline __m256d expPoly256(__m256d r) {
+    __m256d rr = _mm256_mul_pd(r, r);
+    __m256d p = _mm256_fmadd_pd(_mm256_set1_pd(EXP_P0), rr, _mm256_set1_pd(EXP_P1));
+    p = _mm256_mul_pd(_mm256_fmadd_pd(p, rr, _mm256_set1_pd(EXP_P2)), r);
+    __m256d q = _mm256_fmadd_pd(_mm256_set1_pd(EXP_Q0), rr, _mm256_set1_pd(EXP_Q1));
+    q = _mm256_fmadd_pd(q, rr, _mm256_set1_pd(EXP_Q2));
+    q = _mm256_fmadd_pd(q, rr, _mm256_set1_pd(EXP_Q3));
+    __m256d e = _mm256_div_pd(p, _mm256_sub_pd(q, p));
+    return _mm256_fmadd_pd(_mm256_set1_pd(2.0), e, _mm256_set1_pd(1.0));
+}
+
+AVX2 static inline __m256d pow2n256(__m256d e, __m256d n) {
+    __m128i ni = _mm256_cvtpd_epi32(n);
+    __m128i n1 = _mm_srai_epi32(ni, 1);
+    __m128i n2 = _mm_sub_epi32(ni, n1);
+    __m256i bias = _mm256_set1_epi64x(1023);
+    __m256i p1 = _mm256_slli_epi64(_mm256_add_epi64(_mm256_cvtepi32_epi64(n1), bias), 52);
+    __m256i p2 = _mm256_slli_epi64(_mm256_add_epi64(_mm256_cvtepi32_epi64(n2), bias), 52);
+    e = _mm256_mul_pd(e, _mm256_castsi256_pd(p1));
+    return _mm256_mul_pd(e, _mm256_castsi256_pd(p2));
+}
+
+/* the exponent field lands in the mantissa of 2^52 to become a double */
+AVX2 static inline __m256d frexp256(__m256d x, __m256d* e) {
+    __m256i bits = _mm256_castpd_si256(x);
+    __m256i field = _mm256_or_si256(_mm256_srli_epi64(bits, 52), _mm256_set1_epi64x(0x4330000000000000ll));
+    *e = _mm256_sub_pd(_mm256_castsi256_pd(field), _mm256_set1_pd(4503599627370496.0 + 1023.0));
+    bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFFll)), _mm256_set1_epi64x(0x3FF0000000000000ll));
+    return _mm256_castsi256_pd(bits);
+}
+
+AVX2 static inline __m256d pairMax256(__m256d a, __m256d b) {
+    __m256d m = _mm256_max_pd(_mm256_unpacklo_pd(a, b), _mm256_unpackhi_pd(a, b));
+    return _mm256_permute4x64_pd(m, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+AVX2 static inline __m256d gather256(const double* base, __m256d index) {
+    return _mm256_i32gather_pd(base, _mm256_cvttpd_epi32(index), 8);
+}
+
+#endif
+
+AVX2 static real avx2Dot(const real* x, const real* y, int n) {
+    V2 s0 = V2_ZERO();
+    V2 s1 = V2_ZERO();
+    V2 s2 = V2_ZERO();
+    V2 s3 = V2_ZERO();
+    int i = 0;
+    for (; i + 4*V2_LANES <= n; i += 4*V2_LANES) {
+        s0 = V2_FMADD(V2_LOAD(x + i), V2_LOAD(y + i), s0);
+        s1 = V2_FMADD(V2_LOAD(x + i + V2_LANES), V2_LOAD(y + i + V2_LANES), s1);
+        s2 = V2_FMADD(V2_LOAD(x + i + 2*V2_LANES), V2_LOAD(y + i + 2*V2_LANES), s2);
+        s3 = V2_FMADD(V2_LOAD(x + i + 3*V2_LANES), V2_LOAD(y + i + 3*V2_LANES), s3);
+    }
+    for (; i + V2_LANES <= n; i += V2_LANES) {
+        s0 = V2_FMADD(V2_LOAD(x + i), V2_LOAD(y + i), s0);
+    }
+    real sum = hsum256(V2_ADD(V2_ADD(s0, s1), V2_ADD(s2, s3)));
+    for (; i < n; i++) {
+        sum += x[i] * y[i];
+    }
+    return sum;
+}
+
+AVX2 static void avx2Axpy(real alpha, const real* x, real* y, int n) {
+    V2 a = V2_SET1(alpha);
+    int i = 0;
+    for (; i + V2_LANES <= n; i += V2_LANES) {
+        V2_STORE(y + i, V2_FMADD(a, V2_LOAD(x + i), V2_LOAD(y + i)));
+    }
+    for (; i < n; i++) {
+        y[i] += alpha * x[i];
+    }
+}
+
+AVX2 static void avx2Scale(real alpha, const real* x, real* y, int n) {
+    V2 a = V2_SET1(alpha);
+    int i = 0;
+    for (; i + V2_LANES <= n; i += V2_LANES) {
+        V2_STORE(y + i, V2_MUL(a, V2_LOAD(x + i)));
+    }
+    for (; i < n; i++) {
+        y[i] = alpha * x[i];
+    }
+}
+
+/*
+ * exp256()
+ * x = n·ln2 + r, exp(r) from the Cephes approximation, then
+ * scaled by 2^n.
+ */
+AVX2 static inline V2 exp256(V2 x) {
+    x = V2_MAX(V2_MIN(x, V2_SET1(EXP_MAX)), V2_SET1(EXP_MIN));
+    V2 n = V2_ROUND(V2_MUL(x, V2_SET1(EXP_LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    V2 r = V2_FNMADD(n, V2_SET1(EXP_LN2_HI), x);
+    r = V2_FNMADD(n, V2_SET1(EXP_LN2_LO), r);
+    return pow2n256(expPoly256(r), n);
+}
+
+AVX2 static void avx2Exp(const real* x, real* y, int n) {
+    int i = 0;
+    for (; i + V2_LANES <= n; i += V2_LANES) {
+        V2_STORE(y + i, exp256(V2_LOAD(x + i)));
+    }
+    if (i < n) {
+        real in[V2_LANES] = {0};
+        real out[V2_LANES];
+        for (int j = 0; j < n - i; j++) in[j] = x[i + j];
+        V2_STORE(out, exp256(V2_LOAD(in)));
+        for (int j = 0; j < n - i; j++) y[i + j] = out[j];
+    }
+}
+
+AVX2 static void avx2MaxPool(const real* row0, const real* row1, real* out, int width) {
+    int j = 0;
+    for (; j + V2_LANES <= width; j += V2_LANES) {
+        V2 a = V2_MAX(V2_LOAD(row0 + 2*j), V2_LOAD(row1 + 2*j));
+        V2 b = V2_MAX(V2_LOAD(row0 + 2*j + V2_LANES), V2_LOAD(row1 + 2*j + V2_LANES));
+        V2_STORE(out + j, pairMax256(a, b));
+    }
+    for (; j < width; j++) {
+        real max = row0[2*j];
+        if (row0[2*j + 1] > max) max = row0[2*j + 1];
+        if (row1[2*j] > max) max = row1[2*j];
+        if (row1[2*j + 1] > max) max = row1[2*j + 1];
+        out[j] = max;
+    }
+}
+
+/*
+ * avx2GemmKernel()
+ * MR×NR tile in eight ymm accumulators (NR is two ymm wide):
+ * each step loads one row of B and broadcasts four values
+ * of A.
+ */
+AVX2 static void avx2GemmKernel(int kc, const real* a, const real* b, real* C, int ldc, int mr, int nr, real alpha) {
+    V2 c[GEMM_MR][2];
+    for (int i = 0; i < GEMM_MR; i++) {
+        c[i][0] = V2_ZERO();
+        c[i][1] = V2_ZERO();
+    }
+
+    for (int p = 0; p < kc; p++) {
+        V2 b0 = V2_LOAD(b + p * GEMM_NR);
+        V2 b1 = V2_LOAD(b + p * GEMM_NR + V2_LANES);
+        for (int i = 0; i < GEMM_MR; i++) {
+            V2 ai = V2_BROADCAST(a + p * GEMM_MR + i);
+            c[i][0] = V2_FMADD(ai, b0, c[i][0]);
+            c[i][1] = V2_FMADD(ai, b1, c[i][1]);
+        }
+    }
+
+    V2 alphas = V2_SET1(alpha);
+    if (mr == GEMM_MR && nr == GEMM_NR) {
+        for (int i = 0; i < GEMM_MR; i++) {
+            real* row = C + (size_t)i * ldc;
+            V2_STORE(row, V2_FMADD(alphas, c[i][0], V2_LOAD(row)));
+            V2_STORE(row + V2_LANES, V2_FMADD(alphas, c[i][1], V2_LOAD(row + V2_LANES)));
+        }
+        return;
+    }
+
+    real tile[GEMM_MR][GEMM_NR];
+    for (int i = 0; i < GEMM_MR; i++) {
+        V2_STORE(tile[i], c[i][0]);
+        V2_STORE(tile[i] + V2_LANES, c[i][1]);
+    }
+    for (int i = 0; i < mr; i++) {
+        for (int j = 0; j < nr; j++) {
+            C[(size_t)i * ldc + j] += alpha * tile[i][j];
+        }
+    }
+}
+
+/*
+ * loadQuad()
+ * Four int8 taps as one 32-bit value, ready to broadcast to
+ * every lane.
+ */
+static inline int32_t loadQuad(const int8_t* w) {
+    int32_t quad;
+    memcpy(&quad, w, sizeof(quad));
+    return quad;
+}
+
+AVX2 static int32_t avx2DotU8(const uint8_t* x, const int8_t* w, int n) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i s = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i pairs = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(x + i)), _mm256_loadu_si256((const __m256i*)(w + i)));
+        s = _mm256_add_epi32(s, _mm256_madd_epi16(pairs, ones));
+    }
+    __m128i h = _mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+    h = _mm_add_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(1, 0, 3, 2)));
+    h = _mm_add_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(2, 3, 0, 1)));
+    int32_t sum = _mm_cvtsi128_si32(h);
+    for (; i < n; i++) {
+        sum += x[i] * w[i];
+    }
+    return sum;
+}
+
+/*
+ * avx2ConvU8()
+ * Eight columns per step: each 32-bit lane holds one column's
+ * four taps, multiplied by the broadcast filter quad.
+ */
+AVX2 static void avx2ConvU8(const uint8_t* x, const int8_t* w, int quads, int32_t* out, int n) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    int j = 0;
+    for (; j + 8 <= n; j += 8) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int q = 0; q < quads; q++) {
+            __m256i columns = _mm256_loadu_si256((const __m256i*)(x + ((size_t)q * n + j) * 4));
+            __m256i pairs = _mm256_maddubs_epi16(columns, _mm256_set1_epi32(loadQuad(w + 4*q)));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(pairs, ones));
+        }
+        _mm256_storeu_si256((__m256i*)(out + j), acc);
+    }
+    for (; j < n; j++) {
+        int32_t sum = 0;
+        for (int q = 0; q < quads; q++) {
+            for (int t = 0; t < 4; t++) {
+                sum += x[((size_t)q * n + j) * 4 + t] * w[4*q + t];
+            }
+        }
+        out[j] = sum;
+    }
+}
+
+/*
+ * avx2SgdUpdate()
+ * w -= rate·(gradScale·grad + decay·w) in one pass; the
+ * tail falls back to the scalar formula.
+ */
+AVX2 static void avx2SgdUpdate(const UpdateStep* step, const real* grad, real* w, int n) {
+    V2 gradScale = V2_SET1(step->gradScale);
+    V2 decay = V2_SET1(step->decay);
+    V2 rate = V2_SET1(step->rate);
+    int i = 0;
+    for (; i + V2_LANES <= n; i += V2_LANES) {
+        V2 wi = V2_LOAD(w + i);
+        V2 g = V2_FMADD(decay, wi, V2_MUL(gradScale, V2_LOAD(grad + i)));
+        V2_STORE(w + i, V2_FNMADD(rate, g, wi));
+    }
+    for (; i < n; i++) {
+        w[i] -= step->rate * (step->gradScale * grad[i] + step->decay * w[i]);
+    }
+}
+
+/*
+ * avx2MomentumUpdate()
+ * One pass over gradient, velocity and weights; the tail
+ * falls back to the scalar formula.
+ */
+AVX2 static void avx2MomentumUpdate(const UpdateStep* step, const real* grad, real* v, real* w, int n) {
+    V2 gradScale = V2_SET1(step->gradScale);
+    V2 decay = V2_SET1(step->decay);
+    V2 momentum = V2_SET1(step->momentum);
+    V2 gradStep = V2_SET1(step->gradStep);
+    V2 velocityStep = V2_SET1(step->velocityStep);
+    int i = 0;
+    for (; i + V2_LANES <= n; i += V2_LANES) {
+        V2 wi = V2_LOAD(w + i);
+        V2 g = V2_FMADD(decay, wi, V2_MUL(gradScale, V2_LOAD(grad + i)));
+        V2 vi = V2_FMADD(momentum, V2_LOAD(v + i), g);
+        V2_STORE(v + i, vi);
+        V2_STORE(w + i, V2_FNMADD(velocityStep, vi, V2_FNMADD(gradStep, g, wi)));
+    }
+    for (; i < n; i++) {
+        real g = step->gradScale * grad[i] + step->decay * w[i];
+        v[i] = step->momentum * v[i] + g;
+        w[i] -= step->gradStep * g + step->velocityStep * v[i];
+    }
+}
+
+AVX2 static void avx2AdamUpdate(const UpdateStep* step, const real* grad, real* m, real* v, real* w, int n) {
+    V2 gradScale = V2_SET1(step->gradScale);
+    V2 decay = V2_SET1(step->decay);
+    V2 beta1 = V2_SET1(step->momentum);
+    V2 keep1 = V2_SET1(1.0 - step->momentum);
+    V2 beta2 = V2_SET1(step->beta2);
+    V2 keep2 = V2_SET1(1.0 - step->beta2);
+    V2 rate = V2_SET1(step->rate);
+    V2 rootCorrection = V2_SET1(step->rootCorrection);
+    V2 epsilon = V2_SET1(step->epsilon);
+    V2 shrink = V2_SET1(step->shrink);
+    int i = 0;
+    for (; i + V2_LANES <= n; i += V2_LANES) {
+        V2 wi = V2_LOAD(w + i);
+        V2 g = V2_FMADD(decay, wi, V2_MUL(gradScale, V2_LOAD(grad + i)));
+        V2 mi = V2_FMADD(beta1, V2_LOAD(m + i), V2_MUL(keep1, g));
+        V2 vi = V2_FMADD(beta2, V2_LOAD(v + i), V2_MUL(keep2, V2_MUL(g, g)));
+        V2_STORE(m + i, mi);
+        V2_STORE(v + i, vi);
+        V2 denominator = V2_FMADD(rootCorrection, V2_SQRT(vi), epsilon);
+        V2_STORE(w + i, V2_FNMADD(rate, V2_DIV(mi, denominator), V2_MUL(shrink, wi)));
+    }
+    for (; i < n; i++) {
+        real g = step->gradScale * grad[i] + step->decay * w[i];
+        m[i] = step->momentum * m[i] + (1.0 - step->momentum) * g;
+        v[i] = step->beta2 * v[i] + (1.0 - step->beta2) * g * g;
+        w[i] = step->shrink * w[i] - step->rate * m[i] / (step->rootCorrection * (real)sqrt(v[i]) + step->epsilon);
+    }
+}
+
+/*
+ * series256()
+ * Σ c[k]·z^k by Horner.
+ */
+AVX2 static inline V2 series256(const double* c, int terms, V2 z) {
+    V2 p = V2_SET1((real)c[terms - 1]);
+    for (int k = terms - 2; k >= 0; k--) {
+        p = V2_FMADD(p, z, V2_SET1((real)c[k]));
+    }
+    return p;
+}
+
+/*
+ * logUnit256()
+ * ln x for x in (0, 1]: x = m·2^e with m moved into [√½, √2),
+ * then ln m from the atanh series.
+ */
+AVX2 static inline V2 logUnit256(V2 x) {
+    V2 e;
+    V2 m = frexp256(x, &e);
+    V2 big = V2_CMP(m, V2_SET1(SQRT2), _CMP_GT_OQ);
+    m = V2_BLENDV(m, V2_MUL(m, V2_SET1(0.5)), big);
+    e = V2_BLENDV(e, V2_ADD(e, V2_SET1(1.0)), big);
+    V2 f = V2_SUB(m, V2_SET1(1.0));
+    V2 s = V2_DIV(f, V2_ADD(f, V2_SET1(2.0)));
+    V2 lnm = V2_MUL(V2_ADD(s, s), series256(LOG_SERIES, LOG_TERMS, V2_MUL(s, s)));
+    return V2_FMADD(e, V2_SET1(EXP_LN2_HI), V2_FMADD(e, V2_SET1(EXP_LN2_LO), lnm));
+}
+
+/*
+ * sinCos256()
+ * cos and sin of 2π·t for t in [0, 1). The angle is reduced in
+ * turns, where it is exact: q = nearest quarter turn, x = 2π·(t
+ * - q/4) in [-π/4, π/4], then the quadrant swaps and negates.
+ */
+AVX2 static inline void sinCos256(V2 t, V2* cosine, V2* sine) {
+    V2 q = V2_ROUND(V2_MUL(t, V2_SET1(4.0)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    V2 x = V2_MUL(V2_FNMADD(q, V2_SET1(0.25), t), V2_SET1(TWO_PI));
+    V2 z = V2_MUL(x, x);
+    V2 s = V2_FMADD(V2_MUL(x, z), series256(SIN_SERIES, SIN_TERMS, z), x);
+    V2 c = V2_FMADD(z, series256(COS_SERIES, COS_TERMS, z), V2_SET1(1.0));
+
+    V2 q1 = V2_CMP(q, V2_SET1(1.0), _CMP_EQ_OQ);
+    V2 q2 = V2_CMP(q, V2_SET1(2.0), _CMP_EQ_OQ);
+    V2 q3 = V2_CMP(q, V2_SET1(3.0), _CMP_EQ_OQ);
+    V2 swap = V2_OR(q1, q3);
+    V2 cc = V2_BLENDV(c, s, swap);
+    V2 ss = V2_BLENDV(s, c, swap);
+    *cosine = V2_BLENDV(cc, V2_SUB(V2_ZERO(), cc), V2_OR(q1, q2));
+    *sine = V2_BLENDV(ss, V2_SUB(V2_ZERO(), ss), V2_OR(q2, q3));
+}
+
+AVX2 static inline void boxMuller256(V2 u, V2 v, real* z0, real* z1) {
+    V2 r = V2_SQRT(V2_MUL(V2_SET1(-2.0), logUnit256(V2_SUB(V2_SET1(1.0), u))));
+    V2 c, s;
+    sinCos256(v, &c, &s);
+    V2_STORE(z0, V2_MUL(r, c));
+    V2_STORE(z1, V2_MUL(r, s));
+}
+
+AVX2 static void avx2BoxMuller(const real* u, const real* v, real* z0, real* z1, int n) {
+    int i = 0;
+    for (; i + V2_LANES <= n; i += V2_LANES) {
+        boxMuller256(V2_LOAD(u + i), V2_LOAD(v + i), z0 + i, z1 + i);
+    }
+    if (i < n) {
+        real inU[V2_LANES] = {0};
+        real inV[V2_LANES] = {0};
+        real out0[V2_LANES];
+        real out1[V2_LANES];
+        for (int j = 0; j < n - i; j++) {
+            inU[j] = u[i + j];
+            inV[j] = v[i + j];
+        }
+        boxMuller256(V2_LOAD(inU), V2_LOAD(inV), out0, out1);
+        for (int j = 0; j < n - i; j++) {
+            z0[i + j] = out0[j];
+            z1[i + j] = out1[j];
+        }
+    }
+}
+
+/*
+ * bilinear256()
+ * One vector of bilinear samples: clamp, split into corner and
+ * fraction, gather the four corners and blend.
+ */
+AVX2 static inline V2 bilinear256(const real* plane, int stride, int rows, V2 x, V2 y) {
+    x = V2_MIN(V2_MAX(x, V2_ZERO()), V2_SET1(stride - 1));
+    y = V2_MIN(V2_MAX(y, V2_ZERO()), V2_SET1(rows - 1));
+    V2 x0 = V2_MIN(V2_ROUND(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC), V2_SET1(stride - 2));
+    V2 y0 = V2_MIN(V2_ROUND(y, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC), V2_SET1(rows - 2));
+    V2 fx = V2_SUB(x, x0);
+    V2 fy = V2_SUB(y, y0);
+    V2 index = V2_FMADD(y0, V2_SET1(stride), x0);
+    V2 a = gather256(plane, index);
+    V2 b = gather256(plane + 1, index);
+    V2 c = gather256(plane + stride, index);
+    V2 d = gather256(plane + stride + 1, index);
+    V2 top = V2_FMADD(fx, V2_SUB(b, a), a);
+    V2 bottom = V2_FMADD(fx, V2_SUB(d, c), c);
+    return V2_FMADD(fy, V2_SUB(bottom, top), top);
+}
+
+/* the tail goes through a zero-padded vector: (0, 0) is always in range */
+AVX2 static void avx2Bilinear(const real* plane, int stride, int rows, const real* x, const real* y, real* out, int n) {
+    int i = 0;
+    for (; i + V2_LANES <= n; i += V2_LANES) {
+        V2_STORE(out + i, bilinear256(plane, stride, rows, V2_LOAD(x + i), V2_LOAD(y + i)));
+    }
+    if (i < n) {
+        real inX[V2_LANES] = {0};
+        real inY[V2_LANES] = {0};
+        real result[V2_LANES];
+        for (int j = 0; j < n - i; j++) {
+            inX[j] = x[i + j];
+            inY[j] = y[i + j];
+        }
+        V2_STORE(result, bilinear256(plane, stride, rows, V2_LOAD(inX), V2_LOAD(inY)));
+        for (int j = 0; j < n - i; j++) {
+            out[i + j] = result[j];
+        }
+    }
+}
+
+const SimdKernels avx2Kernels = {
+    "avx2",
+    avx2Dot,
+    avx2Axpy,
+    avx2Scale,
+    avx2Exp,
+    avx2MaxPool,
+    avx2GemmKernel,
+    avx2DotU8,
+    avx2ConvU8,
+    avx2SgdUpdate,
+    avx2MomentumUpdate,
+    avx2AdamUpdate,
+    avx2BoxMuller,
+    avx2Bilinear,
+};
+
+/* ------------------------------------------------------------------ */
+/* AVX-512F                                                           */
+/* ------------------------------------------------------------------ */
+
+AVX512 static inline V5_MASK tailMask(int count) {
+    return (V5_MASK)((1u << count) - 1u);
+}
+
+#ifdef CNN_FLOAT32
+
+AVX512 static inline __m512 expPoly512(__m512 r) {
+    __m512 rr = _mm512_mul_ps(r, r);
+    __m512 p = _mm512_fmadd_ps(_mm512_set1_ps(EXP_P0), r, _mm512_set1_ps(EXP_P1));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P2));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P3));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P4));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P5));
+    p = _mm512_fmadd_ps(p, rr, r);
+    return _mm512_add_ps(p, _mm512_set1_ps(1.0f));
+}
+
+AVX512 static inline __m512 pairMax512(__m512 a, __m512 b) {
+    const __m512i even = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+    const __m512i odd = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1);
+    return _mm512_max_ps(_mm512_permutex2var_ps(a, even, b), _mm512_permutex2var_ps(a, odd, b));
+}
+
+AVX512 static inline __m512 gather512(const float* base, __m512 index) {
+    return _mm512_i32gather_ps(_mm512_cvttps_epi32(index), base, 4);
+}
+
+#else
+
+AVX512 static inline __m512d expPoly512(__m512d r) {
+    __m512d rr = _mm512_mul_pd(r, r);
+    __m512d p = _mm512_fmadd_pd(_mm512_set1_pd(EXP_P0), rr, _mm512_set1_pd(EXP_P1));
+    p = _mm512_mul_pd(_mm512_fmadd_pd(p, rr, _mm512_set1_pd(EXP_P2)), r);
+    __m512d q = _mm512_fmadd_pd(_mm512_set1_pd(EXP_Q0), rr, _mm512_set1_pd(EXP_Q1));
+    q = _mm512_fmadd_pd(q, rr, _mm512_set1_pd(EXP_Q2));
+    q = _mm512_fmadd_pd(q, rr, _mm512_set1_pd(EXP_Q3));
+    __m512d e = _mm512_div_pd(p, _mm512_sub_pd(q, p));
+    return _mm512_fmadd_pd(_mm512_set1_pd(2.0), e, _mm512_set1_pd(1.0));
+}
+
+AVX512 static inline __m512d pairMax512(__m512d a, __m512d b) {
+    const __m512i even = _mm512_set_epi64(14, 12, 10, 8, 6, 4, 2, 0);
+    const __m512i odd = _mm512_set_epi64(15, 13, 11, 9, 7, 5, 3, 1);
+    return _mm512_max_pd(_mm512_permutex2var_pd(a, even, b), _mm512_permutex2var_pd(a, odd, b));
+}
+
+AVX512 static inline __m512d gather512(const double* base, __m512d index) {
+    return _mm512_i32gather_pd(_mm512_cvttpd_epi32(index), base, 8);
+}
+
+#endif
+
+AVX512 static real avx512Dot(const real* x, const real* y, int n) {
+    V5 s0 = V5_ZERO();
+    V5 s1 = V5_ZERO();
+    int i = 0;
+    for (; i + 2*V5_LANES <= n; i += 2*V5_LANES) {
+        s0 = V5_FMADD(V5_LOAD(x + i), V5_LOAD(y + i), s0);
+        s1 = V5_FMADD(V5_LOAD(x + i + V5_LANES), V5_LOAD(y + i + V5_LANES), s1);
+    }
+    for (; i < n; i += V5_LANES) {
+        V5_MASK mask = n - i >= V5_LANES ? V5_FULL : tailMask(n - i);
+        s0 = V5_FMADD(V5_MASKZ_LOAD(mask, x + i), V5_MASKZ_LOAD(mask, y + i), s0);
+    }
+    return V5_REDUCE_ADD(V5_ADD(s0, s1));
+}
+
+AVX512 static void avx512Axpy(real alpha, const real* x, real* y, int n) {
+    V5 a = V5_SET1(alpha);
+    for (int i = 0; i < n; i += V5_LANES) {
+        V5_MASK mask = n - i >= V5_LANES ? V5_FULL : tailMask(n - i);
+        V5 r = V5_FMADD(a, V5_MASKZ_LOAD(mask, x + i), V5_MASKZ_LOAD(mask, y + i));
+        V5_MASK_STORE(y + i, mask, r);
+    }
+}
+
+AVX512 static void avx512Scale(real alpha, const real* x, real* y, int n) {
+    V5 a = V5_SET1(alpha);
+    for (int i = 0; i < n; i += V5_LANES) {
+        V5_MASK mask = n - i >= V5_LANES ? V5_FULL : tailMask(n - i);
+        V5_MASK_STORE(y + i, mask, V5_MUL(a, V5_MASKZ_LOAD(mask, x + i)));
+    }
+}
+
+/*
+ * exp512()
+ * Same reduction as exp256(); scalef applies 2^n with correct
+ * overflow and gradual underflow in one instruction.
+ */
+AVX512 static inline V5 exp512(V5 x) {
+    x = V5_MAX(V5_MIN(x, V5_SET1(EXP_MAX)), V5_SET1(EXP_MIN));
+    V5 n = V5_ROUND(V5_MUL(x, V5_SET1(EXP_LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    V5 r = V5_FNMADD(n, V5_SET1(EXP_LN2_HI), x);
+    r = V5_FNMADD(n, V5_SET1(EXP_LN2_LO), r);
+    return V5_SCALEF(expPoly512(r), n);
+}
+
+AVX512 static void avx512Exp(const real* x, real* y, int n) {
+    for (int i = 0; i < n; i += V5_LANES) {
+        V5_MASK mask = n - i >= V5_LANES ? V5_FULL : tailMask(n - i);
+        V5_MASK_STORE(y + i, mask, exp512(V5_MASKZ_LOAD(mask, x + i)));
+    }
+}
+
+AVX512 static void avx512MaxPool(const real* row0, const real* row1, real* out, int width) {
+    for (int j = 0; j < width; j += V5_LANES) {
+        int count = width - j >= V5_LANES ? V5_LANES : width - j;
+        V5_MASK lowMask = 2 * count >= V5_LANES ? V5_FULL : tailMask(2 * count);
+        V5_MASK highMask = 2 * count >= V5_LANES ? tailMask(2 * count - V5_LANES) : 0;
+        V5 a = V5_MAX(V5_MASKZ_LOAD(lowMask, row0 + 2*j), V5_MASKZ_LOAD(lowMask, row1 + 2*j));
+        V5 b = V5_MAX(V5_MASKZ_LOAD(highMask, row0 + 2*j + V5_LANES), V5_MASKZ_LOAD(highMask, row1 + 2*j + V5_LANES));
+        V5_MASK_STORE(out + j, tailMask(count), pairMax512(a, b));
+    }
+}
+
+/*
+ * avx512GemmKernel()
+ * MR×NR tile in four zmm accumulators (NR is one zmm wide);
+ * partial tiles are written back with a column mask.
+ */
+AVX512 static void avx512GemmKernel(int kc, const real* a, const real* b, real* C, int ldc, int mr, int nr, real alpha) {
+    V5 c[GEMM_MR];
+    for (int i = 0; i < GEMM_MR; i++) {
+        c[i] = V5_ZERO();
+    }
+
+    for (int p = 0; p < kc; p++) {
+        V5 bp = V5_LOAD(b + p * GEMM_NR);
+        for (int i = 0; i < GEMM_MR; i++) {
+            c[i] = V5_FMADD(V5_SET1(a[p * GEMM_MR + i]), bp, c[i]);
+        }
+    }
+
+    V5 alphas = V5_SET1(alpha);
+    V5_MASK mask = nr >= V5_LANES ? V5_FULL : tailMask(nr);
+    for (int i = 0; i < mr; i++) {
+        real* row = C + (size_t)i * ldc;
+        V5_MASK_STORE(row, mask, V5_FMADD(alphas, c[i], V5_MASKZ_LOAD(mask, row)));
+    }
+}
+
+AVX512BW static int32_t avx512DotU8(const uint8_t* x, const int8_t* w, int n) {
+    const __m512i ones = _mm512_set1_epi16(1);
+    __m512i s = _mm512_setzero_si512();
+    for (int i = 0; i < n; i += 64) {
+        __mmask64 mask = n - i >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << (n - i)) - 1;
+        __m512i pairs = _mm512_maddubs_epi16(_mm512_maskz_loadu_epi8(mask, x + i), _mm512_maskz_loadu_epi8(mask, w + i));
+        s = _mm512_add_epi32(s, _mm512_madd_epi16(pairs, ones));
+    }
+    return _mm512_reduce_add_epi32(s);
+}
+
+/*
+ * avx512ConvU8()
+ * Sixteen columns per step, one per 32-bit lane; the tail is
+ * a lane mask since every column is exactly one lane wide.
+ */
+AVX512BW static void avx512ConvU8(const uint8_t* x, const int8_t* w, int quads, int32_t* out, int n) {
+    const __m512i ones = _mm512_set1_epi16(1);
+    for (int j = 0; j < n; j += 16) {
+        __mmask16 mask = n - j >= 16 ? 0xFFFF : (__mmask16)((1u << (n - j)) - 1u);
+        __m512i acc = _mm512_setzero_si512();
+        for (int q = 0; q < quads; q++) {
+            __m512i columns = _mm512_maskz_loadu_epi32(mask, x + ((size_t)q * n + j) * 4);
+            __m512i pairs = _mm512_maddubs_epi16(columns, _mm512_set1_epi32(loadQuad(w + 4*q)));
+            acc = _mm512_add_epi32(acc, _mm512_madd_epi16(pairs, ones));
+        }
+        _mm512_mask_storeu_epi32(out + j, mask, acc);
+    }
+}
+
+AVX512VNNI static int32_t vnniDotU8(const uint8_t* x, const int8_t* w, int n) {
+    __m512i s = _mm512_setzero_si512();
+    for (int i = 0; i < n; i += 64) {
+        __mmask64 mask = n - i >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << (n - i)) - 1;
+        s = _mm512_dpbusd_epi32(s, _mm512_maskz_loadu_epi8(mask, x + i), _mm512_maskz_loadu_epi8(mask, w + i));
+    }
+    return _mm512_reduce_add_epi32(s);
+}
+
+AVX512VNNI static void vnniConvU8(const uint8_t* x, const int8_t* w, int quads, int32_t* out, int n) {
+    for (int j = 0; j < n; j += 16) {
+        __mmask16 mask = n - j >= 16 ? 0xFFFF : (__mmask16)((1u << (n - j)) - 1u);
+        __m512i acc = _mm512_setzero_si512();
+        for (int q = 0; q < quads; q++) {
+            __m512i columns = _mm512_maskz_loadu_epi32(mask, x + ((size_t)q * n + j) * 4);
+            acc = _mm512_dpbusd_epi32(acc, columns, _mm512_set1_epi32(loadQuad(w + 4*q)));
+        }
+        _mm512_mask_storeu_epi32(out + j, mask, acc);
+    }
+}
+
+/*
+ * avx512SgdUpdate()
+ * As avx2SgdUpdate(), with the tail done under a mask.
+ */
+AVX512 static void avx512SgdUpdate(const UpdateStep* step, const real* grad, real* w, int n) {
+    V5 gradScale = V5_SET1(step->gradScale);
+    V5 decay = V5_SET1(step->decay);
+    V5 rate = V5_SET1(step->rate);
+    for (int i = 0; i < n; i += V5_LANES) {
+        V5_MASK mask = n - i >= V5_LANES ? V5_FULL : tailMask(n - i);
+        V5 wi = V5_MASKZ_LOAD(mask, w + i);
+        V5 g = V5_FMADD(decay, wi, V5_MUL(gradScale, V5_MASKZ_LOAD(mask, grad + i)));
+        V5_MASK_STORE(w + i, mask, V5_FNMADD(rate, g, wi));
+    }
+}
+
+/*
+ * avx512MomentumUpdate()
+ * As avx2MomentumUpdate(), with the tail done under a mask.
+ */
+AVX512 static void avx512MomentumUpdate(const UpdateStep* step, const real* grad, real* v, real* w, int n) {
+    V5 gradScale = V5_SET1(step->gradScale);
+    V5 decay = V5_SET1(step->decay);
+    V5 momentum = V5_SET1(step->momentum);
+    V5 gradStep = V5_SET1(step->gradStep);
+    V5 velocityStep = V5_SET1(step->velocityStep);
+    for (int i = 0; i < n; i += V5_LANES) {
+        V5_MASK mask = n - i >= V5_LANES ? V5_FULL : tailMask(n - i);
+        V5 wi = V5_MASKZ_LOAD(mask, w + i);
+        V5 g = V5_FMADD(decay, wi, V5_MUL(gradScale, V5_MASKZ_LOAD(mask, grad + i)));
+        V5 vi = V5_FMADD(momentum, V5_MASKZ_LOAD(mask, v + i), g);
+        V5_MASK_STORE(v + i, mask, vi);
+        V5_MASK_STORE(w + i, mask, V5_FNMADD(velocityStep, vi, V5_FNMADD(gradStep, g, wi)));
+    }
+}
+
+AVX512 static void avx512AdamUpdate(const UpdateStep* step, const real* grad, real* m, real* v, real* w, int n) {
+    V5 gradScale = V5_SET1(step->gradScale);
+    V5 decay = V5_SET1(step->decay);
+    V5 beta1 = V5_SET1(step->momentum);
+    V5 keep1 = V5_SET1(1.0 - step->momentum);
+    V5 beta2 = V5_SET1(step->beta2);
+    V5 keep2 = V5_SET1(1.0 - step->beta2);
+    V5 rate = V5_SET1(step->rate);
+    V5 rootCorrection = V5_SET1(step->rootCorrection);
+    V5 epsilon = V5_SET1(step->epsilon);
+    V5 shrink = V5_SET1(step->shrink);
+    for (int i = 0; i < n; i += V5_LANES) {
+        V5_MASK mask = n - i >= V5_LANES ? V5_FULL : tailMask(n - i);
+        V5 wi = V5_MASKZ_LOAD(mask, w + i);
+        V5 g = V5_FMADD(decay, wi, V5_MUL(gradScale, V5_MASKZ_LOAD(mask, grad + i)));
+        V5 mi = V5_FMADD(beta1, V5_MASKZ_LOAD(mask, m + i), V5_MUL(keep1, g));
+        V5 vi = V5_FMADD(beta2, V5_MASKZ_LOAD(mask, v + i), V5_MUL(keep2, V5_MUL(g, g)));
+        V5_MASK_STORE(m + i, mask, mi);
+        V5_MASK_STORE(v + i, mask, vi);
+        V5 denominator = V5_FMADD(rootCorrection, V5_SQRT(vi), epsilon);
+        V5_MASK_STORE(w + i, mask, V5_FNMADD(rate, V5_DIV(mi, denominator), V5_MUL(shrink, wi)));
+    }
+}
+
+AVX512 static inline V5 series512(const double* c, int terms, V5 z) {
+    V5 p = V5_SET1((real)c[terms - 1]);
+    for (int k = terms - 2; k >= 0; k--) {
+        p = V5_FMADD(p, z, V5_SET1((real)c[k]));
+    }
+    return p;
+}
+
+/*
+ * boxMuller512()
+ * As boxMuller256(), with getexp/getmant for the exponent
+ * split and mask blends for the quadrant fix-up.
+ */
+AVX512 static inline void boxMuller512(V5 u, V5 v, V5* z0, V5* z1) {
+    V5 x = V5_SUB(V5_SET1(1.0), u);
+    V5 e = V5_GETEXP(x);
+    V5 m = V5_GETMANT(x);
+    V5_MASK big = V5_CMP_MASK(m, V5_SET1(SQRT2), _CMP_GT_OQ);
+    m = V5_MASK_BLEND(big, m, V5_MUL(m, V5_SET1(0.5)));
+    e = V5_MASK_BLEND(big, e, V5_ADD(e, V5_SET1(1.0)));
+    V5 f = V5_SUB(m, V5_SET1(1.0));
+    V5 s = V5_DIV(f, V5_ADD(f, V5_SET1(2.0)));
+    V5 lnm = V5_MUL(V5_ADD(s, s), series512(LOG_SERIES, LOG_TERMS, V5_MUL(s, s)));
+    V5 ln = V5_FMADD(e, V5_SET1(EXP_LN2_HI), V5_FMADD(e, V5_SET1(EXP_LN2_LO), lnm));
+    V5 r = V5_SQRT(V5_MUL(V5_SET1(-2.0), ln));
+
+    V5 q = V5_ROUND(V5_MUL(v, V5_SET1(4.0)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    V5 a = V5_MUL(V5_FNMADD(q, V5_SET1(0.25), v), V5_SET1(TWO_PI));
+    V5 z = V5_MUL(a, a);
+    V5 sine = V5_FMADD(V5_MUL(a, z), series512(SIN_SERIES, SIN_TERMS, z), a);
+    V5 cosine = V5_FMADD(z, series512(COS_SERIES, COS_TERMS, z), V5_SET1(1.0));
+
+    V5_MASK q1 = V5_CMP_MASK(q, V5_SET1(1.0), _CMP_EQ_OQ);
+    V5_MASK q2 = V5_CMP_MASK(q, V5_SET1(2.0), _CMP_EQ_OQ);
+    V5_MASK q3 = V5_CMP_MASK(q, V5_SET1(3.0), _CMP_EQ_OQ);
+    V5 cc = V5_MASK_BLEND(q1 | q3, cosine, sine);
+    V5 ss = V5_MASK_BLEND(q1 | q3, sine, cosine);
+    cc = V5_MASK_SUB(cc, q1 | q2, V5_ZERO(), cc);
+    ss = V5_MASK_SUB(ss, q2 | q3, V5_ZERO(), ss);
+    *z0 = V5_MUL(r, cc);
+    *z1 = V5_MUL(r, ss);
+}
+
+AVX512 static void avx512BoxMuller(const real* u, const real* v, real* z0, real* z1, int n) {
+    for (int i = 0; i < n; i += V5_LANES) {
+        V5_MASK mask = n - i >= V5_LANES ? V5_FULL : tailMask(n - i);
+        V5 c, s;
+        boxMuller512(V5_MASKZ_LOAD(mask, u + i), V5_MASKZ_LOAD(mask, v + i), &c, &s);
+        V5_MASK_STORE(z0 + i, mask, c);
+        V5_MASK_STORE(z1 + i, mask, s);
+    }
+}
+
+/* masked-off lanes load (0, 0), which is always in range */
+AVX512 static void avx512Bilinear(const real* plane, int stride, int rows, const real* x, const real* y, real* out, int n) {
+    V5 maxX = V5_SET1(stride - 1);
+    V5 maxY = V5_SET1(rows - 1);
+    V5 lastX = V5_SET1(stride - 2);
+    V5 lastY = V5_SET1(rows - 2);
+    V5 width = V5_SET1(stride);
+    for (int i = 0; i < n; i += V5_LANES) {
+        V5_MASK mask = n - i >= V5_LANES ? V5_FULL : tailMask(n - i);
+        V5 xi = V5_MIN(V5_MAX(V5_MASKZ_LOAD(mask, x + i), V5_ZERO()), maxX);
+        V5 yi = V5_MIN(V5_MAX(V5_MASKZ_LOAD(mask, y + i), V5_ZERO()), maxY);
+        V5 x0 = V5_MIN(V5_ROUND(xi, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC), lastX);
+        V5 y0 = V5_MIN(V5_ROUND(yi, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC), lastY);
+        V5 fx = V5_SUB(xi, x0);
+        V5 fy = V5_SUB(yi, y0);
+        V5 index = V5_FMADD(y0, width, x0);
+        V5 a = gather512(plane, index);
+        V5 b = gather512(plane + 1, index);
+        V5 c = gather512(plane + stride, index);
+        V5 d = gather512(plane + stride + 1, index);
+        V5 top = V5_FMADD(fx, V5_SUB(b, a), a);
+        V5 bottom = V5_FMADD(fx, V5_SUB(d, c), c);
+        V5_MASK_STORE(out + i, mask, V5_FMADD(fy, V5_SUB(bottom, top), top));
+    }
+}
+
+const SimdKernels avx512Kernels = {
+    "avx512",
+    avx512Dot,
+    avx512Axpy,
+    avx512Scale,
+    avx512Exp,
+    avx512MaxPool,
+    avx512GemmKernel,
+    avx512DotU8,
+    avx512ConvU8,
+    avx512SgdUpdate,
+    avx512MomentumUpdate,
+    avx512AdamUpdate,
+    avx512BoxMuller,
+    avx512Bilinear,
+};
+
+/* AVX-512 plus VNNI: identical except for the int8 kernels */
+const SimdKernels avx512VnniKernels = {
+    "avx512vnni",
+    avx512Dot,
+    avx512Axpy,
+    avx512Scale,
+    avx512Exp,
+    avx512MaxPool,
+    avx512GemmKernel,
+    vnniDotU8,
+    vnniConvU8,
+    avx512SgdUpdate,
+    avx512MomentumUpdate,
+    avx512AdamUpdate,
+    avx512BoxMuller,
+    avx512Bilinear,
+};
+
+#endif
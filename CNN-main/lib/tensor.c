@@ -0,0 +1,228 @@
+/*
+ * tensor.c — contiguous n-d array implementation
+ * ----------------------------------------------
+ * Row-major storage, one allocation per tensor, aligned
+ * to a cache line so inner loops can stream through it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tensor.h"
+#include "profile.h"
+
+/*
+ * alignedAllocUncounted()
+ * alignedAlloc() without the PROFILE_ALLOCATION hook, for the
+ * profiler's own per-thread blocks.
+ */
+void* alignedAllocUncounted(size_t bytes) {
+    void* ptr = NULL;
+    if (bytes == 0) bytes = TENSOR_ALIGNMENT;
+#ifdef _WIN32
+    ptr = _aligned_malloc(bytes, TENSOR_ALIGNMENT);
+#else
+    if (posix_memalign(&ptr, TENSOR_ALIGNMENT, bytes) != 0) ptr = NULL;
+#endif
+    assert(ptr != NULL);
+    return ptr;
+}
+
+/*
+ * alignedAlloc()
+ * Returns `bytes` of memory aligned to TENSOR_ALIGNMENT.
+ * Must be released with alignedFree().
+ */
+void* alignedAlloc(size_t bytes) {
+    void* ptr = alignedAllocUncounted(bytes);
+    PROFILE_ALLOCATION(bytes);
+    return ptr;
+}
+
+/*
+ * alignedFree()
+ * Counterpart to alignedAlloc().
+ */
+void alignedFree(void* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+/*
+ * tensorShape()
+ * Fills in shape, row-major strides (in elements) and size.
+ */
+static void tensorShape(Tensor* tensor, int ndim, const int* shape) {
+    assert(ndim > 0 && ndim <= TENSOR_MAX_DIMS);
+    tensor->ndim = ndim;
+    tensor->size = 1;
+    for (int i=ndim-1; i>=0; i--) {
+        assert(shape[i] > 0);
+        tensor->shape[i] = shape[i];
+        tensor->strides[i] = tensor->size;
+        tensor->size *= (size_t)shape[i];
+    }
+    for (int i=ndim; i<TENSOR_MAX_DIMS; i++) {
+        tensor->shape[i] = 1;
+        tensor->strides[i] = 1;
+    }
+}
+
+/*
+ * tensorCreate()
+ * Allocates a zero-filled tensor of the given shape. The last
+ * dimension is contiguous; strides are in elements.
+ */
+Tensor* tensorCreate(int ndim, const int* shape) {
+    Tensor* tensor = malloc(sizeof(Tensor));
+    assert(tensor != NULL);
+
+    tensorShape(tensor, ndim, shape);
+    tensor->data = alignedAlloc(tensor->size * sizeof(real));
+    tensorZero(tensor);
+    return tensor;
+}
+
+Tensor* tensorCreate1D(int d0) {
+    int shape[1] = {d0};
+    return tensorCreate(1, shape);
+}
+
+Tensor* tensorCreate2D(int d0, int d1) {
+    int shape[2] = {d0, d1};
+    return tensorCreate(2, shape);
+}
+
+Tensor* tensorCreate3D(int d0, int d1, int d2) {
+    int shape[3] = {d0, d1, d2};
+    return tensorCreate(3, shape);
+}
+
+/*
+ * tensorFree()
+ * Releases the buffer and the tensor header.
+ */
+void tensorFree(Tensor* tensor) {
+    if (tensor == NULL) return;
+    alignedFree(tensor->data);
+    free(tensor);
+}
+
+/*
+ * tensorZero()
+ * Sets every element to 0.0.
+ */
+void tensorZero(Tensor* tensor) {
+    memset(tensor->data, 0, tensor->size * sizeof(real));
+}
+
+/*
+ * tensorSlice()
+ * Pointer to the `index`-th block along the outermost
+ * dimension, e.g. one image of an [N, H, W] image set.
+ */
+real* tensorSlice(Tensor* tensor, int index) {
+    assert(index >= 0 && index < tensor->shape[0]);
+    return tensor->data + (size_t)index * tensor->strides[0];
+}
+
+/*
+ * tensorView()
+ * Initialises a caller-owned tensor header over existing
+ * memory. Nothing is allocated; never pass it to tensorFree().
+ */
+void tensorView(Tensor* tensor, real* data, int ndim, const int* shape) {
+    tensorShape(tensor, ndim, shape);
+    tensor->data = data;
+}
+
+/*
+ * tensorSelect()
+ * Makes `view` the `index`-th block along the outermost
+ * dimension with that dimension dropped, e.g. one
+ * [C, H, W] image out of an [N, C, H, W] batch.
+ */
+void tensorSelect(Tensor* tensor, int index, Tensor* view) {
+    assert(tensor->ndim > 1);
+    tensorView(view, tensorSlice(tensor, index), tensor->ndim - 1, tensor->shape + 1);
+}
+
+/*
+ * tensorNarrow()
+ * Makes `view` the `count` blocks starting at `start` along
+ * the outermost dimension, e.g. the first n rows of a batch.
+ */
+void tensorNarrow(Tensor* tensor, int start, int count, Tensor* view) {
+    int shape[TENSOR_MAX_DIMS];
+    assert(start >= 0 && count > 0 && start + count <= tensor->shape[0]);
+    for (int i=0; i<tensor->ndim; i++) {
+        shape[i] = tensor->shape[i];
+    }
+    shape[0] = count;
+    tensorView(view, tensorSlice(tensor, start), tensor->ndim, shape);
+}
+
+/*
+ * arenaInit()
+ * Allocates a zeroed block of `elements` reals. Passing 0
+ * leaves the arena in measuring mode (see tensor.h).
+ */
+void arenaInit(Arena* arena, size_t elements) {
+    arena->capacity = elements;
+    arena->used = 0;
+    arena->base = NULL;
+    if (elements > 0) {
+        arena->base = alignedAlloc(elements * sizeof(real));
+        memset(arena->base, 0, elements * sizeof(real));
+    }
+}
+
+/*
+ * arenaFree()
+ * Releases the block; every view carved from it dies too.
+ */
+void arenaFree(Arena* arena) {
+    if (arena->base != NULL) alignedFree(arena->base);
+    arena->base = NULL;
+    arena->capacity = 0;
+    arena->used = 0;
+}
+
+/*
+ * arenaAlloc()
+ * Bumps the arena by `elements` reals, rounded up so the next
+ * piece starts on a TENSOR_ALIGNMENT boundary. Returns NULL
+ * while measuring.
+ */
+real* arenaAlloc(Arena* arena, size_t elements) {
+    size_t perLine = TENSOR_ALIGNMENT / sizeof(real);
+    size_t padded = (elements + perLine - 1) / perLine * perLine;
+    real* ptr = arena->base != NULL ? arena->base + arena->used : NULL;
+
+    arena->used += padded;
+    assert(arena->base == NULL || arena->used <= arena->capacity);
+    return ptr;
+}
+
+/*
+ * arenaBytes()
+ * Same as arenaAlloc() for non-`real` data (index buffers and
+ * the like): `bytes` is rounded up to whole reals first.
+ */
+void* arenaBytes(Arena* arena, size_t bytes) {
+    return arenaAlloc(arena, (bytes + sizeof(real) - 1) / sizeof(real));
+}
+
+/*
+ * arenaTensor()
+ * Carves a tensor of the given shape out of the arena.
+ */
+void arenaTensor(Arena* arena, Tensor* tensor, int ndim, const int* shape) {
+    tensorShape(tensor, ndim, shape);
+    tensor->data = arenaAlloc(arena, tensor->size);
+}
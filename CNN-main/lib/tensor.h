@@ -0,0 +1,78 @@
+/*
+ * tensor.h — contiguous n-d array type
+ * ------------------------------------
+ * A single aligned buffer plus shape and strides. Filters,
+ * weights, images and every intermediate activation live in
+ * one of these instead of nested pointer-of-pointer arrays.
+ */
+
+#ifndef TENSOR_H
+#define TENSOR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <float.h>
+
+/*
+ * real: the scalar type of every weight, activation and
+ * gradient. Double by default; build with -DCNN_FLOAT32 to
+ * halve memory traffic and double the SIMD lane count.
+ */
+#ifdef CNN_FLOAT32
+typedef float real;
+#define REAL_NAME "float32"
+#define REAL_EPSILON FLT_EPSILON
+#define REAL_MIN FLT_MIN
+#else
+typedef double real;
+#define REAL_NAME "float64"
+#define REAL_EPSILON DBL_EPSILON
+#define REAL_MIN DBL_MIN
+#endif
+
+#define TENSOR_MAX_DIMS 4
+#define TENSOR_ALIGNMENT 64
+
+typedef struct {
+    int ndim;
+    int shape[TENSOR_MAX_DIMS];
+    size_t strides[TENSOR_MAX_DIMS];
+    size_t size;
+    real* data;
+} Tensor;
+
+/*
+ * Arena: one aligned block handed out in cache-line sized
+ * pieces. With `base == NULL` it only measures, so a layout
+ * routine can be run once to size the block and again to
+ * carve it.
+ */
+typedef struct {
+    real* base;
+    size_t capacity;
+    size_t used;
+} Arena;
+
+void* alignedAllocUncounted(size_t bytes);
+void* alignedAlloc(size_t bytes);
+void alignedFree(void* ptr);
+
+Tensor* tensorCreate(int ndim, const int* shape);
+Tensor* tensorCreate1D(int d0);
+Tensor* tensorCreate2D(int d0, int d1);
+Tensor* tensorCreate3D(int d0, int d1, int d2);
+void tensorFree(Tensor* tensor);
+void tensorZero(Tensor* tensor);
+real* tensorSlice(Tensor* tensor, int index);
+void tensorView(Tensor* tensor, real* data, int ndim, const int* shape);
+void tensorSelect(Tensor* tensor, int index, Tensor* view);
+void tensorNarrow(Tensor* tensor, int start, int count, Tensor* view);
+
+void arenaInit(Arena* arena, size_t elements);
+void arenaFree(Arena* arena);
+real* arenaAlloc(Arena* arena, size_t elements);
+void* arenaBytes(Arena* arena, size_t bytes);
+void arenaTensor(Arena* arena, Tensor* tensor, int ndim, const int* shape);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * threadpool.c — fork/join worker pool implementation
+ * ---------------------------------------------------
+ * Workers sleep on a condition variable between jobs. Within
+ * a job, tasks are claimed with an atomic counter, so the hot
+ * path takes no locks; the mutex is only touched to start a
+ * job and to report that a worker ran out of tasks. Workers
+ * inherit profileExcludeThread() from the thread driving the
+ * pool, so a pool used for background work stays out of the
+ * profile totals too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "profile.h"
+#include "threadpool.h"
+
+typedef struct {
+    ThreadPool* pool;
+    int index;
+} Worker;
+
+struct ThreadPool {
+    int numThreads;
+    pthread_t* threads;
+    Worker* workers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long generation;
+    int active;
+    int shutdown;
+    int excluded;               /* driver is profile-excluded */
+
+    TaskFunction function;
+    void* context;
+    int numTasks;
+    atomic_int nextTask;
+};
+
+/*
+ * runTasks()
+ * Claims and runs tasks until the current job is exhausted.
+ */
+static void runTasks(ThreadPool* pool, int thread) {
+    for (;;) {
+        int task = atomic_fetch_add(&pool->nextTask, 1);
+        if (task >= pool->numTasks) break;
+        pool->function(pool->context, task, thread);
+    }
+}
+
+/*
+ * workerMain()
+ * Body of every background thread: wait for a new job
+ * generation, help run it, report back, repeat.
+ */
+static void* workerMain(void* arg) {
+    Worker* worker = arg;
+    ThreadPool* pool = worker->pool;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->generation == seen && !pool->shutdown) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->shutdown) break;
+        seen = pool->generation;
+        int excluded = pool->excluded;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (excluded && !profileThreadExcluded()) profileExcludeThread();
+
+        runTasks(pool, worker->index);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/*
+ * initThreadPool()
+ * Starts `numThreads - 1` background threads; the caller of
+ * threadPoolRun() is the remaining one.
+ */
+ThreadPool* initThreadPool(int numThreads) {
+    ThreadPool* pool = malloc(sizeof(ThreadPool));
+    assert(pool != NULL && numThreads > 0);
+
+    pool->numThreads = numThreads;
+    pool->generation = 0;
+    pool->active = 0;
+    pool->shutdown = 0;
+    pool->excluded = 0;
+    pool->function = NULL;
+    pool->context = NULL;
+    pool->numTasks = 0;
+    atomic_init(&pool->nextTask, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    pool->threads = malloc(numThreads * sizeof(pthread_t));
+    pool->workers = malloc(numThreads * sizeof(Worker));
+    assert(pool->threads != NULL && pool->workers != NULL);
+
+    for (int i=1; i<numThreads; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        int status = pthread_create(&pool->threads[i], NULL, workerMain, &pool->workers[i]);
+        assert(status == 0);
+        (void)status;
+    }
+    return pool;
+}
+
+/*
+ * freeThreadPool()
+ * Wakes every worker with the shutdown flag set and joins it.
+ */
+void freeThreadPool(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i=1; i<pool->numThreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool->workers);
+    free(pool);
+}
+
+int threadPoolSize(ThreadPool* pool) {
+    return pool->numThreads;
+}
+
+/*
+ * threadPoolRun()
+ * Calls `function(context, task, thread)` for every task in
+ * [0, numTasks) and returns once all of them have finished.
+ * Only one thread may drive a given pool at a time.
+ */
+void threadPoolRun(ThreadPool* pool, TaskFunction function, void* context, int numTasks) {
+    if (numTasks <= 0) return;
+    if (pool->numThreads == 1 || numTasks == 1) {
+        for (int i=0; i<numTasks; i++) {
+            function(context, i, 0);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->function = function;
+    pool->context = context;
+    pool->numTasks = numTasks;
+    pool->excluded = profileThreadExcluded();
+    atomic_store(&pool->nextTask, 0);
+    pool->active = pool->numThreads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    runTasks(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->active > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,31 @@
+/*
+ * threadpool.h — fork/join worker pool
+ * ------------------------------------
+ * A fixed set of threads that run `numTasks` calls of one
+ * function and then wait for the next job. The calling
+ * thread joins in as thread 0, so a pool of one thread
+ * simply runs everything inline.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/*
+ * A task function gets the shared `context`, the index of
+ * the task to run and the index of the thread running it
+ * (0 … numThreads-1), so callers can keep per-thread scratch.
+ */
+typedef void (*TaskFunction)(void* context, int task, int thread);
+
+typedef struct ThreadPool ThreadPool;
+
+ThreadPool* initThreadPool(int numThreads);
+void freeThreadPool(ThreadPool* pool);
+int threadPoolSize(ThreadPool* pool);
+void threadPoolRun(ThreadPool* pool, TaskFunction function, void* context, int numTasks);
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * trainer.c — data-parallel mini-batch trainer
+ * --------------------------------------------
+ * Batch b of size n on T workers: worker t runs
+ * backpropagation() on images [t·⌈n/T⌉, (t+1)·⌈n/T⌉), the T
+ * gradient buffers are reduced element-range by element-range
+ * (again in parallel) and the optimizer steps once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "simd.h"
+#include "profile.h"
+#include "trainer.h"
+
+/*
+ * initTrainer()
+ * Creates the pool and one workspace + gradient buffer per
+ * worker, each sized for that worker's share of a batch, and
+ * an optimizer over the layers' parameters.
+ */
+Trainer* initTrainer(ConvLayer* convLayer, DenseLayer* denseLayer, int width, int height, int batchSize, int numThreads, const OptimizerConfig* optimizer) {
+    Trainer* trainer = malloc(sizeof(Trainer));
+    assert(trainer != NULL && batchSize > 0 && numThreads > 0);
+
+    if (numThreads > batchSize) numThreads = batchSize;
+    trainer->numThreads = numThreads;
+    trainer->batchSize = batchSize;
+    trainer->convLayer = convLayer;
+    trainer->denseLayer = denseLayer;
+    trainer->pool = initThreadPool(numThreads);
+    trainer->workspaces = malloc(numThreads * sizeof(Workspace*));
+    trainer->grads = malloc(numThreads * sizeof(Gradients*));
+    trainer->probs = malloc((size_t)batchSize * denseLayer->size * sizeof(real));
+    assert(trainer->workspaces != NULL && trainer->grads != NULL && trainer->probs != NULL);
+
+    int share = (batchSize + numThreads - 1) / numThreads;
+    for (int t=0; t<numThreads; t++) {
+        trainer->workspaces[t] = initWorkspace(convLayer, denseLayer, width, height, share);
+        trainer->grads[t] = initGradients(convLayer, denseLayer);
+    }
+
+    Gradients* grads = trainer->grads[0];
+    trainer->optimizer = initOptimizer(optimizer, trainer->pool);
+    optimizerAdd(trainer->optimizer, convLayer->filters->data, grads->filters->data, convLayer->filters->size);
+    optimizerAdd(trainer->optimizer, denseLayer->weights->data, grads->weights->data, denseLayer->weights->size);
+    optimizerAdd(trainer->optimizer, denseLayer->biases->data, grads->biases->data, denseLayer->biases->size);
+    return trainer;
+}
+
+/*
+ * freeTrainer()
+ * Stops the pool and frees every per-worker buffer.
+ */
+void freeTrainer(Trainer* trainer) {
+    freeOptimizer(trainer->optimizer);
+    freeThreadPool(trainer->pool);
+    for (int t=0; t<trainer->numThreads; t++) {
+        freeWorkspace(trainer->workspaces[t]);
+        freeGradients(trainer->grads[t]);
+    }
+    free(trainer->workspaces);
+    free(trainer->grads);
+    free(trainer->probs);
+    free(trainer);
+}
+
+/*
+ * backpropTask()
+ * Worker `task` back-propagates its contiguous slice of the
+ * batch into its own gradient buffer.
+ */
+static void backpropTask(void* context, int task, int thread) {
+    Trainer* trainer = context;
+    Workspace* ws = trainer->workspaces[task];
+    int classes = trainer->denseLayer->size;
+    int start = task * trainer->chunk;
+    int count = trainer->count - start < trainer->chunk ? trainer->count - start : trainer->chunk;
+    (void)thread;
+
+    zeroGradients(trainer->grads[task]);
+    if (count <= 0) return;
+
+    size_t imageSize = (size_t)ws->width * ws->height;
+    real* probs = backpropagation(trainer->convLayer, trainer->denseLayer, ws, trainer->grads[task],
+                                    trainer->images + start * imageSize, trainer->labels + start, count);
+    memcpy(trainer->probs + (size_t)start * classes, probs, (size_t)count * classes * sizeof(real));
+}
+
+/*
+ * reduceRange()
+ * Adds parts[1..n-1] into parts[0] over elements [lo, hi),
+ * always in the same order.
+ */
+static void reduceRange(Tensor** parts, int n, size_t lo, size_t hi) {
+    for (int t=1; t<n; t++) {
+        simd->axpy(1.0, parts[t]->data + lo, parts[0]->data + lo, (int)(hi - lo));
+    }
+}
+
+/*
+ * reduceTask()
+ * Reduces the `task`-th slice of every gradient tensor.
+ */
+static void reduceTask(void* context, int task, int thread) {
+    Trainer* trainer = context;
+    int n = trainer->numThreads;
+    Tensor* parts[n];
+    (void)thread;
+
+    for (int which=0; which<3; which++) {
+        for (int t=0; t<n; t++) {
+            Gradients* grads = trainer->grads[t];
+            parts[t] = which == 0 ? grads->filters : which == 1 ? grads->weights : grads->biases;
+        }
+        size_t size = parts[0]->size;
+        size_t lo = size * task / n;
+        size_t hi = size * (task + 1) / n;
+        reduceRange(parts, n, lo, hi);
+    }
+}
+
+/*
+ * trainBatch()
+ * Runs one data-parallel training step on `count` consecutive
+ * images and returns their [count, classes] probabilities
+ * (valid until the next call).
+ */
+real* trainBatch(Trainer* trainer, const uint8_t* images, const uint8_t* labels, int count) {
+    assert(count > 0 && count <= trainer->batchSize);
+    trainer->images = images;
+    trainer->labels = labels;
+    trainer->count = count;
+    trainer->chunk = (count + trainer->numThreads - 1) / trainer->numThreads;
+
+    threadPoolRun(trainer->pool, backpropTask, trainer, trainer->numThreads);
+    if (trainer->numThreads > 1) {
+        PROFILE_BEGIN(reduceStart);
+        threadPoolRun(trainer->pool, reduceTask, trainer, trainer->numThreads);
+        PROFILE_END(PROFILE_REDUCE, reduceStart);
+    }
+    PROFILE_BEGIN(updateStart);
+    optimizerStep(trainer->optimizer, count);
+    PROFILE_END(PROFILE_UPDATE, updateStart);
+    return trainer->probs;
+}
@@ -0,0 +1,47 @@
+/*
+ * trainer.h — data-parallel mini-batch trainer
+ * --------------------------------------------
+ * Splits every mini-batch across a thread pool. Each worker
+ * owns a Workspace and a private Gradients buffer; at the
+ * end of the batch the buffers are summed in a fixed order
+ * and the optimizer takes one step, so a run is reproducible
+ * for a given thread count and seed.
+ */
+
+#ifndef TRAINER_H
+#define TRAINER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "convolution.h"
+#include "dense.h"
+#include "workspace.h"
+#include "backprop.h"
+#include "threadpool.h"
+#include "optimizer.h"
+
+typedef struct {
+    int numThreads;
+    int batchSize;
+    ConvLayer* convLayer;
+    DenseLayer* denseLayer;
+    ThreadPool* pool;
+    Workspace** workspaces;     /* one per worker */
+    Gradients** grads;          /* one per worker, reduced into grads[0] */
+    real* probs;              /* [batchSize, classes] gathered from the workers */
+    Optimizer* optimizer;       /* updates the layers from grads[0] */
+
+    /* batch currently being processed */
+    const uint8_t* images;
+    const uint8_t* labels;
+    int count;
+    int chunk;
+} Trainer;
+
+Trainer* initTrainer(ConvLayer* convLayer, DenseLayer* denseLayer, int width, int height, int batchSize, int numThreads, const OptimizerConfig* optimizer);
+void freeTrainer(Trainer* trainer);
+real* trainBatch(Trainer* trainer, const uint8_t* images, const uint8_t* labels, int count);
+
+#endif
@@ -0,0 +1,291 @@
+/*
+ * validator.c — asynchronous validation on weight snapshots
+ * ---------------------------------------------------------
+ * Two weight buffers: the training thread copies into
+ * `snapshot` under the lock, the evaluation thread swaps it
+ * with `scoring` and points its private layer structs (and
+ * so its Predictor) at the swapped-in copy. The training
+ * thread therefore never touches weights being scored and the
+ * evaluation never sees a half-updated model.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "tensor.h"
+#include "output.h"
+#include "inference.h"
+#include "checkpoint.h"
+#include "profile.h"
+#include "validator.h"
+
+/*
+ * WeightSnapshot: a copy of every trained tensor, tagged with
+ * the step it was taken at.
+ */
+typedef struct {
+    Tensor filters;
+    Tensor weights;
+    Tensor biases;
+    long step;
+} WeightSnapshot;
+
+struct Validator {
+    ConvLayer* trainedConv;     /* the layers being trained */
+    DenseLayer* trainedDense;
+    Dataset* testSet;
+    char* bestPath;             /* NULL = keep the best in memory only */
+    int classes;
+
+    Arena arena;                /* both snapshots */
+    WeightSnapshot buffers[2];
+    WeightSnapshot* snapshot;   /* filled by the training thread */
+    WeightSnapshot* scoring;    /* owned by the evaluation thread */
+    ConvLayer convLayer;        /* views of `scoring` */
+    DenseLayer denseLayer;
+    Predictor* predictor;
+    real* probs;                /* [testSet->count, classes] */
+    Validation latest;
+    Validation best;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t idle;
+    int pending;
+    int busy;
+    int shutdown;
+};
+
+/*
+ * scoreSnapshot()
+ * Runs the test split through the Predictor on the swapped-in
+ * weights and fills validator->latest.
+ */
+static void scoreSnapshot(Validator* validator) {
+    Dataset* testSet = validator->testSet;
+    int classes = validator->classes;
+    Validation* result = &validator->latest;
+
+    double start = profileSeconds();
+    predict(validator->predictor, testSet->images, testSet->count, validator->probs);
+    memset(result->confusion, 0, (size_t)classes * classes * sizeof(int));
+    double l = 0;
+    int correct = 0;
+    for (int i=0; i<testSet->count; i++) {
+        real* probs = validator->probs + (size_t)i * classes;
+        int label = testSet->labels[i];
+        assert(label < classes); /* openDataset() rejects labels >= MNIST_CLASSES */
+        int predicted = argmax(probs, classes);
+        l += loss(probs, label);
+        correct += predicted == label;
+        result->confusion[label * classes + predicted]++;
+    }
+    result->step = validator->scoring->step;
+    result->loss = l / testSet->count;
+    result->accuracy = (double)correct / testSet->count;
+    result->seconds = profileSeconds() - start;
+}
+
+/*
+ * keepIfBest()
+ * Copies `latest` over `best` if it is more accurate (or as
+ * accurate with a lower loss), saving the weights to bestPath
+ * when set. Returns 1 if it was.
+ */
+static int keepIfBest(Validator* validator) {
+    Validation* latest = &validator->latest;
+    Validation* best = &validator->best;
+    if (best->step >= 0 && (latest->accuracy < best->accuracy || (latest->accuracy == best->accuracy && latest->loss >= best->loss))) {
+        return 0;
+    }
+    int* confusion = best->confusion;
+    *best = *latest;
+    best->confusion = confusion;
+    memcpy(confusion, latest->confusion, (size_t)validator->classes * validator->classes * sizeof(int));
+    if (validator->bestPath != NULL) {
+        saveCheckpoint(validator->bestPath, &validator->convLayer, &validator->denseLayer, latest->step);
+    }
+    return 1;
+}
+
+/*
+ * evaluatorMain()
+ * Background thread: take the latest snapshot, score it,
+ * report, repeat. Drains a pending snapshot before exiting.
+ * It and its Predictor workers are kept out of the profile
+ * totals, so the training lines only count training.
+ */
+static void* evaluatorMain(void* arg) {
+    Validator* validator = arg;
+    profileExcludeThread();
+
+    pthread_mutex_lock(&validator->lock);
+    for (;;) {
+        while (!validator->pending && !validator->shutdown) {
+            pthread_cond_wait(&validator->ready, &validator->lock);
+        }
+        if (!validator->pending) break;
+        WeightSnapshot* buffer = validator->snapshot;
+        validator->snapshot = validator->scoring;
+        validator->scoring = buffer;
+        validator->pending = 0;
+        validator->busy = 1;
+        pthread_mutex_unlock(&validator->lock);
+
+        validator->convLayer.filters = &buffer->filters;
+        validator->denseLayer.weights = &buffer->weights;
+        validator->denseLayer.biases = &buffer->biases;
+        scoreSnapshot(validator);
+        int improved = keepIfBest(validator);
+        printf("[Validation][Step %ld] Loss: %f | Accuracy: %.2f%% | best %.2f%% at step %ld%s | %.0f ms\n",
+               validator->latest.step, validator->latest.loss, validator->latest.accuracy * 100.0,
+               validator->best.accuracy * 100.0, validator->best.step,
+               improved && validator->bestPath != NULL ? " (saved)" : "", validator->latest.seconds * 1e3);
+
+        pthread_mutex_lock(&validator->lock);
+        validator->busy = 0;
+        pthread_cond_broadcast(&validator->idle);
+    }
+    pthread_mutex_unlock(&validator->lock);
+    return NULL;
+}
+
+/*
+ * initValidator()
+ * Starts an evaluation thread (plus numThreads - 1 Predictor
+ * workers) that scores snapshots of `convLayer`/`denseLayer`
+ * on `testSet`, which must stay open until freeValidator().
+ * With `bestPath` every new best snapshot is saved there.
+ */
+Validator* initValidator(ConvLayer* convLayer, DenseLayer* denseLayer, Dataset* testSet, int numThreads, const char* bestPath) {
+    Validator* validator = calloc(1, sizeof(Validator));
+    assert(validator != NULL);
+
+    validator->trainedConv = convLayer;
+    validator->trainedDense = denseLayer;
+    validator->testSet = testSet;
+    validator->classes = denseLayer->size;
+    if (bestPath != NULL) {
+        validator->bestPath = malloc(strlen(bestPath) + 1);
+        assert(validator->bestPath != NULL);
+        strcpy(validator->bestPath, bestPath);
+    }
+
+    arenaInit(&validator->arena, 0);
+    for (int pass=0; pass<2; pass++) {
+        for (int b=0; b<2; b++) {
+            WeightSnapshot* buffer = &validator->buffers[b];
+            arenaTensor(&validator->arena, &buffer->filters, convLayer->filters->ndim, convLayer->filters->shape);
+            arenaTensor(&validator->arena, &buffer->weights, denseLayer->weights->ndim, denseLayer->weights->shape);
+            arenaTensor(&validator->arena, &buffer->biases, denseLayer->biases->ndim, denseLayer->biases->shape);
+        }
+        if (pass == 0) arenaInit(&validator->arena, validator->arena.used);
+    }
+    validator->snapshot = &validator->buffers[0];
+    validator->scoring = &validator->buffers[1];
+
+    validator->convLayer = *convLayer;
+    validator->convLayer.filters = &validator->scoring->filters;
+    validator->denseLayer = *denseLayer;
+    validator->denseLayer.weights = &validator->scoring->weights;
+    validator->denseLayer.biases = &validator->scoring->biases;
+    validator->predictor = initPredictor(&validator->convLayer, &validator->denseLayer, testSet->width, testSet->height, numThreads);
+
+    int classes = validator->classes;
+    validator->probs = malloc((size_t)testSet->count * classes * sizeof(real));
+    validator->latest.confusion = calloc((size_t)classes * classes, sizeof(int));
+    validator->best.confusion = calloc((size_t)classes * classes, sizeof(int));
+    assert(validator->probs != NULL && validator->latest.confusion != NULL && validator->best.confusion != NULL);
+    validator->latest.step = -1;
+    validator->best.step = -1;
+
+    pthread_mutex_init(&validator->lock, NULL);
+    pthread_cond_init(&validator->ready, NULL);
+    pthread_cond_init(&validator->idle, NULL);
+    int rc = pthread_create(&validator->thread, NULL, evaluatorMain, validator);
+    assert(rc == 0);
+    (void)rc;
+    return validator;
+}
+
+/*
+ * validateAsync()
+ * Snapshots the current weights for scoring and returns. Call
+ * between batches so the snapshot is consistent.
+ */
+void validateAsync(Validator* validator, long step) {
+    pthread_mutex_lock(&validator->lock);
+    WeightSnapshot* snapshot = validator->snapshot;
+    memcpy(snapshot->filters.data, validator->trainedConv->filters->data, snapshot->filters.size * sizeof(real));
+    memcpy(snapshot->weights.data, validator->trainedDense->weights->data, snapshot->weights.size * sizeof(real));
+    memcpy(snapshot->biases.data, validator->trainedDense->biases->data, snapshot->biases.size * sizeof(real));
+    snapshot->step = step;
+    validator->pending = 1;
+    pthread_cond_signal(&validator->ready);
+    pthread_mutex_unlock(&validator->lock);
+}
+
+/*
+ * validatorResults()
+ * Waits until every snapshot handed over so far is scored,
+ * then fills `latest` and `best` (step -1 if nothing was
+ * scored). Their confusion matrices stay valid until the next
+ * validateAsync().
+ */
+void validatorResults(Validator* validator, Validation* latest, Validation* best) {
+    pthread_mutex_lock(&validator->lock);
+    while (validator->pending || validator->busy) {
+        pthread_cond_wait(&validator->idle, &validator->lock);
+    }
+    *latest = validator->latest;
+    *best = validator->best;
+    pthread_mutex_unlock(&validator->lock);
+}
+
+/*
+ * printConfusion()
+ * The confusion matrix as a table, labels down the side and
+ * predictions across the top.
+ */
+void printConfusion(const Validation* validation, int classes) {
+    printf("Confusion matrix at step %ld (rows: label, columns: prediction):\n     ", validation->step);
+    for (int c=0; c<classes; c++) {
+        printf("%6d", c);
+    }
+    printf("\n");
+    for (int label=0; label<classes; label++) {
+        printf("%4d ", label);
+        for (int c=0; c<classes; c++) {
+            printf("%6d", validation->confusion[label * classes + c]);
+        }
+        printf("\n");
+    }
+}
+
+/*
+ * freeValidator()
+ * Scores a still-pending snapshot, then stops the evaluation
+ * thread.
+ */
+void freeValidator(Validator* validator) {
+    pthread_mutex_lock(&validator->lock);
+    validator->shutdown = 1;
+    pthread_cond_signal(&validator->ready);
+    pthread_mutex_unlock(&validator->lock);
+    pthread_join(validator->thread, NULL);
+
+    pthread_cond_destroy(&validator->idle);
+    pthread_cond_destroy(&validator->ready);
+    pthread_mutex_destroy(&validator->lock);
+    freePredictor(validator->predictor);
+    free(validator->best.confusion);
+    free(validator->latest.confusion);
+    free(validator->probs);
+    arenaFree(&validator->arena);
+    free(validator->bestPath);
+    free(validator);
+}
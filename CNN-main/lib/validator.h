@@ -0,0 +1,48 @@
+/*
+ * validator.h — asynchronous validation on weight snapshots
+ * ---------------------------------------------------------
+ * A Validator scores the model on the test split while it
+ * trains. validateAsync() copies the weights into a snapshot
+ * buffer between batches (a few memcpys) and returns; a
+ * background thread swaps the snapshot into its second
+ * buffer and runs it through its own Predictor, so training
+ * never waits for the evaluation. If a new snapshot arrives
+ * while one is being scored, the newest one wins.
+ *
+ * Every evaluation prints loss and accuracy, so a run yields
+ * a validation curve. The best snapshot so far (by accuracy,
+ * then loss) is kept with its confusion matrix and can be
+ * saved as a checkpoint each time it improves.
+ */
+
+#ifndef VALIDATOR_H
+#define VALIDATOR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "convolution.h"
+#include "dense.h"
+#include "import.h"
+
+/*
+ * Validation: the result of scoring one snapshot.
+ */
+typedef struct {
+    long step;          /* optimizer steps when the snapshot was taken, -1 = none */
+    double loss;        /* mean cross-entropy */
+    double accuracy;    /* fraction correct */
+    double seconds;     /* wall time of the evaluation */
+    int* confusion;     /* [classes, classes]: row = label, column = prediction */
+} Validation;
+
+typedef struct Validator Validator;
+
+Validator* initValidator(ConvLayer* convLayer, DenseLayer* denseLayer, Dataset* testSet, int numThreads, const char* bestPath);
+void freeValidator(Validator* validator);
+void validateAsync(Validator* validator, long step);
+void validatorResults(Validator* validator, Validation* latest, Validation* best);
+void printConfusion(const Validation* validation, int classes);
+
+#endif
@@ -0,0 +1,521 @@
+/*
+ * winograd.c — Winograd F(2×2, 3×3) convolution
+ * ---------------------------------------------
+ * Transform matrices (Lavin & Gray):
+ *
+ *        | 1  0 -1  0 |        | 1    0    0  |
+ *   Bᵀ = | 0  1  1  0 |    G = | ½    ½    ½  |    Aᵀ = | 1  1  1  0 |
+ *        | 0 -1  1  0 |        | ½   -½    ½  |         | 0  1 -1 -1 |
+ *        | 0  1  0 -1 |        | 0    0    1  |
+ *
+ * The per-tile transforms (Bᵀ·d·B, Aᵀ·m·A and their adjoints)
+ * only add and subtract, so they are written out by hand; the
+ * filter transforms run once per call and use the generic
+ * sandwich(). Tile t covers output rows 2·ty, 2·ty+1 and
+ * columns 2·tx, 2·tx+1, with t = ty·tilesX + tx. Partial
+ * tiles at the bottom/right edge read zeros past the input
+ * and drop the outputs past the edge.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "gemm.h"
+#include "simd.h"
+#include "random.h"
+#include "winograd.h"
+
+static const real G[4 * 3] = {
+    1.0, 0.0, 0.0,
+    0.5, 0.5, 0.5,
+    0.5, -0.5, 0.5,
+    0.0, 0.0, 1.0,
+};
+
+static const real Gt[3 * 4] = {
+    1.0, 0.5, 0.5, 0.0,
+    0.0, 0.5, -0.5, 0.0,
+    0.0, 0.5, 0.5, 1.0,
+};
+
+static int enabled = 1;
+static pthread_once_t enabledOnce = PTHREAD_ONCE_INIT;
+
+static void readEnabled(void) {
+    const char* value = getenv("CNN_WINOGRAD");
+    enabled = value == NULL || strcmp(value, "0") != 0;
+}
+
+/*
+ * winogradApplies()
+ * 1 when a convolution with this filter size, stride and
+ * number of input channels takes the Winograd path.
+ */
+int winogradApplies(int filterSize, int stride, int channels) {
+    pthread_once(&enabledOnce, readEnabled);
+    return enabled && filterSize == 3 && stride == 1 && channels >= WINOGRAD_MIN_CHANNELS;
+}
+
+static int tilesAlong(int outSize) {
+    return (outSize + WINOGRAD_TILE - 1) / WINOGRAD_TILE;
+}
+
+size_t winogradColumnSize(int channels, int outHeight, int outWidth) {
+    return (size_t)WINOGRAD_ELEMENTS * channels * tilesAlong(outHeight) * tilesAlong(outWidth);
+}
+
+/*
+ * winogradScratchSize()
+ * U and dL/dU ([16, filters, channels] each) plus the
+ * products ([16, filters, tiles]).
+ */
+size_t winogradScratchSize(int numFilters, int channels, int outHeight, int outWidth) {
+    size_t tiles = (size_t)tilesAlong(outHeight) * tilesAlong(outWidth);
+    return (size_t)WINOGRAD_ELEMENTS * numFilters * (2 * (size_t)channels + tiles);
+}
+
+/*
+ * sandwich()
+ * out (rows×rows) = L·X·Lᵀ with L rows×cols and X cols×cols.
+ */
+static void sandwich(const real* L, int rows, int cols, const real* X, real* out) {
+    real tmp[4 * 4];
+    for (int i=0; i<rows; i++) {
+        for (int j=0; j<cols; j++) {
+            real sum = 0.0;
+            for (int k=0; k<cols; k++) {
+                sum += L[i * cols + k] * X[k * cols + j];
+            }
+            tmp[i * cols + j] = sum;
+        }
+    }
+    for (int i=0; i<rows; i++) {
+        for (int j=0; j<rows; j++) {
+            real sum = 0.0;
+            for (int k=0; k<cols; k++) {
+                sum += tmp[i * cols + k] * L[j * cols + k];
+            }
+            out[i * rows + j] = sum;
+        }
+    }
+}
+
+/*
+ * transformFilters()
+ * U[ξ, f, c] = (G·g[f, c]·Gᵀ)[ξ].
+ */
+static void transformFilters(const real* filters, int numFilters, int channels, real* U) {
+    size_t stride = (size_t)numFilters * channels;
+    for (int f=0; f<numFilters; f++) {
+        for (int c=0; c<channels; c++) {
+            real u[WINOGRAD_ELEMENTS];
+            sandwich(G, 4, 3, filters + ((size_t)f * channels + c) * 9, u);
+            for (int e=0; e<WINOGRAD_ELEMENTS; e++) {
+                U[e * stride + (size_t)f * channels + c] = u[e];
+            }
+        }
+    }
+}
+
+/*
+ * loadRows()
+ * Copies input rows y0 … y0+count-1, columns x0 … x0+span-1
+ * of `plane` into `rows` (count × span), zero outside the
+ * plane, so the transforms below never bounds-check.
+ */
+static void loadRows(const real* plane, int height, int width, int y0, int x0, int count, int span, real* rows) {
+    for (int i=0; i<count; i++) {
+        real* row = rows + i * span;
+        int y = y0 + i;
+        if (y < 0 || y >= height) {
+            memset(row, 0, span * sizeof(real));
+            continue;
+        }
+        for (int j=0; j<span; j++) {
+            int x = x0 + j;
+            row[j] = x >= 0 && x < width ? plane[y * width + x] : 0.0;
+        }
+    }
+}
+
+/*
+ * winogradInput()
+ * V[ξ, c, t] = (Bᵀ·d·B)[ξ] for the 4×4 patch d of every tile
+ * of every channel of one [channels, height, width] image;
+ * `padding` zeros surround the image. A row of tiles at a
+ * time, so the inner loops run along tx.
+ */
+void winogradInput(const real* image, int channels, int height, int width, int padding, int outHeight, int outWidth, real* columns) {
+    int tilesY = tilesAlong(outHeight);
+    int tilesX = tilesAlong(outWidth);
+    int span = WINOGRAD_TILE * tilesX + 2;
+    size_t tiles = (size_t)tilesY * tilesX;
+    size_t stride = (size_t)channels * tiles;
+    real rows[4 * span];
+
+    for (int c=0; c<channels; c++) {
+        const real* plane = image + (size_t)c * height * width;
+        for (int ty=0; ty<tilesY; ty++) {
+            loadRows(plane, height, width, ty * WINOGRAD_TILE - padding, -padding, 4, span, rows);
+            const real* r0 = rows;
+            const real* r1 = rows + span;
+            const real* r2 = rows + 2 * span;
+            const real* r3 = rows + 3 * span;
+            real* v = columns + (size_t)c * tiles + (size_t)ty * tilesX;
+            for (int tx=0; tx<tilesX; tx++) {
+                int x = WINOGRAD_TILE * tx;
+                real t[4][4];
+                for (int j=0; j<4; j++) {
+                    t[0][j] = r0[x + j] - r2[x + j];
+                    t[1][j] = r1[x + j] + r2[x + j];
+                    t[2][j] = r2[x + j] - r1[x + j];
+                    t[3][j] = r1[x + j] - r3[x + j];
+                }
+                for (int i=0; i<4; i++) {
+                    v[(4*i + 0) * stride + tx] = t[i][0] - t[i][2];
+                    v[(4*i + 1) * stride + tx] = t[i][1] + t[i][2];
+                    v[(4*i + 2) * stride + tx] = t[i][2] - t[i][1];
+                    v[(4*i + 3) * stride + tx] = t[i][1] - t[i][3];
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Per-element products. With few input channels the GEMMs
+ * are [filters × 1..7]·[1..7 × tiles] and cost more in
+ * packing than in arithmetic, so they run as rows of axpy /
+ * dot calls instead.
+ */
+#define WINOGRAD_GEMM_CHANNELS 8
+
+/* M (F×T) = U (F×C)·V (C×T) */
+static void multiply(const real* U, const real* V, int numFilters, int channels, int tiles, real* M) {
+    if (channels >= WINOGRAD_GEMM_CHANNELS) {
+        gemm(0, 0, numFilters, tiles, channels, 1.0, U, channels, V, tiles, 0.0, M, tiles);
+        return;
+    }
+    for (int f=0; f<numFilters; f++) {
+        const real* u = U + (size_t)f * channels;
+        real* m = M + (size_t)f * tiles;
+        simd->scale(u[0], V, m, tiles);
+        for (int c=1; c<channels; c++) {
+            simd->axpy(u[c], V + (size_t)c * tiles, m, tiles);
+        }
+    }
+}
+
+/* dU (F×C) = dM (F×T)·Vᵀ */
+static void multiplyFilterGradient(const real* dM, const real* V, int numFilters, int channels, int tiles, real* dU) {
+    if (channels >= WINOGRAD_GEMM_CHANNELS) {
+        gemm(0, 1, numFilters, channels, tiles, 1.0, dM, tiles, V, tiles, 0.0, dU, channels);
+        return;
+    }
+    for (int f=0; f<numFilters; f++) {
+        for (int c=0; c<channels; c++) {
+            dU[(size_t)f * channels + c] = simd->dot(dM + (size_t)f * tiles, V + (size_t)c * tiles, tiles);
+        }
+    }
+}
+
+/* dV (C×T) = Uᵀ·dM (F×T) */
+static void multiplyInputGradient(const real* U, const real* dM, int numFilters, int channels, int tiles, real* dV) {
+    if (channels >= WINOGRAD_GEMM_CHANNELS) {
+        gemm(1, 0, channels, tiles, numFilters, 1.0, U, channels, dM, tiles, 0.0, dV, tiles);
+        return;
+    }
+    for (int c=0; c<channels; c++) {
+        real* v = dV + (size_t)c * tiles;
+        simd->scale(U[c], dM, v, tiles);
+        for (int f=1; f<numFilters; f++) {
+            simd->axpy(U[(size_t)f * channels + c], dM + (size_t)f * tiles, v, tiles);
+        }
+    }
+}
+
+/*
+ * winogradForward()
+ * [numFilters, outHeight, outWidth] `output` of one image from
+ * its transformed input `columns` (see winogradInput()).
+ */
+void winogradForward(const real* filters, const real* columns, int numFilters, int channels, int outHeight, int outWidth, real* scratch, real* output) {
+    int tilesY = tilesAlong(outHeight);
+    int tilesX = tilesAlong(outWidth);
+    int tiles = tilesY * tilesX;
+    size_t filterStride = (size_t)numFilters * channels;
+    size_t productStride = (size_t)numFilters * tiles;
+    real* U = scratch;
+    real* M = U + 2 * WINOGRAD_ELEMENTS * filterStride;
+    real rows[2 * WINOGRAD_TILE * tilesX];
+
+    transformFilters(filters, numFilters, channels, U);
+    for (int e=0; e<WINOGRAD_ELEMENTS; e++) {
+        multiply(U + e * filterStride, columns + e * (size_t)channels * tiles, numFilters, channels, tiles, M + e * productStride);
+    }
+
+    for (int f=0; f<numFilters; f++) {
+        real* plane = output + (size_t)f * outHeight * outWidth;
+        for (int ty=0; ty<tilesY; ty++) {
+            const real* m = M + (size_t)f * tiles + (size_t)ty * tilesX;
+            real* r0 = rows;
+            real* r1 = rows + WINOGRAD_TILE * tilesX;
+            for (int tx=0; tx<tilesX; tx++) {
+                real t[2][4];
+                for (int j=0; j<4; j++) {
+                    real m0 = m[(0 + j) * productStride + tx];
+                    real m1 = m[(4 + j) * productStride + tx];
+                    real m2 = m[(8 + j) * productStride + tx];
+                    real m3 = m[(12 + j) * productStride + tx];
+                    t[0][j] = m0 + m1 + m2;
+                    t[1][j] = m1 - m2 - m3;
+                }
+                r0[2*tx] = t[0][0] + t[0][1] + t[0][2];
+                r0[2*tx + 1] = t[0][1] - t[0][2] - t[0][3];
+                r1[2*tx] = t[1][0] + t[1][1] + t[1][2];
+                r1[2*tx + 1] = t[1][1] - t[1][2] - t[1][3];
+            }
+            int y = ty * WINOGRAD_TILE;
+            memcpy(plane + y * outWidth, r0, outWidth * sizeof(real));
+            if (y + 1 < outHeight) memcpy(plane + (y + 1) * outWidth, r1, outWidth * sizeof(real));
+        }
+    }
+}
+
+/*
+ * winogradBackward()
+ * Adds the filter gradient of one image to `dFilters` and, if
+ * `dInput` is given, adds its input gradient there (the caller
+ * zeroes it). `columns` must still hold the image's V and is
+ * overwritten when an input gradient is computed.
+ */
+void winogradBackward(const real* filters, real* columns, const real* dOutput, int numFilters, int channels, int outHeight, int outWidth,
+                      real* scratch, real* dFilters, real* dInput, int height, int width, int padding) {
+    int tilesY = tilesAlong(outHeight);
+    int tilesX = tilesAlong(outWidth);
+    int tiles = tilesY * tilesX;
+    int span = WINOGRAD_TILE * tilesX + 2;
+    size_t filterStride = (size_t)numFilters * channels;
+    size_t productStride = (size_t)numFilters * tiles;
+    size_t columnStride = (size_t)channels * tiles;
+    real* U = scratch;
+    real* dU = U + WINOGRAD_ELEMENTS * filterStride;
+    real* dM = dU + WINOGRAD_ELEMENTS * filterStride;
+    real rows[4 * span];
+
+    for (int f=0; f<numFilters; f++) {
+        const real* plane = dOutput + (size_t)f * outHeight * outWidth;
+        for (int ty=0; ty<tilesY; ty++) {
+            loadRows(plane, outHeight, outWidth, ty * WINOGRAD_TILE, 0, 2, span, rows);
+            const real* g0 = rows;
+            const real* g1 = rows + span;
+            real* m = dM + (size_t)f * tiles + (size_t)ty * tilesX;
+            for (int tx=0; tx<tilesX; tx++) {
+                int x = WINOGRAD_TILE * tx;
+                real t[4][2];
+                for (int j=0; j<2; j++) {
+                    t[0][j] = g0[x + j];
+                    t[1][j] = g0[x + j] + g1[x + j];
+                    t[2][j] = g0[x + j] - g1[x + j];
+                    t[3][j] = -g1[x + j];
+                }
+                for (int i=0; i<4; i++) {
+                    m[(4*i + 0) * productStride + tx] = t[i][0];
+                    m[(4*i + 1) * productStride + tx] = t[i][0] + t[i][1];
+                    m[(4*i + 2) * productStride + tx] = t[i][0] - t[i][1];
+                    m[(4*i + 3) * productStride + tx] = -t[i][1];
+                }
+            }
+        }
+    }
+
+    for (int e=0; e<WINOGRAD_ELEMENTS; e++) {
+        multiplyFilterGradient(dM + e * productStride, columns + e * columnStride, numFilters, channels, tiles, dU + e * filterStride);
+    }
+    for (int f=0; f<numFilters; f++) {
+        for (int c=0; c<channels; c++) {
+            real du[WINOGRAD_ELEMENTS];
+            real dg[9];
+            for (int e=0; e<WINOGRAD_ELEMENTS; e++) {
+                du[e] = dU[e * filterStride + (size_t)f * channels + c];
+            }
+            sandwich(Gt, 3, 4, du, dg);
+            real* out = dFilters + ((size_t)f * channels + c) * 9;
+            for (int k=0; k<9; k++) {
+                out[k] += dg[k];
+            }
+        }
+    }
+    if (dInput == NULL) return;
+
+    transformFilters(filters, numFilters, channels, U);
+    for (int e=0; e<WINOGRAD_ELEMENTS; e++) {
+        multiplyInputGradient(U + e * filterStride, dM + e * productStride, numFilters, channels, tiles, columns + e * columnStride);
+    }
+    for (int c=0; c<channels; c++) {
+        real* plane = dInput + (size_t)c * height * width;
+        for (int ty=0; ty<tilesY; ty++) {
+            /* tiles overlap by two columns and rows: accumulate a
+               row of patches, then add the rows inside the image */
+            memset(rows, 0, 4 * span * sizeof(real));
+            const real* v = columns + (size_t)c * tiles + (size_t)ty * tilesX;
+            for (int tx=0; tx<tilesX; tx++) {
+                real t[4][4];
+                for (int j=0; j<4; j++) {
+                    real v0 = v[(0 + j) * columnStride + tx];
+                    real v1 = v[(4 + j) * columnStride + tx];
+                    real v2 = v[(8 + j) * columnStride + tx];
+                    real v3 = v[(12 + j) * columnStride + tx];
+                    t[0][j] = v0;
+                    t[1][j] = v1 - v2 + v3;
+                    t[2][j] = v1 + v2 - v0;
+                    t[3][j] = -v3;
+                }
+                int x = WINOGRAD_TILE * tx;
+                for (int i=0; i<4; i++) {
+                    real* row = rows + i * span + x;
+                    row[0] += t[i][0];
+                    row[1] += t[i][1] - t[i][2] + t[i][3];
+                    row[2] += t[i][1] + t[i][2] - t[i][0];
+                    row[3] -= t[i][3];
+                }
+            }
+            for (int i=0; i<4; i++) {
+                int y = ty * WINOGRAD_TILE - padding + i;
+                if (y < 0 || y >= height) continue;
+                const real* row = rows + i * span;
+                for (int j=0; j<span; j++) {
+                    int x = j - padding;
+                    if (x >= 0 && x < width) plane[y * width + x] += row[j];
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Reference direct convolution for the self-test: output[f]
+ * = Σ_c g[f, c] ⋆ image[c] with zero padding.
+ */
+static real referenceTap(const real* image, int height, int width, int y, int x) {
+    return y >= 0 && y < height && x >= 0 && x < width ? image[y * width + x] : 0.0;
+}
+
+static double maxError(const real* a, const real* b, size_t n) {
+    double error = 0.0;
+    double scale = 0.0;
+    for (size_t i=0; i<n; i++) {
+        double diff = fabs((double)a[i] - (double)b[i]);
+        if (diff > error) error = diff;
+        if (fabs((double)b[i]) > scale) scale = fabs((double)b[i]);
+    }
+    return scale > 0.0 ? error / scale : error;
+}
+
+/*
+ * selfTestCase()
+ * Forward output, filter gradient and input gradient of one
+ * random problem against direct loops; returns the largest
+ * error relative to the largest reference value.
+ */
+static double selfTestCase(int numFilters, int channels, int height, int width, int padding) {
+    int outHeight = height + 2 * padding - 2;
+    int outWidth = width + 2 * padding - 2;
+    size_t imageSize = (size_t)channels * height * width;
+    size_t outputSize = (size_t)numFilters * outHeight * outWidth;
+    size_t filterSize = (size_t)numFilters * channels * 9;
+    size_t total = 2 * imageSize + 3 * outputSize + 3 * filterSize
+                 + winogradColumnSize(channels, outHeight, outWidth) + winogradScratchSize(numFilters, channels, outHeight, outWidth);
+    real* block = alignedAlloc(total * sizeof(real));
+    real* image = block;
+    real* dInput = image + imageSize;
+    real* output = dInput + imageSize;
+    real* dOutput = output + outputSize;
+    real* reference = dOutput + outputSize;
+    real* filters = reference + outputSize;
+    real* dFilters = filters + filterSize;
+    real* dReference = dFilters + filterSize;
+    real* columns = dReference + filterSize;
+    real* scratch = columns + winogradColumnSize(channels, outHeight, outWidth);
+
+    uint64_t stream = RANDOM_PART(RANDOM_SELFTEST, RANDOM_FIXTURE_WINOGRAD);
+    uint64_t next = 0;
+    for (size_t i=0; i<imageSize; i++) image[i] = randomBetween(RANDOM_TEST_SEED, stream, next++, 0.0, 1.0);
+    for (size_t i=0; i<filterSize; i++) filters[i] = randomBetween(RANDOM_TEST_SEED, stream, next++, -0.5, 0.5);
+    for (size_t i=0; i<outputSize; i++) dOutput[i] = randomBetween(RANDOM_TEST_SEED, stream, next++, -0.5, 0.5);
+    memset(dInput, 0, imageSize * sizeof(real));
+    memset(dFilters, 0, filterSize * sizeof(real));
+    memset(dReference, 0, filterSize * sizeof(real));
+
+    winogradInput(image, channels, height, width, padding, outHeight, outWidth, columns);
+    winogradForward(filters, columns, numFilters, channels, outHeight, outWidth, scratch, output);
+    winogradBackward(filters, columns, dOutput, numFilters, channels, outHeight, outWidth, scratch, dFilters, dInput, height, width, padding);
+
+    real* dImage = alignedAlloc(imageSize * sizeof(real));
+    memset(dImage, 0, imageSize * sizeof(real));
+    for (int f=0; f<numFilters; f++) {
+        for (int y=0; y<outHeight; y++) {
+            for (int x=0; x<outWidth; x++) {
+                size_t o = ((size_t)f * outHeight + y) * outWidth + x;
+                real sum = 0.0;
+                for (int c=0; c<channels; c++) {
+                    const real* plane = image + (size_t)c * height * width;
+                    for (int k=0; k<9; k++) {
+                        int iy = y + k / 3 - padding;
+                        int ix = x + k % 3 - padding;
+                        size_t w = ((size_t)f * channels + c) * 9 + k;
+                        sum += filters[w] * referenceTap(plane, height, width, iy, ix);
+                        dReference[w] += dOutput[o] * referenceTap(plane, height, width, iy, ix);
+                        if (iy >= 0 && iy < height && ix >= 0 && ix < width) {
+                            dImage[(size_t)c * height * width + iy * width + ix] += dOutput[o] * filters[w];
+                        }
+                    }
+                }
+                reference[o] = sum;
+            }
+        }
+    }
+
+    double error = maxError(output, reference, outputSize);
+    double filterError = maxError(dFilters, dReference, filterSize);
+    double inputError = maxError(dInput, dImage, imageSize);
+    if (filterError > error) error = filterError;
+    if (inputError > error) error = inputError;
+    alignedFree(dImage);
+    alignedFree(block);
+    return error;
+}
+
+/*
+ * winogradSelfTest()
+ * Checks forward and both gradients on a few shapes (odd
+ * sizes, padding, several channels) against the direct
+ * reference. Returns the number of failing cases.
+ */
+int winogradSelfTest(void) {
+    static const int cases[][5] = {
+        {8, 1, 28, 28, 0},
+        {5, 3, 11, 9, 1},
+        {4, 2, 7, 8, 0},
+        {16, 8, 13, 13, 1},
+    };
+#ifdef CNN_FLOAT32
+    double tolerance = 1e-5;
+#else
+    double tolerance = 1e-12;
+#endif
+    int failures = 0;
+    for (size_t i=0; i<sizeof(cases) / sizeof(cases[0]); i++) {
+        const int* c = cases[i];
+        double error = selfTestCase(c[0], c[1], c[2], c[3], c[4]);
+        int ok = error <= tolerance;
+        printf("Winograd self-test: %2d filters × %d channels, %2d×%-2d pad %d: max rel. error %.2e %s\n",
+               c[0], c[1], c[2], c[3], c[4], error, ok ? "ok" : "FAILED");
+        failures += !ok;
+    }
+    return failures;
+}
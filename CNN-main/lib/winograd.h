@@ -0,0 +1,48 @@
+/*
+ * winograd.h — Winograd F(2×2, 3×3) convolution
+ * ---------------------------------------------
+ * Fast path for 3×3, stride-1 convolutions. The output is
+ * cut into 2×2 tiles; each tile needs a 4×4 input patch d,
+ * and with the transformed filter U = G·g·Gᵀ and patch
+ * V = Bᵀ·d·B the tile is Aᵀ·(U ⊙ V)·A. Summed over input
+ * channels, every one of the 16 elements ξ of the product is
+ * a small [filters × channels]·[channels × tiles] GEMM, so a
+ * tile costs 16 multiplies per filter and channel instead of
+ * 36 (2.25× fewer).
+ *
+ * The backward pass runs the same transforms in adjoint form:
+ * dM = A·dY·Aᵀ per tile, dL/dU = dM·Vᵀ, dL/dg += Gᵀ·dU·G and,
+ * when an input gradient is wanted, dV = Uᵀ·dM scattered back
+ * as B·dV·Bᵀ.
+ *
+ * Buffers: `columns` holds V ([16, channels, tiles]) and is
+ * what the forward pass leaves for the backward pass, like the
+ * im2col columns of the GEMM path. `scratch` holds U, the
+ * products and dL/dU. Set CNN_WINOGRAD=0 to always use the
+ * im2col + GEMM path.
+ */
+
+#ifndef WINOGRAD_H
+#define WINOGRAD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "tensor.h"
+
+#define WINOGRAD_TILE 2         /* output tile edge */
+#define WINOGRAD_PATCH 4        /* input patch edge */
+#define WINOGRAD_ELEMENTS 16    /* WINOGRAD_PATCH² */
+#define WINOGRAD_MIN_CHANNELS 2 /* with one input channel the transforms cost more than they save */
+
+int winogradApplies(int filterSize, int stride, int channels);
+size_t winogradColumnSize(int channels, int outHeight, int outWidth);
+size_t winogradScratchSize(int numFilters, int channels, int outHeight, int outWidth);
+void winogradInput(const real* image, int channels, int height, int width, int padding, int outHeight, int outWidth, real* columns);
+void winogradForward(const real* filters, const real* columns, int numFilters, int channels, int outHeight, int outWidth, real* scratch, real* output);
+void winogradBackward(const real* filters, real* columns, const real* dOutput, int numFilters, int channels, int outHeight, int outWidth,
+                      real* scratch, real* dFilters, real* dInput, int height, int width, int padding);
+int winogradSelfTest(void);
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * workspace.c — per-network scratch arena
+ * ---------------------------------------
+ * Lays every intermediate buffer of one forward/backward
+ * pass out in a single aligned block.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "workspace.h"
+
+/*
+ * layoutWorkspace()
+ * Carves all tensors from the arena. Run once in measuring
+ * mode to size the arena, then again to hand out memory.
+ */
+static void layoutWorkspace(Workspace* ws, ConvLayer* convLayer, DenseLayer* denseLayer) {
+    int numFilters = convLayer->numFilters;
+    int filterSize = convLayer->filterSize;
+    int classes = denseLayer->size;
+
+    int batch = ws->batchSize;
+
+    int convShape[3] = {numFilters, ws->convHeight, ws->convWidth};
+    int columnShape[2] = {filterSize * filterSize, batch * ws->convHeight * ws->convWidth};
+    int batchConvShape[2] = {numFilters, batch * ws->convHeight * ws->convWidth};
+    int batchPooledShape[4] = {batch, numFilters, ws->pooledHeight, ws->pooledWidth};
+    int batchClassShape[2] = {batch, classes};
+
+    arenaTensor(&ws->arena, &ws->columns, 2, columnShape);
+    arenaTensor(&ws->arena, &ws->convoluted, 3, convShape);
+    arenaTensor(&ws->arena, &ws->pooled, 4, batchPooledShape);
+    ws->argmax = arenaBytes(&ws->arena, ws->pooled.size);
+    arenaTensor(&ws->arena, &ws->totals, 2, batchClassShape);
+    arenaTensor(&ws->arena, &ws->probs, 2, batchClassShape);
+
+    arenaTensor(&ws->arena, &ws->dL_dtot, 2, batchClassShape);
+    arenaTensor(&ws->arena, &ws->dL_din, 4, batchPooledShape);
+
+    arenaTensor(&ws->arena, &ws->dL_dconv, 2, batchConvShape);
+}
+
+/*
+ * initWorkspace()
+ * Derives every layer's output shape from a `width`×`height`
+ * input and allocates one arena big enough for all buffers of
+ * a `batchSize`-image pass.
+ */
+Workspace* initWorkspace(ConvLayer* convLayer, DenseLayer* denseLayer, int width, int height, int batchSize) {
+    Workspace* ws = malloc(sizeof(Workspace));
+    assert(ws != NULL && batchSize > 0);
+
+    ws->batchSize = batchSize;
+    ws->width = width;
+    ws->height = height;
+    ws->convWidth = width - (convLayer->filterSize-1);
+    ws->convHeight = height - (convLayer->filterSize-1);
+    ws->pooledWidth = ws->convWidth / 2;
+    ws->pooledHeight = ws->convHeight / 2;
+    assert(ws->pooledWidth * ws->pooledHeight * convLayer->numFilters == denseLayer->inputSize);
+
+    arenaInit(&ws->arena, 0);
+    layoutWorkspace(ws, convLayer, denseLayer);
+    arenaInit(&ws->arena, ws->arena.used);
+    layoutWorkspace(ws, convLayer, denseLayer);
+    return ws;
+}
+
+/*
+ * freeWorkspace()
+ * Releases the arena and the workspace header.
+ */
+void freeWorkspace(Workspace* workspace) {
+    arenaFree(&workspace->arena);
+    free(workspace);
+}
@@ -0,0 +1,53 @@
+/*
+ * workspace.h — preallocated per-network scratch memory
+ * -----------------------------------------------------
+ * Every activation and gradient buffer the forward and
+ * backward passes need for a mini-batch, sized once from the
+ * layer shapes and the batch size and carved out of a single
+ * arena. After initWorkspace() the training and inference
+ * loops never call malloc/free.
+ */
+
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "tensor.h"
+#include "convolution.h"
+#include "dense.h"
+
+typedef struct {
+    int batchSize;          /* images per forward/backward pass */
+    int width;              /* input image */
+    int height;
+    int convWidth;          /* convolution output */
+    int convHeight;
+    int pooledWidth;        /* max-pool output */
+    int pooledHeight;
+
+    Arena arena;
+
+    /* forward, one slot per image in the batch */
+    Tensor columns;         /* [filterSize², batch·convH·convW] im2col, image b at column b·convH·convW */
+    Tensor convoluted;      /* [numFilters, convH, convW], one image at a time */
+    Tensor pooled;          /* [batch, numFilters, pooledH, pooledW] */
+    uint8_t* argmax;        /* [batch, numFilters, pooledH, pooledW] POOL_* codes */
+    Tensor totals;          /* [batch, classes] */
+    Tensor probs;           /* [batch, classes] */
+
+    /* backward, whole batch */
+    Tensor dL_dtot;         /* [batch, classes] probs - onehot */
+    Tensor dL_din;          /* [batch, numFilters, pooledH, pooledW] */
+
+    /* convolution backward, laid out like `columns` */
+    Tensor dL_dconv;        /* [numFilters, batch·convH·convW] */
+} Workspace;
+
+Workspace* initWorkspace(ConvLayer* convLayer, DenseLayer* denseLayer, int width, int height, int batchSize);
+void freeWorkspace(Workspace* workspace);
+
+#endif
@@ -0,0 +1,226 @@
+/*
+ * loadgen.c — load generator for the inference server
+ * -------------------------------------------
+ * Opens a number of concurrent connections to a running
+ * `./cnn --serve` and has each one send test images back to
+ * back (closed loop: the next request goes out as soon as the
+ * previous answer is in). Prints throughput, client-side
+ * latency percentiles and, when the MNIST test labels are
+ * available, the accuracy of the answers.
+ *
+ * Without the MNIST test images random pixels are sent, so
+ * the server can be load-tested anywhere.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "lib/import.h"
+#include "lib/server.h"
+#include "lib/random.h"
+#include "lib/profile.h"
+
+/*
+ * Options: command-line settings, see usage().
+ */
+typedef struct {
+    const char* address;
+    int clients;
+    int requests;           /* per client */
+    uint64_t seed;
+    const char* dataDir;
+} Options;
+
+/*
+ * Client: one connection's share of the run.
+ */
+typedef struct {
+    const char* address;
+    const uint8_t* images;
+    const uint8_t* labels;  /* NULL for random images */
+    int count;
+    size_t imageSize;
+    int first;              /* image this client starts at */
+    int requests;
+    double* latencies;      /* [requests], seconds */
+    int answered;
+    int correct;
+} Client;
+
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s --connect PATH|PORT [--clients N] [--requests N] [--seed N] [--data DIR]\n", program);
+}
+
+static int parseOptions(int argc, char** argv, Options* options) {
+    options->address = NULL;
+    options->clients = 4;
+    options->requests = 2000;
+    options->seed = 1;
+    options->dataDir = "./MNIST";
+
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--connect") == 0 && i+1 < argc) {
+            options->address = argv[++i];
+        } else if (strcmp(argv[i], "--clients") == 0 && i+1 < argc) {
+            options->clients = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--requests") == 0 && i+1 < argc) {
+            options->requests = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc) {
+            options->seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--data") == 0 && i+1 < argc) {
+            options->dataDir = argv[++i];
+        } else {
+            return 0;
+        }
+    }
+    return options->address != NULL && options->clients > 0 && options->requests > 0;
+}
+
+/*
+ * clientMain()
+ * Connects, sends `requests` images in turn and times each
+ * answer. Stops early if the connection breaks.
+ */
+static void* clientMain(void* arg) {
+    Client* client = arg;
+    ServerHello hello;
+    int fd = serverConnect(client->address, &hello);
+    if (fd < 0) return NULL;
+    if ((size_t)hello.width * hello.height != client->imageSize) {
+        fprintf(stderr, "server expects %ux%u images\n", hello.width, hello.height);
+        close(fd);
+        return NULL;
+    }
+
+    float* probs = malloc(hello.classes * sizeof(float));
+    assert(probs != NULL);
+    for (int r=0; r<client->requests; r++) {
+        int index = (client->first + r) % client->count;
+        double start = profileSeconds();
+        if (!serverQuery(fd, client->images + index * client->imageSize, client->imageSize, probs, hello.classes)) break;
+        client->latencies[client->answered++] = profileSeconds() - start;
+
+        if (client->labels != NULL) {
+            int best = 0;
+            for (uint32_t k=1; k<hello.classes; k++) {
+                if (probs[k] > probs[best]) best = k;
+            }
+            client->correct += best == client->labels[index];
+        }
+    }
+    free(probs);
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, &options)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char imagesPath[1024];
+    char labelsPath[1024];
+    snprintf(imagesPath, sizeof(imagesPath), "%s/t10k-images.idx3-ubyte", options.dataDir);
+    snprintf(labelsPath, sizeof(labelsPath), "%s/t10k-labels.idx1-ubyte", options.dataDir);
+    Dataset* dataset = NULL;
+    if (access(imagesPath, R_OK) == 0 && access(labelsPath, R_OK) == 0) {
+        dataset = openDataset(imagesPath, labelsPath);
+    }
+
+    const uint8_t* images;
+    const uint8_t* labels = NULL;
+    uint8_t* random = NULL;
+    int count;
+    size_t imageSize;
+    if (dataset != NULL) {
+        images = dataset->images;
+        labels = dataset->labels;
+        count = dataset->count;
+        imageSize = (size_t)dataset->width * dataset->height;
+        printf("Sending %d test images from %s\n", count, options.dataDir);
+    } else {
+        count = 1000;
+        imageSize = 28 * 28;
+        random = malloc(count * imageSize);
+        assert(random != NULL);
+        for (size_t i=0; i<count * imageSize; i++) {
+            random[i] = (uint8_t)randomBelow(options.seed, RANDOM_SYNTHETIC, i, 256);
+        }
+        images = random;
+        printf("No test images in %s, sending random pixels\n", options.dataDir);
+    }
+
+    Client* clients = malloc(options.clients * sizeof(Client));
+    pthread_t* threads = malloc(options.clients * sizeof(pthread_t));
+    double* latencies = malloc((size_t)options.clients * options.requests * sizeof(double));
+    assert(clients != NULL && threads != NULL && latencies != NULL);
+
+    double start = profileSeconds();
+    for (int c=0; c<options.clients; c++) {
+        Client* client = &clients[c];
+        client->address = options.address;
+        client->images = images;
+        client->labels = labels;
+        client->count = count;
+        client->imageSize = imageSize;
+        client->first = (int)((long)c * count / options.clients);
+        client->requests = options.requests;
+        client->latencies = latencies + (size_t)c * options.requests;
+        client->answered = 0;
+        client->correct = 0;
+        int rc = pthread_create(&threads[c], NULL, clientMain, client);
+        assert(rc == 0);
+        (void)rc;
+    }
+    for (int c=0; c<options.clients; c++) {
+        pthread_join(threads[c], NULL);
+    }
+    double elapsed = profileSeconds() - start;
+
+    /* gather every answered request's latency at the front */
+    int answered = 0;
+    int correct = 0;
+    for (int c=0; c<options.clients; c++) {
+        memmove(latencies + answered, clients[c].latencies, clients[c].answered * sizeof(double));
+        answered += clients[c].answered;
+        correct += clients[c].correct;
+    }
+
+    int status = 0;
+    if (answered == 0) {
+        fprintf(stderr, "No requests answered.\n");
+        status = 1;
+    } else {
+        qsort(latencies, answered, sizeof(double), compareDoubles);
+        printf("%d clients, %d requests in %.3f s: %.0f req/s | latency p50 %.3f ms p99 %.3f ms max %.3f ms\n",
+               options.clients, answered, elapsed, answered / elapsed,
+               latencies[answered / 2] * 1e3, latencies[(99 * answered + 99) / 100 - 1] * 1e3, latencies[answered - 1] * 1e3);
+        if (labels != NULL) {
+            printf("Accuracy of the answers: %.2f%%\n", correct * 100.0 / answered);
+        }
+        if (answered < options.clients * options.requests) {
+            fprintf(stderr, "%d requests were not answered.\n", options.clients * options.requests - answered);
+            status = 1;
+        }
+    }
+
+    free(latencies);
+    free(threads);
+    free(clients);
+    free(random);
+    if (dataset != NULL) closeDataset(dataset);
+    return status;
+}
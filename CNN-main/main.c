@@ -10,123 +10,677 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <math.h>
 #include <time.h>
 #include <assert.h>
 
+#include "lib/tensor.h"
+#include "lib/simd.h"
 #include "lib/import.h"
+#include "lib/datastream.h"
+#include "lib/augment.h"
 #include "lib/convolution.h"
 #include "lib/pooling.h"
 #include "lib/dense.h"
 #include "lib/output.h"
+#include "lib/workspace.h"
+#include "lib/inference.h"
 #include "lib/backprop.h"
+#include "lib/trainer.h"
+#include "lib/optimizer.h"
+#include "lib/gradcheck.h"
+#include "lib/checkpoint.h"
+#include "lib/quantize.h"
+#include "lib/qinference.h"
+#include "lib/profile.h"
+#include "lib/network.h"
+#include "lib/winograd.h"
+#include "lib/random.h"
+#include "lib/server.h"
+#include "lib/validator.h"
 
 
 /*
- * forward()
- * Runs a single image through the CNN layers (Conv ➜ MaxPool ➜ Dense ➜ Softmax)
- * and returns the class-probability vector.
+ * TrainLog: rolling loss/accuracy over the last 1000 training
+ * images, plus the profile counters at the last report.
  */
-double* forward(ConvLayer* convLayer, DenseLayer* denseLayer, double** image, int width, int height, int divisor) {
-    double** convolutedImage = convolutionForward(convLayer, image, width, height, divisor);
-    double* pooledImage = poolingForward(convolutedImage, (width-(divisor-1))/2, (height-(divisor-1))/2, convLayer->numFilters);
-    double* totals = denseForward(denseLayer, pooledImage, (width-(divisor-1))/2, (height-(divisor-1))/2, convLayer->numFilters);
-    double* probs = softmax(totals, denseLayer->size);
+typedef struct {
+    double loss;
+    int correct;
+    int step;
+    int sinceLog;
+    double logStart;
+    ProfileTotals profile;
+} TrainLog;
 
-    for (int i = 0; i < convLayer->numFilters; i++) {
-        free(convolutedImage[i]);
+void startLog(TrainLog* log) {
+    log->sinceLog = 0;
+    profileSnapshot(&log->profile);
+    log->logStart = profileSeconds();
+}
+
+void startEpoch(TrainLog* log) {
+    log->loss = 0;
+    log->correct = 0;
+    log->step = 0;
+}
+
+/*
+ * logBatch()
+ * Adds one batch to the rolling metrics and prints the loss
+ * line every 1000 images, followed by the per-stage timings
+ * and images/sec of those images (see profile.h).
+ */
+void logBatch(TrainLog* log, real* probs, const uint8_t* labels, int count, int classes, int epoch) {
+    int logged = 0;
+    for (int b=0; b<count; b++) {
+        log->loss += loss(probs + b * classes, labels[b]);
+        log->correct += accuracy(probs + b * classes, labels[b], classes);
+        if (++log->step % 1000 == 0) {
+            printf("[Epoch %d][Step %d] Past 1000 steps : Average Loss: %f | Accuracy: %d%%\n", epoch+1, log->step, log->loss/1000, log->correct/10);
+            log->loss = 0;
+            log->correct = 0;
+            logged = 1;
+        }
+    }
+    log->sinceLog += count;
+    if (logged) {
+        double now = profileSeconds();
+        profileLog(&log->profile, log->sinceLog, now - log->logStart);
+        log->logStart = now;
+        log->sinceLog = 0;
     }
-    free(convolutedImage);
-    free(pooledImage);
-    free(totals);
-    return probs;
+}
+
+/*
+ * nextBatch()
+ * The next training batch from the augmenter if there is one,
+ * else straight from the stream (see streamNext()). -1 means
+ * the training files could not be read.
+ */
+int nextBatch(DataStream* stream, Augmenter* augmenter, const uint8_t** images, const uint8_t** labels) {
+    return augmenter != NULL ? augmentNext(augmenter, images, labels) : streamNext(stream, images, labels);
+}
+
+/*
+ * reportAugment()
+ * Augmentation throughput so far and how long the trainer
+ * waited for it, printed after every epoch.
+ */
+void reportAugment(Augmenter* augmenter) {
+    AugmentStats stats;
+    augmentStats(augmenter, &stats);
+    printf("Augmented %ld images (%.0f images/sec while busy); trainer waited %ld time(s), %.1f ms in total\n",
+           stats.images, stats.busy > 0.0 ? stats.images / stats.busy : 0.0, stats.stalls, stats.waited * 1e3);
+}
+
+/*
+ * reportValidation()
+ * Waits for the last snapshot to be scored, then prints the best
+ * one and its confusion matrix.
+ */
+void reportValidation(Validator* validator, int classes, const char* bestPath) {
+    Validation latest, best;
+    validatorResults(validator, &latest, &best);
+    if (best.step < 0) return;
+    printf("Best validation: step %ld, Loss: %f | Accuracy: %.2f%%%s%s\n", best.step, best.loss, best.accuracy * 100.0,
+           bestPath != NULL ? " | saved to " : "", bestPath != NULL ? bestPath : "");
+    printConfusion(&best, classes);
+    printf("\n");
 }
 
 /*
  * train()
- * Iterates over the MNIST training set, performs back-prop and updates weights.
- * Prints rolling loss & accuracy every 1k images.
- */
-void train(ConvLayer* convLayer, DenseLayer* denseLayer, int epoch, double learningRate) {
-    char* imagesPath = "./MNIST/train-images.idx3-ubyte";
-    char* labelsPath = "./MNIST/train-labels.idx1-ubyte";
-    int* parameters = readParameters(imagesPath);
-    double*** testImages = readImages(imagesPath);
-    int* testLabels = readLabels(labelsPath);
-
-    printf("Number of images: %d\n", parameters[0]);
-    printf("Heigt: %d\n", parameters[1]);
-    printf("Width: %d\n", parameters[2]);
-    
-    double* probs = malloc(denseLayer->size * sizeof(double));
-    for (int j=0; j<epoch; j++) {
-        double l = 0;
-        int correct = 0;
-        for (int i=0; i<parameters[0]; i++) {
-            probs = backpropagation(convLayer, denseLayer, testImages[i], parameters[1], parameters[2], convLayer->filterSize, testLabels[i], learningRate);
-            l += loss(probs, testLabels[i]);
-            correct += accuracy(probs, testLabels[i], denseLayer->size);
-            if (i%1000 == 999) {
-                printf("[Epoch %d][Step %d] Past 1000 steps : Average Loss: %f | Accuracy: %d%%\n", j+1, i+1, l/1000, correct/10);
-                l = 0;
-                correct = 0;
+ * Streams the MNIST training set in shuffled mini-batches (see
+ * datastream.c): each batch is split across the trainer's worker
+ * threads, their gradients are summed, then the trainer's optimizer
+ * updates the weights once. Prints rolling loss & accuracy every 1k images (see
+ * logBatch()). With a `checkpointer`, the weights are handed to its writer thread
+ * every `saveEvery` batches; `*batches` counts optimizer steps
+ * across runs so resumed checkpoints keep numbering. With `augment`
+ * the batches pass through an Augmenter first. With a `validator`, a weight
+ * snapshot is scored on the test split every `validateEvery` batches and once
+ * more at the end, without waiting for the result. Returns 0 if training had
+ * to stop because the data could not be read, else 1.
+ */
+int train(DenseLayer* denseLayer, Trainer* trainer, int epoch, int window, uint64_t seed, const AugmentConfig* augment, Checkpointer* checkpointer, int saveEvery, Validator* validator, int validateEvery, long* batches) {
+    DataStream* stream = openStream("./MNIST/train-images.idx3-ubyte", "./MNIST/train-labels.idx1-ubyte", trainer->batchSize, window, seed);
+    assert(stream != NULL);
+    Augmenter* augmenter = augment != NULL ? initAugmenter(stream, trainer->batchSize, augment, seed) : NULL;
+
+    int numImages, width, height;
+    streamShape(stream, &numImages, &width, &height);
+    printf("Number of images: %d (streamed through %.1f MB of buffers)\n", numImages, streamBufferBytes(stream) / 1e6);
+    printf("Heigt: %d\n", height);
+    printf("Width: %d\n", width);
+    assert(width == trainer->workspaces[0]->width && height == trainer->workspaces[0]->height);
+    optimizerPlan(trainer->optimizer, (numImages + trainer->batchSize - 1) / trainer->batchSize, epoch);
+    printOptimizer(trainer->optimizer);
+    if (augment != NULL) printAugment(augment);
+
+    TrainLog log;
+    startLog(&log);
+    int count = 0;
+    for (int j=0; j<epoch && count >= 0; j++) {
+        const uint8_t* images;
+        const uint8_t* labels;
+        startEpoch(&log);
+        for (;;) {
+            PROFILE_BEGIN(dataStart);
+            count = nextBatch(stream, augmenter, &images, &labels);
+            PROFILE_END(PROFILE_DATA, dataStart);
+            if (count <= 0) break;
+            real* probs = trainBatch(trainer, images, labels, count);
+            ++*batches;
+            if (checkpointer != NULL && *batches % saveEvery == 0) {
+                checkpointAsync(checkpointer, *batches);
+            }
+            if (validator != NULL && *batches % validateEvery == 0) {
+                validateAsync(validator, *batches);
             }
+            logBatch(&log, probs, labels, count, denseLayer->size, j);
         }
+        if (augmenter != NULL && count >= 0) reportAugment(augmenter);
     }
 
-    free(probs);
-    free(testImages);
-    free(testLabels);
-    free(parameters);
+    if (validator != NULL && count >= 0 && *batches % validateEvery != 0) {
+        validateAsync(validator, *batches);
+    }
+
+    if (augmenter != NULL) freeAugmenter(augmenter);
+    closeStream(stream);
+    if (count < 0) {
+        fprintf(stderr, "Training stopped: cannot read the training data.\n");
+        return 0;
+    }
     printf("Training completed.\n\n");
+    return 1;
 }
 
 /*
  * test()
- * Runs the trained network on the MNIST test split and reports overall metrics.
- */
-void test(ConvLayer* convLayer, DenseLayer* denseLayer) {
-    char* imagesPath = "./MNIST/t10k-images.idx3-ubyte";
-    char* labelsPath = "./MNIST/t10k-labels.idx1-ubyte";
-    int* parameters = readParameters(imagesPath);
-    double*** testImages = readImages(imagesPath);
-    int* testLabels = readLabels(labelsPath);
-
-    printf("Testing CNN on %d images...\n", parameters[0]);
-    
-    double* probs = malloc(denseLayer->size * sizeof(double));
+ * Scores the MNIST test split in one batched, multi-threaded predict() call
+ * and reports overall metrics plus throughput.
+ */
+void test(DenseLayer* denseLayer, Predictor* predictor) {
+    Dataset* testSet = openDataset("./MNIST/t10k-images.idx3-ubyte", "./MNIST/t10k-labels.idx1-ubyte");
+    assert(testSet != NULL);
+
+    printf("Testing CNN on %d images...\n", testSet->count);
+    assert(testSet->width == predictor->workspaces[0]->width && testSet->height == predictor->workspaces[0]->height);
+
+    real* probs = malloc((size_t)testSet->count * denseLayer->size * sizeof(real));
+    assert(probs != NULL);
+    double start = profileSeconds();
+    predict(predictor, testSet->images, testSet->count, probs);
+    double elapsed = profileSeconds() - start;
+
     double l = 0;
     int correct = 0;
-    for (int i=0; i<parameters[0]; i++) {
-        probs = forward(convLayer, denseLayer, testImages[i], parameters[1], parameters[2], convLayer->filterSize);
-        l += loss(probs, testLabels[i]);
-        correct += accuracy(probs, testLabels[i], denseLayer->size);
+    for (int i=0; i<testSet->count; i++) {
+        l += loss(probs + i * denseLayer->size, testSet->labels[i]);
+        correct += accuracy(probs + i * denseLayer->size, testSet->labels[i], denseLayer->size);
     }
-    printf("\n|----------------------------------------|\n| Average Loss: %f | Accuracy: %d%% |\n|----------------------------------------|\n\n", l/parameters[0], correct*100/parameters[0]);
+    printf("\n|----------------------------------------|\n| Average Loss: %f | Accuracy: %d%% |\n|----------------------------------------|\n\n", l/testSet->count, correct*100/testSet->count);
+    printf("Scored %d images in %.3f s (%.0f images/sec)\n", testSet->count, elapsed, testSet->count / elapsed);
 
     free(probs);
-    free(testImages);
-    free(testLabels);
-    free(parameters);
+    closeDataset(testSet);
     printf("Testing completed.\n");
 }
 
 /*
- * main()
- * Boots everything up, kicks off one training epoch and then evaluates.
+ * testQuantized()
+ * Quantizes the model to int8 (activations calibrated on the first
+ * QUANT_CALIBRATION training images), scores the test split with the
+ * integer engine and reports accuracy, how often its top class agrees
+ * with the float model, throughput and weight memory.
+ */
+void testQuantized(ConvLayer* convLayer, DenseLayer* denseLayer, Predictor* predictor, int threads) {
+    Dataset* trainSet = openDataset("./MNIST/train-images.idx3-ubyte", "./MNIST/train-labels.idx1-ubyte");
+    Dataset* testSet = openDataset("./MNIST/t10k-images.idx3-ubyte", "./MNIST/t10k-labels.idx1-ubyte");
+    assert(trainSet != NULL && testSet != NULL);
+
+    int classes = denseLayer->size;
+    int calibration = trainSet->count < QUANT_CALIBRATION ? trainSet->count : QUANT_CALIBRATION;
+    QuantModel* model = quantizeModel(convLayer, denseLayer, trainSet->images, calibration, trainSet->width, trainSet->height);
+    QuantPredictor* quantPredictor = initQuantPredictor(model, testSet->width, testSet->height, threads);
+    size_t floatBytes = (convLayer->filters->size + denseLayer->weights->size) * sizeof(real);
+    printf("\nQuantized to int8 (calibrated on %d images): %zu weight bytes vs %zu in %s.\n", calibration, quantWeightBytes(model), floatBytes, REAL_NAME);
+
+    real* probs = malloc((size_t)testSet->count * classes * sizeof(real));
+    real* reference = malloc((size_t)testSet->count * classes * sizeof(real));
+    assert(probs != NULL && reference != NULL);
+    predict(predictor, testSet->images, testSet->count, reference);
+    double start = profileSeconds();
+    predictQuantized(quantPredictor, testSet->images, testSet->count, probs);
+    double elapsed = profileSeconds() - start;
+
+    double l = 0;
+    int correct = 0;
+    int agree = 0;
+    for (int i=0; i<testSet->count; i++) {
+        l += loss(probs + i * classes, testSet->labels[i]);
+        correct += accuracy(probs + i * classes, testSet->labels[i], classes);
+        agree += argmax(probs + i * classes, classes) == argmax(reference + i * classes, classes);
+    }
+    printf("int8 | Average Loss: %f | Accuracy: %d%% | Agrees with %s on %.2f%% |\n", l/testSet->count, correct*100/testSet->count, REAL_NAME, agree*100.0/testSet->count);
+    printf("Scored %d images in %.3f s (%.0f images/sec, %s kernels)\n", testSet->count, elapsed, testSet->count / elapsed, simd->name);
+
+    free(reference);
+    free(probs);
+    freeQuantPredictor(quantPredictor);
+    freeQuantModel(model);
+    closeDataset(testSet);
+    closeDataset(trainSet);
+}
+
+/*
+ * trainNetwork()
+ * train() for a layer graph: streams the training set in
+ * shuffled mini-batches through networkBackward() on one
+ * workspace whose buffers were all planned up front, with one
+ * optimizer step over the whole parameter block per batch.
+ * Returns 0 if the data could not be read, else 1.
+ */
+int trainNetwork(Network* net, const OptimizerConfig* config, int epoch, int batchSize, int window, uint64_t seed, const AugmentConfig* augment) {
+    DataStream* stream = openStream("./MNIST/train-images.idx3-ubyte", "./MNIST/train-labels.idx1-ubyte", batchSize, window, seed);
+    assert(stream != NULL);
+    Augmenter* augmenter = augment != NULL ? initAugmenter(stream, batchSize, augment, seed) : NULL;
+
+    int numImages, width, height;
+    streamShape(stream, &numImages, &width, &height);
+    assert(width == net->width && height == net->height && net->channels == 1);
+    NetWorkspace* ws = initNetWorkspace(net, batchSize, 1);
+    Tensor* grads = initNetGradients(net);
+    Optimizer* optimizer = initOptimizer(config, NULL);
+    optimizerAdd(optimizer, net->parameters.base, grads->data, net->parameters.capacity);
+    optimizerPlan(optimizer, (numImages + batchSize - 1) / batchSize, epoch);
+    printf("Number of images: %d (streamed through %.1f MB of buffers)\n", numImages, streamBufferBytes(stream) / 1e6);
+    printf("Training buffers: %.1f KB planned (%.1f KB without reuse)\n", ws->plannedBytes / 1e3, ws->unplannedBytes / 1e3);
+    printOptimizer(optimizer);
+    if (augment != NULL) printAugment(augment);
+
+    TrainLog log;
+    startLog(&log);
+    int count = 0;
+    for (int j=0; j<epoch && count >= 0; j++) {
+        const uint8_t* images;
+        const uint8_t* labels;
+        startEpoch(&log);
+        for (;;) {
+            PROFILE_BEGIN(dataStart);
+            count = nextBatch(stream, augmenter, &images, &labels);
+            PROFILE_END(PROFILE_DATA, dataStart);
+            if (count <= 0) break;
+            tensorZero(grads);
+            real* probs = networkBackward(net, ws, grads, images, labels, count);
+            PROFILE_BEGIN(updateStart);
+            optimizerStep(optimizer, count);
+            PROFILE_END(PROFILE_UPDATE, updateStart);
+            logBatch(&log, probs, labels, count, net->classes, j);
+        }
+        if (augmenter != NULL && count >= 0) reportAugment(augmenter);
+    }
+
+    freeOptimizer(optimizer);
+    tensorFree(grads);
+    freeNetWorkspace(ws);
+    if (augmenter != NULL) freeAugmenter(augmenter);
+    closeStream(stream);
+    if (count < 0) {
+        fprintf(stderr, "Training stopped: cannot read the training data.\n");
+        return 0;
+    }
+    printf("Training completed.\n\n");
+    return 1;
+}
+
+/*
+ * testNetwork()
+ * test() for a layer graph: scores the test split in
+ * PREDICT_CHUNK-image passes of one inference workspace.
+ */
+void testNetwork(Network* net) {
+    Dataset* testSet = openDataset("./MNIST/t10k-images.idx3-ubyte", "./MNIST/t10k-labels.idx1-ubyte");
+    assert(testSet != NULL);
+    assert(testSet->width == net->width && testSet->height == net->height && net->channels == 1);
+
+    NetWorkspace* ws = initNetWorkspace(net, PREDICT_CHUNK, 0);
+    size_t imageSize = (size_t)testSet->width * testSet->height;
+    printf("Testing CNN on %d images (%.1f KB of inference buffers)...\n", testSet->count, ws->plannedBytes / 1e3);
+
+    double l = 0;
+    int correct = 0;
+    double start = profileSeconds();
+    for (int i=0; i<testSet->count; i += PREDICT_CHUNK) {
+        int count = testSet->count - i < PREDICT_CHUNK ? testSet->count - i : PREDICT_CHUNK;
+        real* probs = networkForward(net, ws, testSet->images + i * imageSize, count);
+        for (int b=0; b<count; b++) {
+            l += loss(probs + b * net->classes, testSet->labels[i + b]);
+            correct += accuracy(probs + b * net->classes, testSet->labels[i + b], net->classes);
+        }
+    }
+    double elapsed = profileSeconds() - start;
+    printf("\n|----------------------------------------|\n| Average Loss: %f | Accuracy: %d%% |\n|----------------------------------------|\n\n", l/testSet->count, correct*100/testSet->count);
+    printf("Scored %d images in %.3f s (%.0f images/sec)\n", testSet->count, elapsed, testSet->count / elapsed);
+
+    freeNetWorkspace(ws);
+    closeDataset(testSet);
+    printf("Testing completed.\n");
+}
+
+/*
+ * Options: command-line settings, see usage().
  */
-int main() {
-    srand(time(NULL));
+typedef struct {
+    int epochs;
+    OptimizerConfig optimizer;
+    int batchSize;
+    int threads;
+    int window;
+    int relu;
+    uint64_t seed;
+    int augmenting;
+    AugmentConfig augment;
+    int selfTest;
+    int gradCheck;
+    const char* loadPath;
+    const char* savePath;
+    int saveEvery;
+    int validateEvery;
+    int validateThreads;
+    const char* bestPath;
+    int int8;
+    const char* tracePath;
+    const char* netSpec;
+    const char* serveAddress;
+    int maxBatch;
+    int maxLatencyUs;
+} Options;
+
+void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [epochs] [learning_rate] [--optimizer sgd|momentum|nesterov|adam|adamw] [--momentum M] [--beta2 B] [--weight-decay L] [--schedule constant|step[:E[:G]]|cosine] [--warmup STEPS] [--batch N] [--threads N] [--window N] [--no-relu] [--seed N] [--augment shift:P,rotate:D,elastic:A[:S]] [--augment-threads N] [--selftest] [--gradcheck] [--load PATH] [--save PATH] [--save-every N] [--validate-every N] [--validate-threads N] [--save-best PATH] [--int8] [--trace PATH] [--net LAYERS] [--serve PATH|PORT] [--max-batch N] [--max-latency US]\n", program);
+}
 
-    ConvLayer* convLayer = initConvLayer(8, 3);
-    DenseLayer* denseLayer = initDenseLayer(10, 13, 13, 8);
-    printf("CNN Initialized. \n");
+/*
+ * netConflict()
+ * The first option given that a --net graph does not support
+ * (it runs on one thread, without checkpoints, validation,
+ * int8 or serving), or NULL.
+ */
+const char* netConflict(const Options* options) {
+    if (options->threads > 1) return "--threads";
+    if (options->loadPath != NULL) return "--load";
+    if (options->savePath != NULL) return "--save";
+    if (options->validateEvery != 0) return "--validate-every";
+    if (options->int8) return "--int8";
+    if (options->serveAddress != NULL) return "--serve";
+    return NULL;
+}
 
-    train(convLayer, denseLayer, 1, 0.005);
-    test(convLayer, denseLayer);
+/*
+ * parseOptions()
+ * Fills `options` from argv; returns 0 on a malformed command line.
+ * Options a --net graph cannot use are reported by name;
+ * --serve needs a --load model.
+ */
+int parseOptions(int argc, char** argv, Options* options) {
+    int positional = 0;
+    options->epochs = 1;
+    defaultOptimizerConfig(&options->optimizer);
+    options->batchSize = 1;
+    options->threads = 1;
+    options->window = 8192;
+    options->relu = 1;
+    options->seed = (uint64_t)time(NULL);
+    options->augmenting = 0;
+    defaultAugmentConfig(&options->augment);
+    options->selfTest = 0;
+    options->gradCheck = 0;
+    options->loadPath = NULL;
+    options->savePath = NULL;
+    options->saveEvery = 0;
+    options->validateEvery = 0;
+    options->validateThreads = 1;
+    options->bestPath = NULL;
+    options->int8 = 0;
+    options->tracePath = NULL;
+    options->netSpec = NULL;
+    options->serveAddress = NULL;
+    options->maxBatch = 0;
+    options->maxLatencyUs = 2000;
+
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--optimizer") == 0 && i+1 < argc) {
+            if (!parseOptimizerType(argv[++i], &options->optimizer)) return 0;
+        } else if (strcmp(argv[i], "--momentum") == 0 && i+1 < argc) {
+            options->optimizer.momentum = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--beta2") == 0 && i+1 < argc) {
+            options->optimizer.beta2 = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--weight-decay") == 0 && i+1 < argc) {
+            options->optimizer.weightDecay = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--schedule") == 0 && i+1 < argc) {
+            if (!parseSchedule(argv[++i], &options->optimizer)) return 0;
+        } else if (strcmp(argv[i], "--warmup") == 0 && i+1 < argc) {
+            options->optimizer.warmup = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--batch") == 0 && i+1 < argc) {
+            options->batchSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc) {
+            options->threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--window") == 0 && i+1 < argc) {
+            options->window = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-relu") == 0) {
+            options->relu = 0;
+        } else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc) {
+            options->seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--augment") == 0 && i+1 < argc) {
+            if (!parseAugment(argv[++i], &options->augment)) return 0;
+            options->augmenting = 1;
+        } else if (strcmp(argv[i], "--augment-threads") == 0 && i+1 < argc) {
+            options->augment.workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--selftest") == 0) {
+            options->selfTest = 1;
+        } else if (strcmp(argv[i], "--gradcheck") == 0) {
+            options->gradCheck = 1;
+        } else if (strcmp(argv[i], "--load") == 0 && i+1 < argc) {
+            options->loadPath = argv[++i];
+        } else if (strcmp(argv[i], "--save") == 0 && i+1 < argc) {
+            options->savePath = argv[++i];
+        } else if (strcmp(argv[i], "--save-every") == 0 && i+1 < argc) {
+            options->saveEvery = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--validate-every") == 0 && i+1 < argc) {
+            options->validateEvery = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--validate-threads") == 0 && i+1 < argc) {
+            options->validateThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--save-best") == 0 && i+1 < argc) {
+            options->bestPath = argv[++i];
+        } else if (strcmp(argv[i], "--int8") == 0) {
+            options->int8 = 1;
+        } else if (strcmp(argv[i], "--trace") == 0 && i+1 < argc) {
+            options->tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--net") == 0 && i+1 < argc) {
+            options->netSpec = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i+1 < argc) {
+            options->serveAddress = argv[++i];
+        } else if (strcmp(argv[i], "--max-batch") == 0 && i+1 < argc) {
+            options->maxBatch = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-latency") == 0 && i+1 < argc) {
+            options->maxLatencyUs = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && positional == 0) {
+            options->epochs = atoi(argv[i]);
+            positional++;
+        } else if (argv[i][0] != '-' && positional == 1) {
+            options->optimizer.learningRate = atof(argv[i]);
+            positional++;
+        } else {
+            return 0;
+        }
+    }
+    if (options->maxBatch == 0) {
+        options->maxBatch = PREDICT_CHUNK * options->threads;
+    }
+    if (options->netSpec != NULL && netConflict(options) != NULL) {
+        fprintf(stderr, "%s is not supported with --net\n", netConflict(options));
+        return 0;
+    }
+    OptimizerConfig* optimizer = &options->optimizer;
+    return options->epochs >= 0 && optimizer->learningRate >= 0.0 && optimizer->momentum >= 0.0 && optimizer->momentum < 1.0 && optimizer->beta2 >= 0.0 && optimizer->beta2 < 1.0
+        && optimizer->weightDecay >= 0.0 && optimizer->warmup >= 0 && options->batchSize > 0 && options->threads > 0 && options->window > 0 && options->augment.workers > 0 && options->saveEvery >= 0 && (options->saveEvery == 0 || options->savePath != NULL)
+        && options->validateEvery >= 0 && options->validateThreads > 0 && (options->bestPath == NULL || options->validateEvery > 0)
+        && options->maxBatch > 0 && options->maxLatencyUs >= 0 && (options->serveAddress == NULL || options->loadPath != NULL);
+}
+
+/*
+ * runNetwork()
+ * main() for --net: builds the layer graph, then either
+ * gradient-checks it or trains and tests it.
+ */
+int runNetwork(Options* options) {
+    Network* net = parseNetwork(options->netSpec, 1, 28, 28, options->seed);
+    if (net == NULL) return 1;
+    printNetwork(net);
+
+    int status = 0;
+    if (options->gradCheck) {
+        status = networkGradientCheck(net, 4, options->seed) == 0 ? 0 : 1;
+    } else {
+        printf("CNN Initialized (%s kernels, %s). \n", simd->name, REAL_NAME);
+        if (options->tracePath != NULL) {
+            profileStartTrace();
+        }
+        if (trainNetwork(net, &options->optimizer, options->epochs, options->batchSize, options->window, options->seed, options->augmenting ? &options->augment : NULL)) {
+            testNetwork(net);
+        } else {
+            status = 1;
+        }
+        if (options->tracePath != NULL && profileWriteTrace(options->tracePath)) {
+            printf("Wrote trace to %s\n", options->tracePath);
+        }
+    }
+    freeNetwork(net);
+    profileShutdown();
+    return status;
+}
 
-    freeConvLayer(convLayer);
-    freeDenseLayer(denseLayer);
+/*
+ * serve()
+ * main() for --serve: answers requests for the loaded model
+ * until interrupted (see server.h).
+ */
+int serve(Options* options, ConvLayer* convLayer, DenseLayer* denseLayer) {
+    Server* server = initServer(options->serveAddress, convLayer, denseLayer, 28, 28, options->threads, options->maxBatch, options->maxLatencyUs);
+    if (server == NULL) return 1;
+    printf("CNN Initialized (%s kernels, %s). \n", simd->name, REAL_NAME);
+    runServer(server);
+    freeServer(server);
     return 0;
+}
+
+/*
+ * main()
+ * Boots everything up (or resumes from --load), trains for the requested number
+ * of epochs, optionally saves the model and then evaluates (also as int8
+ * with --int8). With --serve the loaded model is served instead.
+ */
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, &options)) {
+        usage(argv[0]);
+        return 1;
+    }
+    simdInit();
+    if (options.selfTest) {
+        int failures = simdSelfTest();
+        failures += winogradSelfTest();
+        failures += randomSelfTest();
+        failures += augmentSelfTest();
+        return failures == 0 ? 0 : 1;
+    }
+    if (options.netSpec != NULL) {
+        return runNetwork(&options);
+    }
+
+    Checkpoint* checkpoint = NULL;
+    ConvLayer* convLayer;
+    DenseLayer* denseLayer;
+    long batches = 0;
+    if (options.loadPath != NULL) {
+        checkpoint = loadCheckpoint(options.loadPath, 28, 28);
+        if (checkpoint == NULL) return 1;
+        convLayer = &checkpoint->convLayer;
+        denseLayer = &checkpoint->denseLayer;
+        batches = checkpoint->step;
+        printf("Loaded %s (step %ld).\n", options.loadPath, batches);
+    } else {
+        convLayer = initConvLayer(8, 3, options.seed);
+        convLayer->relu = options.relu;
+        int pooledSize = (28 - (convLayer->filterSize-1)) / 2;
+        denseLayer = initDenseLayer(10, pooledSize, pooledSize, convLayer->numFilters, options.seed);
+    }
+    if (options.gradCheck) {
+        int failures = gradientCheck(convLayer, denseLayer, 28, 28, 4, options.seed);
+        if (checkpoint != NULL) {
+            freeCheckpoint(checkpoint);
+        } else {
+            freeDenseLayer(denseLayer);
+            freeConvLayer(convLayer);
+        }
+        return failures == 0 ? 0 : 1;
+    }
+    if (options.serveAddress != NULL) {
+        int status = serve(&options, convLayer, denseLayer);
+        freeCheckpoint(checkpoint);
+        profileShutdown();
+        return status;
+    }
+    Predictor* predictor = initPredictor(convLayer, denseLayer, 28, 28, options.threads);
+    Trainer* trainer = initTrainer(convLayer, denseLayer, 28, 28, options.batchSize, options.threads, &options.optimizer);
+    printf("CNN Initialized (%s kernels, %s). \n", simd->name, REAL_NAME);
+
+    if (options.tracePath != NULL) {
+        profileStartTrace();
+    }
+    Checkpointer* checkpointer = options.saveEvery > 0 ? initCheckpointer(options.savePath, convLayer, denseLayer) : NULL;
+    Dataset* validationSet = NULL;
+    Validator* validator = NULL;
+    if (options.validateEvery > 0) {
+        validationSet = openDataset("./MNIST/t10k-images.idx3-ubyte", "./MNIST/t10k-labels.idx1-ubyte");
+        assert(validationSet != NULL);
+        validator = initValidator(convLayer, denseLayer, validationSet, options.validateThreads, options.bestPath);
+    }
+    int trained = train(denseLayer, trainer, options.epochs, options.window, options.seed, options.augmenting ? &options.augment : NULL, checkpointer, options.saveEvery, validator, options.validateEvery, &batches);
+    if (checkpointer != NULL) {
+        freeCheckpointer(checkpointer);
+    }
+    if (validator != NULL) {
+        reportValidation(validator, denseLayer->size, options.bestPath);
+        freeValidator(validator);
+        closeDataset(validationSet);
+    }
+    if (trained && options.savePath != NULL && saveCheckpoint(options.savePath, convLayer, denseLayer, batches)) {
+        printf("Saved %s (step %ld).\n", options.savePath, batches);
+    }
+    if (trained) {
+        test(denseLayer, predictor);
+    }
+    if (trained && options.int8) {
+        testQuantized(convLayer, denseLayer, predictor, options.threads);
+    }
+    if (options.tracePath != NULL && profileWriteTrace(options.tracePath)) {
+        printf("Wrote trace to %s\n", options.tracePath);
+    }
+
+    freeTrainer(trainer);
+    freePredictor(predictor);
+    if (checkpoint != NULL) {
+        freeCheckpoint(checkpoint);
+    } else {
+        freeConvLayer(convLayer);
+        freeDenseLayer(denseLayer);
+    }
+    profileShutdown();
+    return trained ? 0 : 1;
 }
\ No newline at end of file